@@ -75,6 +75,7 @@ static void print_network_status(void)
   uip_ds6_defrt_t *default_route;
 #if RPL_WITH_STORING
   uip_ds6_route_t *route;
+  uip_ipaddr_t route_ipaddr;
 #endif /* RPL_WITH_STORING */
 #if RPL_WITH_NON_STORING
   rpl_ns_node_t *link;
@@ -111,7 +112,8 @@ static void print_network_status(void)
   route = uip_ds6_route_head();
   while(route != NULL) {
 	LOG_RAW("-- ");
-	PRINT6ADDR(&route->ipaddr);
+	uip_ds6_route_ipaddr(route, &route_ipaddr);
+	PRINT6ADDR(&route_ipaddr);
     LOG_RAW(" via ");
     PRINT6ADDR(uip_ds6_route_nexthop(route));
     LOG_RAW(" (lifetime: %lu seconds)\n", (unsigned long)route->state.lifetime);
@@ -65,6 +65,7 @@
 #include "evproc.h"
 #include "queuebuf.h"
 #include "linkaddr.h"
+#include "nbr-table.h"
 #include "ctimer.h"
 #include "rt_tmr.h"
 #include "random.h"
@@ -287,6 +288,9 @@ static int8_t loc_stackInit( s_ns_t* ps_ns )
              (ps_ns->dllsec != NULL) &&
              (ps_ns->hc     != NULL);
   if (is_valid) {
+    /* Reset neighbor tables before the submodules register theirs */
+    nbr_table_init();
+
     /*
      * Netstack submodule initializations
      */
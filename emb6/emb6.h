@@ -196,6 +196,7 @@ typedef enum
      * MAC error codes
      */
     NETSTK_ERR_MAC_XXX                      = 200U,
+    NETSTK_ERR_MAC_TX_QUEUED,
     NETSTK_ERR_MAC_ULE_XXX                  = 250U,
     NETSTK_ERR_MAC_ULE_UNSUPPORTED_FRAME,
     NETSTK_ERR_MAC_ULE_LAST_STROBE,
@@ -246,6 +247,8 @@ typedef enum
      * MAC command codes
      */
     NETSTK_CMD_MAC_RSVD = 200U,
+    NETSTK_CMD_MAC_TX_POLICY_SET,
+    NETSTK_CMD_MAC_CCA_BUSY_GET,
 
     /*
      * PHY command codes
@@ -281,6 +284,10 @@ typedef enum
     NETSTK_CMD_RF_CHAN_NUM_SET,
     NETSTK_CMD_RF_OP_MODE_SET,
     NETSTK_CMD_RF_WOR_EN,
+    NETSTK_CMD_RF_ON_TIME_GET,
+    /* FCS of the frame being delivered, verified by the driver while reading
+     * it from the radio (e_nsErr_t: NETSTK_ERR_NONE or NETSTK_ERR_CRC) */
+    NETSTK_CMD_RF_RX_FCS_GET,
 
 } e_nsIocCmd_t;
 
@@ -709,6 +716,7 @@ extern const s_nsDLLC_t dll_tsch_adaptive_driver;
 extern const s_nsMAC_t mac_driver_null;
 extern const s_nsMAC_t mac_driver_802154;
 extern const s_nsMAC_t mac_driver_smartmac;
+extern const s_nsMAC_t mac_driver_lpl;
 extern const s_nsMAC_t mac_tsch_adaptive_driver;
 
 /* Supported phy drivers */
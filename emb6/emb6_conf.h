@@ -116,6 +116,13 @@
 /** Routing table */
 #define UIP_CONF_MAX_ROUTES                  10
 
+/** Store routes as a prefix ID plus interface identifier, see
+    uip-ds6-route.h. On 32-bit targets this saves 17 bytes per route and
+    7 per neighbor, for about 100 bytes of prefix and exception tables */
+#ifndef UIP_CONF_DS6_ROUTE_COMPACT
+#define UIP_CONF_DS6_ROUTE_COMPACT           FALSE
+#endif
+
 /** Unicast address list */
 #define UIP_CONF_DS6_ADDR_NBU                3
 
@@ -130,6 +137,32 @@
 
 #define SICSLOWPAN_CONF_FRAGMENT_BUFFERS     4
 
+/** Forward fragments at intermediate hops without reassembling them first */
+#ifndef SICSLOWPAN_CONF_FRAG_FORWARDING
+#define SICSLOWPAN_CONF_FRAG_FORWARDING      FALSE
+#endif
+
+/** Use selective fragment recovery (RFC 8931) for fragmented datagrams */
+#ifndef SICSLOWPAN_CONF_SFR
+#define SICSLOWPAN_CONF_SFR                  FALSE
+#endif
+
+/** Compress UDP and RPL payloads with generic header compression (RFC 7400) */
+#ifndef SICSLOWPAN_CONF_GHC
+#define SICSLOWPAN_CONF_GHC                  FALSE
+#endif
+
+/** Reuse the IPHC header of recent flows instead of compressing it again */
+#ifndef SICSLOWPAN_CONF_FLOW_CACHE
+#define SICSLOWPAN_CONF_FLOW_CACHE           FALSE
+#endif
+
+/** Learn address contexts from 6LoWPAN context options (RFC 6775) in
+    RAs, routers advertise their own contexts */
+#ifndef SICSLOWPAN_CONF_6CO
+#define SICSLOWPAN_CONF_6CO                  FALSE
+#endif
+
 /** Most browsers reissue GETs after 3 seconds which stops frag reassembly, longer MAXAGE does no good */
 #define SICSLOWPAN_CONF_MAXAGE               3
 
@@ -230,7 +263,9 @@
 #endif /* UIP_CONF_IPV6_RPL */
 
 /** Set to 1 to enable RPL statistics */
+#ifndef RPL_CONF_STATS
 #define    RPL_CONF_STATS                   FALSE
+#endif
 #define    RPL_CONF_DAO_LATENCY             bsp_getTRes()
 #define    RPL_CONF_DAG_MC                  RPL_DAG_MC_ETX
 /*
@@ -335,6 +370,14 @@
 #define RPL_MAX_INSTANCES                   1
 #endif /* RPL_CONF_MAX_INSTANCES */
 
+/**
+ * Each RPL instance forwards along the routes of its own routing table,
+ * see uip-ds6-route.h.
+ */
+#ifndef UIP_CONF_DS6_ROUTE_TABLES
+#define UIP_CONF_DS6_ROUTE_TABLES           RPL_MAX_INSTANCES
+#endif /* UIP_CONF_DS6_ROUTE_TABLES */
+
 /**
  * Maximum number of DAGs within an instance.
  */
@@ -457,6 +500,34 @@
 #define RPL_WITH_PROBING 1
 #endif
 
+/*
+ * RPL fast local reroute. When enabled, a backup parent with a fresh link
+ * and a lower rank is kept for the preferred parent, and RPL switches to it
+ * as soon as a transmission to the preferred parent fails. The failed
+ * datagram is then sent again through the new parent by 6LoWPAN, which
+ * requires the MAC to report the transmission status synchronously, i.e.
+ * NETSTK_CFG_CSMA_ASYNC_EN disabled.
+ * */
+#ifdef RPL_CONF_WITH_FAST_REROUTE
+#define RPL_WITH_FAST_REROUTE RPL_CONF_WITH_FAST_REROUTE
+#else
+#define RPL_WITH_FAST_REROUTE 0
+#endif /* RPL_CONF_WITH_FAST_REROUTE */
+
+/*
+ * RPL adaptive trickle. When enabled, a node whose preferred parent stays
+ * the same and which hears few inconsistencies over several DIO intervals
+ * locally raises its minimum DIO interval and lowers its DIO redundancy,
+ * so a stable network sends fewer DIOs. Any parent change or burst of
+ * inconsistencies restores the parameters advertised by the root. The
+ * advertised DODAG configuration itself is never changed.
+ * */
+#ifdef RPL_CONF_WITH_ADAPTIVE_TRICKLE
+#define RPL_WITH_ADAPTIVE_TRICKLE RPL_CONF_WITH_ADAPTIVE_TRICKLE
+#else
+#define RPL_WITH_ADAPTIVE_TRICKLE 0
+#endif /* RPL_CONF_WITH_ADAPTIVE_TRICKLE */
+
 /*
  * RPL probing interval.
  * */
@@ -498,6 +569,19 @@
 #define RPL_PROBING_DELAY_FUNC get_probing_delay
 #endif
 
+/*
+ * Function used to select the RPL instance of a datagram originated by
+ * this node. It is called with the datagram in uip_buf and returns the
+ * instance whose routes and RPL option the datagram uses, e.g. based on
+ * its traffic class or destination port. Forwarded datagrams keep the
+ * instance of their RPL option.
+ * */
+#ifdef RPL_CONF_OUTPUT_INSTANCE_FUNC
+#define RPL_OUTPUT_INSTANCE_FUNC RPL_CONF_OUTPUT_INSTANCE_FUNC
+#else
+#define RPL_OUTPUT_INSTANCE_FUNC rpl_get_default_instance
+#endif
+
 /*
  * Interval of DIS transmission
  */
@@ -529,6 +613,18 @@
 #define RPL_NS_CONF_LINK_NUM 20
 #endif /* RPL_NS_CONF_LINK_NUM */
 
+/* RPL_NS_CONF_HASH_SIZE specifies the number of buckets (a power of two)
+ * of the index the root uses to look up non-storing mode nodes. */
+#ifndef RPL_NS_CONF_HASH_SIZE
+#define RPL_NS_CONF_HASH_SIZE 16
+#endif /* RPL_NS_CONF_HASH_SIZE */
+
+/* RPL_NS_CONF_SRH_CACHE_ENTRIES specifies how many source routing headers
+ * the root keeps ready for recent destinations (0 disables the cache). */
+#ifndef RPL_NS_CONF_SRH_CACHE_ENTRIES
+#define RPL_NS_CONF_SRH_CACHE_ENTRIES 4
+#endif /* RPL_NS_CONF_SRH_CACHE_ENTRIES */
+
 
 /*=============================================================================
                                   uIP SECTION
@@ -575,8 +671,8 @@
 #endif
 
 #ifndef UIP_CONF_DS6_DEFRT_NBU
-/** Minimum number of default routers */
-#define UIP_CONF_DS6_DEFRT_NBU              1
+/** Minimum number of default routers, one per RPL instance */
+#define UIP_CONF_DS6_DEFRT_NBU              RPL_MAX_INSTANCES
 #endif
 
 /**
@@ -897,6 +993,7 @@
 
 /**
  * If we use IPHC compression, how many address contexts do we support
+ * (at most 16)
  */
 #ifndef SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS
 #define SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS 1
@@ -1213,6 +1310,128 @@ void uip_log(char *msg);
 #define NETSTK_CFG_CSMA_MAX_BACKOFF               (uint8_t )(   4u )
 #define NETSTK_CFG_CSMA_UNIT_BACKOFF_US           (uint32_t)( 400u )  /* @50kbps 2FSK */
 
+/*!< Enable/Disable non-blocking CSMA-CA
+ * Backoff and ACK-wait periods are then timed by the real-time timer rather
+ * than busy-waited, so that the result of a transmission is only signaled
+ * through the TX callback function.
+ * Every queued frame holds a queuebuf until it is sent, and 6LoWPAN needs one
+ * more while fragmenting, so QUEUEBUF_CONF_NUM must exceed the number of
+ * fragments of the largest datagram. 6LoWPAN does not learn the status of
+ * queued frames, i.e. neither stops fragmenting on a failure nor reroutes
+ * (RPL_WITH_FAST_REROUTE).
+ */
+#ifndef NETSTK_CFG_CSMA_ASYNC_EN
+#define NETSTK_CFG_CSMA_ASYNC_EN                            FALSE
+#endif
+
+/*!< Transmission queues of non-blocking CSMA-CA, served round-robin */
+#if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE)
+  /*!< Maximum number of receivers with queued frames */
+  #ifndef NETSTK_CFG_CSMA_MAX_NEIGHBOR_QUEUES
+    #define NETSTK_CFG_CSMA_MAX_NEIGHBOR_QUEUES             2
+  #endif
+
+  /*!< Maximum number of queued frames per receiver */
+  #ifndef NETSTK_CFG_CSMA_MAX_PACKET_PER_NEIGHBOR
+    #define NETSTK_CFG_CSMA_MAX_PACKET_PER_NEIGHBOR         QUEUEBUF_CONF_NUM
+  #endif
+#endif
+
+/*!< Default CSMA-CA transmission policy, see mac_txPolicyDefault() */
+/*!< ETX from which a link is considered poor */
+#ifndef NETSTK_CFG_CSMA_POLICY_POOR_ETX
+#define NETSTK_CFG_CSMA_POLICY_POOR_ETX                     3
+#endif
+
+/*!< Maximum number of transmissions over a poor link when the datagram can
+ * be rerouted through another neighbor. Not applied with non-blocking CSMA-CA,
+ * which does not report failures in time for the reroute */
+#ifndef NETSTK_CFG_CSMA_POLICY_REROUTABLE_MAX_TX
+#define NETSTK_CFG_CSMA_POLICY_REROUTABLE_MAX_TX            2
+#endif
+
+/*!< Additional transmissions to the final destination of a datagram */
+#ifndef NETSTK_CFG_CSMA_POLICY_LAST_HOP_EXTRA_TX
+#define NETSTK_CFG_CSMA_POLICY_LAST_HOP_EXTRA_TX            2
+#endif
+
+/*!< Ratio of busy CCAs in percent from which the initial backoff exponent
+ * and the number of backoffs are increased */
+#ifndef NETSTK_CFG_CSMA_POLICY_BUSY_CCA
+#define NETSTK_CFG_CSMA_POLICY_BUSY_CCA                     50
+#endif
+
+/*!< Number of received frames the MAC can hold until the upper layers
+ * process them. Received frames are acknowledged and filtered for duplicates
+ * right away and handed over to the DLLC from the event loop. Must be a power
+ * of two; 0 hands frames over directly from the reception handler. Each slot
+ * takes PACKETBUF_SIZE bytes of RAM.
+ */
+#ifndef NETSTK_CFG_MAC_RX_RING_SIZE
+#define NETSTK_CFG_MAC_RX_RING_SIZE                         0
+#endif
+
+/*!< Low-power-listening MAC configuration, see mac_driver_lpl */
+/*!< Wake-up interval in milliseconds. The sleep timeout of the low power
+ * mode is used instead when that mode is enabled */
+#ifndef NETSTK_CFG_LPL_WAKEUP_INTERVAL
+#define NETSTK_CFG_LPL_WAKEUP_INTERVAL                      125
+#endif
+
+/*!< Number of CCAs performed at each wake-up */
+#ifndef NETSTK_CFG_LPL_CCA_COUNT
+#define NETSTK_CFG_LPL_CCA_COUNT                            2
+#endif
+
+/*!< Time between the CCAs of a wake-up in microseconds. Must be longer than
+ * NETSTK_CFG_LPL_INTER_FRAME_US so that the CCAs cannot all fall into the gap
+ * between two repetitions of a frame */
+#ifndef NETSTK_CFG_LPL_CCA_SLEEP_US
+#define NETSTK_CFG_LPL_CCA_SLEEP_US                         500
+#endif
+
+/*!< Gap between two repetitions of a frame in microseconds, during which the
+ * ACK of the receiver is expected */
+#ifndef NETSTK_CFG_LPL_INTER_FRAME_US
+#define NETSTK_CFG_LPL_INTER_FRAME_US                       400
+#endif
+
+/*!< Time in milliseconds to listen for a frame after the channel was found
+ * busy. Must exceed the airtime of the longest frame */
+#ifndef NETSTK_CFG_LPL_LISTEN_TIME
+#define NETSTK_CFG_LPL_LISTEN_TIME                          50
+#endif
+
+/*!< Fast-sleep: the radio goes back to sleep once the channel was found free
+ * for this many milliseconds while listening */
+#ifndef NETSTK_CFG_LPL_MAX_SILENCE
+#define NETSTK_CFG_LPL_MAX_SILENCE                          3
+#endif
+
+/*!< Fast-sleep: the radio goes back to sleep once the channel was found busy
+ * for this many milliseconds without a frame being received, e.g. noise */
+#ifndef NETSTK_CFG_LPL_MAX_NONACTIVITY
+#define NETSTK_CFG_LPL_MAX_NONACTIVITY                      30
+#endif
+
+/*!< Enable/Disable phase-lock: unicast frames are repeated starting shortly
+ * before the wake-up of the receiver learned from its last ACK */
+#ifndef NETSTK_CFG_LPL_PHASE_OPT_EN
+#define NETSTK_CFG_LPL_PHASE_OPT_EN                         TRUE
+#endif
+
+/*!< Time in milliseconds the repetitions start before the learned wake-up */
+#ifndef NETSTK_CFG_LPL_PHASE_GUARD
+#define NETSTK_CFG_LPL_PHASE_GUARD                          4
+#endif
+
+/*!< Number of MAC headers the 802.15.4 framer keeps as templates. Frames to a
+ * cached destination are framed by copying the template and patching the
+ * sequence number and frame counter. Must be at least 1 */
+#ifndef NETSTK_CFG_FRAMER_HDR_CACHE_SIZE
+#define NETSTK_CFG_FRAMER_HDR_CACHE_SIZE                    4
+#endif
+
 /*!< Default transceiver's transmission power */
 #ifndef TX_POWER
 #define TX_POWER              0
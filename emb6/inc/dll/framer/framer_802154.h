@@ -234,6 +234,9 @@ typedef struct {
 } frame802154_t;
 
 
+/** \brief Cached MAC header, see frame802154_hdrtmpl_get() */
+typedef struct frame802154_hdrtmpl frame802154_hdrtmpl_t;
+
 /* Access Control List(ACL) structure for Replay Protection */
  typedef struct{
 	uint8_t src_addr[8]; /**< Source address */
@@ -247,6 +250,8 @@ frame802154_replayProtection database[10];
 int frame802154_hdrlen(frame802154_t *p);
 int frame802154_create(frame802154_t *p, uint8_t *buf);
 int frame802154_parse(uint8_t *data, int length, frame802154_t *pf);
+int frame802154_hdrtmpl_get(frame802154_t *p, const frame802154_hdrtmpl_t **pp_tmpl);
+void frame802154_hdrtmpl_write(const frame802154_hdrtmpl_t *p_tmpl, const frame802154_t *p, uint8_t *buf);
 
 /* Get current PAN ID */
 uint16_t frame802154_get_pan_id(void);
@@ -45,13 +45,23 @@
 #ifndef MAC_SEQUENCE_H
 #define MAC_SEQUENCE_H
 
+#include "linkaddr.h"
+
+/**
+ * \brief      Register the neighbor table holding the sequence numbers
+ *
+ *             This function shall be called once the neighbor tables are
+ *             initialized and before any other function of this module.
+ */
+void mac_sequence_init(void);
+
 /**
  * \brief      Tell whether the packetbuf is a duplicate packet
  * \return     Non-zero if the packetbuf is a duplicate packet, zero otherwise
  *
  *             This function is used to check for duplicate packet by comparing
- *             the sequence number of the incoming packet with the last few ones
- *             we saw, filtering with the Rime address.
+ *             the sequence number of the incoming packet with the window of
+ *             recent ones kept in the neighbor table entry of the sender.
  */
 int mac_sequence_is_duplicate(void);
 
@@ -63,4 +73,22 @@ int mac_sequence_is_duplicate(void);
  */
 void mac_sequence_register_seqno(void);
 
+/**
+ * \brief      Tell whether a frame is a duplicate
+ * \param sender The link-layer address of the sender of the frame
+ * \param seqno  The MAC sequence number of the frame
+ * \return     Non-zero if the frame is a duplicate, zero otherwise
+ *
+ *             Same as mac_sequence_is_duplicate() but for frames that are not
+ *             held in the packetbuf, e.g. when filtering at the MAC layer.
+ */
+int mac_sequence_is_duplicate_from(const linkaddr_t *sender, uint8_t seqno);
+
+/**
+ * \brief      Register the sequence number of a frame
+ * \param sender The link-layer address of the sender of the frame
+ * \param seqno  The MAC sequence number of the frame
+ */
+void mac_sequence_register_seqno_from(const linkaddr_t *sender, uint8_t seqno);
+
 #endif /* MAC_SEQUENCE_H */
@@ -73,4 +73,36 @@ enum {
   MAC_TX_ERR_FATAL,
 };
 
+/* Traffic classes of outgoing frames, see PACKETBUF_ATTR_MAC_TX_CLASS */
+enum {
+  /**< Regular traffic. */
+  MAC_TX_CLASS_DEFAULT,
+
+  /**< The receiver is the final destination of the datagram. */
+  MAC_TX_CLASS_LAST_HOP,
+
+  /**< The datagram is sent again through another neighbor if the receiver
+     does not acknowledge it. */
+  MAC_TX_CLASS_REROUTABLE,
+};
+
+/* CSMA-CA parameters of a frame */
+typedef struct {
+  uint8_t minBe;        /**< Initial backoff exponent */
+  uint8_t maxBe;        /**< Maximum backoff exponent */
+  uint8_t maxBackoff;   /**< Maximum number of backoffs per transmission */
+  uint8_t maxTx;        /**< Maximum number of transmissions */
+} s_macTxParam_t;
+
+/**
+ * Transmission policy, set through NETSTK_CMD_MAC_TX_POLICY_SET. It adapts
+ * the parameters of a frame, holding the defaults on call, to the receiver,
+ * the traffic class and the ratio of busy CCAs in percent.
+ */
+typedef void (*macTxPolicyFnct_t)(const linkaddr_t *p_dst, uint8_t txClass,
+                                  uint8_t ccaBusy, s_macTxParam_t *p_param);
+
+void mac_txPolicyDefault(const linkaddr_t *p_dst, uint8_t txClass,
+                         uint8_t ccaBusy, s_macTxParam_t *p_param);
+
 #endif /* MAC_H_ */
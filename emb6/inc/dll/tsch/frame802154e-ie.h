@@ -46,6 +46,88 @@
 
 #define FRAME802154E_IE_MAX_LINKS       4
 
+/* Little-endian access to IE content */
+#define WRITE16(buf, val) \
+  do { ((uint8_t *)(buf))[0] = (val) & 0xff; \
+       ((uint8_t *)(buf))[1] = ((val) >> 8) & 0xff; } while(0);
+
+#define READ16(buf, var) \
+  (var) = ((uint8_t *)(buf))[0] | ((uint8_t *)(buf))[1] << 8
+
+/* c.f. IEEE 802.15.4e Table 4b */
+enum ieee802154e_header_ie_id {
+  HEADER_IE_LE_CSL = 0x1a,
+  HEADER_IE_LE_RIT,
+  HEADER_IE_DSME_PAN_DESCRIPTOR,
+  HEADER_IE_RZ_TIME,
+  HEADER_IE_ACK_NACK_TIME_CORRECTION,
+  HEADER_IE_GACK,
+  HEADER_IE_LOW_LATENCY_NETWORK_INFO,
+  HEADER_IE_LIST_TERMINATION_1 = 0x7e,
+  HEADER_IE_LIST_TERMINATION_2 = 0x7f,
+};
+
+/* c.f. IEEE 802.15.4e Table 4c */
+enum ieee802154e_payload_ie_id {
+  PAYLOAD_IE_ESDU = 0,
+  PAYLOAD_IE_MLME,
+  PAYLOAD_IE_LIST_TERMINATION = 0xf,
+};
+
+/* c.f. IEEE 802.15.4e Table 4d */
+enum ieee802154e_mlme_short_subie_id {
+  MLME_SHORT_IE_TSCH_SYNCHRONIZATION = 0x1a,
+  MLME_SHORT_IE_TSCH_SLOFTRAME_AND_LINK,
+  MLME_SHORT_IE_TSCH_TIMESLOT,
+  MLME_SHORT_IE_TSCH_HOPPING_TIMING,
+  MLME_SHORT_IE_TSCH_EB_FILTER,
+  MLME_SHORT_IE_TSCH_MAC_METRICS_1,
+  MLME_SHORT_IE_TSCH_MAC_METRICS_2,
+};
+
+/* c.f. IEEE 802.15.4e Table 4e */
+enum ieee802154e_mlme_long_subie_id {
+  MLME_LONG_IE_TSCH_CHANNEL_HOPPING_SEQUENCE = 0x9,
+};
+
+/* Kinds of Information Elements, c.f. fig 48n-48s in IEEE 802.15.4e */
+enum ieee802154e_ie_kind {
+  IE_KIND_HEADER,
+  IE_KIND_PAYLOAD,
+  IE_KIND_MLME_SHORT,
+  IE_KIND_MLME_LONG,
+};
+
+/* An Information Element as found in a frame. The content is not copied
+ * but points into the frame buffer */
+struct ieee802154_ie {
+  uint8_t kind;
+  uint8_t id;
+  uint16_t len;
+  const uint8_t *content;
+};
+
+/* Iterator walking the Information Elements of a frame in place. MLME IEs
+ * are entered and their sub-IEs returned, list terminations are consumed */
+struct ieee802154_ie_iterator {
+  const uint8_t *start;
+  const uint8_t *buf;
+  const uint8_t *end;
+  int nested_mlme_len;
+  uint8_t state;
+  /* Offset of the payload IEs, i.e. length of the header IEs */
+  uint8_t payload_ie_offset;
+};
+
+/* Builder writing Information Elements directly into a frame buffer */
+struct ieee802154_ie_builder {
+  uint8_t *start;
+  uint8_t *buf;
+  uint8_t *end;
+  /* Descriptor of the MLME IE being built, NULL if none */
+  uint8_t *mlme;
+};
+
 /* Structures used for the Slotframe and Links information element */
 struct tsch_slotframe_and_links_link {
   uint16_t timeslot;
@@ -117,4 +199,37 @@ int frame80215e_create_ie_tsch_channel_hopping_sequence(uint8_t *buf, int len,
 int frame802154e_parse_information_elements(const uint8_t *buf, uint8_t buf_size,
     struct ieee802154_ies *ies);
 
+/** Walk Information Elements in place **/
+void frame802154e_ie_iterator_init(struct ieee802154_ie_iterator *it,
+    const uint8_t *buf, uint8_t buf_size);
+/* Get the next IE. Returns 1 if found, 0 at the end of the IEs and -1 if
+ * the IEs are malformed */
+int frame802154e_ie_iterator_next(struct ieee802154_ie_iterator *it,
+    struct ieee802154_ie *ie);
+/* Total length of the IEs walked so far */
+int frame802154e_ie_iterator_len(const struct ieee802154_ie_iterator *it);
+/* Find a single IE of the given kind and id. Returns 1 if found, 0 if not
+ * found and -1 if the IEs are malformed */
+int frame802154e_ie_find(const uint8_t *buf, uint8_t buf_size,
+    uint8_t kind, uint8_t id, struct ieee802154_ie *ie);
+/* Decode the content of an ACK/NACK time correction header IE */
+int frame802154e_ie_get_time_correction(const struct ieee802154_ie *ie,
+    int16_t *drift_us, uint8_t *is_nack);
+/* Decode the content of a TSCH synchronization MLME sub-IE */
+int frame802154e_ie_get_tsch_synchronization(const struct ieee802154_ie *ie,
+    struct tsch_asn_t *asn, uint8_t *join_priority);
+
+/** Write Information Elements in place **/
+void frame802154e_ie_builder_init(struct ieee802154_ie_builder *b,
+    uint8_t *buf, int buf_size);
+/* Append an IE descriptor. Returns a pointer to the len bytes of content
+ * to be written by the caller, NULL if the buffer is too short */
+uint8_t *frame802154e_ie_builder_add(struct ieee802154_ie_builder *b,
+    uint8_t kind, uint8_t id, uint16_t len);
+/* Open a MLME payload IE, the sub-IEs added until it is closed are nested */
+int frame802154e_ie_builder_mlme_open(struct ieee802154_ie_builder *b);
+void frame802154e_ie_builder_mlme_close(struct ieee802154_ie_builder *b);
+/* Total length of the IEs written so far */
+int frame802154e_ie_builder_len(const struct ieee802154_ie_builder *b);
+
 #endif /* FRAME_802154E_H */
@@ -101,5 +101,10 @@ int tsch_packet_update_eb(uint8_t *buf, int buf_size, uint8_t tsch_sync_ie_offse
 int tsch_packet_parse_eb(const uint8_t *buf, int buf_size,
     frame802154_t *frame, struct ieee802154_ies *ies,
     uint8_t *hdrlen, int frame_without_mic);
+/* Parse EB and extract only ASN and join priority, without copying other IEs.
+ * Returns 0 if the EB has no TSCH synchronization IE */
+int tsch_packet_parse_eb_sync(const uint8_t *buf, int buf_size,
+    frame802154_t *frame, struct tsch_asn_t *asn, uint8_t *join_priority,
+    int frame_without_mic);
 
 #endif /* __TSCH_PACKET_H__ */
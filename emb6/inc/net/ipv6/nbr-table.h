@@ -105,6 +105,10 @@ nbr_table_item_t *nbr_table_next(nbr_table_t *table, nbr_table_item_t *item);
 /** @{ */
 nbr_table_item_t *nbr_table_add_lladdr(nbr_table_t *table, const linkaddr_t *lladdr, nbr_table_reason_t reason, void *data);
 nbr_table_item_t *nbr_table_get_from_lladdr(nbr_table_t *table, const linkaddr_t *lladdr);
+/* Tells whether a neighbor is used by any of the tables. The MAC only adds
+ * entries for such neighbors, as entries added on behalf of the MAC could
+ * not be reclaimed by the neighbor policy */
+int nbr_table_has_lladdr(const linkaddr_t *lladdr);
 /** @} */
 
 /** \name Neighbor tables: set flags (unused, locked, unlocked) */
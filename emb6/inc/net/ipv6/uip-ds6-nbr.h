@@ -60,6 +60,9 @@
 #define  NBR_STALE 2
 #define  NBR_DELAY 3
 #define  NBR_PROBE 4
+/** \brief State of an entry passed to the state change callback while
+ *  it is being removed, e.g. after NUD failed */
+#define  NBR_REMOVED 5
 
 NBR_TABLE_DECLARE(ds6_neighbors);
 
@@ -89,6 +89,58 @@ void uip_ds6_notification_rm(struct uip_ds6_notification *n);
 #define UIP_DS6_ROUTE_NB 4
 #endif /* UIP_CONF_MAX_ROUTES */
 
+/** \brief Compact routing table. Routes are stored as an index into a small
+ *  table of 64-bit prefixes plus the 64-bit interface identifier, so the
+ *  prefix shared by most routes of a DAG is stored only once. Routes whose
+ *  prefix finds no room in the prefix table go to a separate exception
+ *  table that keeps the prefix in the entry. The per-neighbor route lists
+ *  are replaced by a route counter. */
+#ifdef UIP_CONF_DS6_ROUTE_COMPACT
+#define UIP_DS6_ROUTE_COMPACT UIP_CONF_DS6_ROUTE_COMPACT
+#else /* UIP_CONF_DS6_ROUTE_COMPACT */
+#define UIP_DS6_ROUTE_COMPACT 0
+#endif /* UIP_CONF_DS6_ROUTE_COMPACT */
+
+/** \brief Number of distinct prefixes of the compact routing table */
+#ifdef UIP_CONF_DS6_ROUTE_PREFIX_NB
+#define UIP_DS6_ROUTE_PREFIX_NB UIP_CONF_DS6_ROUTE_PREFIX_NB
+#else /* UIP_CONF_DS6_ROUTE_PREFIX_NB */
+#define UIP_DS6_ROUTE_PREFIX_NB 2
+#endif /* UIP_CONF_DS6_ROUTE_PREFIX_NB */
+
+/** \brief Number of exception routes, in addition to UIP_DS6_ROUTE_NB */
+#ifdef UIP_CONF_DS6_ROUTE_EXCEPTION_NB
+#define UIP_DS6_ROUTE_EXCEPTION_NB UIP_CONF_DS6_ROUTE_EXCEPTION_NB
+#else /* UIP_CONF_DS6_ROUTE_EXCEPTION_NB */
+#define UIP_DS6_ROUTE_EXCEPTION_NB 2
+#endif /* UIP_CONF_DS6_ROUTE_EXCEPTION_NB */
+
+/** \brief Prefix ID of the routes held in the exception table */
+#define UIP_DS6_ROUTE_PREFIX_EXCEPTION 0xff
+
+/** \brief Number of buckets (a power of two) of the index through which
+ *  host routes, i.e. routes of prefix length 128, are looked up. The
+ *  route list is then only scanned for shorter prefixes. With 0, all
+ *  lookups scan the route list. */
+#ifdef UIP_CONF_DS6_ROUTE_HASH_SIZE
+#define UIP_DS6_ROUTE_HASH_SIZE UIP_CONF_DS6_ROUTE_HASH_SIZE
+#else /* UIP_CONF_DS6_ROUTE_HASH_SIZE */
+#define UIP_DS6_ROUTE_HASH_SIZE 8
+#endif /* UIP_CONF_DS6_ROUTE_HASH_SIZE */
+
+/** \brief Number of routing tables. Each route belongs to one table, and a
+ *  route added to a table never replaces a route of another table, so
+ *  several routing protocol instances (e.g. RPL instances) can hold routes
+ *  to the same destination. */
+#ifdef UIP_CONF_DS6_ROUTE_TABLES
+#define UIP_DS6_ROUTE_TABLES UIP_CONF_DS6_ROUTE_TABLES
+#else /* UIP_CONF_DS6_ROUTE_TABLES */
+#define UIP_DS6_ROUTE_TABLES 1
+#endif /* UIP_CONF_DS6_ROUTE_TABLES */
+
+/** \brief Table looked up by uip_ds6_route_lookup(): the best match of any table */
+#define UIP_DS6_ROUTE_TABLE_ANY 0xff
+
 /** \brief define some additional RPL related route state and
  *  neighbor callback for RPL - if not a DS6_ROUTE_STATE is already set */
 #ifndef UIP_DS6_ROUTE_STATE_TYPE
@@ -142,7 +194,11 @@ typedef struct rpl_route_entry {
 /** \brief The neighbor routes hold a list of routing table entries
     that are attached to a specific neihbor. */
 struct uip_ds6_route_neighbor_routes {
+#if UIP_DS6_ROUTE_COMPACT
+  uint8_t num_routes;
+#else /* UIP_DS6_ROUTE_COMPACT */
   LIST_STRUCT(route_list);
+#endif /* UIP_DS6_ROUTE_COMPACT */
 };
 
 /** \brief An entry in the routing table */
@@ -154,11 +210,25 @@ typedef struct uip_ds6_route {
      belong to the neighbor table entry that this routing table entry
      uses. */
   struct uip_ds6_route_neighbor_routes *neighbor_routes;
+  uint8_t length;
+#if UIP_DS6_ROUTE_TABLES > 1
+  uint8_t table;
+#endif /* UIP_DS6_ROUTE_TABLES > 1 */
+#if UIP_DS6_ROUTE_HASH_SIZE
+  /* next host route in the same index bucket */
+  uint8_t hash_next;
+#endif /* UIP_DS6_ROUTE_HASH_SIZE */
+#if UIP_DS6_ROUTE_COMPACT
+  /* The destination is the prefix with this ID followed by iid. Use
+     uip_ds6_route_ipaddr() to get the full address. */
+  uint8_t prefix_id;
+  uint8_t iid[8];
+#else /* UIP_DS6_ROUTE_COMPACT */
   uip_ipaddr_t ipaddr;
+#endif /* UIP_DS6_ROUTE_COMPACT */
 #ifdef UIP_DS6_ROUTE_STATE_TYPE
   UIP_DS6_ROUTE_STATE_TYPE state;
 #endif
-  uint8_t length;
 } uip_ds6_route_t;
 
 /** \brief A neighbor route list entry, used on the
@@ -193,10 +263,15 @@ void uip_ds6_defrt_periodic(void);
 uip_ds6_route_t *uip_ds6_route_lookup(uip_ipaddr_t *destipaddr);
 uip_ds6_route_t *uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
                                    uip_ipaddr_t *next_hop);
+uip_ds6_route_t *uip_ds6_route_lookup_table(uip_ipaddr_t *destipaddr,
+                                            uint8_t table);
+uip_ds6_route_t *uip_ds6_route_add_table(uip_ipaddr_t *ipaddr, uint8_t length,
+                                         uip_ipaddr_t *next_hop, uint8_t table);
 void uip_ds6_route_rm(uip_ds6_route_t *route);
 void uip_ds6_route_rm_by_nexthop(uip_ipaddr_t *nexthop);
 
 uip_ipaddr_t *uip_ds6_route_nexthop(uip_ds6_route_t *);
+void uip_ds6_route_ipaddr(const uip_ds6_route_t *route, uip_ipaddr_t *ipaddr);
 int uip_ds6_route_num_routes(void);
 uip_ds6_route_t *uip_ds6_route_head(void);
 uip_ds6_route_t *uip_ds6_route_next(uip_ds6_route_t *);
@@ -42,18 +42,48 @@
 #define LINK_STATS_ETX_DIVISOR              128
 #endif /* LINK_STATS_CONF_ETX_DIVISOR */
 
+/* Keep the outcome of the last transmissions and histograms of burst-loss
+ * lengths and of transmissions per packet for every link */
+#ifdef LINK_STATS_CONF_WITH_HISTORY
+#define LINK_STATS_WITH_HISTORY             LINK_STATS_CONF_WITH_HISTORY
+#else /* LINK_STATS_CONF_WITH_HISTORY */
+#define LINK_STATS_WITH_HISTORY             1
+#endif /* LINK_STATS_CONF_WITH_HISTORY */
+
+/* Number of transmissions whose outcome is kept */
+#define LINK_STATS_HISTORY_LEN              32
+/* Burst-loss bins: 1, 2, 3-4, 5-8 and 9 or more consecutive lost transmissions */
+#define LINK_STATS_BURST_BINS               5
+/* Transmissions per packet bins: acknowledged after 1, 2, 3 and 4 or more
+ * transmissions, and not acknowledged */
+#define LINK_STATS_NUMTX_BINS               5
+/* Returned by the queries when no transmission has been recorded */
+#define LINK_STATS_UNKNOWN                  0xff
+
 /* All statistics of a given link */
 struct link_stats {
   uint16_t etx;               /* ETX using ETX_DIVISOR as fixed point divisor */
   int16_t rssi;               /* RSSI (received signal strength) */
   uint8_t freshness;          /* Freshness of the statistics */
   clock_time_t last_tx_time;  /* Last Tx timestamp */
+  clock_time_t aging_time;    /* Last aging of freshness and histograms */
+#if LINK_STATS_WITH_HISTORY
+  uint32_t tx_history;        /* Last transmissions, newest in bit 0, set if acknowledged */
+  uint8_t tx_history_len;     /* Number of transmissions in tx_history */
+  uint8_t loss_run;           /* Consecutive lost transmissions so far */
+  uint8_t burst_hist[LINK_STATS_BURST_BINS];
+  uint8_t numtx_hist[LINK_STATS_NUMTX_BINS];
+#endif /* LINK_STATS_WITH_HISTORY */
 };
 
 /* Returns the neighbor's link statistics */
 const struct link_stats *link_stats_from_lladdr(const linkaddr_t *lladdr);
 /* Are the statistics fresh? */
 int link_stats_is_fresh(const struct link_stats *stats);
+/* PRR in percent over the last window transmissions (at most LINK_STATS_HISTORY_LEN) */
+uint8_t link_stats_prr(const struct link_stats *stats, uint8_t window);
+/* Probability in percent that a lost transmission is followed by another loss */
+uint8_t link_stats_loss_burstiness(const struct link_stats *stats);
 
 /* Initializes link-stats module */
 void link_stats_init(void);
@@ -125,6 +125,90 @@
 #define RPL_DAO_DELAY                 (bsp_getTRes() * 4)
 #endif /* RPL_CONF_DAO_DELAY */
 
+/* In storing mode, the targets of the DAOs received from children within
+ * RPL_DAO_AGGREGATION_DELAY are forwarded to the parent in a single DAO.
+ * With 0, the targets of each received DAO are forwarded right away. */
+#ifdef RPL_CONF_DAO_AGGREGATION_DELAY
+#define RPL_DAO_AGGREGATION_DELAY     RPL_CONF_DAO_AGGREGATION_DELAY
+#else /* RPL_CONF_DAO_AGGREGATION_DELAY */
+#define RPL_DAO_AGGREGATION_DELAY     (bsp_getTRes())
+#endif /* RPL_CONF_DAO_AGGREGATION_DELAY */
+
+/* Maximum number of targets in a forwarded DAO */
+#ifdef RPL_CONF_DAO_AGGREGATION_MAX_TARGETS
+#define RPL_DAO_AGGREGATION_MAX_TARGETS RPL_CONF_DAO_AGGREGATION_MAX_TARGETS
+#else /* RPL_CONF_DAO_AGGREGATION_MAX_TARGETS */
+#define RPL_DAO_AGGREGATION_MAX_TARGETS 8
+#endif /* RPL_CONF_DAO_AGGREGATION_MAX_TARGETS */
+
+/* The root sends its DAO-ACKs RPL_DAO_ACK_DELAY after the first pending
+ * one, up to RPL_DAO_ACK_QUEUE_SIZE at a time. A newer DAO from the same
+ * node replaces its pending DAO-ACK. With 0, DAOs are acknowledged right
+ * away. */
+#ifdef RPL_CONF_DAO_ACK_DELAY
+#define RPL_DAO_ACK_DELAY             RPL_CONF_DAO_ACK_DELAY
+#else /* RPL_CONF_DAO_ACK_DELAY */
+#define RPL_DAO_ACK_DELAY             (bsp_getTRes() / 8)
+#endif /* RPL_CONF_DAO_ACK_DELAY */
+
+#ifdef RPL_CONF_DAO_ACK_QUEUE_SIZE
+#define RPL_DAO_ACK_QUEUE_SIZE        RPL_CONF_DAO_ACK_QUEUE_SIZE
+#else /* RPL_CONF_DAO_ACK_QUEUE_SIZE */
+#define RPL_DAO_ACK_QUEUE_SIZE        4
+#endif /* RPL_CONF_DAO_ACK_QUEUE_SIZE */
+
+/* Number of consecutive stable DIO intervals after which the adaptive
+ * trickle takes one more step towards fewer DIOs */
+#ifdef RPL_CONF_TRICKLE_STABLE_INTERVALS
+#define RPL_TRICKLE_STABLE_INTERVALS  RPL_CONF_TRICKLE_STABLE_INTERVALS
+#else /* RPL_CONF_TRICKLE_STABLE_INTERVALS */
+#define RPL_TRICKLE_STABLE_INTERVALS  4
+#endif /* RPL_CONF_TRICKLE_STABLE_INTERVALS */
+
+/* Maximum number of doublings added to the advertised minimum DIO interval */
+#ifdef RPL_CONF_TRICKLE_MAX_IMIN_BOOST
+#define RPL_TRICKLE_MAX_IMIN_BOOST    RPL_CONF_TRICKLE_MAX_IMIN_BOOST
+#else /* RPL_CONF_TRICKLE_MAX_IMIN_BOOST */
+#define RPL_TRICKLE_MAX_IMIN_BOOST    2
+#endif /* RPL_CONF_TRICKLE_MAX_IMIN_BOOST */
+
+/* Lowest DIO redundancy constant the adaptive trickle goes down to */
+#ifdef RPL_CONF_TRICKLE_MIN_REDUNDANCY
+#define RPL_TRICKLE_MIN_REDUNDANCY    RPL_CONF_TRICKLE_MIN_REDUNDANCY
+#else /* RPL_CONF_TRICKLE_MIN_REDUNDANCY */
+#define RPL_TRICKLE_MIN_REDUNDANCY    2
+#endif /* RPL_CONF_TRICKLE_MIN_REDUNDANCY */
+
+/* A DIO interval is stable if it saw no parent change and at least
+ * RPL_TRICKLE_CONSISTENCY_RATIO consistent DIOs per inconsistency */
+#ifdef RPL_CONF_TRICKLE_CONSISTENCY_RATIO
+#define RPL_TRICKLE_CONSISTENCY_RATIO RPL_CONF_TRICKLE_CONSISTENCY_RATIO
+#else /* RPL_CONF_TRICKLE_CONSISTENCY_RATIO */
+#define RPL_TRICKLE_CONSISTENCY_RATIO 8
+#endif /* RPL_CONF_TRICKLE_CONSISTENCY_RATIO */
+
+/* Airtime in milliseconds that probes may use per RPL_PROBING_INTERVAL,
+ * and the airtime accounted for one probe (frame, ACK and retries) */
+#ifdef RPL_CONF_PROBING_MAX_AIRTIME
+#define RPL_PROBING_MAX_AIRTIME       RPL_CONF_PROBING_MAX_AIRTIME
+#else /* RPL_CONF_PROBING_MAX_AIRTIME */
+#define RPL_PROBING_MAX_AIRTIME       20
+#endif /* RPL_CONF_PROBING_MAX_AIRTIME */
+
+#ifdef RPL_CONF_PROBING_PROBE_AIRTIME
+#define RPL_PROBING_PROBE_AIRTIME     RPL_CONF_PROBING_PROBE_AIRTIME
+#else /* RPL_CONF_PROBING_PROBE_AIRTIME */
+#define RPL_PROBING_PROBE_AIRTIME     5
+#endif /* RPL_CONF_PROBING_PROBE_AIRTIME */
+
+/* A neighbour that carried unicast traffic within RPL_PROBING_PIGGYBACK_TIME
+ * is not probed: its link statistics are refreshed by that traffic */
+#ifdef RPL_CONF_PROBING_PIGGYBACK_TIME
+#define RPL_PROBING_PIGGYBACK_TIME    RPL_CONF_PROBING_PIGGYBACK_TIME
+#else /* RPL_CONF_PROBING_PIGGYBACK_TIME */
+#define RPL_PROBING_PIGGYBACK_TIME    (30 * bsp_getTRes())
+#endif /* RPL_CONF_PROBING_PIGGYBACK_TIME */
+
 /* Delay between reception of a no-path DAO and actual route removal */
 #ifdef RPL_CONF_NOPATH_REMOVAL_DELAY
 #define RPL_NOPATH_REMOVAL_DELAY          RPL_CONF_NOPATH_REMOVAL_DELAY
@@ -320,6 +404,15 @@ struct rpl_stats {
   uint16_t loop_errors;
   uint16_t loop_warnings;
   uint16_t root_repairs;
+  uint16_t fast_reroutes;
+  /* DAOs received, and those of which not all targets were installed */
+  uint16_t dao_received;
+  uint16_t dao_dropped;
+  /* Pending DAO-ACKs replaced by a newer DAO of the same node */
+  uint16_t dao_acks_coalesced;
+  /* Longest time in clock ticks from the reception of a DAO until it was
+   * processed and acknowledged, or its DAO-ACK queued */
+  uint16_t dao_latency_max;
 };
 typedef struct rpl_stats rpl_stats_t;
 
@@ -340,6 +433,13 @@ extern rpl_stats_t rpl_stats;
 extern rpl_instance_t instance_table[];
 extern rpl_instance_t *default_instance;
 
+/* Routing table holding the routes of an instance */
+#if UIP_DS6_ROUTE_TABLES > 1
+#define RPL_ROUTE_TABLE(instance) ((uint8_t)((instance) - instance_table))
+#else /* UIP_DS6_ROUTE_TABLES > 1 */
+#define RPL_ROUTE_TABLE(instance) 0
+#endif /* UIP_DS6_ROUTE_TABLES > 1 */
+
 /* ICMPv6 functions for RPL. */
 void dis_output(uip_ipaddr_t *addr);
 void dio_output(rpl_instance_t *, uip_ipaddr_t *uc_addr);
@@ -371,7 +471,9 @@ rpl_parent_t *rpl_find_parent_any_dag(rpl_instance_t *instance, uip_ipaddr_t *ad
 void rpl_nullify_parent(rpl_parent_t *);
 void rpl_remove_parent(rpl_parent_t *);
 void rpl_move_parent(rpl_dag_t *dag_src, rpl_dag_t *dag_dst, rpl_parent_t *parent);
+void rpl_parent_set_update(rpl_parent_t *parent);
 rpl_parent_t *rpl_select_parent(rpl_dag_t *dag);
+int rpl_local_reroute(rpl_parent_t *parent);
 rpl_dag_t *rpl_select_dag(rpl_instance_t *instance,rpl_parent_t *parent);
 void rpl_recalculate_ranks(void);
 
@@ -393,6 +495,9 @@ void rpl_cancel_dao(rpl_instance_t *instance);
 void rpl_schedule_probing(rpl_instance_t *instance);
 
 void rpl_reset_dio_timer(rpl_instance_t *);
+#if RPL_WITH_ADAPTIVE_TRICKLE
+void rpl_trickle_parent_changed(rpl_instance_t *instance);
+#endif /* RPL_WITH_ADAPTIVE_TRICKLE */
 void rpl_reset_periodic_timer(void);
 
 /* Route poisoning. */
@@ -44,6 +44,7 @@
 #include "clist.h"
 #include "uip.h"
 #include "uip-ds6.h"
+#include "nbr-table.h"
 #include "ctimer.h"
 
 /*---------------------------------------------------------------------------*/
@@ -111,6 +112,7 @@ struct rpl_dag;
 /*---------------------------------------------------------------------------*/
 #define RPL_PARENT_FLAG_UPDATED           0x1
 #define RPL_PARENT_FLAG_LINK_METRIC_VALID 0x2
+#define RPL_PARENT_FLAG_PROBED            0x4
 
 struct rpl_parent {
   struct rpl_dag *dag;
@@ -120,6 +122,10 @@ struct rpl_parent {
   rpl_rank_t rank;
   uint8_t dtsn;
   uint8_t flags;
+  /* DAG whose parent set holds this parent and the path cost it is
+     ordered by there */
+  struct rpl_dag *set_dag;
+  uint16_t set_cost;
 };
 typedef struct rpl_parent rpl_parent_t;
 /*---------------------------------------------------------------------------*/
@@ -147,6 +153,11 @@ struct rpl_dag {
   struct rpl_instance *instance;
   rpl_prefix_t prefix_info;
   uint32_t lifetime;
+  /* candidate parents in increasing path cost order */
+  rpl_parent_t *parent_set[NBR_TABLE_MAX_NEIGHBORS];
+  uint8_t parent_set_len;
+  /* loop-free alternative to the preferred parent, see rpl_local_reroute() */
+  rpl_parent_t *backup_parent;
 };
 typedef struct rpl_dag rpl_dag_t;
 typedef struct rpl_instance rpl_instance_t;
@@ -215,6 +226,28 @@ struct rpl_of {
 };
 typedef struct rpl_of rpl_of_t;
 
+/*---------------------------------------------------------------------------*/
+#if RPL_WITH_ADAPTIVE_TRICKLE
+/* State and statistics of the adaptive DIO trickle of an instance */
+struct rpl_trickle_stats {
+  /* totals since the instance was created */
+  uint16_t intervals;
+  uint16_t consistent;
+  uint16_t inconsistent;
+  uint16_t parent_changes;
+  uint16_t dio_sent;
+  uint16_t dio_suppressed;
+  /* counters of the running DIO interval */
+  uint16_t win_consistent;
+  uint16_t win_inconsistent;
+  uint8_t win_parent_changes;
+  /* consecutive stable intervals since the last adaptation step */
+  uint8_t stable_intervals;
+  /* current deviation from the advertised Imin and k */
+  uint8_t imin_boost;
+  uint8_t redundancy_cut;
+};
+#endif /* RPL_WITH_ADAPTIVE_TRICKLE */
 /*---------------------------------------------------------------------------*/
 /* Instance */
 struct rpl_instance {
@@ -250,9 +283,15 @@ struct rpl_instance {
   uint16_t dio_totrecv;
 #endif /* RPL_CONF_STATS */
   clock_time_t dio_next_delay; /* delay for completion of dio interval */
+#if RPL_WITH_ADAPTIVE_TRICKLE
+  struct rpl_trickle_stats trickle;
+#endif /* RPL_WITH_ADAPTIVE_TRICKLE */
 #if RPL_WITH_PROBING
   struct ctimer probing_timer;
   rpl_parent_t *urgent_probing_target;
+  /* Probe airtime used in the current probing window, in milliseconds */
+  clock_time_t probing_window_start;
+  uint16_t probing_airtime;
 #endif /* RPL_WITH_PROBING */
   struct ctimer dio_timer;
   struct ctimer dao_timer;
@@ -276,6 +315,10 @@ rpl_dag_t *rpl_get_dag(const uip_ipaddr_t *addr);
 rpl_dag_t *rpl_get_any_dag(void);
 rpl_instance_t *rpl_get_instance(uint8_t instance_id);
 int rpl_update_header(void);
+/* Instance, routes and default route of the datagram in uip_buf */
+rpl_instance_t *rpl_get_output_instance(void);
+uip_ds6_route_t *rpl_route_lookup(uip_ipaddr_t *addr);
+uip_ipaddr_t *rpl_defrt_choose(void);
 int rpl_finalize_header(uip_ipaddr_t *addr);
 int rpl_verify_hbh_header(int);
 void rpl_insert_header(void);
@@ -294,6 +337,8 @@ uip_ds6_nbr_t *rpl_get_nbr(rpl_parent_t *parent);
 void rpl_print_neighbor_list(void);
 int rpl_process_srh_header(void);
 int rpl_srh_get_next_hop(uip_ipaddr_t *ipaddr);
+const linkaddr_t *rpl_get_reroute_nexthop(const linkaddr_t *addr);
+int rpl_has_backup_parent(const linkaddr_t *addr);
 
 /* Per-parent RPL information */
 NBR_TABLE_DECLARE(rpl_parents);
@@ -49,6 +49,7 @@
 #define SICSLOWPAN_H_
 #include "uip.h"
 #include "mac.h"
+#include "stimer.h"
 
 /**
  * \name General sicslowpan defines
@@ -80,6 +81,18 @@
 #define SICSLOWPAN_DISPATCH_IPHC                    0x60UL /* 011xxxxx = ... */
 #define SICSLOWPAN_DISPATCH_FRAG1                   0xc0UL /* 11000xxx */
 #define SICSLOWPAN_DISPATCH_FRAGN                   0xe0UL /* 11100xxx */
+#define SICSLOWPAN_DISPATCH_RFRAG                   0xe8UL /* 1110100E */
+#define SICSLOWPAN_DISPATCH_RFRAG_ACK               0xeaUL /* 1110101Y */
+/** @} */
+
+/** \name Selective fragment recovery (RFC 8931) encoding
+ * @{
+ */
+#define SICSLOWPAN_RFRAG_DISPATCH_MASK              0xfeUL
+#define SICSLOWPAN_RFRAG_ACK_REQ                    0x8000UL /* X flag */
+#define SICSLOWPAN_RFRAG_SEQ_MASK                   0x1fUL
+#define SICSLOWPAN_RFRAG_SEQ_BIT                    10
+#define SICSLOWPAN_RFRAG_SIZE_MASK                  0x03ffUL
 /** @} */
 
 /** \name HC1 encoding
@@ -158,6 +171,20 @@
 #define SICSLOWPAN_NHC_UDP_CS_P_11  0xF3 /* source & dest = 0xF0B + 4bit inline */
 /** @} */
 
+/**
+ * \name LOWPAN_GHC encoding (RFC 7400, works together with IPHC)
+ * @{
+ */
+#define SICSLOWPAN_NHC_GHC_UDP                      0xD0 /* UDP header and payload */
+#define SICSLOWPAN_NHC_GHC_ICMP6                    0xDF /* ICMPv6 header and payload */
+/* bytecodes of the compressed data */
+#define SICSLOWPAN_GHC_APPEND_MAX                   95   /* 0kkkkkkk, k < 96 */
+#define SICSLOWPAN_GHC_ZEROS                        0x80 /* 1000nnnn */
+#define SICSLOWPAN_GHC_STOP                         0x90 /* 10010000 */
+#define SICSLOWPAN_GHC_EXT                          0xA0 /* 101nssss */
+#define SICSLOWPAN_GHC_BACKREF                      0xC0 /* 11nnnkkk */
+/** @} */
+
 
 /**
  * \name The 6lowpan "headers" length
@@ -169,6 +196,8 @@
 #define SICSLOWPAN_HC1_HC_UDP_HDR_LEN               7
 #define SICSLOWPAN_FRAG1_HDR_LEN                    4
 #define SICSLOWPAN_FRAGN_HDR_LEN                    5
+#define SICSLOWPAN_RFRAG_HDR_LEN                    6
+#define SICSLOWPAN_RFRAG_ACK_HDR_LEN                6
 /** @} */
 
 /**
@@ -217,8 +246,17 @@ struct sicslowpan_addr_context {
   uint8_t used; /* possibly use as prefix-length */
   uint8_t number;
   uint8_t prefix[8];
+  uint8_t ghc; /* nodes in this context decompress GHC (RFC 7400) */
+  uint8_t length; /* prefix length, bits beyond it are zero */
+  uint8_t compress; /* C flag, zero if only used for decompression */
+  uint8_t isinfinite;
+  struct stimer lifetime;
 };
 
+/** \brief Lifetime of a context that never expires. A 6CO has no such
+ * value, its lifetime of 0xffff minutes expires like any other */
+#define SICSLOWPAN_CONTEXT_INFINITE 0xffffffffUL
+
 /**
  * \name Address compressibility test functions
  * @{
@@ -315,6 +353,37 @@ struct sicslowpan_nh_compressor {
 
 int sicslowpan_get_last_rssi(void);
 
+/**
+ * \brief Enable or disable generic header compression (RFC 7400) towards
+ * the addresses of an IPHC context.
+ * \param number the context number
+ * \param enable non-zero if the nodes of the context support GHC
+ * \return 1 on success, 0 if there is no such context
+ */
+int sicslowpan_set_context_ghc(uint8_t number, uint8_t enable);
+
+/**
+ * \brief Add, update or remove an IPHC address context, e.g. from a
+ * 6LoWPAN context option (RFC 6775).
+ * \param number the context number (0-15)
+ * \param prefix the context prefix, only the first 64 bits are used
+ * \param length the prefix length in bits
+ * \param compress zero if the context is only used for decompression
+ * \param lifetime valid lifetime in minutes, 0 removes the context and
+ * SICSLOWPAN_CONTEXT_INFINITE keeps it forever, e.g. for a preconfigured
+ * context
+ * \return 1 on success, 0 if the context table is full
+ */
+int sicslowpan_context_set(uint8_t number, const uip_ipaddr_t *prefix,
+                           uint8_t length, uint8_t compress,
+                           uint32_t lifetime);
+
+/**
+ * \brief Get the IPHC address context with the given number.
+ * \return the context or NULL if it is not in use
+ */
+const struct sicslowpan_addr_context *sicslowpan_context_get(uint8_t number);
+
 
 #endif /* SICSLOWPAN_H_ */
 /** @} */
@@ -56,14 +56,36 @@
 #define PHY_PSDU_MAX                    (uint16_t)( 2047u )
 #define PHY_PSDU_CRC16(a)               ((a & 0x1000))
 #define PHY_PSDU_MIN(a)                 (PHY_PSDU_CRC16(a) ? 2 : 4)
+#define PHY_FCS_LEN_MAX                 (uint16_t)(    4u )
 #else
 #define PHY_HEADER_LEN                  (uint16_t)(    1u )
 #define PHY_PSDU_MAX                    (uint16_t)(  127u )
 #define PHY_PSDU_MIN(a)                 ((uint16_t)(    2u )) /* 2-byte CRC */
+#define PHY_FCS_LEN_MAX                 (uint16_t)(    2u )
 #endif
 
 
+/**
+ * @brief   Frame check sequence computed while the PSDU is read from the
+ *          radio, chunk by chunk. The octets following the MHR and the MAC
+ *          payload are taken as the received FCS
+ */
+typedef struct
+{
+  uint32_t crc;             /*!< checksum of the octets processed so far */
+  uint16_t psdu_len;        /*!< length of the PSDU, including the FCS */
+  uint16_t num_bytes;       /*!< number of PSDU octets processed so far */
+  uint8_t  fcs_len;         /*!< length of the FCS, 2 or 4 octets */
+  uint8_t  fcs[4];          /*!< received FCS */
+} phy_framer802154_fcs_t;
+
 
 uint16_t phy_framer802154_getPktLen(uint8_t *p_data, uint16_t len);
+uint8_t phy_framer802154_getFcsLen(uint8_t *p_data);
+
+void phy_framer802154_fcsInit(phy_framer802154_fcs_t *p_fcs, uint16_t psdu_len, uint8_t fcs_len);
+void phy_framer802154_fcsUpdate(phy_framer802154_fcs_t *p_fcs, uint8_t *p_data, uint16_t len);
+uint32_t phy_framer802154_fcsFinal(phy_framer802154_fcs_t *p_fcs);
+e_nsErr_t phy_framer802154_fcsCheck(phy_framer802154_fcs_t *p_fcs);
 
 #endif /* PHY_FRAMER154_PRESENT */
@@ -390,6 +390,7 @@ static void dllc_send(uint8_t *p_data, uint16_t len, e_nsErr_t *p_err)
   int is_broadcast;
   uint8_t hdr_len;
   frame802154_t params;
+  const frame802154_hdrtmpl_t *p_hdrtmpl;
 
 #if NETSTK_CFG_ARG_CHK_EN
   if (p_err == NULL) {
@@ -497,7 +498,7 @@ static void dllc_send(uint8_t *p_data, uint16_t len, e_nsErr_t *p_err)
   params.payload = packetbuf_dataptr();
 
   /* allocate buffer for MAC header */
-  hdr_len = frame802154_hdrlen(&params);
+  hdr_len = frame802154_hdrtmpl_get(&params, &p_hdrtmpl);
   alloc = packetbuf_hdralloc(hdr_len);
   if (alloc == 0) {
     *p_err = NETSTK_ERR_BUF_OVERFLOW;
@@ -505,7 +506,7 @@ static void dllc_send(uint8_t *p_data, uint16_t len, e_nsErr_t *p_err)
   }
 
   /* write the header */
-  frame802154_create(&params, packetbuf_hdrptr());
+  frame802154_hdrtmpl_write(p_hdrtmpl, &params, packetbuf_hdrptr());
 
 #if LLSEC802154_ENABLED
 
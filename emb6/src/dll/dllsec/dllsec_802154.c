@@ -64,6 +64,7 @@
 
 static s_ns_t *pdllsec_netstk;
 static mac_callback_t dllsec_txCbFnct;
+static uint8_t dllsec_isTxPending;
 
 #if LLSEC802154_ENABLED
 static frame802154_frame_counter_t counter;
@@ -133,7 +134,23 @@ static void dllsec_cbTx(void *p_arg, e_nsErr_t *p_err)
 
   if (dllsec_txCbFnct != NULL) {
     dllsec_txCbFnct(p_arg, status, retx);
-    dllsec_txCbFnct = NULL;
+  }
+}
+
+
+/*
+ * @brief   Transmission callback function handler of lower layers
+ *
+ *          Only the results of frames queued by the MAC are taken, as
+ *          dllsec_send() reports on the others itself.
+ *
+ * @param   p_arg
+ * @param   p_err
+ */
+static void dllsec_cbTxQueued(void *p_arg, e_nsErr_t *p_err)
+{
+  if (dllsec_isTxPending == FALSE) {
+    dllsec_cbTx(p_arg, p_err);
   }
 }
 
@@ -276,6 +293,7 @@ static void dllsec_send(mac_callback_t sent, void *p_arg)
   e_nsErr_t err = NETSTK_ERR_NONE;
 
   dllsec_txCbFnct = sent;
+  dllsec_isTxPending = TRUE;
   packetbuf_set_attr(PACKETBUF_ATTR_FRAME_TYPE, FRAME802154_DATAFRAME);
 
 #if LLSEC802154_ENABLED
@@ -293,6 +311,13 @@ static void dllsec_send(mac_callback_t sent, void *p_arg)
    * Issue next lower layer to transmit the prepared packet
    */
   pdllsec_netstk->dllc->send(packetbuf_hdrptr(), packetbuf_totlen(), &err );
+  dllsec_isTxPending = FALSE;
+
+  /* has the frame been queued? then its TX status follows via dllsec_cbTxQueued() */
+  if (err == NETSTK_ERR_MAC_TX_QUEUED) {
+    return;
+  }
+
   if (err != NETSTK_ERR_NONE) {
     TRACE_LOG_ERR("<DLLS> e=-%d", err);
   }
@@ -326,6 +351,7 @@ static void dllsec_init(s_ns_t *p_netstk)
 
   pdllsec_netstk = p_netstk;
   pdllsec_netstk->dllc->ioctrl(NETSTK_CMD_RX_CBFNT_SET, (void *) dllsec_input, &err);
+  pdllsec_netstk->dllc->ioctrl(NETSTK_CMD_TX_CBFNCT_SET, (void *) dllsec_cbTxQueued, &err);
 #if LLSEC802154_ENABLED
   /* Initialising the value of frame counter of Auxiliary Security Header */
   counter.u32 = 0;
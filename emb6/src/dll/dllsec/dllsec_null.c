@@ -50,6 +50,7 @@
 
 static s_ns_t *pdllsec_netstk;
 static mac_callback_t dllsec_txCbFnct;
+static uint8_t dllsec_isTxPending;
 
 /**
  * @brief   Transmission callback function handler
@@ -91,7 +92,23 @@ static void dllsec_cbTx(void *p_arg, e_nsErr_t *p_err)
 
   if (dllsec_txCbFnct != NULL) {
     dllsec_txCbFnct(p_arg, status, retx);
-    dllsec_txCbFnct = NULL;
+  }
+}
+
+
+/*
+ * @brief   Transmission callback function handler of lower layers
+ *
+ *          Only the results of frames queued by the MAC are taken, as
+ *          dllsec_send() reports on the others itself.
+ *
+ * @param   p_arg
+ * @param   p_err
+ */
+static void dllsec_cbTxQueued(void *p_arg, e_nsErr_t *p_err)
+{
+  if (dllsec_isTxPending == FALSE) {
+    dllsec_cbTx(p_arg, p_err);
   }
 }
 
@@ -101,12 +118,20 @@ static void dllsec_send(mac_callback_t sent, void *p_arg)
   e_nsErr_t err = NETSTK_ERR_NONE;
 
   dllsec_txCbFnct = sent;
+  dllsec_isTxPending = TRUE;
   packetbuf_set_attr(PACKETBUF_ATTR_FRAME_TYPE, FRAME802154_DATAFRAME);
 
   /*
    * Issue next lower layer to transmit the prepared packet
    */
   pdllsec_netstk->dllc->send( packetbuf_hdrptr(), packetbuf_totlen(), &err );
+  dllsec_isTxPending = FALSE;
+
+  /* has the frame been queued? then its TX status follows via dllsec_cbTxQueued() */
+  if (err == NETSTK_ERR_MAC_TX_QUEUED) {
+    return;
+  }
+
   if (err != NETSTK_ERR_NONE) {
     TRACE_LOG_ERR("<DLLS> e=-%d", err);
   }
@@ -146,6 +171,7 @@ static void dllsec_init(s_ns_t *p_netstk)
 
   pdllsec_netstk = p_netstk;
   pdllsec_netstk->dllc->ioctrl(NETSTK_CMD_RX_CBFNT_SET, (void *) dllsec_input, &err);
+  pdllsec_netstk->dllc->ioctrl(NETSTK_CMD_TX_CBFNCT_SET, (void *) dllsec_cbTxQueued, &err);
 }
 
 /*---------------------------------------------------------------------------*/
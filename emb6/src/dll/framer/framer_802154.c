@@ -97,6 +97,37 @@ typedef struct {
   uint8_t aux_sec_len;     /**<  Length (in bytes) of aux security header field */
 } field_length_t;
 
+/** \brief Maximum length of a MAC header written by \ref frame802154_create() */
+#if LLSEC802154_USES_AUX_HEADER
+#define FRAME802154_MAX_HDR_LEN         (2 + 1 + 2 + 8 + 2 + 8 + 15)
+#else
+#define FRAME802154_MAX_HDR_LEN         (2 + 1 + 2 + 8 + 2 + 8)
+#endif /* LLSEC802154_USES_AUX_HEADER */
+
+/**
+ *  \brief Serialized MAC header of a recent transmission. Headers to the same
+ *  destination with the same frame type and security settings only differ in
+ *  the sequence number and the frame counter, which are patched on reuse.
+ *  The remaining fields are the lookup key.
+ */
+struct frame802154_hdrtmpl {
+  uint8_t mhr[FRAME802154_MAX_HDR_LEN]; /**<  Serialized header, FCF first */
+  uint8_t len;             /**<  Length of the header, 0 if unused */
+  uint8_t ref;             /**<  Used since the clock hand passed by */
+  uint8_t dest_addr[8];    /**<  Destination address */
+  uint8_t src_addr[8];     /**<  Source address */
+  uint16_t dest_pid;       /**<  Destination PAN ID */
+  uint16_t src_pid;        /**<  Source PAN ID */
+#if LLSEC802154_USES_AUX_HEADER
+  uint8_t fc_pos;          /**<  Offset of the frame counter, 0 if none */
+  frame802154_scf_t scf;   /**<  Security control of the aux header */
+#if LLSEC802154_USES_EXPLICIT_KEYS
+  frame802154_key_source_t key_source;  /**<  Key source of the aux header */
+  uint8_t key_index[9];    /**<  Key index of the aux header */
+#endif /* LLSEC802154_USES_EXPLICIT_KEYS */
+#endif /* LLSEC802154_USES_AUX_HEADER */
+};
+
 
 
 
@@ -104,6 +135,10 @@ typedef struct {
 /*----------------------------------------------------------------------------*/
 static uint8_t Framer802154_DSN;
 
+/* header templates, replaced in clock order */
+static frame802154_hdrtmpl_t hdrtmpl[NETSTK_CFG_FRAMER_HDR_CACHE_SIZE];
+static uint8_t hdrtmpl_hand;
+
 CC_INLINE static uint8_t
 addr_len(uint8_t mode)
 {
@@ -393,19 +428,8 @@ frame802154_extract_linkaddr(frame802154_t *frame,
 }
 /*----------------------------------------------------------------------------*/
 static void
-field_len(frame802154_t *p, field_length_t *flen)
+panid_compression(frame802154_t *p)
 {
-  int has_src_panid;
-  int has_dest_panid;
-
-  /* init flen to zeros */
-  memset(flen, 0, sizeof(field_length_t));
-
-  /* Determine lengths of each field based on fcf and other args */
-  if((p->fcf.sequence_number_suppression & 1) == 0) {
-    flen->seqno_len = 1;
-  }
-
   /* IEEE802.15.4e changes the meaning of PAN ID Compression (see Table 2a).
    * In this case, we leave the decision whether to compress PAN ID or not
    * up to the caller. */
@@ -418,6 +442,39 @@ field_len(frame802154_t *p, field_length_t *flen)
       p->fcf.panid_compression = 0;
     }
   }
+}
+/*----------------------------------------------------------------------------*/
+static void
+fcf_write(const frame802154_fcf_t *fcf, uint8_t *buf)
+{
+  buf[0] = (fcf->frame_type & 7)
+          | ((fcf->security_enabled & 1) << 3)
+          | ((fcf->frame_pending & 1) << 4)
+          | ((fcf->ack_required & 1) << 5)
+          | ((fcf->panid_compression & 1) << 6);
+
+  buf[1] = ((fcf->sequence_number_suppression & 1))
+          | ((fcf->ie_list_present & 1)) << 1
+          | ((fcf->dest_addr_mode & 3) << 2)
+          | ((fcf->frame_version & 3) << 4)
+          | ((fcf->src_addr_mode & 3) << 6);
+}
+/*----------------------------------------------------------------------------*/
+static void
+field_len(frame802154_t *p, field_length_t *flen)
+{
+  int has_src_panid;
+  int has_dest_panid;
+
+  /* init flen to zeros */
+  memset(flen, 0, sizeof(field_length_t));
+
+  /* Determine lengths of each field based on fcf and other args */
+  if((p->fcf.sequence_number_suppression & 1) == 0) {
+    flen->seqno_len = 1;
+  }
+
+  panid_compression(p);
 
   frame802154_has_panid(&p->fcf, &has_src_panid, &has_dest_panid);
 
@@ -506,17 +563,7 @@ frame802154_create(frame802154_t *p, uint8_t *buf)
 
     /* OK, now we have field lengths.  Time to actually construct */
     /* the outgoing frame, and store it in buf */
-    buf[0] = (p->fcf.frame_type & 7)
-            | ((p->fcf.security_enabled & 1) << 3)
-            | ((p->fcf.frame_pending & 1) << 4)
-            | ((p->fcf.ack_required & 1) << 5)
-            | ((p->fcf.panid_compression & 1) << 6);
-
-    buf[1] = ((p->fcf.sequence_number_suppression & 1))
-            | ((p->fcf.ie_list_present & 1)) << 1
-            | ((p->fcf.dest_addr_mode & 3) << 2)
-            | ((p->fcf.frame_version & 3) << 4)
-            | ((p->fcf.src_addr_mode & 3) << 6);
+    fcf_write(&p->fcf, buf);
 
     pos = 2;
 
@@ -580,6 +627,126 @@ frame802154_create(frame802154_t *p, uint8_t *buf)
     return (int) pos;
 }
 /*----------------------------------------------------------------------------*/
+static uint8_t
+hdrtmpl_match(const frame802154_hdrtmpl_t *t, const frame802154_t *p,
+              const uint8_t *fcf)
+{
+  if((t->len == 0) ||
+     (t->mhr[0] != fcf[0]) || (t->mhr[1] != fcf[1]) ||
+     (t->dest_pid != p->dest_pid) || (t->src_pid != p->src_pid) ||
+     memcmp(t->dest_addr, p->dest_addr, addr_len(p->fcf.dest_addr_mode & 3)) ||
+     memcmp(t->src_addr, p->src_addr, addr_len(p->fcf.src_addr_mode & 3))) {
+    return 0;
+  }
+#if LLSEC802154_USES_AUX_HEADER
+  if(p->fcf.security_enabled & 1) {
+    if(memcmp(&t->scf, &p->aux_hdr.security_control, sizeof(t->scf))) {
+      return 0;
+    }
+#if LLSEC802154_USES_EXPLICIT_KEYS
+    if(memcmp(&t->key_source, &p->aux_hdr.key_source, sizeof(t->key_source)) ||
+       memcmp(t->key_index, p->aux_hdr.key_index, sizeof(t->key_index))) {
+      return 0;
+    }
+#endif /* LLSEC802154_USES_EXPLICIT_KEYS */
+  }
+#endif /* LLSEC802154_USES_AUX_HEADER */
+  return 1;
+}
+/*----------------------------------------------------------------------------*/
+/**
+ *   \brief Looks up the header template of a frame, creating it from
+ *   \p p if none of the cached templates matches.  The template stays valid
+ *   until the next call and is written with \ref frame802154_hdrtmpl_write().
+ *
+ *   \param p Pointer to frame802154_t struct, which specifies the
+ *   frame to send.
+ *
+ *   \param pp_tmpl Pointer to store the template at.
+ *
+ *   \return The length of the frame header.
+ */
+int
+frame802154_hdrtmpl_get(frame802154_t *p, const frame802154_hdrtmpl_t **pp_tmpl)
+{
+  frame802154_hdrtmpl_t *t;
+  uint8_t fcf[2];
+  uint8_t i;
+#if LLSEC802154_USES_AUX_HEADER
+  field_length_t flen;
+#endif /* LLSEC802154_USES_AUX_HEADER */
+
+  panid_compression(p);
+  fcf_write(&p->fcf, fcf);
+
+  for(i = 0; i < NETSTK_CFG_FRAMER_HDR_CACHE_SIZE; i++) {
+    t = &hdrtmpl[i];
+    if(hdrtmpl_match(t, p, fcf)) {
+      t->ref = 1;
+      *pp_tmpl = t;
+      return t->len;
+    }
+  }
+
+  /* replace the first template not used since the last round */
+  while(hdrtmpl[hdrtmpl_hand].ref) {
+    hdrtmpl[hdrtmpl_hand].ref = 0;
+    hdrtmpl_hand = (hdrtmpl_hand + 1) % NETSTK_CFG_FRAMER_HDR_CACHE_SIZE;
+  }
+  t = &hdrtmpl[hdrtmpl_hand];
+  hdrtmpl_hand = (hdrtmpl_hand + 1) % NETSTK_CFG_FRAMER_HDR_CACHE_SIZE;
+
+  memcpy(t->dest_addr, p->dest_addr, sizeof(t->dest_addr));
+  memcpy(t->src_addr, p->src_addr, sizeof(t->src_addr));
+  t->dest_pid = p->dest_pid;
+  t->src_pid = p->src_pid;
+  t->len = frame802154_create(p, t->mhr);
+  t->ref = 1;
+#if LLSEC802154_USES_AUX_HEADER
+  t->scf = p->aux_hdr.security_control;
+#if LLSEC802154_USES_EXPLICIT_KEYS
+  t->key_source = p->aux_hdr.key_source;
+  memcpy(t->key_index, p->aux_hdr.key_index, sizeof(t->key_index));
+#endif /* LLSEC802154_USES_EXPLICIT_KEYS */
+  t->fc_pos = 0;
+  if((p->fcf.security_enabled & 1) &&
+     (p->aux_hdr.security_control.frame_counter_suppression == 0)) {
+    field_len(p, &flen);
+    t->fc_pos = 2 + flen.seqno_len + flen.dest_pid_len + flen.dest_addr_len +
+                flen.src_pid_len + flen.src_addr_len + 1;
+  }
+#endif /* LLSEC802154_USES_AUX_HEADER */
+
+  *pp_tmpl = t;
+  return t->len;
+}
+/*----------------------------------------------------------------------------*/
+/**
+ *   \brief Writes a header template, patching in the sequence number and
+ *   the frame counter of the frame.
+ *
+ *   \param p_tmpl Template returned by \ref frame802154_hdrtmpl_get().
+ *
+ *   \param p Pointer to frame802154_t struct, which specifies the
+ *   frame to send.
+ *
+ *   \param buf Pointer to the buffer to use for the frame.
+ */
+void
+frame802154_hdrtmpl_write(const frame802154_hdrtmpl_t *p_tmpl,
+                          const frame802154_t *p, uint8_t *buf)
+{
+  memcpy(buf, p_tmpl->mhr, p_tmpl->len);
+  if((buf[1] & 1) == 0) {
+    buf[2] = p->seq;
+  }
+#if LLSEC802154_USES_AUX_HEADER
+  if(p_tmpl->fc_pos) {
+    memcpy(buf + p_tmpl->fc_pos, p->aux_hdr.frame_counter.u8, 4);
+  }
+#endif /* LLSEC802154_USES_AUX_HEADER */
+}
+/*----------------------------------------------------------------------------*/
 /**
  *   \brief Parses an input frame.  Scans the input frame to find each
  *   section, and stores the information of each section in a
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2010, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Copyright (c) 2013, ADVANSEE - http://www.advansee.com/
+ * Benoît Thébaudeau <benoit.thebaudeau@advansee.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         MAC sequence numbers management
+ * \author
+ *         Adam Dunkels <adam@sics.se>
+ *         Benoît Thébaudeau <benoit.thebaudeau@advansee.com>
+ */
+
+#include <string.h>
+
+#include "emb6.h"
+#include "mac-sequence.h"
+#include "linkaddr.h"
+#include "nbr-table.h"
+#include "packetbuf.h"
+#include "bsp.h"
+
+/*
+ * Window of the recently received sequence numbers of a sender. Bit i of
+ * the bitmap is set when sequence number (last - i) was received, so that
+ * a sender is checked and updated in constant time once its window is found.
+ */
+struct seqno {
+  clock_time_t timestamp;
+  uint32_t bitmap;
+  uint8_t last;
+};
+
+/* Window of a sender that is not in the neighbor table */
+struct seqno_other {
+  linkaddr_t sender;
+  struct seqno window;
+};
+
+#ifdef NETSTACK_CONF_MAC_SEQNO_MAX_AGE
+#define SEQNO_MAX_AGE NETSTACK_CONF_MAC_SEQNO_MAX_AGE
+#else /* NETSTACK_CONF_MAC_SEQNO_MAX_AGE */
+#define SEQNO_MAX_AGE (20 * bsp_getTRes())
+#endif /* NETSTACK_CONF_MAC_SEQNO_MAX_AGE */
+
+/* Number of senders outside the neighbor table that are tracked */
+#ifdef NETSTACK_CONF_MAC_SEQNO_HISTORY
+#define MAX_SEQNOS NETSTACK_CONF_MAC_SEQNO_HISTORY
+#else /* NETSTACK_CONF_MAC_SEQNO_HISTORY */
+#define MAX_SEQNOS 8
+#endif /* NETSTACK_CONF_MAC_SEQNO_HISTORY */
+
+/* Number of sequence numbers tracked per sender */
+#define SEQNO_WINDOW (sizeof(uint32_t) * 8)
+
+/*
+ * Windows are attached to the neighbor table entries of known neighbors only,
+ * see nbr_table_has_lladdr(). Frames of other senders are tracked in a small
+ * history.
+ */
+NBR_TABLE(struct seqno, received_seqnos);
+static struct seqno_other other_seqnos[MAX_SEQNOS];
+static uint8_t other_next;
+
+/*---------------------------------------------------------------------------*/
+/* Tells whether a window is outdated, e.g. as the sender rebooted */
+static int
+is_expired(const struct seqno *s, clock_time_t now)
+{
+  return (SEQNO_MAX_AGE > 0) && (now - s->timestamp > SEQNO_MAX_AGE);
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the window of a sender outside the neighbor table, if any */
+static struct seqno_other *
+other_from_lladdr(const linkaddr_t *sender)
+{
+  int i;
+
+  for(i = 0; i < MAX_SEQNOS; ++i) {
+    if(other_seqnos[i].window.bitmap != 0 &&
+       linkaddr_cmp(sender, &other_seqnos[i].sender)) {
+      return &other_seqnos[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the window of a sender, creating it if needed */
+static struct seqno *
+window_add(const linkaddr_t *sender)
+{
+  struct seqno *s;
+  struct seqno_other *o;
+
+  o = other_from_lladdr(sender);
+  if(nbr_table_has_lladdr(sender)) {
+    s = nbr_table_add_lladdr(received_seqnos, sender, NBR_TABLE_REASON_MAC, NULL);
+    if(s != NULL) {
+      /* the sender became a neighbor, keep its history */
+      if(o != NULL) {
+        memcpy(s, &o->window, sizeof(struct seqno));
+        o->window.bitmap = 0;
+      }
+      return s;
+    }
+  }
+  if(o != NULL) {
+    return &o->window;
+  }
+
+  /* Replace the sender that was added first */
+  o = &other_seqnos[other_next];
+  other_next = (other_next + 1) % MAX_SEQNOS;
+  linkaddr_copy(&o->sender, sender);
+  o->window.bitmap = 0;
+  return &o->window;
+}
+/*---------------------------------------------------------------------------*/
+void
+mac_sequence_init(void)
+{
+  memset(other_seqnos, 0, sizeof(other_seqnos));
+  other_next = 0;
+  nbr_table_register(received_seqnos, NULL);
+}
+/*---------------------------------------------------------------------------*/
+int
+mac_sequence_is_duplicate_from(const linkaddr_t *sender, uint8_t seqno)
+{
+  struct seqno *s;
+  struct seqno_other *o;
+  uint8_t offset;
+
+  s = nbr_table_get_from_lladdr(received_seqnos, sender);
+  if(s == NULL) {
+    o = other_from_lladdr(sender);
+    s = (o != NULL) ? &o->window : NULL;
+  }
+  if(s == NULL || is_expired(s, bsp_getTick())) {
+    return 0;
+  }
+
+  /* Distance to the most recent sequence number, modulo 256 */
+  offset = (uint8_t)(s->last - seqno);
+  return (offset < SEQNO_WINDOW) && ((s->bitmap >> offset) & 1);
+}
+/*---------------------------------------------------------------------------*/
+void
+mac_sequence_register_seqno_from(const linkaddr_t *sender, uint8_t seqno)
+{
+  struct seqno *s;
+  uint8_t offset;
+  clock_time_t now = bsp_getTick();
+
+  s = nbr_table_get_from_lladdr(received_seqnos, sender);
+  if(s == NULL) {
+    s = window_add(sender);
+  }
+  if(is_expired(s, now)) {
+    s->bitmap = 0;
+  }
+
+  offset = (uint8_t)(seqno - s->last);
+  if(s->bitmap == 0) {
+    /* First sequence number of the window */
+    s->last = seqno;
+    s->bitmap = 1;
+  } else if(offset < 0x80) {
+    /* Newer sequence number: slide the window forward */
+    s->bitmap = (offset < SEQNO_WINDOW) ? (s->bitmap << offset) : 0;
+    s->bitmap |= 1;
+    s->last = seqno;
+  } else if((uint8_t)(s->last - seqno) < SEQNO_WINDOW) {
+    /* Older sequence number still within the window */
+    s->bitmap |= (uint32_t)1 << (uint8_t)(s->last - seqno);
+  } else {
+    /* Far behind the window, the sender restarted its sequence */
+    s->last = seqno;
+    s->bitmap = 1;
+  }
+  s->timestamp = now;
+}
+/*---------------------------------------------------------------------------*/
+int
+mac_sequence_is_duplicate(void)
+{
+  return mac_sequence_is_duplicate_from(packetbuf_addr(PACKETBUF_ADDR_SENDER),
+                                        packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO));
+}
+/*---------------------------------------------------------------------------*/
+void
+mac_sequence_register_seqno(void)
+{
+  mac_sequence_register_seqno_from(packetbuf_addr(PACKETBUF_ADDR_SENDER),
+                                   packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO));
+}
+/*---------------------------------------------------------------------------*/
@@ -56,7 +56,14 @@
 #include "evproc.h"
 #include "framer_802154.h"
 #include "packetbuf.h"
+#include "queuebuf.h"
+#include "clist.h"
+#include "mac.h"
+#include "mac-sequence.h"
+#include "memb.h"
+#include "phy_framer_802154.h"
 #include "random.h"
+#include "ringbufindex.h"
 #include "rt_tmr.h"
 
 
@@ -77,6 +84,63 @@
   #endif
 #endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) */
 
+/*!< Weight of the latest CCA in the ratio of busy CCAs, as a divisor */
+#define MAC_CCA_BUSY_EWMA_DIV                   8
+
+/*!< Convert a delay in microseconds into real-time timer ticks, rounded up */
+#define MAC_US_TO_TMR_TICKS(_us)                                              \
+  (rt_tmr_tick_t )((((_us) * RT_TMR_CFG_TICK_FREQ_IN_HZ) + 999999u) / 1000000u)
+
+/*!< States of the CSMA-CA transmission process */
+typedef enum {
+  E_MAC_TX_STATE_IDLE,
+  E_MAC_TX_STATE_BACKOFF,
+  E_MAC_TX_STATE_CCA,
+  E_MAC_TX_STATE_TX,
+  E_MAC_TX_STATE_WFA,
+  E_MAC_TX_STATE_DONE,
+} e_macTxState_t;
+
+struct s_macTx {
+  e_macTxState_t    state;
+  uint8_t          *p_data;
+  uint16_t          len;
+  uint8_t           seq;
+  uint8_t           nb;
+  uint8_t           be;
+  uint8_t           numTx;
+  uint8_t           numTxMax;
+  uint8_t           minBe;
+  uint8_t           maxBe;
+  uint8_t           maxBackoff;
+  e_nsErr_t         err;
+};
+
+#if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE)
+/*!< Frame waiting for transmission */
+struct s_macTxPacket {
+  struct s_macTxPacket *next;
+  struct queuebuf      *buf;
+  nsTxCbFnct_t          cbTxFnct;
+  void                 *p_cbTxArg;
+};
+
+/*!< Frames waiting for transmission to the same receiver */
+struct s_macNbrQueue {
+  struct s_macNbrQueue *next;
+  linkaddr_t            addr;
+  LIST_STRUCT(packets);
+};
+#endif /* #if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE) */
+
+#if (NETSTK_CFG_MAC_RX_RING_SIZE > 0)
+/*!< Received frame waiting for the upper layers */
+struct s_macRxSlot {
+  uint16_t          len;
+  uint8_t           data[PACKETBUF_SIZE];
+};
+#endif /* #if (NETSTK_CFG_MAC_RX_RING_SIZE > 0) */
+
 
 /*
 ********************************************************************************
@@ -92,10 +156,31 @@ static void mac_ioctl(e_nsIocCmd_t cmd, void *p_val, e_nsErr_t *p_err);
 
 #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE)
 static void mac_txAck(uint8_t seq, e_nsErr_t *p_err);
+#if (NETSTK_CFG_CSMA_ASYNC_EN == FALSE)
 static void mac_rxBufTimeout(s_rt_tmr_t *p_tmr, e_nsErr_t *p_err);
+#endif /* #if (NETSTK_CFG_CSMA_ASYNC_EN == FALSE) */
 #endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) */
 
-static void mac_csma(e_nsErr_t *p_err);
+static void mac_txPolicyApply(const linkaddr_t *p_dst, uint8_t txClass, uint8_t numTxMax);
+static void mac_ccaBusyUpdate(uint8_t isBusy);
+static void mac_txStart(uint8_t isBurst);
+static void mac_txBackoffInit(void);
+static void mac_txRun(void);
+static void mac_txDone(void);
+static uint8_t mac_txWait(uint32_t delay);
+
+#if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE)
+static void mac_tmrTxCb(void *p_arg);
+static void mac_eventHandler(c_event_t c_event, p_data_t p_data);
+static void mac_txEnqueue(e_nsErr_t *p_err);
+static void mac_txNext(void);
+static void mac_txFreeNbr(struct s_macNbrQueue *p_nbr);
+#endif /* #if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE) */
+
+#if (NETSTK_CFG_MAC_RX_RING_SIZE > 0)
+static void mac_rxPut(uint8_t *p_data, uint16_t len, e_nsErr_t *p_err);
+static void mac_rxEventHandler(c_event_t c_event, p_data_t p_data);
+#endif /* #if (NETSTK_CFG_MAC_RX_RING_SIZE > 0) */
 
 
 /*
@@ -113,10 +198,37 @@ static void            *pmac_cbTxArg;
 static nsTxCbFnct_t     mac_cbTxFnct;
 static e_nsErr_t        mac_txErr;
 static uint8_t          mac_hasData;
+static struct s_macTx   mac_tx;
+static macTxPolicyFnct_t mac_txPolicy;
+/** ratio of busy CCAs in 1/256 percent */
+static uint16_t         mac_ccaBusy;
 
-#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE)
+#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) && (NETSTK_CFG_CSMA_ASYNC_EN == FALSE)
 static s_rt_tmr_t       mac_tmrWfa;
-#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) */
+#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) && (NETSTK_CFG_CSMA_ASYNC_EN == FALSE) */
+
+#if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE)
+/** timer driving the backoff and ACK-wait periods */
+static s_rt_tmr_t       mac_tmrTx;
+/** set when the radio shall be turned off upon the pending transmission */
+static uint8_t          mac_isOffPending;
+/** copy of the frame in transmission, leaving room for the PHY header and the
+ *  FCS the PHY appends with NETSTK_SUPPORT_SW_MAC_AUTOACK */
+static uint8_t          mac_txBuf[PHY_HEADER_LEN + PACKETBUF_SIZE + PHY_FCS_LEN_MAX];
+/** set when the next frame follows the previous one without CSMA-CA */
+static uint8_t          mac_isBurst;
+
+/** receivers with queued frames, the one being served first */
+LIST(mac_nbrList);
+MEMB(mac_nbrMemb, struct s_macNbrQueue, NETSTK_CFG_CSMA_MAX_NEIGHBOR_QUEUES);
+MEMB(mac_pktMemb, struct s_macTxPacket, QUEUEBUF_NUM);
+#endif /* #if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE) */
+
+#if (NETSTK_CFG_MAC_RX_RING_SIZE > 0)
+/** received frames not yet handed over to the DLLC */
+static struct s_macRxSlot mac_rxSlots[NETSTK_CFG_MAC_RX_RING_SIZE];
+static struct ringbufindex mac_rxRing;
+#endif /* #if (NETSTK_CFG_MAC_RX_RING_SIZE > 0) */
 
 /*
 ********************************************************************************
@@ -168,10 +280,29 @@ void mac_init(void *p_netstk, e_nsErr_t *p_err)
   pmac_cbTxArg = NULL;
   mac_isAckReq = 0;
   mac_txErr = NETSTK_ERR_NONE;
+  mac_tx.state = E_MAC_TX_STATE_IDLE;
+  mac_txPolicy = mac_txPolicyDefault;
+  mac_ccaBusy = 0;
 
-#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE)
+#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) && (NETSTK_CFG_CSMA_ASYNC_EN == FALSE)
   rt_tmr_create(&mac_tmrWfa, E_RT_TMR_TYPE_ONE_SHOT, MAC_CFG_TMR_WFA_IN_MS, 0, NULL);
-#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) */
+#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) && (NETSTK_CFG_CSMA_ASYNC_EN == FALSE) */
+
+#if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE)
+  rt_tmr_stop(&mac_tmrTx);
+  mac_isOffPending = FALSE;
+  mac_isBurst = FALSE;
+  list_init(mac_nbrList);
+  memb_init(&mac_nbrMemb);
+  memb_init(&mac_pktMemb);
+  evproc_regCallback(EVENT_TYPE_MAC_TX, mac_eventHandler);
+#endif /* #if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE) */
+
+#if (NETSTK_CFG_MAC_RX_RING_SIZE > 0)
+  ringbufindex_init(&mac_rxRing, NETSTK_CFG_MAC_RX_RING_SIZE);
+  evproc_regCallback(EVENT_TYPE_MAC_RX, mac_rxEventHandler);
+#endif /* #if (NETSTK_CFG_MAC_RX_RING_SIZE > 0) */
+  mac_sequence_init();
 
   /*
    * Configure stack address
@@ -223,6 +354,10 @@ void mac_on(e_nsErr_t *p_err)
   }
 #endif
 
+#if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE)
+  mac_isOffPending = FALSE;
+#endif /* #if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE) */
+
   pmac_netstk->phy->on(p_err);
 }
 
@@ -240,6 +375,16 @@ void mac_off(e_nsErr_t *p_err)
   }
 #endif
 
+#if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE)
+  /* are frames still being transmitted? */
+  if ((mac_tx.state != E_MAC_TX_STATE_IDLE) || (list_head(mac_nbrList) != NULL)) {
+    /* then turn the radio off once all of them are done */
+    mac_isOffPending = TRUE;
+    *p_err = NETSTK_ERR_NONE;
+    return;
+  }
+#endif /* #if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE) */
+
   pmac_netstk->phy->off(p_err);
 }
 
@@ -356,149 +501,41 @@ void mac_send(uint8_t *p_data, uint16_t len, e_nsErr_t *p_err)
 
   LOG_INFO("MAC_TX: Transmit %d bytes.", len);
 
-  uint8_t is_tx_done;
-  uint8_t tx_retries;
-  uint8_t tx_retriesMax;
-
-  /* find out if ACK is required */
-  mac_isAckReq = packetbuf_attr(PACKETBUF_ATTR_MAC_ACK);
-
-  /*
-   * Transmission handling
+#if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE)
+  /* frames are queued together with the attributes of the packet buffer
+   * holding them
    */
-  tx_retriesMax = packetbuf_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS);
-  tx_retries = 0;
-  is_tx_done = FALSE;
-
-  /* set result of TX process to default */
-  mac_txErr = NETSTK_ERR_TX_NOACK;
-
-  /* perform CSMA-CA */
-  mac_csma(p_err);
-
-  /* was channel free? */
-  if (*p_err == NETSTK_ERR_NONE) {
-    /* then attempt to transmit the packet */
-    pmac_netstk->phy->send(p_data, len, p_err);
+  if ((p_data != packetbuf_hdrptr()) || (len != packetbuf_totlen())) {
+    *p_err = NETSTK_ERR_INVALID_ARGUMENT;
+  } else {
+    mac_txEnqueue(p_err);
   }
 
-  /* is ACK required? */
-  if (mac_isAckReq == TRUE) {
-
-  /* is software Auto-ACK feature of MAC disabled? */
-#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == FALSE)
-    {
-      /* has the frame not been acknowledged? */
-      if (*p_err == NETSTK_ERR_TX_NOACK) {
-        /* then perform retransmission */
-        tx_retries++;
-
-        /* iterates retransmission as long as number of retries does not exceed
-        * the maximum retries and ACK was not arrived
-        */
-        while ((tx_retries < tx_retriesMax) && (is_tx_done == FALSE)) {
-          TRACE_LOG_ERR("+ MAC_TX: seq=%02x; retry=%d; err=-%d", p_data[2], tx_retries, *p_err);
-
-          /* perform unslotted CSMA-CA */
-          mac_csma(p_err);
-
-          /* is channel free? */
-          if (*p_err == NETSTK_ERR_NONE) {
-            /* then retransmit the frame */
-            pmac_netstk->phy->send(p_data, len, p_err);
-            /* was ACK not arrived? */
-            if (*p_err == NETSTK_ERR_TX_NOACK) {
-              /* then increase number of retries */
-              tx_retries++;
-            } else {
-              /* otherwise terminate the transmission */
-              is_tx_done = TRUE;
-              TRACE_LOG_ERR("+ MAC_TX: TX done, r=%d, e=-%d", tx_retries, *p_err);
-            }
-          }
-          /* was channel free or was the radio busy */
-          else {
-            /* then terminate transmission process */
-            is_tx_done = TRUE;
-            TRACE_LOG_ERR("+ MAC_TX: CCA failed, r=%d, e=%d", tx_retries, *p_err);
-          }
-        }
-      }
-    }
-#else
-    {
-      /* was the packet successfully transmitted? */
-      if (*p_err == NETSTK_ERR_NONE) {
-        /* then waits for ACK */
-        is_tx_done = FALSE;
-        do {
-          tx_retries++;
-          /* polling for ACK until timeout is expired */
-          mac_rxBufTimeout(&mac_tmrWfa, p_err);
-          /* was no packet arrived during AckWaitDuration? */
-          if (*p_err == NETSTK_ERR_FATAL) {
-            TRACE_LOG_ERR("MAC_TX: WFA timeout seq=%02x, r=%d", p_data[2], tx_retries);
-            /* was number of retries smaller than maximum retry? */
-            if (tx_retries < tx_retriesMax) {
-              /* then check if channel is free */
-              mac_csma(p_err);
-              /* was the channel free? */
-              if (*p_err == NETSTK_ERR_NONE) {
-                /* then retransmit the frame */
-                #if (NETSTK_CFG_RF_RETX_EN == TRUE)
-                pmac_netstk->phy->ioctrl(NETSTK_CMD_RF_RETX, NULL, p_err);
-                #else
-                pmac_netstk->phy->send(p_data, len, p_err);
-                #endif
-                /* has frame failed to transmit? */
-                if (*p_err != NETSTK_ERR_NONE) {
-                  /* then terminate the transmission */
-                  is_tx_done = TRUE;
-                  TRACE_LOG_ERR("MAC_TX: TX failed, r=%d", tx_retries);
-                }
-              }
-              /* was channel free or was the radio busy */
-              else {
-                is_tx_done = TRUE;
-                TRACE_LOG_ERR("MAC_TX: CCA failed, r=%d, e=%d", tx_retries, *p_err);
-              }
-            }
-            /* was number of retries equal or greater than the maximum retry? */
-            else {
-              /* then terminate the transmission process */
-              is_tx_done = TRUE;
-              *p_err = NETSTK_ERR_TX_NOACK;
-              TRACE_LOG_ERR("MAC_TX: NO_ACK, r=%d", tx_retries);
-            }
-          }
-          /* was a packet arrived during ACK-wait duration? */
-          else {
-            /* then TX result is set in mac_recv() and terminate the TX process */
-            *p_err = mac_txErr;
-            is_tx_done = TRUE;
-          }
-        } while (is_tx_done == FALSE);
-      }
+  if (*p_err != NETSTK_ERR_NONE) {
+    if (mac_cbTxFnct) {
+      mac_cbTxFnct(pmac_cbTxArg, p_err);
     }
-#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == FALSE) */
-  }
-  /* is ACK not required? */
-  else {
-    /* then terminate transmission process */
+    return;
   }
 
+  /* serve the queues once the caller has returned */
+  evproc_putEvent(E_EVPROC_TAIL, EVENT_TYPE_MAC_TX, NULL);
 
-  /* reset local variables */
-  mac_isAckReq = 0;
-  mac_txErr = NETSTK_ERR_NONE;
-  TRACE_LOG_MAIN("MAC_TX: finished e=-%d", *p_err);
-  LOG_INFO("MAC_TX: --> Done - TX Status %d (%d/%d retries).", *p_err, tx_retries, tx_retriesMax);
+  /* result of the transmission is signaled via the TX callback function */
+  *p_err = NETSTK_ERR_MAC_TX_QUEUED;
+#else
+  /* find out if ACK is required */
+  mac_isAckReq = packetbuf_attr(PACKETBUF_ATTR_MAC_ACK);
 
-  /* was transmission callback function set? */
-  if (mac_cbTxFnct) {
-    /* then signal the upper layer of the result of transmission process */
-    mac_cbTxFnct(pmac_cbTxArg, p_err);
-  }
+  mac_tx.p_data = p_data;
+  mac_tx.len = len;
+  mac_tx.seq = (uint8_t) packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO);
+  mac_txPolicyApply(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
+                    packetbuf_attr(PACKETBUF_ATTR_MAC_TX_CLASS),
+                    packetbuf_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS));
+  mac_txStart(FALSE);
+  *p_err = mac_tx.err;
+#endif /* #if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE) */
 }
 
 
@@ -554,12 +591,12 @@ void mac_recv(uint8_t *p_data, uint16_t len, e_nsErr_t *p_err)
   mac_hasData = 1;
 
   /* was MAC waiting for ACK? */
-  if (mac_isAckReq) {
+  if (mac_tx.state == E_MAC_TX_STATE_WFA) {
 #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE)
     /* then frames other than ACK shall be discarded silently */
 
     /* check if this is expected ACK */
-    exp_seq = (uint8_t) packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO);
+    exp_seq = mac_tx.seq;
     is_acked = ((frame.seq == exp_seq) &&
                 (frame.fcf.frame_type == FRAME802154_ACKFRAME));
     if (is_acked) {
@@ -570,12 +607,30 @@ void mac_recv(uint8_t *p_data, uint16_t len, e_nsErr_t *p_err)
       mac_txErr = NETSTK_ERR_TX_COLLISION;
       TRACE_LOG_ERR("MAC_TX: collided");
     }
+
+#if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE)
+    /* resume the transmission process without waiting for the timeout */
+    if (rt_tmr_getState(&mac_tmrTx) == E_RT_TMR_STATE_RUNNING) {
+      rt_tmr_stop(&mac_tmrTx);
+      evproc_putEvent(E_EVPROC_HEAD, EVENT_TYPE_MAC_TX, NULL);
+    }
+#endif /* #if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE) */
 #endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) */
   }
   else {
     switch (frame.fcf.frame_type) {
       case FRAME802154_DATAFRAME:
       case FRAME802154_CMDFRAME:
+#if (NETSTK_CFG_MAC_RX_RING_SIZE > 0)
+        /* a frame that cannot be stored is neither acknowledged nor
+         * registered, so that the sender retransmits it */
+        if (ringbufindex_peek_put(&mac_rxRing) < 0) {
+          *p_err = NETSTK_ERR_BUF_OVERFLOW;
+          TRACE_LOG_ERR("MAC_RX: ring full");
+          return;
+        }
+#endif /* #if (NETSTK_CFG_MAC_RX_RING_SIZE > 0) */
+
 #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE)
         /* perform Auto-ACK */
         if ((frame.fcf.ack_required == 1) &&
@@ -586,8 +641,22 @@ void mac_recv(uint8_t *p_data, uint16_t len, e_nsErr_t *p_err)
         }
 #endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) */
 
+        /* discard retransmissions of frames whose ACK was lost */
+        if (frame.fcf.src_addr_mode != FRAME802154_NOADDR) {
+          if (mac_sequence_is_duplicate_from((linkaddr_t *) frame.src_addr, frame.seq)) {
+            *p_err = NETSTK_ERR_NONE;
+            LOG_INFO("MAC_RX: duplicate %d", frame.seq);
+            return;
+          }
+          mac_sequence_register_seqno_from((linkaddr_t *) frame.src_addr, frame.seq);
+        }
+
         /* signal upper layer of the received packet */
+#if (NETSTK_CFG_MAC_RX_RING_SIZE > 0)
+        mac_rxPut(p_data, len, p_err);
+#else
         pmac_netstk->dllc->recv(p_data, len, p_err);
+#endif /* #if (NETSTK_CFG_MAC_RX_RING_SIZE > 0) */
         break;
 
       case FRAME802154_ACKFRAME:
@@ -633,6 +702,19 @@ void mac_ioctl(e_nsIocCmd_t cmd, void *p_val, e_nsErr_t *p_err)
       pmac_cbTxArg = p_val;
       break;
 
+    case NETSTK_CMD_MAC_TX_POLICY_SET:
+      /* NULL keeps the configured CSMA-CA parameters for all frames */
+      mac_txPolicy = (macTxPolicyFnct_t) p_val;
+      break;
+
+    case NETSTK_CMD_MAC_CCA_BUSY_GET:
+      if (p_val == NULL) {
+        *p_err = NETSTK_ERR_INVALID_ARGUMENT;
+      } else {
+        *((uint8_t *) p_val) = (uint8_t) ((mac_ccaBusy + 128u) >> 8);
+      }
+      break;
+
     default:
       pmac_netstk->phy->ioctrl(cmd, p_val, p_err);
       break;
@@ -688,54 +770,488 @@ static void mac_txAck(uint8_t seq, e_nsErr_t *p_err)
 
 
 /**
- * @brief   This function performs CSMA-CA mechanism.
+ * @brief   Set the CSMA-CA parameters of the frame described by mac_tx
  *
- * @param   p_err   Pointer to a variable storing returned error code
+ * @param   p_dst       Link-layer address of the receiver
+ * @param   txClass     Traffic class of the frame, e.g. MAC_TX_CLASS_DEFAULT
+ * @param   numTxMax    Maximum number of transmissions requested by the
+ *                      upper layer
+ */
+static void mac_txPolicyApply(const linkaddr_t *p_dst, uint8_t txClass, uint8_t numTxMax)
+{
+  s_macTxParam_t param;
+
+  param.minBe = NETSTK_CFG_CSMA_MIN_BE;
+  param.maxBe = NETSTK_CFG_CSMA_MAX_BE;
+  param.maxBackoff = NETSTK_CFG_CSMA_MAX_BACKOFF;
+  param.maxTx = numTxMax;
+  if (mac_txPolicy != NULL) {
+    mac_txPolicy(p_dst, txClass, (uint8_t) ((mac_ccaBusy + 128u) >> 8), &param);
+  }
+
+  mac_tx.minBe = param.minBe;
+  mac_tx.maxBe = param.maxBe;
+  mac_tx.maxBackoff = param.maxBackoff;
+  mac_tx.numTxMax = param.maxTx;
+}
+
+
+/**
+ * @brief   Account a CCA in the ratio of busy CCAs
+ *
+ * @param   isBusy      TRUE if the CCA did not find the channel free
+ */
+static void mac_ccaBusyUpdate(uint8_t isBusy)
+{
+  int32_t sample;
+
+  sample = (isBusy == TRUE) ? (100L << 8) : 0;
+  mac_ccaBusy += (int16_t) ((sample - (int32_t) mac_ccaBusy) / MAC_CCA_BUSY_EWMA_DIV);
+}
+
+
+/**
+ * @brief   Start the transmission process of the frame described by mac_tx
+ *
+ * @param   isBurst     TRUE if the frame directly follows an acknowledged
+ *                      frame to the same receiver, so that the channel is
+ *                      still held and CSMA-CA is skipped
+ */
+static void mac_txStart(uint8_t isBurst)
+{
+  mac_tx.numTx = 0;
+  mac_tx.err = NETSTK_ERR_NONE;
+
+  /* set result of TX process to default */
+  mac_txErr = NETSTK_ERR_TX_NOACK;
+
+  if (isBurst == TRUE) {
+    mac_tx.state = E_MAC_TX_STATE_TX;
+  } else {
+    /* perform CSMA-CA */
+    mac_txBackoffInit();
+  }
+  mac_txRun();
+}
+
+
+/**
+ * @brief   (Re-)initialize unslotted CSMA-CA before a (re-)transmission
+ */
+static void mac_txBackoffInit(void)
+{
+  mac_tx.nb = 0;
+  mac_tx.be = mac_tx.minBe;
+  mac_tx.state = E_MAC_TX_STATE_BACKOFF;
+}
+
+
+/**
+ * @brief   Run the transmission process until either it completes or has to
+ *          wait for the TX timer
  */
-static void mac_csma(e_nsErr_t *p_err)
+static void mac_txRun(void)
 {
-  uint32_t delay = 0;
+  uint32_t delay;
   uint32_t max_random;
-  uint8_t nb;
-  uint8_t be;
+  uint8_t is_waiting = FALSE;
+
+  while ((mac_tx.state != E_MAC_TX_STATE_IDLE) && (is_waiting == FALSE)) {
+    switch (mac_tx.state) {
+      case E_MAC_TX_STATE_BACKOFF:
+        /* delay for random (2^BE - 1) unit backoff periods */
+        max_random = (1 << mac_tx.be) - 1;
+        delay  = bsp_getrand(0, max_random);
+        delay *= NETSTK_CFG_CSMA_UNIT_BACKOFF_US;
+        mac_tx.state = E_MAC_TX_STATE_CCA;
+        is_waiting = mac_txWait(delay);
+        break;
 
-  /* initialize CSMA variables */
-  nb = 0;
-  be = NETSTK_CFG_CSMA_MIN_BE;
-  *p_err = NETSTK_ERR_NONE;
+      case E_MAC_TX_STATE_CCA:
+        /* perform CCA */
+        pmac_netstk->phy->ioctrl(NETSTK_CMD_RF_CCA_GET, 0, &mac_tx.err);
+        mac_ccaBusyUpdate(mac_tx.err != NETSTK_ERR_NONE);
+        /* was channel free or was the radio busy? */
+        if (mac_tx.err == NETSTK_ERR_NONE) {
+          /* channel free */
+          LOG_INFO("MAC_TX: NB %d.", mac_tx.nb);
+          mac_tx.state = E_MAC_TX_STATE_TX;
+        }
+        else if (mac_tx.err == NETSTK_ERR_BUSY) {
+          /* radio is likely busy receiving a packet and therefore should let it handle the received packet now */
+          mac_tx.err = NETSTK_ERR_CHANNEL_ACESS_FAILURE;
+          mac_tx.state = E_MAC_TX_STATE_DONE;
+          TRACE_LOG_ERR("+ MAC_TX: CCA failed, r=%d, e=%d", mac_tx.numTx, mac_tx.err);
+        }
+        /* was channel busy? */
+        else {
+          /* then increase number of backoff by one */
+          mac_tx.nb++;
+          /* be = MIN((be + 1), MaxBE) */
+          mac_tx.be = ((mac_tx.be + 1) < mac_tx.maxBe) ? (mac_tx.be + 1) : (mac_tx.maxBe);
+          /* perform CCA maximum MaxBackoff time */
+          if (mac_tx.nb <= mac_tx.maxBackoff) {
+            mac_tx.state = E_MAC_TX_STATE_BACKOFF;
+          } else {
+            mac_tx.state = E_MAC_TX_STATE_DONE;
+            TRACE_LOG_ERR("+ MAC_TX: CCA failed, r=%d, e=%d", mac_tx.numTx, mac_tx.err);
+          }
+        }
+        break;
 
-  /* perform CCA maximum MaxBackoff time */
-  while (nb <= NETSTK_CFG_CSMA_MAX_BACKOFF) {
-    /* delay for random (2^BE - 1) unit backoff periods */
-    max_random = (1 << be) - 1;
-    delay  = bsp_getrand(0, max_random);
-    delay *= NETSTK_CFG_CSMA_UNIT_BACKOFF_US;
-    bsp_delayUs(delay);
-
-    /* perform CCA */
-    pmac_netstk->phy->ioctrl(NETSTK_CMD_RF_CCA_GET, 0, p_err);
-    /* was channel free or was the radio busy? */
-    if (*p_err == NETSTK_ERR_NONE) {
-      /* channel free */
-      break;
+      case E_MAC_TX_STATE_TX:
+#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) && (NETSTK_CFG_RF_RETX_EN == TRUE)
+        if (mac_tx.numTx > 0) {
+          /* retransmit the frame */
+          pmac_netstk->phy->ioctrl(NETSTK_CMD_RF_RETX, NULL, &mac_tx.err);
+        } else
+#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) && (NETSTK_CFG_RF_RETX_EN == TRUE) */
+        {
+          pmac_netstk->phy->send(mac_tx.p_data, mac_tx.len, &mac_tx.err);
+        }
+        mac_tx.numTx++;
+        mac_tx.state = E_MAC_TX_STATE_DONE;
+
+        /* is ACK required? */
+        if (mac_isAckReq == TRUE) {
+#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == FALSE)
+          /* has the frame not been acknowledged and may it be retransmitted? */
+          if ((mac_tx.err == NETSTK_ERR_TX_NOACK) &&
+              (mac_tx.numTx < mac_tx.numTxMax)) {
+            TRACE_LOG_ERR("+ MAC_TX: seq=%02x; retry=%d; err=-%d", mac_tx.seq, mac_tx.numTx, mac_tx.err);
+            /* then perform unslotted CSMA-CA again */
+            mac_txBackoffInit();
+          }
+#else
+          /* was the packet successfully transmitted? */
+          if (mac_tx.err == NETSTK_ERR_NONE) {
+            /* then waits for ACK */
+            mac_hasData = 0;
+            mac_tx.state = E_MAC_TX_STATE_WFA;
+#if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE)
+            is_waiting = mac_txWait(MAC_CFG_TMR_WFA_IN_MS * 1000u);
+#endif /* #if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE) */
+          } else if (mac_tx.numTx > 1) {
+            TRACE_LOG_ERR("MAC_TX: TX failed, r=%d", mac_tx.numTx);
+          }
+#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == FALSE) */
+        }
+        break;
+
+#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE)
+      case E_MAC_TX_STATE_WFA:
+#if (NETSTK_CFG_CSMA_ASYNC_EN == FALSE)
+        /* polling for ACK until timeout is expired */
+        mac_rxBufTimeout(&mac_tmrWfa, &mac_tx.err);
+#endif /* #if (NETSTK_CFG_CSMA_ASYNC_EN == FALSE) */
+        /* was a packet arrived during ACK-wait duration? */
+        if (mac_hasData) {
+          /* then TX result is set in mac_recv() and terminate the TX process */
+          mac_tx.err = mac_txErr;
+          mac_tx.state = E_MAC_TX_STATE_DONE;
+        }
+        /* was number of transmissions smaller than maximum? */
+        else if (mac_tx.numTx < mac_tx.numTxMax) {
+          TRACE_LOG_ERR("MAC_TX: WFA timeout seq=%02x, r=%d", mac_tx.seq, mac_tx.numTx);
+          /* then check if channel is free for the retransmission */
+          mac_txBackoffInit();
+        }
+        else {
+          /* then terminate the transmission process */
+          mac_tx.err = NETSTK_ERR_TX_NOACK;
+          mac_tx.state = E_MAC_TX_STATE_DONE;
+          TRACE_LOG_ERR("MAC_TX: NO_ACK, r=%d", mac_tx.numTx);
+        }
+        break;
+#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) */
+
+      case E_MAC_TX_STATE_DONE:
+      default:
+        mac_txDone();
+        break;
     }
-    else if (*p_err == NETSTK_ERR_BUSY) {
-      /* radio is likely busy receiving a packet and therefore should let it handle the received packet now */
-      *p_err = NETSTK_ERR_CHANNEL_ACESS_FAILURE;
+  }
+}
+
+
+/**
+ * @brief   Terminate the transmission process and signal its result to the
+ *          upper layer
+ */
+static void mac_txDone(void)
+{
+  e_nsErr_t err;
+  nsTxCbFnct_t cbTxFnct;
+  void *p_cbTxArg;
+
+  err = mac_tx.err;
+  cbTxFnct = mac_cbTxFnct;
+  p_cbTxArg = pmac_cbTxArg;
+  TRACE_LOG_MAIN("MAC_TX: finished e=-%d", err);
+  LOG_INFO("MAC_TX: --> Done - TX Status %d (%d/%d transmissions).", err, mac_tx.numTx, mac_tx.numTxMax);
+
+#if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE)
+  struct s_macNbrQueue *p_nbr;
+  struct s_macTxPacket *p_pkt;
+
+  p_nbr = list_head(mac_nbrList);
+  p_pkt = list_head(p_nbr->packets);
+  list_remove(p_nbr->packets, p_pkt);
+  cbTxFnct = p_pkt->cbTxFnct;
+  p_cbTxArg = p_pkt->p_cbTxArg;
+
+  /* restore the packet buffer of the frame for the upper layers */
+  queuebuf_to_packetbuf(p_pkt->buf);
+  queuebuf_free(p_pkt->buf);
+  memb_free(&mac_pktMemb, p_pkt);
+
+  /* did the acknowledged frame announce a following one by the frame
+   * pending bit? then send it right away, otherwise serve the next receiver
+   */
+  mac_isBurst = (err == NETSTK_ERR_NONE) &&
+                (mac_isAckReq == TRUE) &&
+                ((mac_tx.p_data[0] >> 4) & 1) &&
+                (list_head(p_nbr->packets) != NULL);
+  if (list_head(p_nbr->packets) == NULL) {
+    mac_txFreeNbr(p_nbr);
+  } else if (mac_isBurst == FALSE) {
+    list_remove(mac_nbrList, p_nbr);
+    list_add(mac_nbrList, p_nbr);
+  }
+#endif /* #if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE) */
+
+  /* reset local variables */
+  mac_tx.state = E_MAC_TX_STATE_IDLE;
+  mac_isAckReq = 0;
+  mac_txErr = NETSTK_ERR_NONE;
+
+#if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE)
+  if (list_head(mac_nbrList) != NULL) {
+    /* serve the next frame */
+    evproc_putEvent(E_EVPROC_TAIL, EVENT_TYPE_MAC_TX, NULL);
+  } else if (mac_isOffPending == TRUE) {
+    /* turn the radio off as requested meanwhile */
+    e_nsErr_t off_err;
+    mac_isOffPending = FALSE;
+    pmac_netstk->phy->off(&off_err);
+  }
+#endif /* #if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE) */
+
+  /* was transmission callback function set? */
+  if (cbTxFnct) {
+    /* then signal the upper layer of the result of transmission process */
+    cbTxFnct(p_cbTxArg, &err);
+  }
+}
+
+
+/**
+ * @brief   Delay the next state of the transmission process
+ *
+ * @param   delay   Delay in microseconds
+ * @return  TRUE if the process is resumed by the TX timer, otherwise FALSE
+ */
+static uint8_t mac_txWait(uint32_t delay)
+{
+#if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE)
+  rt_tmr_tick_t ticks;
+
+  ticks = MAC_US_TO_TMR_TICKS(delay);
+  if (ticks == 0) {
+    return FALSE;
+  }
+
+  rt_tmr_stop(&mac_tmrTx);
+  rt_tmr_create(&mac_tmrTx, E_RT_TMR_TYPE_ONE_SHOT, ticks, mac_tmrTxCb, NULL);
+  rt_tmr_start(&mac_tmrTx);
+  return TRUE;
+#else
+  bsp_delayUs(delay);
+  return FALSE;
+#endif /* #if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE) */
+}
+
+
+#if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE)
+/**
+ * @brief   TX timer callback, invoked from the timer interrupt
+ */
+static void mac_tmrTxCb(void *p_arg)
+{
+  (void)p_arg;
+
+  /* resume the transmission process outside of the interrupt context */
+  evproc_putEvent(E_EVPROC_TAIL, EVENT_TYPE_MAC_TX, NULL);
+}
+
+
+/**
+ * @brief   MAC event handler
+ */
+static void mac_eventHandler(c_event_t c_event, p_data_t p_data)
+{
+  (void)p_data;
+
+  if (c_event != EVENT_TYPE_MAC_TX) {
+    return;
+  }
+
+  if (mac_tx.state == E_MAC_TX_STATE_IDLE) {
+    mac_txNext();
+  }
+  /* discard events outdated by a restarted timer */
+  else if (rt_tmr_getState(&mac_tmrTx) != E_RT_TMR_STATE_RUNNING) {
+    mac_txRun();
+  }
+}
+
+
+/**
+ * @brief   Append the frame held by the packet buffer to the queue of its
+ *          receiver
+ *
+ * @param   p_err       Pointer to a variable storing returned error code
+ */
+static void mac_txEnqueue(e_nsErr_t *p_err)
+{
+  struct s_macNbrQueue *p_nbr;
+  struct s_macTxPacket *p_pkt = NULL;
+  const linkaddr_t *p_addr;
+
+  p_addr = packetbuf_addr(PACKETBUF_ADDR_RECEIVER);
+  for (p_nbr = list_head(mac_nbrList); p_nbr != NULL; p_nbr = list_item_next(p_nbr)) {
+    if (linkaddr_cmp(&p_nbr->addr, p_addr)) {
       break;
     }
-    /* was channel busy? */
-    else {
-      /* then increase number of backoff by one */
-      nb++;
-      /* be = MIN((be + 1), MaxBE) */
-      be = ((be + 1) < NETSTK_CFG_CSMA_MAX_BE) ? (be + 1) : (NETSTK_CFG_CSMA_MAX_BE);
+  }
+
+  /* is it the first queued frame to the receiver? */
+  if (p_nbr == NULL) {
+    p_nbr = memb_alloc(&mac_nbrMemb);
+    if (p_nbr == NULL) {
+      *p_err = NETSTK_ERR_BUF_OVERFLOW;
+      return;
+    }
+    linkaddr_copy(&p_nbr->addr, p_addr);
+    LIST_STRUCT_INIT(p_nbr, packets);
+    /* then the receiver is served after the others */
+    list_add(mac_nbrList, p_nbr);
+  }
+
+  if (list_length(p_nbr->packets) < NETSTK_CFG_CSMA_MAX_PACKET_PER_NEIGHBOR) {
+    p_pkt = memb_alloc(&mac_pktMemb);
+  }
+  if (p_pkt != NULL) {
+    p_pkt->buf = queuebuf_new_from_packetbuf();
+    if (p_pkt->buf == NULL) {
+      memb_free(&mac_pktMemb, p_pkt);
+      p_pkt = NULL;
     }
   }
-  LOG_INFO("MAC_TX: NB %d.", nb);
+  if (p_pkt == NULL) {
+    if (list_head(p_nbr->packets) == NULL) {
+      mac_txFreeNbr(p_nbr);
+    }
+    *p_err = NETSTK_ERR_BUF_OVERFLOW;
+    return;
+  }
+
+  p_pkt->cbTxFnct = mac_cbTxFnct;
+  p_pkt->p_cbTxArg = pmac_cbTxArg;
+  list_add(p_nbr->packets, p_pkt);
+  *p_err = NETSTK_ERR_NONE;
 }
 
-#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE)
+
+/**
+ * @brief   Start transmission of the first frame to the first receiver
+ */
+static void mac_txNext(void)
+{
+  struct s_macNbrQueue *p_nbr;
+  struct s_macTxPacket *p_pkt;
+
+  p_nbr = list_head(mac_nbrList);
+  if (p_nbr == NULL) {
+    return;
+  }
+  p_pkt = list_head(p_nbr->packets);
+
+  /* the frame outlives its queue buffer which is only loaded temporarily */
+  mac_tx.len = queuebuf_datalen(p_pkt->buf);
+  memcpy(&mac_txBuf[PHY_HEADER_LEN], queuebuf_dataptr(p_pkt->buf), mac_tx.len);
+  mac_tx.p_data = &mac_txBuf[PHY_HEADER_LEN];
+  mac_tx.seq = (uint8_t) queuebuf_attr(p_pkt->buf, PACKETBUF_ATTR_MAC_SEQNO);
+  mac_txPolicyApply(&p_nbr->addr,
+                    queuebuf_attr(p_pkt->buf, PACKETBUF_ATTR_MAC_TX_CLASS),
+                    queuebuf_attr(p_pkt->buf, PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS));
+  mac_isAckReq = queuebuf_attr(p_pkt->buf, PACKETBUF_ATTR_MAC_ACK);
+
+  mac_txStart(mac_isBurst);
+}
+
+
+/**
+ * @brief   Release the queue of a receiver without queued frames
+ */
+static void mac_txFreeNbr(struct s_macNbrQueue *p_nbr)
+{
+  list_remove(mac_nbrList, p_nbr);
+  memb_free(&mac_nbrMemb, p_nbr);
+}
+#endif /* #if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE) */
+
+#if (NETSTK_CFG_MAC_RX_RING_SIZE > 0)
+/**
+ * @brief   Store a received frame until the upper layers process it, so that
+ *          the radio buffer is released for the next reception
+ *
+ * @param   p_data      Pointer to buffer holding the received frame
+ * @param   len         Length of the received frame
+ * @param   p_err       Pointer to a variable storing returned error code
+ */
+static void mac_rxPut(uint8_t *p_data, uint16_t len, e_nsErr_t *p_err)
+{
+  int idx;
+
+  idx = ringbufindex_peek_put(&mac_rxRing);
+  if (idx < 0) {
+    *p_err = NETSTK_ERR_BUF_OVERFLOW;
+    TRACE_LOG_ERR("MAC_RX: ring full");
+    return;
+  }
+
+  memcpy(mac_rxSlots[idx].data, p_data, len);
+  mac_rxSlots[idx].len = len;
+  ringbufindex_put(&mac_rxRing);
+  evproc_putEvent(E_EVPROC_TAIL, EVENT_TYPE_MAC_RX, NULL);
+}
+
+
+/**
+ * @brief   MAC reception event handler, hands stored frames over to the DLLC
+ */
+static void mac_rxEventHandler(c_event_t c_event, p_data_t p_data)
+{
+  int idx;
+  e_nsErr_t err;
+
+  (void)p_data;
+
+  if (c_event != EVENT_TYPE_MAC_RX) {
+    return;
+  }
+
+  /* the slot is released only afterwards as the DLLC may trigger further
+   * receptions, e.g. while waiting for an ACK */
+  while ((idx = ringbufindex_peek_get(&mac_rxRing)) >= 0) {
+    pmac_netstk->dllc->recv(mac_rxSlots[idx].data, mac_rxSlots[idx].len, &err);
+    ringbufindex_get(&mac_rxRing);
+  }
+}
+#endif /* #if (NETSTK_CFG_MAC_RX_RING_SIZE > 0) */
+
+#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) && (NETSTK_CFG_CSMA_ASYNC_EN == FALSE)
 /**
  * @brief Polling for data until either the data is available or timeout is over
  * @param p_tmr
@@ -778,7 +1294,7 @@ static void mac_rxBufTimeout(s_rt_tmr_t *p_tmr, e_nsErr_t *p_err)
     *p_err = NETSTK_ERR_NONE;
   }
 }
-#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) */
+#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) && (NETSTK_CFG_CSMA_ASYNC_EN == FALSE) */
 
 
 /*
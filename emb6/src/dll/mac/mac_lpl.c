@@ -0,0 +1,853 @@
+/*
+ * emb6 is licensed under the 3-clause BSD license. This license gives everyone
+ * the right to use and distribute the code, either in binary or source code
+ * format, as long as the copyright license is retained in the source code.
+ *
+ * The emb6 is derived from the Contiki OS platform with the explicit approval
+ * from Adam Dunkels. However, emb6 is made independent from the OS through the
+ * removal of protothreads. In addition, APIs are made more flexible to gain
+ * more adaptivity during run-time.
+ *
+ * The license text is:
+ *
+ * Copyright (c) 2015,
+ * Hochschule Offenburg, University of Applied Sciences
+ * Laboratory Embedded Systems and Communications Electronics.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+/*============================================================================*/
+
+/**
+ * @file    mac_lpl.c
+ * @date    19.10.2026
+ * @brief   Low-power-listening MAC in the manner of ContikiMAC
+ *
+ * The radio wakes up every wake-up interval and performs a few CCAs. Unless
+ * the channel is found busy it goes back to sleep right away, otherwise it
+ * listens for a frame. A sender repeats the data frame itself, instead of
+ * dedicated strobes, until the receiver acknowledges it or a whole wake-up
+ * interval has passed. Listening is cut short when the channel turns silent
+ * or when a frame destined to another node is received (fast-sleep). The
+ * wake-up phase of a neighbor is learned from its ACKs, so that following
+ * frames are repeated starting shortly before its next wake-up only.
+ */
+
+
+/*
+********************************************************************************
+*                                   INCLUDES
+********************************************************************************
+*/
+#include "emb6.h"
+
+#include "bsp.h"
+#include "evproc.h"
+#include "framer_802154.h"
+#include "linkaddr.h"
+#include "mac-sequence.h"
+#include "nbr-table.h"
+#include "packetbuf.h"
+#include "phy_framer_802154.h"
+#include "rt_tmr.h"
+
+
+#define     LOGGER_ENABLE        LOGGER_MAC
+#include    "logger.h"
+
+
+/*
+********************************************************************************
+*                               LOCAL MACROS
+********************************************************************************
+*/
+/*!< Wake-up interval in milliseconds */
+#if (NETSTK_CFG_LOW_POWER_MODE_EN == TRUE)
+#define LPL_WAKEUP_INTERVAL                     (mac_phy_config.sleepTimeout)
+#else
+#define LPL_WAKEUP_INTERVAL                     (NETSTK_CFG_LPL_WAKEUP_INTERVAL)
+#endif /* #if (NETSTK_CFG_LOW_POWER_MODE_EN == TRUE) */
+
+/*!< Time in milliseconds a frame is repeated, so that it covers a whole
+ * wake-up interval of the receiver including its CCAs */
+#define LPL_STROBE_TIME                         (LPL_WAKEUP_INTERVAL + 2)
+
+/*!< Number of unacknowledged transmissions after which a learned phase is
+ * dropped, e.g. as the receiver rebooted */
+#define LPL_PHASE_MAX_NOACKS                    1
+
+/*!< States of the MAC */
+typedef enum {
+  E_LPL_STATE_OFF,
+  E_LPL_STATE_CCA,
+  E_LPL_STATE_LISTEN,
+  E_LPL_STATE_TX,
+} e_lplState_t;
+
+#if (NETSTK_CFG_LPL_PHASE_OPT_EN == TRUE)
+/*!< Wake-up phase of a neighbor, stored in the neighbor table */
+struct s_lplPhase {
+  uint32_t          time;
+  uint8_t           noAcks;
+};
+#endif /* #if (NETSTK_CFG_LPL_PHASE_OPT_EN == TRUE) */
+
+
+/*
+********************************************************************************
+*                          LOCAL FUNCTION DECLARATIONS
+********************************************************************************
+*/
+static void lpl_init(void *p_netstk, e_nsErr_t *p_err);
+static void lpl_on(e_nsErr_t *p_err);
+static void lpl_off(e_nsErr_t *p_err);
+static void lpl_send(uint8_t *p_data, uint16_t len, e_nsErr_t *p_err);
+static void lpl_recv(uint8_t *p_data, uint16_t len, e_nsErr_t *p_err);
+static void lpl_ioctl(e_nsIocCmd_t cmd, void *p_val, e_nsErr_t *p_err);
+
+#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE)
+static void lpl_txAck(uint8_t seq, e_nsErr_t *p_err);
+static void lpl_rxPoll(void);
+#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) */
+
+static uint8_t lpl_cca(void);
+static uint8_t lpl_isRxBusy(void);
+static void lpl_strobe(uint16_t len, uint8_t isAckReq, uint32_t *p_ackTime, e_nsErr_t *p_err);
+static void lpl_wakeup(void);
+static void lpl_listen(void);
+static void lpl_listenStart(void);
+static void lpl_sleep(void);
+
+#if (NETSTK_CFG_LPL_PHASE_OPT_EN == TRUE)
+static void lpl_phaseWait(const linkaddr_t *p_dst);
+static void lpl_phaseUpdate(const linkaddr_t *p_dst, uint32_t time, uint8_t isAcked);
+#endif /* #if (NETSTK_CFG_LPL_PHASE_OPT_EN == TRUE) */
+
+static void lpl_tmrWakeupCb(void *p_arg);
+static void lpl_tmrListenCb(void *p_arg);
+static void lpl_eventHandler(c_event_t c_event, p_data_t p_data);
+
+
+/*
+********************************************************************************
+*                               LOCAL VARIABLES
+********************************************************************************
+*/
+static s_ns_t          *plpl_netstk;
+static void            *plpl_cbTxArg;
+static nsTxCbFnct_t     lpl_cbTxFnct;
+static e_lplState_t     lpl_state;
+
+/** timer of the periodic wake-ups */
+static s_rt_tmr_t       lpl_tmrWakeup;
+/** timer sampling the channel while listening */
+static s_rt_tmr_t       lpl_tmrListen;
+/** events posted by the timers, told apart by their address */
+static uint8_t          lpl_evWakeup;
+static uint8_t          lpl_evListen;
+
+/** tick at which listening started */
+static uint32_t         lpl_listenStartTime;
+/** consecutive milliseconds the channel was found free resp. busy while listening */
+static uint8_t          lpl_silence;
+static uint8_t          lpl_activity;
+
+/** copy of the frame being repeated, leaving room for the PHY header and the
+ *  FCS the PHY appends with NETSTK_SUPPORT_SW_MAC_AUTOACK */
+static uint8_t          lpl_txBuf[PHY_HEADER_LEN + PACKETBUF_SIZE + PHY_FCS_LEN_MAX];
+static uint8_t          lpl_txSeq;
+#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE)
+static uint8_t          lpl_isAcked;
+#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) */
+
+#if (NETSTK_CFG_LPL_PHASE_OPT_EN == TRUE)
+/** wake-up phases of the neighbors, learned from their ACKs */
+NBR_TABLE(struct s_lplPhase, lpl_phases);
+#endif /* #if (NETSTK_CFG_LPL_PHASE_OPT_EN == TRUE) */
+
+
+/*
+********************************************************************************
+*                               GLOBAL VARIABLES
+********************************************************************************
+*/
+const s_nsMAC_t mac_driver_lpl =
+{
+ "MAC LPL",
+  lpl_init,
+  lpl_on,
+  lpl_off,
+  lpl_send,
+  lpl_recv,
+  lpl_ioctl,
+};
+
+extern uip_lladdr_t uip_lladdr;
+
+
+/*
+********************************************************************************
+*                           LOCAL FUNCTION DEFINITIONS
+********************************************************************************
+*/
+
+/**
+ * @brief   Initialize driver
+ *
+ * @param   p_netstk    Pointer to netstack structure
+ * @param   p_err       Pointer to a variable storing returned error code
+ */
+static void lpl_init(void *p_netstk, e_nsErr_t *p_err)
+{
+#if NETSTK_CFG_ARG_CHK_EN
+  if (p_err == NULL) {
+    return;
+  }
+
+  if (p_netstk == NULL) {
+    *p_err = NETSTK_ERR_INVALID_ARGUMENT;
+    return;
+  }
+#endif
+
+  /* initialize local variables */
+  plpl_netstk = (s_ns_t *) p_netstk;
+  lpl_cbTxFnct = 0;
+  plpl_cbTxArg = NULL;
+  lpl_state = E_LPL_STATE_OFF;
+
+  rt_tmr_create(&lpl_tmrWakeup, E_RT_TMR_TYPE_PERIODIC, LPL_WAKEUP_INTERVAL, lpl_tmrWakeupCb, NULL);
+  rt_tmr_create(&lpl_tmrListen, E_RT_TMR_TYPE_PERIODIC, 1, lpl_tmrListenCb, NULL);
+  evproc_regCallback(EVENT_TYPE_MAC_ULE, lpl_eventHandler);
+  mac_sequence_init();
+
+#if (NETSTK_CFG_LPL_PHASE_OPT_EN == TRUE)
+  nbr_table_register(lpl_phases, NULL);
+#endif /* #if (NETSTK_CFG_LPL_PHASE_OPT_EN == TRUE) */
+
+  /*
+   * Configure stack address
+   */
+  memcpy(&uip_lladdr.addr, &mac_phy_config.mac_address, 8);
+  linkaddr_set_node_addr((linkaddr_t *) mac_phy_config.mac_address);
+
+  /* set returned error */
+  *p_err = NETSTK_ERR_NONE;
+}
+
+
+/**
+ * @brief   Start duty cycling the radio
+ *
+ * @param   p_err       Pointer to a variable storing returned error code
+ */
+static void lpl_on(e_nsErr_t *p_err)
+{
+#if NETSTK_CFG_ARG_CHK_EN
+  if (p_err == NULL) {
+    return;
+  }
+#endif
+
+  rt_tmr_start(&lpl_tmrWakeup);
+  *p_err = NETSTK_ERR_NONE;
+}
+
+
+/**
+ * @brief   Stop duty cycling and turn the radio off
+ *
+ * @param   p_err       Pointer to a variable storing returned error code
+ */
+static void lpl_off(e_nsErr_t *p_err)
+{
+#if NETSTK_CFG_ARG_CHK_EN
+  if (p_err == NULL) {
+    return;
+  }
+#endif
+
+  rt_tmr_stop(&lpl_tmrWakeup);
+  rt_tmr_stop(&lpl_tmrListen);
+  lpl_state = E_LPL_STATE_OFF;
+  plpl_netstk->phy->off(p_err);
+}
+
+
+/**
+ * @brief   Frame transmission handler
+ *
+ * The frame is repeated until it is acknowledged or it covered a whole
+ * wake-up interval. Broadcast frames are always repeated for the whole
+ * interval.
+ *
+ * @param   p_data      Pointer to buffer holding frame to send
+ * @param   len         Length of frame to send
+ * @param   p_err       Pointer to a variable storing returned error code
+ */
+static void lpl_send(uint8_t *p_data, uint16_t len, e_nsErr_t *p_err)
+{
+  uint8_t ix;
+  uint8_t isAckReq;
+  uint32_t ackTime = 0;
+  linkaddr_t dstAddr;
+
+#if NETSTK_CFG_ARG_CHK_EN
+  if (p_err == NULL) {
+    return;
+  }
+
+  if ((len == 0) || (p_data == NULL)) {
+    *p_err = NETSTK_ERR_INVALID_ARGUMENT;
+    return;
+  }
+#endif
+
+  if (lpl_state == E_LPL_STATE_TX) {
+    /* MAC is busy repeating another frame */
+    *p_err = NETSTK_ERR_BUSY;
+  }
+  else if (len > PACKETBUF_SIZE) {
+    *p_err = NETSTK_ERR_INVALID_ARGUMENT;
+  }
+  else {
+    /* a pending wake-up is cut short by the transmission */
+    rt_tmr_stop(&lpl_tmrListen);
+    lpl_state = E_LPL_STATE_TX;
+
+    /* the frame is kept aside, as frames received in the meantime may
+     * overwrite the packet buffer */
+    memcpy(&lpl_txBuf[PHY_HEADER_LEN], p_data, len);
+    lpl_txSeq = (uint8_t) packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO);
+    linkaddr_copy(&dstAddr, packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
+    isAckReq = (packetbuf_holds_broadcast() == 0) &&
+               (packetbuf_attr(PACKETBUF_ATTR_MAC_ACK) != 0);
+
+#if (NETSTK_CFG_LPL_PHASE_OPT_EN == TRUE)
+    if (isAckReq == TRUE) {
+      lpl_phaseWait(&dstAddr);
+    }
+#endif /* #if (NETSTK_CFG_LPL_PHASE_OPT_EN == TRUE) */
+
+    plpl_netstk->phy->on(p_err);
+
+    /* make sure no other node is transmitting */
+    for (ix = 0; (ix < NETSTK_CFG_LPL_CCA_COUNT) && (*p_err == NETSTK_ERR_NONE); ix++) {
+      if (ix > 0) {
+        bsp_delayUs(NETSTK_CFG_LPL_CCA_SLEEP_US);
+      }
+      if (lpl_cca() == TRUE) {
+        *p_err = NETSTK_ERR_CHANNEL_ACESS_FAILURE;
+      }
+    }
+
+    if (*p_err == NETSTK_ERR_NONE) {
+      lpl_strobe(len, isAckReq, &ackTime, p_err);
+#if (NETSTK_CFG_LPL_PHASE_OPT_EN == TRUE)
+      if (isAckReq == TRUE) {
+        lpl_phaseUpdate(&dstAddr, ackTime, (*p_err == NETSTK_ERR_NONE));
+      }
+#endif /* #if (NETSTK_CFG_LPL_PHASE_OPT_EN == TRUE) */
+    }
+    LOG_INFO("MAC_TX: seq=%d e=-%d", lpl_txSeq, *p_err);
+
+    lpl_sleep();
+  }
+
+  /* was transmission callback function set? */
+  if (lpl_cbTxFnct) {
+    /* then signal the upper layer of the result of transmission process */
+    lpl_cbTxFnct(plpl_cbTxArg, p_err);
+  }
+}
+
+
+/**
+ * @brief   Frame reception handler
+ *
+ * @param   p_data      Pointer to buffer holding frame to receive
+ * @param   len         Length of frame to receive
+ * @param   p_err       Pointer to a variable storing returned error code
+ */
+static void lpl_recv(uint8_t *p_data, uint16_t len, e_nsErr_t *p_err)
+{
+  uint8_t isPending;
+  frame802154_t frame;
+
+#if NETSTK_CFG_ARG_CHK_EN
+  if (p_err == NULL) {
+    return;
+  }
+
+  if ((len == 0) || (p_data == NULL)) {
+    *p_err = NETSTK_ERR_INVALID_ARGUMENT;
+    return;
+  }
+#endif
+
+  /* set returned error code to default */
+  *p_err = NETSTK_ERR_NONE;
+
+  if ((len > PACKETBUF_SIZE) ||
+      (frame802154_parse(p_data, len, &frame) == 0)) {
+    *p_err = NETSTK_ERR_INVALID_FRAME;
+    TRACE_LOG_ERR("MAC_RX: invalid frame");
+    return;
+  }
+
+  /* is the MAC repeating a frame? */
+  if (lpl_state == E_LPL_STATE_TX) {
+#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE)
+    /* then only the ACK of that frame is of interest */
+    if ((frame.fcf.frame_type == FRAME802154_ACKFRAME) &&
+        (frame.seq == lpl_txSeq)) {
+      lpl_isAcked = TRUE;
+    }
+#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) */
+    return;
+  }
+
+  switch (frame.fcf.frame_type) {
+    case FRAME802154_DATAFRAME:
+    case FRAME802154_CMDFRAME:
+      /* is the frame destined to another node? */
+      if ((frame802154_broadcast(&frame) == 0) &&
+          (linkaddr_cmp((linkaddr_t *) frame.dest_addr, &linkaddr_node_addr) == 0)) {
+        /* then the repetitions that follow are of no interest either */
+        lpl_sleep();
+        break;
+      }
+
+#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE)
+      /* perform Auto-ACK */
+      if ((frame.fcf.ack_required == 1) &&
+          (frame.dest_pid == mac_phy_config.pan_id) &&
+          (frame802154_broadcast(&frame) == 0)) {
+        lpl_txAck(frame.seq, p_err);
+      }
+#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) */
+
+      /* keep listening for frames announced by the frame pending bit */
+      isPending = frame.fcf.frame_pending;
+
+      /* every repetition of a broadcast frame is received */
+      if ((frame.fcf.src_addr_mode != FRAME802154_NOADDR) &&
+          mac_sequence_is_duplicate_from((linkaddr_t *) frame.src_addr, frame.seq)) {
+        LOG_INFO("MAC_RX: duplicate %d", frame.seq);
+      }
+      else {
+        if (frame.fcf.src_addr_mode != FRAME802154_NOADDR) {
+          mac_sequence_register_seqno_from((linkaddr_t *) frame.src_addr, frame.seq);
+        }
+
+        /* signal upper layer of the received packet */
+        plpl_netstk->dllc->recv(p_data, len, p_err);
+        LOG_INFO("MAC_RX: Received %d bytes.", len);
+      }
+
+      /* the upper layers may have transmitted in the meantime, otherwise go
+       * back to sleep unless more frames follow */
+      if ((lpl_state == E_LPL_STATE_CCA) || (lpl_state == E_LPL_STATE_LISTEN)) {
+        if (isPending) {
+          lpl_listenStart();
+        }
+        else {
+          lpl_sleep();
+        }
+      }
+      break;
+
+    case FRAME802154_ACKFRAME:
+      /* silently discard unwanted ACK */
+      break;
+
+    default:
+      *p_err = NETSTK_ERR_INVALID_FRAME;
+      break;
+  }
+}
+
+
+/**
+ * @brief    Miscellaneous commands handler
+ *
+ * @param   cmd         Command to be issued
+ * @param   p_val       Pointer to a variable related to the command
+ * @param   p_err       Pointer to a variable storing returned error code
+ */
+static void lpl_ioctl(e_nsIocCmd_t cmd, void *p_val, e_nsErr_t *p_err)
+{
+#if NETSTK_CFG_ARG_CHK_EN
+  if (p_err == NULL) {
+    return;
+  }
+#endif
+
+  *p_err = NETSTK_ERR_NONE;
+  switch (cmd) {
+    case NETSTK_CMD_TX_CBFNCT_SET:
+      if (p_val == NULL) {
+        *p_err = NETSTK_ERR_INVALID_ARGUMENT;
+      } else {
+        lpl_cbTxFnct = (nsTxCbFnct_t) p_val;
+      }
+      break;
+
+    case NETSTK_CMD_TX_CBARG_SET:
+      plpl_cbTxArg = p_val;
+      break;
+
+    default:
+      plpl_netstk->phy->ioctrl(cmd, p_val, p_err);
+      break;
+  }
+}
+
+
+#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE)
+/**
+ * @brief   ACK transmission
+ *
+ * @param   seq     Frame sequence number of the outgoing ACK
+ */
+static void lpl_txAck(uint8_t seq, e_nsErr_t *p_err)
+{
+  uint8_t buf[9];
+  uint8_t ack_len;
+  uint8_t *p_ack;
+  frame802154_t frame;
+
+  /* clear buffer, 2 is maximum PHY header length */
+  p_ack = &buf[2];
+  memset(buf, 0, sizeof(buf));
+  memset(&frame, 0, sizeof(frame));
+
+  frame.fcf.frame_type = FRAME802154_ACKFRAME;
+  frame.fcf.frame_version = FRAME802154_IEEE802154_2006;
+  frame.fcf.src_addr_mode = FRAME802154_NOADDR;
+  frame.fcf.dest_addr_mode = FRAME802154_NOADDR;
+  frame.seq = seq;
+
+  ack_len = frame802154_create(&frame, p_ack);
+  plpl_netstk->phy->send(p_ack, ack_len, p_err);
+}
+
+
+/**
+ * @brief   Let the radio hand over a frame being received, i.e. an ACK
+ */
+static void lpl_rxPoll(void)
+{
+  e_nsErr_t err;
+
+  while (lpl_isRxBusy() == TRUE) {
+    plpl_netstk->phy->ioctrl(NETSTK_CMD_RX_BUF_READ, NULL, &err);
+  }
+}
+#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) */
+
+
+/**
+ * @brief   Perform a CCA
+ *
+ * @return  TRUE if the channel is busy or a frame is being received
+ */
+static uint8_t lpl_cca(void)
+{
+  e_nsErr_t err = NETSTK_ERR_NONE;
+
+  plpl_netstk->phy->ioctrl(NETSTK_CMD_RF_CCA_GET, NULL, &err);
+  return (err != NETSTK_ERR_NONE);
+}
+
+
+/**
+ * @brief   Tell whether the radio is receiving a frame
+ */
+static uint8_t lpl_isRxBusy(void)
+{
+  e_nsErr_t err = NETSTK_ERR_NONE;
+  uint8_t isRxBusy = FALSE;
+
+  plpl_netstk->phy->ioctrl(NETSTK_CMD_RF_IS_RX_BUSY, &isRxBusy, &err);
+  return (isRxBusy == TRUE) || (err == NETSTK_ERR_BUSY);
+}
+
+
+/**
+ * @brief   Repeat the frame in lpl_txBuf
+ *
+ * @param   len         Length of the frame
+ * @param   isAckReq    TRUE if the repetitions end with the ACK of the frame
+ * @param   p_ackTime   Pointer to a variable storing the tick at which the
+ *                      acknowledged repetition was started
+ * @param   p_err       Pointer to a variable storing returned error code
+ */
+static void lpl_strobe(uint16_t len, uint8_t isAckReq, uint32_t *p_ackTime, e_nsErr_t *p_err)
+{
+  uint8_t isAcked = FALSE;
+  uint32_t txTime;
+  uint32_t startTime;
+
+#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE)
+  lpl_isAcked = FALSE;
+#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) */
+
+  startTime = bsp_getTick();
+  do {
+    txTime = bsp_getTick();
+    plpl_netstk->phy->send(&lpl_txBuf[PHY_HEADER_LEN], len, p_err);
+
+#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE)
+    if (*p_err != NETSTK_ERR_NONE) {
+      break;
+    }
+
+    /* the ACK is expected in the gap before the next repetition */
+    lpl_rxPoll();
+    bsp_delayUs(NETSTK_CFG_LPL_INTER_FRAME_US);
+    lpl_rxPoll();
+    isAcked = (isAckReq == TRUE) && (lpl_isAcked == TRUE);
+#else
+    /* the radio reports the ACK of the frame */
+    if (*p_err == NETSTK_ERR_TX_NOACK) {
+      *p_err = NETSTK_ERR_NONE;
+    }
+    else if (*p_err != NETSTK_ERR_NONE) {
+      break;
+    }
+    else {
+      isAcked = isAckReq;
+    }
+
+    if (isAcked == FALSE) {
+      bsp_delayUs(NETSTK_CFG_LPL_INTER_FRAME_US);
+    }
+#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) */
+  } while ((isAcked == FALSE) && ((bsp_getTick() - startTime) < LPL_STROBE_TIME));
+
+  if (*p_err == NETSTK_ERR_NONE) {
+    if (isAcked == TRUE) {
+      *p_ackTime = txTime;
+    }
+    else if (isAckReq == TRUE) {
+      *p_err = NETSTK_ERR_TX_NOACK;
+    }
+  }
+}
+
+
+/**
+ * @brief   Check the channel for activity at a periodic wake-up
+ */
+static void lpl_wakeup(void)
+{
+  uint8_t ix;
+  uint8_t isBusy = FALSE;
+  e_nsErr_t err;
+
+  /* is the MAC transmitting or listening already? */
+  if (lpl_state != E_LPL_STATE_OFF) {
+    return;
+  }
+
+  lpl_state = E_LPL_STATE_CCA;
+  plpl_netstk->phy->on(&err);
+
+  for (ix = 0; (ix < NETSTK_CFG_LPL_CCA_COUNT) && (isBusy == FALSE); ix++) {
+    if (ix > 0) {
+      bsp_delayUs(NETSTK_CFG_LPL_CCA_SLEEP_US);
+    }
+    isBusy = lpl_cca();
+
+    /* a frame may have been received and handled meanwhile */
+    if (lpl_state != E_LPL_STATE_CCA) {
+      return;
+    }
+  }
+
+  if (isBusy == TRUE) {
+    lpl_listenStart();
+  }
+  else {
+    lpl_sleep();
+  }
+}
+
+
+/**
+ * @brief   Sample the channel while listening for a frame and go back to
+ *          sleep early when no frame is to be expected (fast-sleep)
+ */
+static void lpl_listen(void)
+{
+  uint8_t isBusy;
+
+  if (lpl_state != E_LPL_STATE_LISTEN) {
+    return;
+  }
+
+  isBusy = lpl_cca();
+  if (lpl_state != E_LPL_STATE_LISTEN) {
+    return;
+  }
+
+  if (isBusy == TRUE) {
+    lpl_silence = 0;
+    lpl_activity++;
+  }
+  else {
+    lpl_silence++;
+    lpl_activity = 0;
+  }
+
+  if ((lpl_silence >= NETSTK_CFG_LPL_MAX_SILENCE) ||
+      (lpl_activity >= NETSTK_CFG_LPL_MAX_NONACTIVITY) ||
+      ((bsp_getTick() - lpl_listenStartTime) >= NETSTK_CFG_LPL_LISTEN_TIME)) {
+    /* let a frame being received complete */
+    if (lpl_isRxBusy() == FALSE) {
+      lpl_sleep();
+    }
+  }
+}
+
+
+/**
+ * @brief   Keep the radio on for a frame to be received
+ */
+static void lpl_listenStart(void)
+{
+  lpl_state = E_LPL_STATE_LISTEN;
+  lpl_silence = 0;
+  lpl_activity = 0;
+  lpl_listenStartTime = bsp_getTick();
+  rt_tmr_stop(&lpl_tmrListen);
+  rt_tmr_start(&lpl_tmrListen);
+}
+
+
+/**
+ * @brief   Turn the radio off until the next wake-up
+ */
+static void lpl_sleep(void)
+{
+  e_nsErr_t err;
+
+  rt_tmr_stop(&lpl_tmrListen);
+  lpl_state = E_LPL_STATE_OFF;
+  plpl_netstk->phy->off(&err);
+}
+
+
+#if (NETSTK_CFG_LPL_PHASE_OPT_EN == TRUE)
+/**
+ * @brief   Sleep until shortly before the next wake-up of the receiver, if
+ *          its phase is known
+ *
+ * @param   p_dst       Link-layer address of the receiver
+ */
+static void lpl_phaseWait(const linkaddr_t *p_dst)
+{
+  uint32_t wait;
+  e_nsErr_t err;
+  struct s_lplPhase *p_phase;
+
+  p_phase = nbr_table_get_from_lladdr(lpl_phases, p_dst);
+  if (p_phase == NULL) {
+    return;
+  }
+
+  wait = LPL_WAKEUP_INTERVAL - ((bsp_getTick() - p_phase->time) % LPL_WAKEUP_INTERVAL);
+  if (wait > NETSTK_CFG_LPL_PHASE_GUARD) {
+    plpl_netstk->phy->off(&err);
+    bsp_delayUs((wait - NETSTK_CFG_LPL_PHASE_GUARD) * 1000);
+  }
+}
+
+
+/**
+ * @brief   Learn the phase of a receiver from the result of a transmission
+ *
+ * @param   p_dst       Link-layer address of the receiver
+ * @param   time        Tick at which the acknowledged repetition started
+ * @param   isAcked     TRUE if the frame was acknowledged
+ */
+static void lpl_phaseUpdate(const linkaddr_t *p_dst, uint32_t time, uint8_t isAcked)
+{
+  struct s_lplPhase *p_phase;
+
+  p_phase = nbr_table_get_from_lladdr(lpl_phases, p_dst);
+  if (isAcked == TRUE) {
+    /* phases are only attached to neighbors known by the upper layers, see
+     * nbr_table_has_lladdr() */
+    if ((p_phase == NULL) && nbr_table_has_lladdr(p_dst)) {
+      p_phase = nbr_table_add_lladdr(lpl_phases, p_dst, NBR_TABLE_REASON_MAC, NULL);
+    }
+    if (p_phase != NULL) {
+      p_phase->time = time;
+      p_phase->noAcks = 0;
+    }
+  }
+  else if (p_phase != NULL) {
+    /* the receiver may have shifted its wake-ups, then repeat the next frame
+     * for a whole interval */
+    p_phase->noAcks++;
+    if (p_phase->noAcks >= LPL_PHASE_MAX_NOACKS) {
+      nbr_table_remove(lpl_phases, p_phase);
+    }
+  }
+}
+#endif /* #if (NETSTK_CFG_LPL_PHASE_OPT_EN == TRUE) */
+
+
+/**
+ * @brief   Wake-up timer callback
+ */
+static void lpl_tmrWakeupCb(void *p_arg)
+{
+  evproc_putEvent(E_EVPROC_HEAD, EVENT_TYPE_MAC_ULE, &lpl_evWakeup);
+}
+
+
+/**
+ * @brief   Listen timer callback
+ */
+static void lpl_tmrListenCb(void *p_arg)
+{
+  evproc_putEvent(E_EVPROC_HEAD, EVENT_TYPE_MAC_ULE, &lpl_evListen);
+}
+
+
+/**
+ * @brief   Handle the events posted by the timers
+ */
+static void lpl_eventHandler(c_event_t c_event, p_data_t p_data)
+{
+  if (p_data == &lpl_evWakeup) {
+    lpl_wakeup();
+  }
+  else if (p_data == &lpl_evListen) {
+    lpl_listen();
+  }
+}
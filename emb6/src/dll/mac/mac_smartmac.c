@@ -18,6 +18,7 @@
 #include "phy_framer_802154.h"
 #include "framer_802154.h"
 #include "framer_smartmac.h"
+#include "nbr-table.h"
 
 #include "ctimer.h"
 #include "rt_tmr.h"
@@ -28,9 +29,17 @@
 ********************************************************************************
 */
 #define SMARTMAC_CFG_WAKEUP_INTERVAL_OFFSET_MAX     10u
-#define SMARTMAC_CFG_WAKEUP_TBL_SIZE                5u
 #define SMARTMAC_CFG_MIN_NUM_STROBE_TO_BE_SENT      1u
 
+/* wake-up phase lock parameters */
+#define SMARTMAC_CFG_WAKEUP_HASH_SIZE               8u    /* must be a power of 2 */
+#define SMARTMAC_CFG_WAKEUP_GUARD                   2u    /* minimum guard time in milliseconds */
+#define SMARTMAC_CFG_WAKEUP_GUARD_PERIODS           8u    /* 1ms more guard time per this many wake-up intervals */
+#define SMARTMAC_CFG_DRIFT_MAX_PERIODS              32u   /* longest sampling period for drift estimation */
+#define SMARTMAC_CFG_DRIFT_EWMA_DIV                 4u
+
+#define SMARTMAC_WAKEUP_HASH(p_addr)                (((p_addr)->u8[LINKADDR_SIZE - 1] ^ (p_addr)->u8[LINKADDR_SIZE - 2]) & (SMARTMAC_CFG_WAKEUP_HASH_SIZE - 1))
+
 /*
 ********************************************************************************
 *                               LOCAL TYPEDEF
@@ -59,10 +68,10 @@ typedef enum
   E_SMARTMAC_EVENT_ASYNC_SCAN_EXIT,
 } e_smartmacEvent;
 
-struct s_wakeupTableEntry {
-  uint32_t lastWakeupInterval;
-  uint16_t destId;
-  uint16_t numStrobeSent;
+/* wake-up phase of a neighbour, stored in the neighbour table */
+struct s_wakeupPhase {
+  uint32_t lastWakeup;    /* tick at which the neighbour was last found awake */
+  int16_t  drift;         /* phase drift per wake-up interval in 1/256 milliseconds */
 };
 
 struct s_smartmac {
@@ -92,7 +101,8 @@ struct s_smartmac {
   struct ctimer     tmr1TxDelay;
 
 #if (NETSTK_CFG_LOOSELY_SYNC_EN == TRUE)
-  struct s_wakeupTableEntry wakeupTable[SMARTMAC_CFG_WAKEUP_TBL_SIZE];
+  /* direct-mapped cache of neighbour table entries to avoid linear lookups */
+  struct s_wakeupPhase *wakeupHash[SMARTMAC_CFG_WAKEUP_HASH_SIZE];
 #endif
 };
 
@@ -125,8 +135,10 @@ static void mac_tmrRxDelayCb(void *p_arg);
 static uint32_t mac_calcRxDelay(struct s_smartmac *p_ctx, uint8_t counter);
 
 #if (NETSTK_CFG_LOOSELY_SYNC_EN == TRUE)
-static void mac_updateWakeupTable(struct s_smartmac *p_ctx, uint16_t destId);
-static uint32_t mac_calcTxDelay(struct s_smartmac *p_ctx, uint16_t destId);
+static struct s_wakeupPhase *mac_getWakeupPhase(struct s_smartmac *p_ctx, const linkaddr_t *p_dst, uint8_t isCreate);
+static void mac_wakeupPhaseRemovedCb(nbr_table_item_t *p_item);
+static void mac_updateWakeupTable(struct s_smartmac *p_ctx, const linkaddr_t *p_dst);
+static uint32_t mac_calcTxDelay(struct s_smartmac *p_ctx, const linkaddr_t *p_dst);
 #endif
 
 /* state-event handling functions */
@@ -165,6 +177,12 @@ static void mac_txUnicast_exit(struct s_smartmac *p_ctx);
 static struct s_smartmac smartmac;
 static uint8_t smartmacStrobe[15];
 
+#if (NETSTK_CFG_LOOSELY_SYNC_EN == TRUE)
+/* wake-up phases are attached to the neighbour table entries, so that every
+ * known neighbour can be reached with a short strobe train */
+NBR_TABLE(struct s_wakeupPhase, smartmac_phases);
+#endif
+
 /*
 ********************************************************************************
 *                               GLOBAL VARIABLES
@@ -252,6 +270,12 @@ static void smartmac_init (void *p_netstk, e_nsErr_t *p_err) {
   ctimer_stop(&p_ctx->tmr1Scan);
   ctimer_stop(&p_ctx->tmr1RxPending);
 
+#if (NETSTK_CFG_LOOSELY_SYNC_EN == TRUE)
+  /* initialize wake-up phase table */
+  memset(p_ctx->wakeupHash, 0, sizeof(p_ctx->wakeupHash));
+  nbr_table_register(smartmac_phases, mac_wakeupPhaseRemovedCb);
+#endif
+
   /* register MAC event */
   evproc_regCallback(EVENT_TYPE_MAC_ULE, mac_eventHandler);
 
@@ -567,7 +591,7 @@ static void mac_txUnicast(struct s_smartmac *p_ctx, uint8_t *p_data, uint16_t le
   uint32_t actualDelay;
   uint32_t delayOffset;
   uint32_t txReqInterval = bsp_getTick();
-  estimatedDelay = mac_calcTxDelay(p_ctx, dstShortAddr);
+  estimatedDelay = mac_calcTxDelay(p_ctx, &dstAddr);
 #endif
 
   /* perform Listen-Before-Talk */
@@ -595,11 +619,11 @@ static void mac_txUnicast(struct s_smartmac *p_ctx, uint8_t *p_data, uint16_t le
            * value to ensure that the the wake-up strobe stream actually hit periodic channel scan
            * of the receiver instead of some extended listening following data packet reception */
           if ((p_ctx->maxUnicastCounter - counter) >= SMARTMAC_CFG_MIN_NUM_STROBE_TO_BE_SENT) {
-            mac_updateWakeupTable(p_ctx, dstShortAddr);
+            mac_updateWakeupTable(p_ctx, &dstAddr);
           }
           else {
             if (delayOffset <= p_ctx->scanTimeout) {
-              mac_updateWakeupTable(p_ctx, dstShortAddr);
+              mac_updateWakeupTable(p_ctx, &dstAddr);
             }
           }
           TRACE_LOG_MAIN("<TXDELAY> estimated=%d, actual=%d, numStrobeSent=%d", estimatedDelay, actualDelay, p_ctx->maxUnicastCounter - counter);
@@ -868,20 +892,87 @@ static uint32_t mac_calcRxDelay(struct s_smartmac *p_ctx, uint8_t counter) {
 }
 
 #if (NETSTK_CFG_LOOSELY_SYNC_EN == TRUE)
-static void mac_updateWakeupTable(struct s_smartmac *p_ctx, uint16_t destId)
+static struct s_wakeupPhase *mac_getWakeupPhase(struct s_smartmac *p_ctx, const linkaddr_t *p_dst, uint8_t isCreate)
+{
+  uint8_t hash;
+  linkaddr_t *p_addr;
+  struct s_wakeupPhase *p_phase;
+
+  /* is the destination the one cached in its hash slot? */
+  hash = SMARTMAC_WAKEUP_HASH(p_dst);
+  p_phase = p_ctx->wakeupHash[hash];
+  if (p_phase != NULL) {
+    p_addr = nbr_table_get_lladdr(smartmac_phases, p_phase);
+    if ((p_addr != NULL) && linkaddr_cmp(p_addr, p_dst)) {
+      return p_phase;
+    }
+  }
+
+  /* otherwise fall back to the neighbour table. Entries are only attached to
+   * neighbours known by the upper layers, see nbr_table_has_lladdr() */
+  p_phase = nbr_table_get_from_lladdr(smartmac_phases, p_dst);
+  if ((p_phase == NULL) && (isCreate == TRUE) && nbr_table_has_lladdr(p_dst)) {
+    p_phase = nbr_table_add_lladdr(smartmac_phases, p_dst, NBR_TABLE_REASON_MAC, NULL);
+    if (p_phase != NULL) {
+      memset(p_phase, 0, sizeof(*p_phase));
+    }
+  }
+
+  if (p_phase != NULL) {
+    p_ctx->wakeupHash[hash] = p_phase;
+  }
+  return p_phase;
+}
+
+static void mac_wakeupPhaseRemovedCb(nbr_table_item_t *p_item)
 {
+  struct s_smartmac *p_ctx = &smartmac;
   uint8_t ix;
-  for (ix = 0; ix < SMARTMAC_CFG_WAKEUP_TBL_SIZE ; ix++) {
-    if (p_ctx->wakeupTable[ix].destId == destId) {
-      /* the table is usually updated complete strobe transmission, i.e., the strobe was acknowledged,
-       * therefore the strobe transmission time should be omitted */
-      p_ctx->wakeupTable[ix].lastWakeupInterval = bsp_getTick() - p_ctx->strobeTxInterval;
-      break;
+
+  /* the neighbour was evicted, then drop it from the cache */
+  for (ix = 0; ix < SMARTMAC_CFG_WAKEUP_HASH_SIZE; ix++) {
+    if (p_ctx->wakeupHash[ix] == p_item) {
+      p_ctx->wakeupHash[ix] = NULL;
     }
   }
 }
 
-static uint32_t mac_calcTxDelay(struct s_smartmac *p_ctx, uint16_t destId)
+static void mac_updateWakeupTable(struct s_smartmac *p_ctx, const linkaddr_t *p_dst)
+{
+  uint32_t wakeup;
+  uint32_t elapsed;
+  uint32_t periods;
+  int32_t offset;
+  int32_t drift;
+  struct s_wakeupPhase *p_phase;
+
+  p_phase = mac_getWakeupPhase(p_ctx, p_dst, TRUE);
+  if (p_phase == NULL) {
+    return;
+  }
+
+  /* the table is usually updated complete strobe transmission, i.e., the strobe was acknowledged,
+   * therefore the strobe transmission time should be omitted */
+  wakeup = bsp_getTick() - p_ctx->strobeTxInterval;
+
+  /* estimate the clock drift of the neighbour from the offset of the observed
+   * wake-up to the nominal wake-up interval */
+  if (p_phase->lastWakeup != 0) {
+    elapsed = wakeup - p_phase->lastWakeup;
+    periods = (elapsed + p_ctx->sleepTimeout / 2) / p_ctx->sleepTimeout;
+    if ((periods > 0) && (periods <= SMARTMAC_CFG_DRIFT_MAX_PERIODS)) {
+      offset = (int32_t)(elapsed - periods * p_ctx->sleepTimeout);
+      /* larger offsets stem from extended listening rather than from drift */
+      if ((offset <= (int32_t)p_ctx->scanTimeout) && (offset >= -(int32_t)p_ctx->scanTimeout)) {
+        drift = (offset * 256) / (int32_t)periods;
+        p_phase->drift += (int16_t)((drift - p_phase->drift) / (int32_t)SMARTMAC_CFG_DRIFT_EWMA_DIV);
+      }
+    }
+  }
+  p_phase->lastWakeup = wakeup;
+}
+
+static uint32_t mac_calcTxDelay(struct s_smartmac *p_ctx, const linkaddr_t *p_dst)
 {
   uint8_t isDone;
   uint32_t ix;
@@ -889,31 +980,17 @@ static uint32_t mac_calcTxDelay(struct s_smartmac *p_ctx, uint16_t destId)
   uint32_t onNext;
   uint32_t txDelay;
   uint32_t minDelay;
+  uint32_t guard;
   uint32_t lastWakeup;
   uint32_t currTime;
   uint32_t estimatedWakeupInterval = 0;
+  struct s_wakeupPhase *p_phase;
 
   /* look for records with regard to the destination node */
-  isDone = TRUE;
-  txDelay = 0;
-  lastWakeup = 0;
-  for (ix = 0; ix < SMARTMAC_CFG_WAKEUP_TBL_SIZE ; ix++) {
-    if (p_ctx->wakeupTable[ix].destId == destId) {
-      lastWakeup = p_ctx->wakeupTable[ix].lastWakeupInterval;
-      break;
-    }
-  }
+  p_phase = mac_getWakeupPhase(p_ctx, p_dst, FALSE);
+  lastWakeup = (p_phase != NULL) ? p_phase->lastWakeup : 0;
 
-  if (lastWakeup == 0) {
-    /* the record has not found then allocate an entry for the destination node */
-    for (ix = 0; ix < SMARTMAC_CFG_WAKEUP_TBL_SIZE ; ix++) {
-      if (p_ctx->wakeupTable[ix].lastWakeupInterval == 0) {
-        p_ctx->wakeupTable[ix].destId = destId;
-        break;
-      }
-    }
-  }
-  else {
+  if (lastWakeup != 0) {
     /* preparation */
     ix = 1;
     txDelay = 0;
@@ -923,16 +1000,14 @@ static uint32_t mac_calcTxDelay(struct s_smartmac *p_ctx, uint16_t destId)
     /* compute number of wake-up intervals since the last recorded interval */
     onQty = (currTime - lastWakeup) / p_ctx->sleepTimeout;
 
-    /* minimum delay that allows immediate sleep before actual transmission attempt */
-    minDelay = p_ctx->lbtTimeout + SMARTMAC_CFG_MIN_NUM_STROBE_TO_BE_SENT * p_ctx->strobeTxInterval;
-
     /* wake-up estimation algorithm */
     do {
-      /* prefer to hit the closest estimated wake-up */
+      /* prefer to hit the closest estimated wake-up, compensating the drift of the neighbour */
       onNext = lastWakeup + (onQty + ix) * p_ctx->sleepTimeout;
+      onNext += ((int32_t)(onQty + ix) * p_phase->drift) / 256;
       estimatedWakeupInterval = (onNext - currTime);
 
-      if (estimatedWakeupInterval < p_ctx->lbtTimeout) {
+      if ((int32_t)estimatedWakeupInterval < (int32_t)p_ctx->lbtTimeout) {
         /* time before estimated wake-up not enough to perform LBT then try to hit the following wake-up */
         ix++;
       }
@@ -940,12 +1015,22 @@ static uint32_t mac_calcTxDelay(struct s_smartmac *p_ctx, uint16_t destId)
         /* declare that the process has finished */
         isDone = TRUE;
 
+        /* the estimation becomes less accurate the older the record is, then
+         * start strobing earlier. Strobe immediately when the record is too old */
+        guard = SMARTMAC_CFG_WAKEUP_GUARD + (onQty + ix) / SMARTMAC_CFG_WAKEUP_GUARD_PERIODS;
+        if (guard > (p_ctx->sleepTimeout / 2)) {
+          break;
+        }
+
+        /* minimum delay that allows immediate sleep before actual transmission attempt */
+        minDelay = p_ctx->lbtTimeout + SMARTMAC_CFG_MIN_NUM_STROBE_TO_BE_SENT * p_ctx->strobeTxInterval + guard;
+
         /* put radio to sleep when estimated time is sufficient */
         if (estimatedWakeupInterval > minDelay) {
           txDelay = estimatedWakeupInterval - minDelay;
           if (txDelay > 0) {
             mac_txDelay_entry(p_ctx);
-            bsp_delay_us(txDelay * 1000);
+            bsp_delayUs(txDelay * 1000);
             mac_txDelay_exit(p_ctx);
           }
         }
@@ -0,0 +1,124 @@
+/*
+ * emb6 is licensed under the 3-clause BSD license. This license gives everyone
+ * the right to use and distribute the code, either in binary or source code
+ * format, as long as the copyright license is retained in the source code.
+ *
+ * The emb6 is derived from the Contiki OS platform with the explicit approval
+ * from Adam Dunkels. However, emb6 is made independent from the OS through the
+ * removal of protothreads. In addition, APIs are made more flexible to gain
+ * more adaptivity during run-time.
+ *
+ * The license text is:
+ *
+ * Copyright (c) 2015,
+ * Hochschule Offenburg, University of Applied Sciences
+ * Laboratory Embedded Systems and Communications Electronics.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+/*============================================================================*/
+
+/**
+ * @file    mac_txpolicy.c
+ * @date    19.10.2026
+ * @brief   Default CSMA-CA transmission policy of the 802.15.4 MAC
+ *
+ * Adapts the number of transmissions of a frame to the link quality and the
+ * traffic class, and the backoff to the channel load. A datagram that RPL
+ * can reroute through a backup parent gives up early on a poor link, while
+ * the delivery to the final destination of a datagram gets more attempts.
+ */
+
+
+/*
+********************************************************************************
+*                                   INCLUDES
+********************************************************************************
+*/
+#include "emb6.h"
+#include "linkaddr.h"
+#include "link-stats.h"
+#include "mac.h"
+
+
+/*
+********************************************************************************
+*                             API FUNCTIONS DEFINITIONS
+********************************************************************************
+*/
+
+/**
+ * @brief   Default transmission policy, see macTxPolicyFnct_t
+ *
+ * @param   p_dst       Link-layer address of the receiver
+ * @param   txClass     Traffic class of the frame, e.g. MAC_TX_CLASS_DEFAULT
+ * @param   ccaBusy     Ratio of busy CCAs in percent
+ * @param   p_param     CSMA-CA parameters of the frame to adapt
+ */
+void mac_txPolicyDefault(const linkaddr_t *p_dst, uint8_t txClass,
+                         uint8_t ccaBusy, s_macTxParam_t *p_param)
+{
+  /* spread the transmissions over a larger window on a loaded channel */
+  if (ccaBusy >= NETSTK_CFG_CSMA_POLICY_BUSY_CCA) {
+    if (p_param->minBe < p_param->maxBe) {
+      p_param->minBe++;
+    }
+    p_param->maxBackoff++;
+  }
+
+  /* broadcast frames are never retransmitted */
+  if (linkaddr_cmp(p_dst, &linkaddr_null)) {
+    return;
+  }
+
+  switch (txClass) {
+    case MAC_TX_CLASS_LAST_HOP:
+      /* no other neighbor can deliver the datagram */
+      p_param->maxTx += NETSTK_CFG_CSMA_POLICY_LAST_HOP_EXTRA_TX;
+      break;
+
+    case MAC_TX_CLASS_REROUTABLE:
+#if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE)
+      /* queued frames are never rerouted, as the upper layers do not learn
+       * about the failed transmission in time */
+#else
+    {
+      const struct link_stats *p_stats;
+
+      /* stop wasting airtime on a poor link, the datagram takes another
+       * route once the transmission failed */
+      p_stats = link_stats_from_lladdr(p_dst);
+      if ((p_stats != NULL) && link_stats_is_fresh(p_stats) &&
+          (p_stats->etx >= NETSTK_CFG_CSMA_POLICY_POOR_ETX * LINK_STATS_ETX_DIVISOR) &&
+          (p_param->maxTx > NETSTK_CFG_CSMA_POLICY_REROUTABLE_MAX_TX)) {
+        p_param->maxTx = NETSTK_CFG_CSMA_POLICY_REROUTABLE_MAX_TX;
+      }
+    }
+#endif /* #if (NETSTK_CFG_CSMA_ASYNC_EN == TRUE) */
+      break;
+
+    default:
+      break;
+  }
+}
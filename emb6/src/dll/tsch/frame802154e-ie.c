@@ -43,49 +43,6 @@
 #define DEBUG DEBUG_NONE
 #include "net/net-debug.h"
 
-/* c.f. IEEE 802.15.4e Table 4b */
-enum ieee802154e_header_ie_id {
-  HEADER_IE_LE_CSL = 0x1a,
-  HEADER_IE_LE_RIT,
-  HEADER_IE_DSME_PAN_DESCRIPTOR,
-  HEADER_IE_RZ_TIME,
-  HEADER_IE_ACK_NACK_TIME_CORRECTION,
-  HEADER_IE_GACK,
-  HEADER_IE_LOW_LATENCY_NETWORK_INFO,
-  HEADER_IE_LIST_TERMINATION_1 = 0x7e,
-  HEADER_IE_LIST_TERMINATION_2 = 0x7f,
-};
-
-/* c.f. IEEE 802.15.4e Table 4c */
-enum ieee802154e_payload_ie_id {
-  PAYLOAD_IE_ESDU = 0,
-  PAYLOAD_IE_MLME,
-  PAYLOAD_IE_LIST_TERMINATION = 0xf,
-};
-
-/* c.f. IEEE 802.15.4e Table 4d */
-enum ieee802154e_mlme_short_subie_id {
-  MLME_SHORT_IE_TSCH_SYNCHRONIZATION = 0x1a,
-  MLME_SHORT_IE_TSCH_SLOFTRAME_AND_LINK,
-  MLME_SHORT_IE_TSCH_TIMESLOT,
-  MLME_SHORT_IE_TSCH_HOPPING_TIMING,
-  MLME_SHORT_IE_TSCH_EB_FILTER,
-  MLME_SHORT_IE_TSCH_MAC_METRICS_1,
-  MLME_SHORT_IE_TSCH_MAC_METRICS_2,
-};
-
-/* c.f. IEEE 802.15.4e Table 4e */
-enum ieee802154e_mlme_long_subie_id {
-  MLME_LONG_IE_TSCH_CHANNEL_HOPPING_SEQUENCE = 0x9,
-};
-
-#define WRITE16(buf, val) \
-  do { ((uint8_t *)(buf))[0] = (val) & 0xff; \
-       ((uint8_t *)(buf))[1] = ((val) >> 8) & 0xff; } while(0);
-
-#define READ16(buf, var) \
-  (var) = ((uint8_t *)(buf))[0] | ((uint8_t *)(buf))[1] << 8
-
 /* Create a header IE 2-byte descriptor */
 static void
 create_header_ie_descriptor(uint8_t *buf, uint8_t element_id, int ie_len)
@@ -317,6 +274,27 @@ frame80215e_create_ie_tsch_channel_hopping_sequence(uint8_t *buf, int len,
   }
 }
 
+/* Decode the ACK/NACK time correction field */
+static void
+decode_time_correction(const uint8_t *buf, int16_t *drift_us, uint8_t *is_nack)
+{
+  /* If the originator was a time source neighbor, the receiver adjust
+   * its own clock by incorporating the received drift correction */
+  uint16_t time_sync_field = 0;
+  /* Extract drift correction from Sync-IE, cast from 12 to 16-bit,
+   * and convert it to RTIMER ticks.
+   * See page 88 in IEEE Std 802.15.4e-2012. */
+  READ16(buf, time_sync_field);
+  /* First extract NACK */
+  *is_nack = (time_sync_field & (uint16_t)0x8000) ? 1 : 0;
+  /* Then cast from 12 to 16 bit signed */
+  if(time_sync_field & 0x0800) { /* Negative integer */
+    *drift_us = time_sync_field | 0xf000;
+  } else { /* Positive integer */
+    *drift_us = time_sync_field & 0x0fff;
+  }
+}
+
 /* Parse a header IE */
 static int
 frame802154e_parse_header_ie(const uint8_t *buf, int len,
@@ -326,24 +304,7 @@ frame802154e_parse_header_ie(const uint8_t *buf, int len,
     case HEADER_IE_ACK_NACK_TIME_CORRECTION:
       if(len == 2) {
         if(ies != NULL) {
-          /* If the originator was a time source neighbor, the receiver adjust
-           * its own clock by incorporating the received drift correction */
-          uint16_t time_sync_field = 0;
-          int16_t drift_us = 0;
-          /* Extract drift correction from Sync-IE, cast from 12 to 16-bit,
-           * and convert it to RTIMER ticks.
-           * See page 88 in IEEE Std 802.15.4e-2012. */
-          READ16(buf, time_sync_field);
-          /* First extract NACK */
-          ies->ie_is_nack = (time_sync_field & (uint16_t)0x8000) ? 1 : 0;
-          /* Then cast from 12 to 16 bit signed */
-          if(time_sync_field & 0x0800) { /* Negative integer */
-            drift_us = time_sync_field | 0xf000;
-          } else { /* Positive integer */
-            drift_us = time_sync_field & 0x0fff;
-          }
-          /* Convert to RTIMER ticks */
-          ies->ie_time_correction = drift_us;
+          decode_time_correction(buf, &ies->ie_time_correction, &ies->ie_is_nack);
         }
         return len;
       }
@@ -440,39 +401,69 @@ frame802154e_parse_mlme_long_ie(const uint8_t *buf, int len,
   return -1;
 }
 
-/* Parse all IEEE 802.15.4e Information Elements (IE) from a frame */
+/* Create the 2-byte descriptor of an IE of a given kind */
+static void
+create_ie_descriptor(uint8_t *buf, uint8_t kind, uint8_t id, int ie_len)
+{
+  switch(kind) {
+    case IE_KIND_HEADER:
+      create_header_ie_descriptor(buf, id, ie_len);
+      break;
+    case IE_KIND_PAYLOAD:
+      create_payload_ie_descriptor(buf, id, ie_len);
+      break;
+    case IE_KIND_MLME_SHORT:
+      create_mlme_short_ie_descriptor(buf, id, ie_len);
+      break;
+    default:
+      create_mlme_long_ie_descriptor(buf, id, ie_len);
+      break;
+  }
+}
+
+enum {PARSING_HEADER_IE, PARSING_PAYLOAD_IE, PARSING_MLME_SUBIE, PARSING_DONE};
+
+/* Start walking the IEs of a frame */
+void
+frame802154e_ie_iterator_init(struct ieee802154_ie_iterator *it,
+    const uint8_t *buf, uint8_t buf_size)
+{
+  it->start = buf;
+  it->buf = buf;
+  it->end = buf + buf_size;
+  it->nested_mlme_len = 0;
+  /* Always look for a header IE first (at least "list termination 1") */
+  it->state = PARSING_HEADER_IE;
+  it->payload_ie_offset = 0;
+}
+
+/* Get the next IE of a frame, without copying its content */
 int
-frame802154e_parse_information_elements(const uint8_t *buf, uint8_t buf_size,
-    struct ieee802154_ies *ies)
+frame802154e_ie_iterator_next(struct ieee802154_ie_iterator *it,
+    struct ieee802154_ie *ie)
 {
-  const uint8_t *start = buf;
   uint16_t ie_desc;
   uint8_t type;
+  uint16_t len;
   uint8_t id;
-  uint16_t len = 0;
-  int nested_mlme_len = 0;
-  enum {PARSING_HEADER_IE, PARSING_PAYLOAD_IE, PARSING_MLME_SUBIE} parsing_state;
-
-  if(ies == NULL) {
-    return -1;
-  }
-
-  /* Always look for a header IE first (at least "list termination 1") */
-  parsing_state = PARSING_HEADER_IE;
-  ies->ie_payload_ie_offset = 0;
 
-  /* Loop over all IEs */
-  while(buf_size > 0) {
-    if(buf_size < 2) { /* Not enough space for IE descriptor */
+  while(it->state != PARSING_DONE) {
+    if(it->buf == it->end) {
+      if(it->state == PARSING_HEADER_IE) {
+        it->payload_ie_offset = it->buf - it->start; /* Save IE header len */
+      }
+      it->state = PARSING_DONE;
+      break;
+    }
+    if(it->end - it->buf < 2) { /* Not enough space for IE descriptor */
       return -1;
     }
-    READ16(buf, ie_desc);
-    buf_size -= 2;
-    buf += 2;
+    READ16(it->buf, ie_desc);
+    it->buf += 2;
     type = ie_desc & 0x8000 ? 1 : 0; /* b15 */
-    PRINTF("frame802154e: ie type %u, current state %u\n", type, parsing_state);
+    PRINTF("frame802154e: ie type %u, current state %u\n", type, it->state);
 
-    switch(parsing_state) {
+    switch(it->state) {
       case PARSING_HEADER_IE:
         if(type != 0) {
           PRINTF("frame802154e: wrong type %04x\n", ie_desc);
@@ -482,35 +473,18 @@ frame802154e_parse_information_elements(const uint8_t *buf, uint8_t buf_size,
         len = ie_desc & 0x007f; /* b0-b6 */
         id = (ie_desc & 0x7f80) >> 7; /* b7-b14 */
         PRINTF("frame802154e: header ie len %u id %x\n", len, id);
-        switch(id) {
-          case HEADER_IE_LIST_TERMINATION_1:
-            if(len == 0) {
-              /* End of payload IE list, now expect payload IEs */
-              parsing_state = PARSING_PAYLOAD_IE;
-              ies->ie_payload_ie_offset = buf - start; /* Save IE header len */
-              PRINTF("frame802154e: list termination 1, look for payload IEs\n");
-            } else {
-              PRINTF("frame802154e: list termination 1, wrong len %u\n", len);
-              return -1;
-            }
-            break;
-          case HEADER_IE_LIST_TERMINATION_2:
-            /* End of IE parsing */
-            if(len == 0) {
-              ies->ie_payload_ie_offset = buf - start; /* Save IE header len */
-              PRINTF("frame802154e: list termination 2\n");
-              return buf + len - start;
-            } else {
-              PRINTF("frame802154e: list termination 2, wrong len %u\n", len);
-              return -1;
-            }
-          default:
-            if(len > buf_size || frame802154e_parse_header_ie(buf, len, id, ies) == -1) {
-              PRINTF("frame802154e: failed to parse\n");
-              return -1;
-            }
-            break;
+        if(id == HEADER_IE_LIST_TERMINATION_1 || id == HEADER_IE_LIST_TERMINATION_2) {
+          if(len != 0) {
+            PRINTF("frame802154e: list termination, wrong len %u\n", len);
+            return -1;
+          }
+          it->payload_ie_offset = it->buf - it->start; /* Save IE header len */
+          /* Termination 1 is followed by payload IEs, 2 by the payload */
+          it->state = (id == HEADER_IE_LIST_TERMINATION_1) ?
+              PARSING_PAYLOAD_IE : PARSING_DONE;
+          continue;
         }
+        ie->kind = IE_KIND_HEADER;
         break;
       case PARSING_PAYLOAD_IE:
         if(type != 1) {
@@ -521,65 +495,222 @@ frame802154e_parse_information_elements(const uint8_t *buf, uint8_t buf_size,
         len = ie_desc & 0x7ff; /* b0-b10 */
         id = (ie_desc & 0x7800) >> 11; /* b11-b14 */
         PRINTF("frame802154e: payload ie len %u id %x\n", len, id);
-        switch(id) {
-          case PAYLOAD_IE_MLME:
-            /* Now expect 'len' bytes of MLME sub-IEs */
-            parsing_state = PARSING_MLME_SUBIE;
-            nested_mlme_len = len;
-            len = 0; /* Reset len as we want to read subIEs and not jump over them */
-            PRINTF("frame802154e: entering MLME ie with len %u\n", nested_mlme_len);
-            break;
-          case PAYLOAD_IE_LIST_TERMINATION:
-            PRINTF("frame802154e: payload ie list termination %u\n", len);
-            return (len == 0) ? buf + len - start : -1;
-          default:
-            PRINTF("frame802154e: non-supported payload ie\n");
+        if(id == PAYLOAD_IE_MLME) {
+          /* Now expect 'len' bytes of MLME sub-IEs */
+          if(len > 0) {
+            it->state = PARSING_MLME_SUBIE;
+            it->nested_mlme_len = len;
+          }
+          PRINTF("frame802154e: entering MLME ie with len %u\n", len);
+          continue;
+        }
+        if(id == PAYLOAD_IE_LIST_TERMINATION) {
+          PRINTF("frame802154e: payload ie list termination %u\n", len);
+          if(len != 0) {
             return -1;
+          }
+          it->state = PARSING_DONE;
+          continue;
         }
+        ie->kind = IE_KIND_PAYLOAD;
         break;
-      case PARSING_MLME_SUBIE:
+      default:
         /* MLME sub-IE: 2 bytes descriptor, c.f. fig 48q in IEEE 802.15.4e */
         /* type == 0 means short sub-IE, type == 1 means long sub-IE */
         if(type == 0) {
           /* Short sub-IE, c.f. fig 48r in IEEE 802.15.4e */
           len = ie_desc & 0x00ff; /* b0-b7 */
           id = (ie_desc & 0x7f00) >> 8; /* b8-b14 */
-          PRINTF("frame802154e: short mlme ie len %u id %x\n", len, id);
-          if(len > buf_size || frame802154e_parse_mlme_short_ie(buf, len, id, ies) == -1) {
-            PRINTF("frame802154e: failed to parse ie\n");
-            return -1;
-          }
+          ie->kind = IE_KIND_MLME_SHORT;
         } else {
           /* Long sub-IE, c.f. fig 48s in IEEE 802.15.4e */
           len = ie_desc & 0x7ff; /* b0-b10 */
           id = (ie_desc & 0x7800) >> 11; /* b11-b14 */
-          PRINTF("frame802154e: long mlme ie len %u id %x\n", len, id);
-          if(len > buf_size || frame802154e_parse_mlme_long_ie(buf, len, id, ies) == -1) {
-            PRINTF("frame802154e: failed to parse ie\n");
-            return -1;
-          }
+          ie->kind = IE_KIND_MLME_LONG;
         }
+        PRINTF("frame802154e: mlme ie len %u id %x\n", len, id);
         /* Update remaining nested MLME len */
-        nested_mlme_len -= 2 + len;
-        if(nested_mlme_len < 0) {
+        it->nested_mlme_len -= 2 + len;
+        if(it->nested_mlme_len < 0) {
           PRINTF("frame802154e: found more sub-IEs than initially advertised\n");
           /* We found more sub-IEs than initially advertised */
           return -1;
         }
-        if(nested_mlme_len == 0) {
+        if(it->nested_mlme_len == 0) {
           PRINTF("frame802154e: end of MLME IE parsing\n");
-          /* End of IE parsing, look for another payload IE */
-          parsing_state = PARSING_PAYLOAD_IE;
+          /* End of MLME IE, look for another payload IE */
+          it->state = PARSING_PAYLOAD_IE;
         }
         break;
     }
-    buf += len;
-    buf_size -= len;
+
+    if(len > it->end - it->buf) {
+      PRINTF("frame802154e: ie exceeds the frame\n");
+      return -1;
+    }
+    ie->id = id;
+    ie->len = len;
+    ie->content = it->buf;
+    it->buf += len;
+    return 1;
   }
+  return 0;
+}
+
+/* Total length of the IEs walked so far */
+int
+frame802154e_ie_iterator_len(const struct ieee802154_ie_iterator *it)
+{
+  return it->buf - it->start;
+}
 
-  if(parsing_state == PARSING_HEADER_IE) {
-    ies->ie_payload_ie_offset = buf - start; /* Save IE header len */
+/* Find a single IE, stop walking as soon as it is found */
+int
+frame802154e_ie_find(const uint8_t *buf, uint8_t buf_size,
+    uint8_t kind, uint8_t id, struct ieee802154_ie *ie)
+{
+  struct ieee802154_ie_iterator it;
+  int ret;
+
+  frame802154e_ie_iterator_init(&it, buf, buf_size);
+  while((ret = frame802154e_ie_iterator_next(&it, ie)) == 1) {
+    if(ie->kind == kind && ie->id == id) {
+      return 1;
+    }
+  }
+  return ret;
+}
+
+/* Decode an ACK/NACK time correction header IE */
+int
+frame802154e_ie_get_time_correction(const struct ieee802154_ie *ie,
+    int16_t *drift_us, uint8_t *is_nack)
+{
+  if(ie->kind != IE_KIND_HEADER ||
+     ie->id != HEADER_IE_ACK_NACK_TIME_CORRECTION || ie->len != 2) {
+    return -1;
+  }
+  decode_time_correction(ie->content, drift_us, is_nack);
+  return 0;
+}
+
+/* Decode a TSCH synchronization MLME sub-IE */
+int
+frame802154e_ie_get_tsch_synchronization(const struct ieee802154_ie *ie,
+    struct tsch_asn_t *asn, uint8_t *join_priority)
+{
+  const uint8_t *buf = ie->content;
+
+  if(ie->kind != IE_KIND_MLME_SHORT ||
+     ie->id != MLME_SHORT_IE_TSCH_SYNCHRONIZATION || ie->len != 6) {
+    return -1;
+  }
+  asn->ls4b = (uint32_t)buf[0];
+  asn->ls4b |= (uint32_t)buf[1] << 8;
+  asn->ls4b |= (uint32_t)buf[2] << 16;
+  asn->ls4b |= (uint32_t)buf[3] << 24;
+  asn->ms1b = buf[4];
+  *join_priority = buf[5];
+  return 0;
+}
+
+/* Start writing IEs into a frame buffer */
+void
+frame802154e_ie_builder_init(struct ieee802154_ie_builder *b,
+    uint8_t *buf, int buf_size)
+{
+  b->start = buf;
+  b->buf = buf;
+  b->end = buf + (buf_size > 0 ? buf_size : 0);
+  b->mlme = NULL;
+}
+
+/* Append an IE descriptor, the caller writes the content in place */
+uint8_t *
+frame802154e_ie_builder_add(struct ieee802154_ie_builder *b,
+    uint8_t kind, uint8_t id, uint16_t len)
+{
+  uint8_t *content;
+
+  if(b->end - b->buf < 2 + len) {
+    return NULL;
+  }
+  create_ie_descriptor(b->buf, kind, id, len);
+  content = b->buf + 2;
+  b->buf = content + len;
+  return content;
+}
+
+/* Open a MLME payload IE, its length is written when it is closed */
+int
+frame802154e_ie_builder_mlme_open(struct ieee802154_ie_builder *b)
+{
+  if(b->end - b->buf < 2) {
+    return -1;
+  }
+  b->mlme = b->buf;
+  b->buf += 2; /* Space needed for MLME descriptor */
+  return 0;
+}
+
+/* Close the MLME payload IE, nesting all sub-IEs added since it was opened */
+void
+frame802154e_ie_builder_mlme_close(struct ieee802154_ie_builder *b)
+{
+  if(b->mlme != NULL) {
+    /* The length of the outer MLME IE is the total length of sub-IEs */
+    create_payload_ie_descriptor(b->mlme, PAYLOAD_IE_MLME, b->buf - b->mlme - 2);
+    b->mlme = NULL;
+  }
+}
+
+/* Total length of the IEs written so far */
+int
+frame802154e_ie_builder_len(const struct ieee802154_ie_builder *b)
+{
+  return b->buf - b->start;
+}
+
+/* Parse all IEEE 802.15.4e Information Elements (IE) from a frame */
+int
+frame802154e_parse_information_elements(const uint8_t *buf, uint8_t buf_size,
+    struct ieee802154_ies *ies)
+{
+  struct ieee802154_ie_iterator it;
+  struct ieee802154_ie ie;
+  int ret;
+
+  if(ies == NULL) {
+    return -1;
+  }
+
+  /* Loop over all IEs */
+  frame802154e_ie_iterator_init(&it, buf, buf_size);
+  while((ret = frame802154e_ie_iterator_next(&it, &ie)) == 1) {
+    switch(ie.kind) {
+      case IE_KIND_HEADER:
+        ret = frame802154e_parse_header_ie(ie.content, ie.len, ie.id, ies);
+        break;
+      case IE_KIND_MLME_SHORT:
+        ret = frame802154e_parse_mlme_short_ie(ie.content, ie.len, ie.id, ies);
+        break;
+      case IE_KIND_MLME_LONG:
+        ret = frame802154e_parse_mlme_long_ie(ie.content, ie.len, ie.id, ies);
+        break;
+      default:
+        PRINTF("frame802154e: non-supported payload ie\n");
+        ret = -1;
+        break;
+    }
+    if(ret == -1) {
+      PRINTF("frame802154e: failed to parse ie\n");
+      return -1;
+    }
+  }
+  if(ret == -1) {
+    return -1;
   }
 
-  return buf - start;
+  ies->ie_payload_ie_offset = it.payload_ie_offset;
+  return frame802154e_ie_iterator_len(&it);
 }
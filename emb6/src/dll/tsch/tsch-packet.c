@@ -60,16 +60,29 @@
 #endif /* TSCH_LOG_LEVEL */
 #include "net/net-debug.h"
 
+/*---------------------------------------------------------------------------*/
+/* Write the content of the TSCH synchronization sub-IE: ASN and join priority */
+static void
+write_tsch_synchronization(uint8_t *ie)
+{
+  ie[0] = tsch_current_asn.ls4b;
+  ie[1] = tsch_current_asn.ls4b >> 8;
+  ie[2] = tsch_current_asn.ls4b >> 16;
+  ie[3] = tsch_current_asn.ls4b >> 24;
+  ie[4] = tsch_current_asn.ms1b;
+  ie[5] = tsch_join_priority;
+}
 /*---------------------------------------------------------------------------*/
 /* Construct enhanced ACK packet and return ACK length */
 int
 tsch_packet_create_eack(uint8_t *buf, int buf_size,
                         const linkaddr_t *dest_addr, uint8_t seqno, int16_t drift, int nack)
 {
-  int ret;
   uint8_t curr_len = 0;
   frame802154_t p;
-  struct ieee802154_ies ies;
+  struct ieee802154_ie_builder b;
+  uint16_t time_sync_field;
+  uint8_t *ie;
 
   memset(&p, 0, sizeof(p));
   p.fcf.frame_type = FRAME802154_ACKFRAME;
@@ -108,14 +121,18 @@ tsch_packet_create_eack(uint8_t *buf, int buf_size,
   }
 
   /* Append IE timesync */
-  memset(&ies, 0, sizeof(ies));
-  ies.ie_time_correction = drift;
-  ies.ie_is_nack = nack;
-
-  if((ret = frame80215e_create_ie_header_ack_nack_time_correction(buf+curr_len, buf_size-curr_len, &ies)) == -1) {
+  frame802154e_ie_builder_init(&b, buf + curr_len, buf_size - curr_len);
+  if((ie = frame802154e_ie_builder_add(&b, IE_KIND_HEADER,
+          HEADER_IE_ACK_NACK_TIME_CORRECTION, 2)) == NULL) {
     return -1;
   }
-  curr_len += ret;
+  time_sync_field = drift & 0x0fff;
+  if(nack) {
+    time_sync_field |= 0x8000;
+  }
+  ie[0] = time_sync_field & 0xff;
+  ie[1] = time_sync_field >> 8;
+  curr_len += frame802154e_ie_builder_len(&b);
 
   return curr_len;
 }
@@ -158,12 +175,16 @@ tsch_packet_parse_eack(const uint8_t *buf, int buf_size,
     return 0;
   }
 
-  if(ies != NULL) {
-    memset(ies, 0, sizeof(struct ieee802154_ies));
-  }
+  /* Only the time correction of an EACK is used, do not clear the whole
+   * IE structure */
+  ies->ie_time_correction = 0;
+  ies->ie_is_nack = 0;
+  ies->ie_payload_ie_offset = 0;
 
   if(frame->fcf.ie_list_present) {
     int mic_len = 0;
+    struct ieee802154_ie_iterator it;
+    struct ieee802154_ie ie;
 #if LLSEC802154_ENABLED
     /* Check if there is space for the security MIC (if any) */
     mic_len = tsch_security_mic_len(frame);
@@ -171,11 +192,19 @@ tsch_packet_parse_eack(const uint8_t *buf, int buf_size,
       return 0;
     }
 #endif /* LLSEC802154_ENABLED */
-    /* Parse information elements. We need to substract the MIC length, as the exact payload len is needed while parsing */
-    if((ret = frame802154e_parse_information_elements(buf + curr_len, buf_size - curr_len - mic_len, ies)) == -1) {
+    /* Walk information elements. We need to substract the MIC length, as the exact payload len is needed while parsing */
+    frame802154e_ie_iterator_init(&it, buf + curr_len, buf_size - curr_len - mic_len);
+    while((ret = frame802154e_ie_iterator_next(&it, &ie)) == 1) {
+      if(ie.kind == IE_KIND_HEADER && ie.id == HEADER_IE_ACK_NACK_TIME_CORRECTION
+         && frame802154e_ie_get_time_correction(&ie, &ies->ie_time_correction, &ies->ie_is_nack) == -1) {
+        return 0;
+      }
+    }
+    if(ret == -1) {
       return 0;
     }
-    curr_len += ret;
+    ies->ie_payload_ie_offset = it.payload_ie_offset;
+    curr_len += frame802154e_ie_iterator_len(&it);
   }
 
   if(hdr_len != NULL) {
@@ -190,12 +219,17 @@ int
 tsch_packet_create_eb(uint8_t *buf, int buf_size,
                       uint8_t *hdr_len, uint8_t *tsch_sync_ie_offset)
 {
-  int ret = 0;
   uint8_t curr_len = 0;
-  uint8_t mlme_ie_offset;
+  int with_sequence = 0;
+  struct tsch_slotframe *sf0 = NULL;
+  struct tsch_link *link0 = NULL;
+#if TSCH_PACKET_EB_WITH_TIMESLOT_TIMING
+  int i;
+#endif /* TSCH_PACKET_EB_WITH_TIMESLOT_TIMING */
 
   frame802154_t p;
-  struct ieee802154_ies ies;
+  struct ieee802154_ie_builder b;
+  uint8_t *ie;
 
   if(buf_size < TSCH_PACKET_MAX_LEN) {
     return 0;
@@ -234,98 +268,114 @@ tsch_packet_create_eb(uint8_t *buf, int buf_size,
     return 0;
   }
 
-  /* Prepare Information Elements for inclusion in the EB */
-  memset(&ies, 0, sizeof(ies));
-
-  /* Add TSCH timeslot timing IE. */
-#if TSCH_PACKET_EB_WITH_TIMESLOT_TIMING
-  {
-    int i;
-    ies.ie_tsch_timeslot_id = 1;
-    for(i = 0; i < tsch_ts_elements_count; i++) {
-      ies.ie_tsch_timeslot[i] = RTIMERTICKS_TO_US(tsch_timing[i]);
-    }
-  }
-#endif /* TSCH_PACKET_EB_WITH_TIMESLOT_TIMING */
-
-  /* Add TSCH hopping sequence IE */
-#if TSCH_PACKET_EB_WITH_HOPPING_SEQUENCE
-  if(tsch_hopping_sequence_length.val <= sizeof(ies.ie_hopping_sequence_list)) {
-    ies.ie_channel_hopping_sequence_id = 1;
-    ies.ie_hopping_sequence_len = tsch_hopping_sequence_length.val;
-    memcpy(ies.ie_hopping_sequence_list, tsch_hopping_sequence, ies.ie_hopping_sequence_len);
-  }
-#endif /* TSCH_PACKET_EB_WITH_HOPPING_SEQUENCE */
-
-  /* Add Slotframe and Link IE */
-#if TSCH_PACKET_EB_WITH_SLOTFRAME_AND_LINK
-  {
-    /* Send slotframe 0 with link at timeslot 0 */
-    struct tsch_slotframe *sf0 = tsch_schedule_get_slotframe_by_handle(0);
-    struct tsch_link *link0 = tsch_schedule_get_link_by_timeslot(sf0, 0);
-    if(sf0 && link0) {
-      ies.ie_tsch_slotframe_and_link.num_slotframes = 1;
-      ies.ie_tsch_slotframe_and_link.slotframe_handle = sf0->handle;
-      ies.ie_tsch_slotframe_and_link.slotframe_size = sf0->size.val;
-      ies.ie_tsch_slotframe_and_link.num_links = 1;
-      ies.ie_tsch_slotframe_and_link.links[0].timeslot = link0->timeslot;
-      ies.ie_tsch_slotframe_and_link.links[0].channel_offset = link0->channel_offset;
-      ies.ie_tsch_slotframe_and_link.links[0].link_options = link0->link_options;
-    }
-  }
-#endif /* TSCH_PACKET_EB_WITH_SLOTFRAME_AND_LINK */
+  /* Information Elements are written in place from the TSCH state */
+  frame802154e_ie_builder_init(&b, buf + curr_len, buf_size - curr_len);
 
   /* First add header-IE termination IE to stipulate that next come payload IEs */
-  if((ret = frame80215e_create_ie_header_list_termination_1(buf + curr_len, buf_size - curr_len, &ies)) == -1) {
+  if(frame802154e_ie_builder_add(&b, IE_KIND_HEADER, HEADER_IE_LIST_TERMINATION_1, 0) == NULL) {
     return -1;
   }
-  curr_len += ret;
 
   /* We start payload IEs, save offset */
   if(hdr_len != NULL) {
-    *hdr_len = curr_len;
+    *hdr_len = curr_len + frame802154e_ie_builder_len(&b);
   }
 
-  /* Save offset of the MLME IE descriptor, we need to know the total length
-   * before writing it */
-  mlme_ie_offset = curr_len;
-  curr_len += 2; /* Space needed for MLME descriptor */
+  /* Sub-IEs are nested in a MLME IE, its length is written once they are
+   * all added */
+  if(frame802154e_ie_builder_mlme_open(&b) == -1) {
+    return -1;
+  }
 
   /* Save the offset of the TSCH Synchronization IE, needed to update ASN and join priority before sending */
   if(tsch_sync_ie_offset != NULL) {
-    *tsch_sync_ie_offset = curr_len;
+    *tsch_sync_ie_offset = curr_len + frame802154e_ie_builder_len(&b);
   }
-  if((ret = frame80215e_create_ie_tsch_synchronization(buf + curr_len, buf_size - curr_len, &ies)) == -1) {
+  if((ie = frame802154e_ie_builder_add(&b, IE_KIND_MLME_SHORT,
+          MLME_SHORT_IE_TSCH_SYNCHRONIZATION, 6)) == NULL) {
     return -1;
   }
-  curr_len += ret;
+  write_tsch_synchronization(ie);
 
-  if((ret = frame80215e_create_ie_tsch_timeslot(buf + curr_len, buf_size - curr_len, &ies)) == -1) {
+  /* Add TSCH timeslot timing IE: only ID if ID == 0, else full timing description */
+#if TSCH_PACKET_EB_WITH_TIMESLOT_TIMING
+  if((ie = frame802154e_ie_builder_add(&b, IE_KIND_MLME_SHORT,
+          MLME_SHORT_IE_TSCH_TIMESLOT, 25)) == NULL) {
     return -1;
   }
-  curr_len += ret;
-
-  if((ret = frame80215e_create_ie_tsch_channel_hopping_sequence(buf + curr_len, buf_size - curr_len, &ies)) == -1) {
+  ie[0] = 1;
+  for(i = 0; i < tsch_ts_elements_count; i++) {
+    WRITE16(ie + 1 + 2 * i, RTIMERTICKS_TO_US(tsch_timing[i]));
+  }
+#else /* TSCH_PACKET_EB_WITH_TIMESLOT_TIMING */
+  if((ie = frame802154e_ie_builder_add(&b, IE_KIND_MLME_SHORT,
+          MLME_SHORT_IE_TSCH_TIMESLOT, 1)) == NULL) {
     return -1;
   }
-  curr_len += ret;
+  ie[0] = 0;
+#endif /* TSCH_PACKET_EB_WITH_TIMESLOT_TIMING */
 
-  if((ret = frame80215e_create_ie_tsch_slotframe_and_link(buf + curr_len, buf_size - curr_len, &ies)) == -1) {
-    return -1;
+  /* Add TSCH hopping sequence IE */
+#if TSCH_PACKET_EB_WITH_HOPPING_SEQUENCE
+  with_sequence = tsch_hopping_sequence_length.val <= sizeof(tsch_hopping_sequence);
+#endif /* TSCH_PACKET_EB_WITH_HOPPING_SEQUENCE */
+  if(with_sequence) {
+    uint16_t seq_len = tsch_hopping_sequence_length.val;
+    if((ie = frame802154e_ie_builder_add(&b, IE_KIND_MLME_LONG,
+            MLME_LONG_IE_TSCH_CHANNEL_HOPPING_SEQUENCE, 12 + seq_len)) == NULL) {
+      return -1;
+    }
+    ie[0] = 1;
+    ie[1] = 0; /* channel page */
+    WRITE16(ie + 2, 0); /* number of channels */
+    WRITE16(ie + 4, 0); /* phy configuration */
+    WRITE16(ie + 6, 0);
+    /* Extended bitmap. Size: 0 */
+    WRITE16(ie + 8, seq_len); /* sequence len */
+    memcpy(ie + 10, tsch_hopping_sequence, seq_len); /* sequence list */
+    WRITE16(ie + 10 + seq_len, 0); /* current hop */
+  } else {
+    if((ie = frame802154e_ie_builder_add(&b, IE_KIND_MLME_LONG,
+            MLME_LONG_IE_TSCH_CHANNEL_HOPPING_SEQUENCE, 1)) == NULL) {
+      return -1;
+    }
+    ie[0] = 0;
   }
-  curr_len += ret;
 
-  ies.ie_mlme_len = curr_len - mlme_ie_offset - 2;
-  if((ret = frame80215e_create_ie_mlme(buf + mlme_ie_offset, buf_size - mlme_ie_offset, &ies)) == -1) {
-    return -1;
+  /* Add Slotframe and Link IE */
+#if TSCH_PACKET_EB_WITH_SLOTFRAME_AND_LINK
+  /* Send slotframe 0 with link at timeslot 0 */
+  sf0 = tsch_schedule_get_slotframe_by_handle(0);
+  link0 = tsch_schedule_get_link_by_timeslot(sf0, 0);
+#endif /* TSCH_PACKET_EB_WITH_SLOTFRAME_AND_LINK */
+  if(sf0 && link0) {
+    if((ie = frame802154e_ie_builder_add(&b, IE_KIND_MLME_SHORT,
+            MLME_SHORT_IE_TSCH_SLOFTRAME_AND_LINK, 1 + 4 + 5)) == NULL) {
+      return -1;
+    }
+    ie[0] = 1; /* num slotframes */
+    ie[1] = sf0->handle;
+    WRITE16(ie + 2, sf0->size.val);
+    ie[4] = 1; /* num links */
+    WRITE16(ie + 5, link0->timeslot);
+    WRITE16(ie + 7, link0->channel_offset);
+    ie[9] = link0->link_options;
+  } else {
+    if((ie = frame802154e_ie_builder_add(&b, IE_KIND_MLME_SHORT,
+            MLME_SHORT_IE_TSCH_SLOFTRAME_AND_LINK, 1)) == NULL) {
+      return -1;
+    }
+    ie[0] = 0; /* num slotframes */
   }
 
+  frame802154e_ie_builder_mlme_close(&b);
+  curr_len += frame802154e_ie_builder_len(&b);
+
   /* Payload IE list termination: optional */
   /*
-  if((ret = frame80215e_create_ie_payload_list_termination(buf + curr_len, buf_size - curr_len, &ies)) == -1) {
+  if(frame802154e_ie_builder_add(&b, IE_KIND_PAYLOAD, PAYLOAD_IE_LIST_TERMINATION, 0) == NULL) {
     return -1;
   }
-  curr_len += ret;
   */
 
   return curr_len;
@@ -335,19 +385,19 @@ tsch_packet_create_eb(uint8_t *buf, int buf_size,
 int
 tsch_packet_update_eb(uint8_t *buf, int buf_size, uint8_t tsch_sync_ie_offset)
 {
-  struct ieee802154_ies ies;
-  ies.ie_asn = tsch_current_asn;
-  ies.ie_join_priority = tsch_join_priority;
-  frame80215e_create_ie_tsch_synchronization(buf+tsch_sync_ie_offset, buf_size-tsch_sync_ie_offset, &ies);
+  if(tsch_sync_ie_offset + 2 + 6 > buf_size) {
+    return 0;
+  }
+  /* Skip the sub-IE descriptor, only its content changes */
+  write_tsch_synchronization(buf + tsch_sync_ie_offset + 2);
   return 1;
 }
 /*---------------------------------------------------------------------------*/
-/* Parse a IEEE 802.15.4e TSCH Enhanced Beacon (EB) */
-int
-tsch_packet_parse_eb(const uint8_t *buf, int buf_size,
-                     frame802154_t *frame, struct ieee802154_ies *ies, uint8_t *hdr_len, int frame_without_mic)
+/* Parse the 802.15.4 header of an EB and get the length of its IEs */
+static int
+parse_eb_header(const uint8_t *buf, int buf_size,
+                frame802154_t *frame, int frame_without_mic, int *ies_len)
 {
-  uint8_t curr_len = 0;
   int ret;
 
   if(frame == NULL || buf_size < 0) {
@@ -372,29 +422,50 @@ tsch_packet_parse_eb(const uint8_t *buf, int buf_size,
     return 0;
   }
 
-  if(hdr_len != NULL) {
-    *hdr_len = ret;
-  }
-  curr_len += ret;
-
-  if(ies != NULL) {
-    memset(ies, 0, sizeof(struct ieee802154_ies));
-    ies->ie_join_priority = 0xff; /* Use max value in case the Beacon does not include a join priority */
-  }
+  *ies_len = 0;
   if(frame->fcf.ie_list_present) {
     /* Calculate space needed for the security MIC, if any, before attempting to parse IEs */
     int mic_len = 0;
 #if LLSEC802154_ENABLED
     if(!frame_without_mic) {
       mic_len = tsch_security_mic_len(frame);
-      if(buf_size < curr_len + mic_len) {
+      if(buf_size < ret + mic_len) {
         return 0;
       }
     }
 #endif /* LLSEC802154_ENABLED */
+    /* We need to substract the MIC length, as the exact payload len is needed while parsing */
+    *ies_len = buf_size - ret - mic_len;
+  }
+
+  return ret;
+}
+/*---------------------------------------------------------------------------*/
+/* Parse a IEEE 802.15.4e TSCH Enhanced Beacon (EB) */
+int
+tsch_packet_parse_eb(const uint8_t *buf, int buf_size,
+                     frame802154_t *frame, struct ieee802154_ies *ies, uint8_t *hdr_len, int frame_without_mic)
+{
+  uint8_t curr_len = 0;
+  int ies_len;
+  int ret;
+
+  if((ret = parse_eb_header(buf, buf_size, frame, frame_without_mic, &ies_len)) == 0) {
+    return 0;
+  }
 
-    /* Parse information elements. We need to substract the MIC length, as the exact payload len is needed while parsing */
-    if((ret = frame802154e_parse_information_elements(buf + curr_len, buf_size - curr_len - mic_len, ies)) == -1) {
+  if(hdr_len != NULL) {
+    *hdr_len = ret;
+  }
+  curr_len += ret;
+
+  if(ies != NULL) {
+    memset(ies, 0, sizeof(struct ieee802154_ies));
+    ies->ie_join_priority = 0xff; /* Use max value in case the Beacon does not include a join priority */
+  }
+  if(frame->fcf.ie_list_present) {
+    /* Parse information elements */
+    if((ret = frame802154e_parse_information_elements(buf + curr_len, ies_len, ies)) == -1) {
       PRINTF("TSCH:! parse_eb: failed to parse IEs\n");
       return 0;
     }
@@ -408,3 +479,42 @@ tsch_packet_parse_eb(const uint8_t *buf, int buf_size,
   return curr_len;
 }
 /*---------------------------------------------------------------------------*/
+/* Parse only the ASN and join priority of an EB, leaving other IEs in place.
+ * An EB without TSCH synchronization IE is rejected */
+int
+tsch_packet_parse_eb_sync(const uint8_t *buf, int buf_size,
+                          frame802154_t *frame, struct tsch_asn_t *asn, uint8_t *join_priority,
+                          int frame_without_mic)
+{
+  struct ieee802154_ie ie;
+  int ies_len;
+  int ret;
+
+  if((ret = parse_eb_header(buf, buf_size, frame, frame_without_mic, &ies_len)) == 0) {
+    return 0;
+  }
+
+  if(!frame->fcf.ie_list_present) {
+    PRINTF("TSCH:! parse_eb: no IEs\n");
+    return 0;
+  }
+
+  switch(frame802154e_ie_find(buf + ret, ies_len, IE_KIND_MLME_SHORT,
+                              MLME_SHORT_IE_TSCH_SYNCHRONIZATION, &ie)) {
+    case 1:
+      if(frame802154e_ie_get_tsch_synchronization(&ie, asn, join_priority) == -1) {
+        PRINTF("TSCH:! parse_eb: failed to parse sync IE\n");
+        return 0;
+      }
+      break;
+    case 0:
+      PRINTF("TSCH:! parse_eb: no sync IE\n");
+      return 0;
+    default:
+      PRINTF("TSCH:! parse_eb: failed to parse IEs\n");
+      return 0;
+  }
+
+  return ret;
+}
+/*---------------------------------------------------------------------------*/
@@ -306,8 +306,8 @@ eb_input(struct input_packet *current_input)
    * and update our join priority. */
   struct ieee802154_ies eb_ies;
 
-  if(tsch_packet_parse_eb(current_input->payload, current_input->len,
-                          &frame, &eb_ies, NULL, 1)) {
+  if(tsch_packet_parse_eb_sync(current_input->payload, current_input->len,
+                               &frame, &eb_ies.ie_asn, &eb_ies.ie_join_priority, 1)) {
     /* PAN ID check and authentication done at rx time */
 
 #if TSCH_AUTOSELECT_TIME_SOURCE
@@ -876,6 +876,7 @@ rtimer_clock_t t;
 
   /* initialize local variables */
   pmac_netstk = (s_ns_t *) p_netstk;
+  mac_sequence_init();
   /* register TISCH process handler  */
   TISCH_REG_PROCESS_HANDLER();
   /* register TISCH TX RX pending handler  */
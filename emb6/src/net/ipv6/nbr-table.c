@@ -403,6 +403,14 @@ nbr_table_get_from_lladdr(nbr_table_t *table, const linkaddr_t *lladdr)
   return nbr_get_bit(used_map, table, item) ? item : NULL;
 }
 /*---------------------------------------------------------------------------*/
+/* Tells whether a neighbor is used by any of the tables */
+int
+nbr_table_has_lladdr(const linkaddr_t *lladdr)
+{
+  int index = index_from_lladdr(lladdr);
+  return index != -1 && used_map[index] != 0;
+}
+/*---------------------------------------------------------------------------*/
 /* Removes a neighbor from the current table (unset "used" bit) */
 int
 nbr_table_remove(nbr_table_t *table, void *item)
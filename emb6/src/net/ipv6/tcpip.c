@@ -549,12 +549,21 @@ tcpip_ipv6_output(void)
     if(nexthop == NULL) {
       uip_ds6_route_t *route;
       /* Check if we have a route to the destination address. */
+#if UIP_CONF_IPV6_RPL
+      /* Routes of the RPL instance of the datagram */
+      route = rpl_route_lookup(&UIP_IP_BUF->destipaddr);
+#else /* UIP_CONF_IPV6_RPL */
       route = uip_ds6_route_lookup(&UIP_IP_BUF->destipaddr);
+#endif /* UIP_CONF_IPV6_RPL */
 
       /* No route was found - we send to the default route instead. */
       if(route == NULL) {
         PRINTF("tcpip_ipv6_output: no route found, using default route\n\r");
+#if UIP_CONF_IPV6_RPL
+        nexthop = rpl_defrt_choose();
+#else /* UIP_CONF_IPV6_RPL */
         nexthop = uip_ds6_defrt_choose();
+#endif /* UIP_CONF_IPV6_RPL */
         if(nexthop == NULL) {
 #ifdef UIP_FALLBACK_INTERFACE
       PRINTF("FALLBACK: removing ext hdrs & setting proto %d %d\n\r",
@@ -130,6 +130,7 @@ uip_ds6_nbr_rm(uip_ds6_nbr_t *nbr)
 #if UIP_CONF_IPV6_QUEUE_PKT
     uip_packetqueue_free(&nbr->packethandle);
 #endif /* UIP_CONF_IPV6_QUEUE_PKT */
+    nbr->state = NBR_REMOVED;
     NEIGHBOR_STATE_CHANGED(nbr);
     return nbr_table_remove(ds6_neighbors, nbr);
   }
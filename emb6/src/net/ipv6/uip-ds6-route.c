@@ -65,7 +65,9 @@ void NETSTACK_CONF_ROUTING_NEIGHBOR_REMOVED_CALLBACK(const linkaddr_t *addr);
    so that it will be maintained along with the rest of the neighbor
    tables in the system. */
 NBR_TABLE_GLOBAL(struct uip_ds6_route_neighbor_routes, nbr_routes);
+#if !UIP_DS6_ROUTE_COMPACT
 MEMB(neighborroutememb, struct uip_ds6_route_neighbor_route, UIP_DS6_ROUTE_NB);
+#endif /* !UIP_DS6_ROUTE_COMPACT */
 
 /* Each route is repressented by a uip_ds6_route_t structure and
    memory for each route is allocated from the routememb memory
@@ -74,6 +76,46 @@ LIST(routelist);
 MEMB(routememb, uip_ds6_route_t, UIP_DS6_ROUTE_NB);
 
 static int num_routes = 0;
+
+#if UIP_DS6_ROUTE_COMPACT
+/* Routes whose prefix has no room in the prefix table are allocated
+   from the exceptionmemb memory block together with their prefix. They
+   are maintained on the routelist along with the compact routes. */
+struct route_exception {
+  uip_ds6_route_t route;
+  uint8_t prefix[8];
+};
+MEMB(exceptionmemb, struct route_exception, UIP_DS6_ROUTE_EXCEPTION_NB);
+
+static int num_exceptions = 0;
+
+/* The prefixes of the compact routes. A prefix slot is free when no
+   route refers to it. */
+struct route_prefix {
+  uint8_t prefix[8];
+  uint8_t refcount;
+};
+static struct route_prefix route_prefixes[UIP_DS6_ROUTE_PREFIX_NB];
+#endif /* UIP_DS6_ROUTE_COMPACT */
+
+#if UIP_DS6_ROUTE_HASH_SIZE
+/* Host routes hashed by interface identifier. Routes are referred to by
+   their slot: the index in routememb, followed by the indices in
+   exceptionmemb. */
+#define ROUTE_SLOT_NONE 0xff
+#if UIP_DS6_ROUTE_COMPACT
+#define ROUTE_SLOT_NUM (UIP_DS6_ROUTE_NB + UIP_DS6_ROUTE_EXCEPTION_NB)
+#else /* UIP_DS6_ROUTE_COMPACT */
+#define ROUTE_SLOT_NUM UIP_DS6_ROUTE_NB
+#endif /* UIP_DS6_ROUTE_COMPACT */
+#if ROUTE_SLOT_NUM >= ROUTE_SLOT_NONE
+#error "Too many routes for the host route index, set UIP_CONF_DS6_ROUTE_HASH_SIZE to 0"
+#endif
+static uint8_t route_hash[UIP_DS6_ROUTE_HASH_SIZE];
+
+/* Number of routes that are not in the index */
+static int num_prefix_routes = 0;
+#endif /* UIP_DS6_ROUTE_HASH_SIZE */
 static void rm_routelist_callback(nbr_table_item_t *ptr);
 
 #endif /* (UIP_CONF_MAX_ROUTES != 0) */
@@ -91,6 +133,18 @@ LIST(notificationlist);
 #define DEBUG DEBUG_NONE
 #include "uip-debug.h"
 
+#if UIP_DS6_ROUTE_COMPACT && ((DEBUG) & DEBUG_PRINT)
+#define PRINTROUTE(r) do {                                      \
+    uip_ipaddr_t route_ipaddr;                                  \
+    uip_ds6_route_ipaddr(r, &route_ipaddr);                     \
+    PRINT6ADDR(&route_ipaddr);                                  \
+  } while(0)
+#elif UIP_DS6_ROUTE_COMPACT
+#define PRINTROUTE(r)
+#else
+#define PRINTROUTE(r) PRINT6ADDR(&(r)->ipaddr)
+#endif
+
 /*---------------------------------------------------------------------------*/
 #if DEBUG != DEBUG_NONE
 static void
@@ -163,6 +217,15 @@ uip_ds6_route_init(void)
 #if (UIP_CONF_MAX_ROUTES != 0)
   memb_init(&routememb);
   list_init(routelist);
+#if UIP_DS6_ROUTE_COMPACT
+  memb_init(&exceptionmemb);
+  memset(route_prefixes, 0, sizeof(route_prefixes));
+  num_exceptions = 0;
+#endif /* UIP_DS6_ROUTE_COMPACT */
+#if UIP_DS6_ROUTE_HASH_SIZE
+  memset(route_hash, ROUTE_SLOT_NONE, sizeof(route_hash));
+  num_prefix_routes = 0;
+#endif /* UIP_DS6_ROUTE_HASH_SIZE */
   nbr_table_register(nbr_routes,
                      (nbr_table_callback *)rm_routelist_callback);
 #endif /* (UIP_CONF_MAX_ROUTES != 0) */
@@ -175,6 +238,294 @@ uip_ds6_route_init(void)
 #endif
 }
 #if (UIP_CONF_MAX_ROUTES != 0)
+#if UIP_DS6_ROUTE_COMPACT
+/*---------------------------------------------------------------------------*/
+/* Returns the ID of a prefix, or UIP_DS6_ROUTE_PREFIX_EXCEPTION if the
+   prefix table does not hold it. */
+static uint8_t
+prefix_lookup(const uint8_t *prefix)
+{
+  uint8_t i;
+
+  for(i = 0; i < UIP_DS6_ROUTE_PREFIX_NB; i++) {
+    if(route_prefixes[i].refcount > 0 &&
+       memcmp(route_prefixes[i].prefix, prefix, 8) == 0) {
+      return i;
+    }
+  }
+  return UIP_DS6_ROUTE_PREFIX_EXCEPTION;
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the ID the prefix has or would get, or
+   UIP_DS6_ROUTE_PREFIX_EXCEPTION if the prefix table is full. */
+static uint8_t
+prefix_slot(const uint8_t *prefix)
+{
+  uint8_t i;
+
+  i = prefix_lookup(prefix);
+  if(i == UIP_DS6_ROUTE_PREFIX_EXCEPTION) {
+    for(i = 0; i < UIP_DS6_ROUTE_PREFIX_NB; i++) {
+      if(route_prefixes[i].refcount == 0) {
+        return i;
+      }
+    }
+    return UIP_DS6_ROUTE_PREFIX_EXCEPTION;
+  }
+  return i;
+}
+/*---------------------------------------------------------------------------*/
+static const uint8_t *
+route_prefix(const uip_ds6_route_t *r)
+{
+  if(r->prefix_id == UIP_DS6_ROUTE_PREFIX_EXCEPTION) {
+    return ((const struct route_exception *)r)->prefix;
+  }
+  return route_prefixes[r->prefix_id].prefix;
+}
+#endif /* UIP_DS6_ROUTE_COMPACT */
+/*---------------------------------------------------------------------------*/
+/* Checks whether the route covers addr. In the compact table, prefix_id
+   is the ID of the prefix of addr as returned by prefix_lookup(). */
+static int
+route_matches(const uip_ds6_route_t *r, const uip_ipaddr_t *addr,
+              uint8_t prefix_id)
+{
+#if UIP_DS6_ROUTE_COMPACT
+  if(r->length <= 64) {
+    return memcmp(route_prefix(r), addr->u8, r->length >> 3) == 0;
+  }
+  if(r->prefix_id != UIP_DS6_ROUTE_PREFIX_EXCEPTION) {
+    if(r->prefix_id != prefix_id) {
+      return 0;
+    }
+  } else if(memcmp(route_prefix(r), addr->u8, 8) != 0) {
+    return 0;
+  }
+  return memcmp(r->iid, &addr->u8[8], (r->length - 64) >> 3) == 0;
+#else /* UIP_DS6_ROUTE_COMPACT */
+  return uip_ipaddr_prefixcmp(addr, &r->ipaddr, r->length);
+#endif /* UIP_DS6_ROUTE_COMPACT */
+}
+/*---------------------------------------------------------------------------*/
+#if UIP_DS6_ROUTE_TABLES > 1
+#define ROUTE_IN_TABLE(r, t) ((t) == UIP_DS6_ROUTE_TABLE_ANY || (r)->table == (t))
+#else /* UIP_DS6_ROUTE_TABLES > 1 */
+#define ROUTE_IN_TABLE(r, t) 1
+#endif /* UIP_DS6_ROUTE_TABLES > 1 */
+/*---------------------------------------------------------------------------*/
+/* Returns the longest prefix match for addr on the route list. */
+static uip_ds6_route_t *
+route_longest_match(const uip_ipaddr_t *addr, uint8_t prefix_id,
+                    uint8_t table)
+{
+  uip_ds6_route_t *r;
+  uip_ds6_route_t *found_route;
+  uint8_t longestmatch;
+
+  found_route = NULL;
+  longestmatch = 0;
+  for(r = uip_ds6_route_head();
+      r != NULL;
+      r = uip_ds6_route_next(r)) {
+            PRINTROUTE(r);
+            PRINTF("\n\r");
+            if(r->length >= longestmatch && ROUTE_IN_TABLE(r, table) &&
+              route_matches(r, addr, prefix_id)) {
+                longestmatch = r->length;
+                found_route = r;
+            /* check if total match - e.g. all 128 bits do match */
+            if(longestmatch == 128) {
+                 break;
+            }
+        }
+  }
+  return found_route;
+}
+/*---------------------------------------------------------------------------*/
+#if UIP_DS6_ROUTE_HASH_SIZE
+#if UIP_DS6_ROUTE_COMPACT
+#define ROUTE_IID(r) ((r)->iid)
+#else /* UIP_DS6_ROUTE_COMPACT */
+#define ROUTE_IID(r) (&(r)->ipaddr.u8[8])
+#endif /* UIP_DS6_ROUTE_COMPACT */
+/*---------------------------------------------------------------------------*/
+static unsigned
+route_hash_key(const uint8_t *iid)
+{
+  unsigned h = 0;
+  int i;
+  for(i = 0; i < 8; i++) {
+    h = (h * 31) + iid[i];
+  }
+  return h & (UIP_DS6_ROUTE_HASH_SIZE - 1);
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+route_slot(const uip_ds6_route_t *r)
+{
+#if UIP_DS6_ROUTE_COMPACT
+  if(r->prefix_id == UIP_DS6_ROUTE_PREFIX_EXCEPTION) {
+    return UIP_DS6_ROUTE_NB + ((const struct route_exception *)r -
+                               (const struct route_exception *)exceptionmemb.mem);
+  }
+#endif /* UIP_DS6_ROUTE_COMPACT */
+  return r - (const uip_ds6_route_t *)routememb.mem;
+}
+/*---------------------------------------------------------------------------*/
+static uip_ds6_route_t *
+route_at_slot(uint8_t slot)
+{
+#if UIP_DS6_ROUTE_COMPACT
+  if(slot >= UIP_DS6_ROUTE_NB) {
+    return &((struct route_exception *)exceptionmemb.mem)[slot - UIP_DS6_ROUTE_NB].route;
+  }
+#endif /* UIP_DS6_ROUTE_COMPACT */
+  return &((uip_ds6_route_t *)routememb.mem)[slot];
+}
+/*---------------------------------------------------------------------------*/
+static void
+route_hash_add(uip_ds6_route_t *r)
+{
+  unsigned h;
+
+  if(r->length == 128) {
+    h = route_hash_key(ROUTE_IID(r));
+    r->hash_next = route_hash[h];
+    route_hash[h] = route_slot(r);
+  } else {
+    num_prefix_routes++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+route_hash_remove(uip_ds6_route_t *r)
+{
+  uint8_t *s;
+  uint8_t slot;
+
+  if(r->length == 128) {
+    slot = route_slot(r);
+    for(s = &route_hash[route_hash_key(ROUTE_IID(r))]; *s != ROUTE_SLOT_NONE;
+        s = &route_at_slot(*s)->hash_next) {
+      if(*s == slot) {
+        *s = r->hash_next;
+        return;
+      }
+    }
+  } else {
+    num_prefix_routes--;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static uip_ds6_route_t *
+route_hash_lookup(const uip_ipaddr_t *addr, uint8_t prefix_id, uint8_t table)
+{
+  uip_ds6_route_t *r;
+  uint8_t slot;
+
+  for(slot = route_hash[route_hash_key(&addr->u8[8])]; slot != ROUTE_SLOT_NONE;
+      slot = r->hash_next) {
+    r = route_at_slot(slot);
+    if(ROUTE_IN_TABLE(r, table) && route_matches(r, addr, prefix_id)) {
+      return r;
+    }
+  }
+  return NULL;
+}
+#endif /* UIP_DS6_ROUTE_HASH_SIZE */
+/*---------------------------------------------------------------------------*/
+/* Checks whether there is room for one more route to ipaddr. */
+static int
+route_room(const uip_ipaddr_t *ipaddr)
+{
+#if UIP_DS6_ROUTE_COMPACT
+  if(prefix_slot(ipaddr->u8) == UIP_DS6_ROUTE_PREFIX_EXCEPTION) {
+    return num_exceptions < UIP_DS6_ROUTE_EXCEPTION_NB;
+  }
+  return num_routes - num_exceptions < UIP_DS6_ROUTE_NB;
+#else /* UIP_DS6_ROUTE_COMPACT */
+  return num_routes < UIP_DS6_ROUTE_NB;
+#endif /* UIP_DS6_ROUTE_COMPACT */
+}
+/*---------------------------------------------------------------------------*/
+#if UIP_DS6_ROUTE_REMOVE_LEAST_RECENTLY_USED
+/* Returns the least recently used route whose removal makes room for a
+   route to ipaddr. */
+static uip_ds6_route_t *
+route_oldest(const uip_ipaddr_t *ipaddr)
+{
+#if UIP_DS6_ROUTE_COMPACT
+  uip_ds6_route_t *r;
+  uip_ds6_route_t *oldest;
+  uint8_t exception;
+
+  exception = prefix_slot(ipaddr->u8) == UIP_DS6_ROUTE_PREFIX_EXCEPTION;
+  oldest = NULL;
+  for(r = list_head(routelist); r != NULL; r = list_item_next(r)) {
+    if((r->prefix_id == UIP_DS6_ROUTE_PREFIX_EXCEPTION) == exception) {
+      oldest = r;
+    }
+  }
+  return oldest;
+#else /* UIP_DS6_ROUTE_COMPACT */
+  return list_tail(routelist);
+#endif /* UIP_DS6_ROUTE_COMPACT */
+}
+#endif /* UIP_DS6_ROUTE_REMOVE_LEAST_RECENTLY_USED */
+/*---------------------------------------------------------------------------*/
+/* Allocates a route entry and stores ipaddr in it. */
+static uip_ds6_route_t *
+route_alloc(const uip_ipaddr_t *ipaddr)
+{
+  uip_ds6_route_t *r;
+#if UIP_DS6_ROUTE_COMPACT
+  struct route_exception *e;
+  uint8_t id;
+
+  id = prefix_slot(ipaddr->u8);
+  if(id == UIP_DS6_ROUTE_PREFIX_EXCEPTION) {
+    e = memb_alloc(&exceptionmemb);
+    if(e == NULL) {
+      return NULL;
+    }
+    memcpy(e->prefix, ipaddr->u8, 8);
+    r = &e->route;
+    num_exceptions++;
+  } else {
+    r = memb_alloc(&routememb);
+    if(r == NULL) {
+      return NULL;
+    }
+    memcpy(route_prefixes[id].prefix, ipaddr->u8, 8);
+    route_prefixes[id].refcount++;
+  }
+  r->prefix_id = id;
+  memcpy(r->iid, &ipaddr->u8[8], 8);
+#else /* UIP_DS6_ROUTE_COMPACT */
+  r = memb_alloc(&routememb);
+  if(r != NULL) {
+    uip_ipaddr_copy(&r->ipaddr, ipaddr);
+  }
+#endif /* UIP_DS6_ROUTE_COMPACT */
+  return r;
+}
+/*---------------------------------------------------------------------------*/
+static void
+route_free(uip_ds6_route_t *r)
+{
+#if UIP_DS6_ROUTE_COMPACT
+  if(r->prefix_id == UIP_DS6_ROUTE_PREFIX_EXCEPTION) {
+    memb_free(&exceptionmemb, r);
+    num_exceptions--;
+  } else {
+    route_prefixes[r->prefix_id].refcount--;
+    memb_free(&routememb, r);
+  }
+#else /* UIP_DS6_ROUTE_COMPACT */
+  memb_free(&routememb, r);
+#endif /* UIP_DS6_ROUTE_COMPACT */
+}
 /*---------------------------------------------------------------------------*/
 static uip_lladdr_t *
 uip_ds6_route_nexthop_lladdr(uip_ds6_route_t *route)
@@ -202,6 +553,17 @@ uip_ds6_route_nexthop(uip_ds6_route_t *route)
 #endif /* (UIP_CONF_MAX_ROUTES != 0) */
 }
 /*---------------------------------------------------------------------------*/
+void
+uip_ds6_route_ipaddr(const uip_ds6_route_t *route, uip_ipaddr_t *ipaddr)
+{
+#if (UIP_CONF_MAX_ROUTES != 0) && UIP_DS6_ROUTE_COMPACT
+  memcpy(ipaddr->u8, route_prefix(route), 8);
+  memcpy(&ipaddr->u8[8], route->iid, 8);
+#elif (UIP_CONF_MAX_ROUTES != 0)
+  uip_ipaddr_copy(ipaddr, &route->ipaddr);
+#endif /* (UIP_CONF_MAX_ROUTES != 0) */
+}
+/*---------------------------------------------------------------------------*/
 uip_ds6_route_t *
 uip_ds6_route_head(void)
 {
@@ -253,34 +615,35 @@ uip_ds6_route_num_routes(void)
 /*---------------------------------------------------------------------------*/
 uip_ds6_route_t *
 uip_ds6_route_lookup(uip_ipaddr_t *addr)
+{
+  return uip_ds6_route_lookup_table(addr, UIP_DS6_ROUTE_TABLE_ANY);
+}
+/*---------------------------------------------------------------------------*/
+uip_ds6_route_t *
+uip_ds6_route_lookup_table(uip_ipaddr_t *addr, uint8_t table)
 {
 #if (UIP_CONF_MAX_ROUTES != 0)
-  uip_ds6_route_t *r;
   uip_ds6_route_t *found_route;
-  uint8_t longestmatch;
+  uint8_t prefix_id;
 
   PRINTF("uip-ds6-route: Looking up route for ");
   PRINT6ADDR(addr);
   PRINTF("\n\r");
 
+#if UIP_DS6_ROUTE_COMPACT
+  prefix_id = prefix_lookup(addr->u8);
+#else /* UIP_DS6_ROUTE_COMPACT */
+  prefix_id = 0;
+#endif /* UIP_DS6_ROUTE_COMPACT */
 
-  found_route = NULL;
-  longestmatch = 0;
-  for(r = uip_ds6_route_head();
-      r != NULL;
-      r = uip_ds6_route_next(r)) {
-            PRINT6ADDR(&r->ipaddr);
-            PRINTF("\n\r");
-            if(r->length >= longestmatch &&
-              uip_ipaddr_prefixcmp(addr, &r->ipaddr, r->length)) {
-                longestmatch = r->length;
-                found_route = r;
-            /* check if total match - e.g. all 128 bits do match */
-            if(longestmatch == 128) {
-                 break;
-            }
-        }
+#if UIP_DS6_ROUTE_HASH_SIZE
+  found_route = route_hash_lookup(addr, prefix_id, table);
+  if(found_route == NULL && num_prefix_routes > 0) {
+    found_route = route_longest_match(addr, prefix_id, table);
   }
+#else /* UIP_DS6_ROUTE_HASH_SIZE */
+  found_route = route_longest_match(addr, prefix_id, table);
+#endif /* UIP_DS6_ROUTE_HASH_SIZE */
 
   if(found_route != NULL) {
     PRINTF("uip-ds6-route: Found route: ");
@@ -310,10 +673,19 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
 uip_ds6_route_t *
 uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
           uip_ipaddr_t *nexthop)
+{
+  return uip_ds6_route_add_table(ipaddr, length, nexthop, 0);
+}
+/*---------------------------------------------------------------------------*/
+uip_ds6_route_t *
+uip_ds6_route_add_table(uip_ipaddr_t *ipaddr, uint8_t length,
+          uip_ipaddr_t *nexthop, uint8_t table)
 {
 #if (UIP_CONF_MAX_ROUTES != 0)
   uip_ds6_route_t *r;
+#if !UIP_DS6_ROUTE_COMPACT
   struct uip_ds6_route_neighbor_route *nbrr;
+#endif /* !UIP_DS6_ROUTE_COMPACT */
 
 #if DEBUG != DEBUG_NONE
   assert_nbr_routes_list_sane();
@@ -332,7 +704,7 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
   PRINT6ADDR(ipaddr);
   PRINTF("\n\r");
 
-  r = uip_ds6_route_lookup(ipaddr);
+  r = uip_ds6_route_lookup_table(ipaddr, table);
 
   if ((r != NULL) && (!uip_ipaddr_cmp(nexthop,uip_ds6_route_nexthop(r)))) {
       uip_ds6_route_rm(r);
@@ -341,7 +713,7 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
   /* First make sure that we don't add a route twice. If we find an
      existing route for our destination, we'll delete the old
      one first. */
-  r = uip_ds6_route_lookup(ipaddr);
+  r = uip_ds6_route_lookup_table(ipaddr, table);
   if(r != NULL) {
       uip_ipaddr_t *current_nexthop;
       current_nexthop = uip_ds6_route_nexthop(r);
@@ -361,19 +733,19 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
           check if we have room for this route. If not, we remove the
           least recently used one we have. */
 
-    if(uip_ds6_route_num_routes() == UIP_DS6_ROUTE_NB) {
+    if(!route_room(ipaddr)) {
     	uip_ds6_route_t *oldest;
     	oldest = NULL;
 #if UIP_DS6_ROUTE_REMOVE_LEAST_RECENTLY_USED
         /* Removing the oldest route entry from the route table. The
              least recently used route is the first route on the list. */
-    	oldest = list_tail(routelist);
+    	oldest = route_oldest(ipaddr);
     	#endif
     	if(oldest == NULL) {
     	  return NULL;
     	}
         PRINTF("uip_ds6_route_add: dropping route to ");
-        PRINT6ADDR(&oldest->ipaddr);
+        PRINTROUTE(oldest);
         PRINTF("\n");
         uip_ds6_route_rm(oldest);
     }
@@ -405,14 +777,18 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
         PRINTF("uip_ds6_route_add: could not allocate neighbor table entry\n");
         return NULL;
       }
+#if UIP_DS6_ROUTE_COMPACT
+      routes->num_routes = 0;
+#else /* UIP_DS6_ROUTE_COMPACT */
       LIST_STRUCT_INIT(routes, route_list);
+#endif /* UIP_DS6_ROUTE_COMPACT */
 #ifdef NETSTACK_CONF_ROUTING_NEIGHBOR_ADDED_CALLBACK
       NETSTACK_CONF_ROUTING_NEIGHBOR_ADDED_CALLBACK((const linkaddr_t *)nexthop_lladdr);
 #endif
     }
 
     /* Allocate a routing entry and populate it. */
-    r = memb_alloc(&routememb);
+    r = route_alloc(ipaddr);
 
     if(r == NULL) {
         /* This should not happen, as we explicitly deallocated one
@@ -425,18 +801,23 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
            and that there is a packet coming soon. */
     list_push(routelist, r);
 
+#if UIP_DS6_ROUTE_COMPACT
+    routes->num_routes++;
+#else /* UIP_DS6_ROUTE_COMPACT */
     nbrr = memb_alloc(&neighborroutememb);
     if(nbrr == NULL) {
         /* This should not happen, as we explicitly deallocated one
              route table entry above. */
         PRINTF("uip_ds6_route_add: could not allocate neighbor route list entry\n");
-        memb_free(&routememb, r);
+        list_remove(routelist, r);
+        route_free(r);
         return NULL;
     }
 
     nbrr->route = r;
     /* Add the route to this neighbor */
     list_add(routes->route_list, nbrr);
+#endif /* UIP_DS6_ROUTE_COMPACT */
     r->neighbor_routes = routes;
     num_routes++;
 
@@ -446,8 +827,13 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
     nbr_table_lock(nbr_routes, routes);
   }
 
-  uip_ipaddr_copy(&(r->ipaddr), ipaddr);
   r->length = length;
+#if UIP_DS6_ROUTE_TABLES > 1
+  r->table = table;
+#endif /* UIP_DS6_ROUTE_TABLES > 1 */
+#if UIP_DS6_ROUTE_HASH_SIZE
+  route_hash_add(r);
+#endif /* UIP_DS6_ROUTE_HASH_SIZE */
 
 #ifdef UIP_DS6_ROUTE_STATE_TYPE
   memset(&r->state, 0, sizeof(UIP_DS6_ROUTE_STATE_TYPE));
@@ -479,19 +865,34 @@ void
 uip_ds6_route_rm(uip_ds6_route_t *route)
 {
 #if (UIP_CONF_MAX_ROUTES != 0)
+#if UIP_DS6_ROUTE_COMPACT
+#if UIP_DS6_NOTIFICATIONS
+  uip_ipaddr_t route_ipaddr;
+#endif /* UIP_DS6_NOTIFICATIONS */
+#else /* UIP_DS6_ROUTE_COMPACT */
   struct uip_ds6_route_neighbor_route *neighbor_route;
+#endif /* UIP_DS6_ROUTE_COMPACT */
 #if DEBUG != DEBUG_NONE
   assert_nbr_routes_list_sane();
 #endif /* DEBUG != DEBUG_NONE */
   if(route != NULL && route->neighbor_routes != NULL) {
 
     PRINTF("uip_ds6_route_rm: removing route: ");
-    PRINT6ADDR(&route->ipaddr);
+    PRINTROUTE(route);
     PRINTF("\n\r");
 
     /* Remove the route from the route list */
     list_remove(routelist, route);
+#if UIP_DS6_ROUTE_HASH_SIZE
+    route_hash_remove(route);
+#endif /* UIP_DS6_ROUTE_HASH_SIZE */
 
+#if UIP_DS6_ROUTE_COMPACT
+#if UIP_DS6_NOTIFICATIONS
+    uip_ds6_route_ipaddr(route, &route_ipaddr);
+#endif /* UIP_DS6_NOTIFICATIONS */
+    if(--route->neighbor_routes->num_routes == 0) {
+#else /* UIP_DS6_ROUTE_COMPACT */
     /* Find the corresponding neighbor_route and remove it. */
     for(neighbor_route = list_head(route->neighbor_routes->route_list);
             neighbor_route != NULL && neighbor_route->route != route;
@@ -504,6 +905,7 @@ uip_ds6_route_rm(uip_ds6_route_t *route)
     }
     list_remove(route->neighbor_routes->route_list, neighbor_route);
     if(list_head(route->neighbor_routes->route_list) == NULL) {
+#endif /* UIP_DS6_ROUTE_COMPACT */
       /* If this was the only route using this neighbor, remove the
          neighbor from the table - this implicitly unlocks nexthop */
 #if (DEBUG) & DEBUG_ANNOTATE
@@ -513,22 +915,29 @@ uip_ds6_route_rm(uip_ds6_route_t *route)
       }
 #endif /* (DEBUG) & DEBUG_ANNOTATE */
       PRINTF("uip_ds6_route_rm: removing neighbor too\n\r");
-      nbr_table_remove(nbr_routes, route->neighbor_routes->route_list);
+      nbr_table_remove(nbr_routes, route->neighbor_routes);
 #ifdef NETSTACK_CONF_ROUTING_NEIGHBOR_REMOVED_CALLBACK
       NETSTACK_CONF_ROUTING_NEIGHBOR_REMOVED_CALLBACK(
-          (const linkaddr_t *)nbr_table_get_lladdr(nbr_routes, route->neighbor_routes->route_list));
+          (const linkaddr_t *)nbr_table_get_lladdr(nbr_routes, route->neighbor_routes));
 #endif
     }
-    memb_free(&routememb, route);
+    route_free(route);
+#if !UIP_DS6_ROUTE_COMPACT
     memb_free(&neighborroutememb, neighbor_route);
+#endif /* !UIP_DS6_ROUTE_COMPACT */
 
     num_routes--;
 
     PRINTF("uip_ds6_route_rm num %d\n\r", num_routes);
 
 #if UIP_DS6_NOTIFICATIONS
+#if UIP_DS6_ROUTE_COMPACT
+    call_route_callback(UIP_DS6_NOTIFICATION_ROUTE_RM,
+        &route_ipaddr, uip_ds6_route_nexthop(route));
+#else /* UIP_DS6_ROUTE_COMPACT */
     call_route_callback(UIP_DS6_NOTIFICATION_ROUTE_RM,
         &route->ipaddr, uip_ds6_route_nexthop(route));
+#endif /* UIP_DS6_ROUTE_COMPACT */
 #endif
   }
 
@@ -547,6 +956,21 @@ rm_routelist(struct uip_ds6_route_neighbor_routes *routes)
   assert_nbr_routes_list_sane();
 #endif /* DEBUG != DEBUG_NONE */
   PRINTF("uip_ds6_route_rm_routelist\n\r");
+#if UIP_DS6_ROUTE_COMPACT
+  if(routes != NULL) {
+    uip_ds6_route_t *r;
+    r = list_head(routelist);
+    while(r != NULL) {
+      if(r->neighbor_routes == routes) {
+        uip_ds6_route_rm(r);
+        r = list_head(routelist);
+      } else {
+        r = list_item_next(r);
+      }
+    }
+    nbr_table_remove(nbr_routes, routes);
+  }
+#else /* UIP_DS6_ROUTE_COMPACT */
   if(routes != NULL && routes->route_list != NULL) {
     struct uip_ds6_route_neighbor_route *r;
     r = list_head(routes->route_list);
@@ -556,6 +980,7 @@ rm_routelist(struct uip_ds6_route_neighbor_routes *routes)
     }
     nbr_table_remove(nbr_routes, routes);
   }
+#endif /* UIP_DS6_ROUTE_COMPACT */
 #if DEBUG != DEBUG_NONE
   assert_nbr_routes_list_sane();
 #endif /* DEBUG != DEBUG_NONE */
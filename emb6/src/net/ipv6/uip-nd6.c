@@ -79,6 +79,9 @@
 #include "uip-nameserver.h"
 #include "bsp.h"
 #include "random.h"
+#if SICSLOWPAN_CONF_6CO
+#include "sicslowpan.h"
+#endif /* SICSLOWPAN_CONF_6CO */
 
 /*------------------------------------------------------------------*/
 #define DEBUG DEBUG_NONE
@@ -119,6 +122,7 @@ void uip_log(char *msg);
 #define UIP_ND6_OPT_PREFIX_BUF ((uip_nd6_opt_prefix_info *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
 #define UIP_ND6_OPT_MTU_BUF ((uip_nd6_opt_mtu *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
 #define UIP_ND6_OPT_RDNSS_BUF ((uip_nd6_opt_dns *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
+#define UIP_ND6_OPT_6CO_BUF ((uip_nd6_opt_6co *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
 /** @} */
 
 #if UIP_ND6_SEND_NA || UIP_ND6_SEND_RA || !UIP_CONF_ROUTER
@@ -743,6 +747,44 @@ uip_nd6_ra_output(uip_ipaddr_t * dest)
     }
   }
 
+#if SICSLOWPAN_CONF_6CO
+  /* 6LoWPAN context list */
+  {
+    const struct sicslowpan_addr_context *ctx;
+    unsigned long lifetime;
+    uint8_t cid;
+
+    for(cid = 0; cid <= UIP_ND6_6CO_CID_MASK; cid++) {
+      ctx = sicslowpan_context_get(cid);
+      if(ctx == NULL) {
+        continue;
+      }
+      /* 6CO has no infinite lifetime, RAs refresh the longest one */
+      lifetime = 0xffff;
+      if(!ctx->isinfinite) {
+        /* minutes, rounded up so it is not advertised as removed */
+        lifetime = (stimer_remaining((struct stimer *)&ctx->lifetime) + 59) / 60;
+        if(lifetime == 0) {
+          continue;
+        }
+        if(lifetime > 0xffff) {
+          lifetime = 0xffff;
+        }
+      }
+      UIP_ND6_OPT_6CO_BUF->type = UIP_ND6_OPT_6CO;
+      UIP_ND6_OPT_6CO_BUF->len = UIP_ND6_OPT_6CO_LEN / 8;
+      UIP_ND6_OPT_6CO_BUF->ctxlen = ctx->length;
+      UIP_ND6_OPT_6CO_BUF->flags_cid = cid |
+        (ctx->compress ? UIP_ND6_6CO_FLAG_C : 0);
+      UIP_ND6_OPT_6CO_BUF->reserved = 0;
+      UIP_ND6_OPT_6CO_BUF->lifetime = uip_htons((uint16_t)lifetime);
+      memcpy(UIP_ND6_OPT_6CO_BUF->prefix, ctx->prefix, sizeof(ctx->prefix));
+      nd6_opt_offset += UIP_ND6_OPT_6CO_LEN;
+      uip_len += UIP_ND6_OPT_6CO_LEN;
+    }
+  }
+#endif /* SICSLOWPAN_CONF_6CO */
+
   /* Source link-layer option */
   create_llao((uint8_t *)UIP_ND6_OPT_HDR_BUF, UIP_ND6_OPT_SLLAO);
 
@@ -1032,6 +1074,25 @@ ra_input(void)
             }
              break;
       #endif /* UIP_ND6_RA_RDNSS */
+#if SICSLOWPAN_CONF_6CO
+    case UIP_ND6_OPT_6CO:
+      PRINTF("Processing 6CO option in RA\n");
+      if((UIP_ND6_OPT_6CO_BUF->len < 2) ||
+         (UIP_ND6_OPT_6CO_BUF->ctxlen > 128) ||
+         ((UIP_ND6_OPT_6CO_BUF->ctxlen > 64) &&
+          (UIP_ND6_OPT_6CO_BUF->len < 3))) {
+        PRINTF("6CO option is bad\n");
+        break;
+      }
+      memset(&ipaddr, 0, sizeof(ipaddr));
+      memcpy(&ipaddr, UIP_ND6_OPT_6CO_BUF->prefix,
+             UIP_ND6_OPT_6CO_BUF->len < 3 ? 8 : 16);
+      sicslowpan_context_set(UIP_ND6_OPT_6CO_BUF->flags_cid & UIP_ND6_6CO_CID_MASK,
+                             &ipaddr, UIP_ND6_OPT_6CO_BUF->ctxlen,
+                             UIP_ND6_OPT_6CO_BUF->flags_cid & UIP_ND6_6CO_FLAG_C,
+                             uip_ntohs(UIP_ND6_OPT_6CO_BUF->lifetime));
+      break;
+#endif /* SICSLOWPAN_CONF_6CO */
     default:
       PRINTF("ND option not supported in RA");
       break;
@@ -33,7 +33,6 @@
 #include "emb6.h"
 #include "bsp.h"
 // #include "clock.h"
-#include "ctimer.h"
 #include "packetbuf.h"
 #include "nbr-table.h"
 #include "link-stats.h"
@@ -46,8 +45,9 @@
 #define PRINTF(...)
 #endif
 
-/* Half time for the freshness counter, in minutes */
+/* Half time for the freshness counter and the histograms, in minutes */
 #define FRESHNESS_HALF_LIFE             20
+#define HALF_LIFE_TIME                  (60 * bsp_getTRes() * FRESHNESS_HALF_LIFE)
 /* Statistics are fresh if the freshness counter is FRESHNESS_TARGET or more */
 #define FRESHNESS_TARGET                 4
 /* Maximum value for the freshness counter */
@@ -70,9 +70,6 @@
 /* Per-neighbor link statistics table */
 NBR_TABLE(struct link_stats, link_stats);
 
-/* Called every FRESHNESS_HALF_LIFE minutes */
-struct ctimer periodic_timer;
-
 /* Used to initialize ETX before any transmission occurs. In order to
  * infer the initial ETX from the RSSI of previously received packets, use: */
 /* #define LINK_STATS_CONF_INIT_ETX(stats) guess_etx_from_rssi(stats) */
@@ -83,12 +80,107 @@ struct ctimer periodic_timer;
 #define LINK_STATS_INIT_ETX(stats) (ETX_INIT * ETX_DIVISOR)
 #endif /* LINK_STATS_INIT_ETX */
 
+/*---------------------------------------------------------------------------*/
+#if LINK_STATS_WITH_HISTORY
+/* Halves all bins of a histogram */
+static void
+hist_halve(uint8_t *hist, int bins, int n)
+{
+  int i;
+  for(i = 0; i < bins; i++) {
+    hist[i] >>= n;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Adds one to a bin, halving the histogram first if the bin is full */
+static void
+hist_add(uint8_t *hist, int bins, int bin)
+{
+  if(hist[bin] == 0xff) {
+    hist_halve(hist, bins, 1);
+  }
+  hist[bin]++;
+}
+/*---------------------------------------------------------------------------*/
+static int
+burst_bin(uint8_t run)
+{
+  if(run <= 2) {
+    return run - 1;
+  } else if(run <= 4) {
+    return 2;
+  } else if(run <= 8) {
+    return 3;
+  }
+  return 4;
+}
+/*---------------------------------------------------------------------------*/
+/* Records the outcome of a transmission */
+static void
+history_add(struct link_stats *stats, int acked)
+{
+  stats->tx_history = (stats->tx_history << 1) | (acked ? 1 : 0);
+  if(stats->tx_history_len < LINK_STATS_HISTORY_LEN) {
+    stats->tx_history_len++;
+  }
+  if(!acked) {
+    if(stats->loss_run < 0xff) {
+      stats->loss_run++;
+    }
+  } else if(stats->loss_run > 0) {
+    hist_add(stats->burst_hist, LINK_STATS_BURST_BINS, burst_bin(stats->loss_run));
+    stats->loss_run = 0;
+  }
+}
+#endif /* LINK_STATS_WITH_HISTORY */
+/*---------------------------------------------------------------------------*/
+/* Halves the freshness counter and the histograms once per half life
+ * elapsed since they were last aged. Done on access rather than by a
+ * periodic sweep over all neighbors. */
+static struct link_stats *
+age(struct link_stats *stats)
+{
+  clock_time_t elapsed;
+  int n;
+
+  if(stats == NULL) {
+    return NULL;
+  }
+  elapsed = bsp_getTick() - stats->aging_time;
+  if(elapsed < HALF_LIFE_TIME) {
+    return stats;
+  }
+  n = elapsed / HALF_LIFE_TIME;
+  stats->aging_time += n * HALF_LIFE_TIME;
+  if(n > 8) {
+    n = 8;
+  }
+  stats->freshness >>= n;
+#if LINK_STATS_WITH_HISTORY
+  hist_halve(stats->burst_hist, LINK_STATS_BURST_BINS, n);
+  hist_halve(stats->numtx_hist, LINK_STATS_NUMTX_BINS, n);
+#endif /* LINK_STATS_WITH_HISTORY */
+  return stats;
+}
+/*---------------------------------------------------------------------------*/
+/* Adds a neighbor */
+static struct link_stats *
+add(const linkaddr_t *lladdr)
+{
+  struct link_stats *stats;
+
+  stats = nbr_table_add_lladdr(link_stats, lladdr, NBR_TABLE_REASON_LINK_STATS, NULL);
+  if(stats != NULL) {
+    stats->aging_time = bsp_getTick();
+  }
+  return stats;
+}
 /*---------------------------------------------------------------------------*/
 /* Returns the neighbor's link stats */
 const struct link_stats *
 link_stats_from_lladdr(const linkaddr_t *lladdr)
 {
-  return nbr_table_get_from_lladdr(link_stats, lladdr);
+  return age(nbr_table_get_from_lladdr(link_stats, lladdr));
 }
 /*---------------------------------------------------------------------------*/
 /* Are the statistics fresh? */
@@ -100,6 +192,66 @@ link_stats_is_fresh(const struct link_stats *stats)
       && stats->freshness >= FRESHNESS_TARGET;
 }
 /*---------------------------------------------------------------------------*/
+/* PRR in percent over the last window transmissions */
+uint8_t
+link_stats_prr(const struct link_stats *stats, uint8_t window)
+{
+#if LINK_STATS_WITH_HISTORY
+  uint32_t history;
+  uint8_t acked;
+  uint8_t i;
+
+  if(stats == NULL || stats->tx_history_len == 0) {
+    return LINK_STATS_UNKNOWN;
+  }
+  window = MIN(window, stats->tx_history_len);
+  if(window == 0) {
+    return LINK_STATS_UNKNOWN;
+  }
+  history = stats->tx_history;
+  for(i = 0, acked = 0; i < window; i++, history >>= 1) {
+    acked += history & 1;
+  }
+  return (uint16_t)acked * 100 / window;
+#else /* LINK_STATS_WITH_HISTORY */
+  return LINK_STATS_UNKNOWN;
+#endif /* LINK_STATS_WITH_HISTORY */
+}
+/*---------------------------------------------------------------------------*/
+/* Probability in percent that a lost transmission is followed by another
+ * loss. Close to the loss rate on links with independent losses, higher
+ * on links that lose packets in bursts. */
+uint8_t
+link_stats_loss_burstiness(const struct link_stats *stats)
+{
+#if LINK_STATS_WITH_HISTORY
+  uint32_t history;
+  uint8_t losses;
+  uint8_t repeated;
+  uint8_t i;
+
+  if(stats == NULL) {
+    return LINK_STATS_UNKNOWN;
+  }
+  /* Bit i + 1 is the transmission before bit i */
+  history = stats->tx_history;
+  for(i = 1, losses = 0, repeated = 0; i < stats->tx_history_len; i++, history >>= 1) {
+    if(!(history & 2)) {
+      losses++;
+      if(!(history & 1)) {
+        repeated++;
+      }
+    }
+  }
+  if(losses == 0) {
+    return LINK_STATS_UNKNOWN;
+  }
+  return (uint16_t)repeated * 100 / losses;
+#else /* LINK_STATS_WITH_HISTORY */
+  return LINK_STATS_UNKNOWN;
+#endif /* LINK_STATS_WITH_HISTORY */
+}
+/*---------------------------------------------------------------------------*/
 uint16_t
 guess_etx_from_rssi(const struct link_stats *stats)
 {
@@ -142,10 +294,10 @@ link_stats_packet_sent(const linkaddr_t *lladdr, int status, int numtx)
     return;
   }
 
-  stats = nbr_table_get_from_lladdr(link_stats, lladdr);
+  stats = age(nbr_table_get_from_lladdr(link_stats, lladdr));
   if(stats == NULL) {
     /* Add the neighbor */
-    stats = nbr_table_add_lladdr(link_stats, lladdr, NBR_TABLE_REASON_LINK_STATS, NULL);
+    stats = add(lladdr);
     if(stats != NULL) {
       stats->etx = LINK_STATS_INIT_ETX(stats);
     } else {
@@ -157,6 +309,23 @@ link_stats_packet_sent(const linkaddr_t *lladdr, int status, int numtx)
   stats->last_tx_time = bsp_getTick();
   stats->freshness = MIN(stats->freshness + numtx, FRESHNESS_MAX);
 
+#if LINK_STATS_WITH_HISTORY
+  {
+    int i;
+    int lost = (status == MAC_TX_NOACK) ? numtx : numtx - 1;
+    /* Only the last transmissions fit in the history */
+    for(i = MAX(lost - LINK_STATS_HISTORY_LEN, 0); i < lost; i++) {
+      history_add(stats, 0);
+    }
+    if(status == MAC_TX_OK) {
+      history_add(stats, 1);
+    }
+    hist_add(stats->numtx_hist, LINK_STATS_NUMTX_BINS,
+             status == MAC_TX_NOACK ? LINK_STATS_NUMTX_BINS - 1 :
+             MIN(MAX(numtx, 1), LINK_STATS_NUMTX_BINS - 1) - 1);
+  }
+#endif /* LINK_STATS_WITH_HISTORY */
+
   /* ETX used for this update */
   packet_etx = ((status == MAC_TX_NOACK) ? ETX_NOACK_PENALTY : numtx) * ETX_DIVISOR;
   /* ETX alpha used for this update */
@@ -174,10 +343,10 @@ link_stats_input_callback(const linkaddr_t *lladdr)
   struct link_stats *stats;
   int16_t packet_rssi = packetbuf_attr(PACKETBUF_ATTR_RSSI);
 
-  stats = nbr_table_get_from_lladdr(link_stats, lladdr);
+  stats = age(nbr_table_get_from_lladdr(link_stats, lladdr));
   if(stats == NULL) {
     /* Add the neighbor */
-    stats = nbr_table_add_lladdr(link_stats, lladdr, NBR_TABLE_REASON_LINK_STATS, NULL);
+    stats = add(lladdr);
     if(stats != NULL) {
       /* Initialize */
       stats->rssi = packet_rssi;
@@ -191,23 +360,9 @@ link_stats_input_callback(const linkaddr_t *lladdr)
       (int32_t)packet_rssi * EWMA_ALPHA) / EWMA_SCALE;
 }
 /*---------------------------------------------------------------------------*/
-/* Periodic timer called every FRESHNESS_HALF_LIFE minutes */
-static void
-periodic(void *ptr)
-{
-  /* Age (by halving) freshness counter of all neighbors */
-  struct link_stats *stats;
-  ctimer_reset(&periodic_timer);
-  for(stats = nbr_table_head(link_stats); stats != NULL; stats = nbr_table_next(link_stats, stats)) {
-    stats->freshness >>= 1;
-  }
-}
-/*---------------------------------------------------------------------------*/
 /* Initializes link-stats module */
 void
 link_stats_init(void)
 {
   nbr_table_register(link_stats, NULL);
-  ctimer_set(&periodic_timer, 60 * bsp_getTRes() * FRESHNESS_HALF_LIFE,
-      periodic, NULL);
 }
@@ -142,7 +142,6 @@ rpl_dag_init(void)
     memset( instance_table, 0, sizeof(instance_table) );
     default_instance = NULL;
 
-    nbr_table_init();
     nbr_table_register(rpl_parents, (nbr_table_callback *)nbr_callback);
 }
 /*---------------------------------------------------------------------------*/
@@ -232,6 +231,76 @@ rpl_parent_is_reachable(rpl_parent_t *p) {
   }
 }
 /*---------------------------------------------------------------------------*/
+/* Index of the first parent of the set whose path cost is at least cost */
+static int
+parent_set_search(rpl_dag_t *dag, uint16_t cost)
+{
+  int low = 0;
+  int high = dag->parent_set_len;
+  int mid;
+
+  while(low < high) {
+    mid = (low + high) / 2;
+    if(dag->parent_set[mid]->set_cost < cost) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+/*---------------------------------------------------------------------------*/
+static void
+parent_set_remove(rpl_parent_t *p)
+{
+  rpl_dag_t *dag = p->set_dag;
+  int i;
+
+  if(dag == NULL) {
+    return;
+  }
+  for(i = parent_set_search(dag, p->set_cost); i < dag->parent_set_len; i++) {
+    if(dag->parent_set[i] == p) {
+      dag->parent_set_len--;
+      memmove(&dag->parent_set[i], &dag->parent_set[i + 1],
+          (dag->parent_set_len - i) * sizeof(rpl_parent_t *));
+      break;
+    }
+  }
+  p->set_dag = NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Must be called whenever the DAG, rank, metric container or link metric
+ * of a parent changes, so that its DAG's parent set stays ordered. */
+void
+rpl_parent_set_update(rpl_parent_t *p)
+{
+  rpl_dag_t *dag;
+  rpl_of_t *of;
+  int i;
+
+  parent_set_remove(p);
+
+  dag = p->dag;
+  if(dag == NULL || dag->parent_set_len >= NBR_TABLE_MAX_NEIGHBORS) {
+    return;
+  }
+  of = dag->instance != NULL ? dag->instance->of : NULL;
+  if(of != NULL && of->parent_path_cost != NULL) {
+    p->set_cost = of->parent_path_cost(p);
+  } else {
+    /* The OF is not known yet, it is set when joining the instance */
+    p->set_cost = p->rank;
+  }
+
+  i = parent_set_search(dag, p->set_cost);
+  memmove(&dag->parent_set[i + 1], &dag->parent_set[i],
+      (dag->parent_set_len - i) * sizeof(rpl_parent_t *));
+  dag->parent_set[i] = p;
+  dag->parent_set_len++;
+  p->set_dag = dag;
+}
+/*---------------------------------------------------------------------------*/
 static void
 rpl_set_preferred_parent(rpl_dag_t *dag, rpl_parent_t *p)
 {
@@ -259,6 +328,11 @@ rpl_set_preferred_parent(rpl_dag_t *dag, rpl_parent_t *p)
     nbr_table_unlock(rpl_parents, dag->preferred_parent);
     nbr_table_lock(rpl_parents, p);
     dag->preferred_parent = p;
+#if RPL_WITH_ADAPTIVE_TRICKLE
+    if(dag->instance != NULL) {
+      rpl_trickle_parent_changed(dag->instance);
+    }
+#endif /* RPL_WITH_ADAPTIVE_TRICKLE */
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -693,6 +767,11 @@ rpl_add_parent(rpl_dag_t *dag, rpl_dio_t *dio, uip_ipaddr_t *addr)
   PRINT6ADDR(addr);
   PRINTF("\n");
   if(lladdr != NULL) {
+    /* An existing entry is reinitialized, take it out of its parent set */
+    p = nbr_table_get_from_lladdr(rpl_parents, (linkaddr_t *)lladdr);
+    if(p != NULL) {
+      parent_set_remove(p);
+    }
 	/* Add parent in rpl_parents - again this is due to DIO */
 	p = nbr_table_add_lladdr(rpl_parents, (linkaddr_t *)lladdr,
 	                         NBR_TABLE_REASON_RPL_DIO, dio);
@@ -705,6 +784,7 @@ rpl_add_parent(rpl_dag_t *dag, rpl_dio_t *dio, uip_ipaddr_t *addr)
 #if RPL_WITH_MC
         memcpy(&p->mc, &dio->mc, sizeof(p->mc));
 #endif /* RPL_WITH_MC */
+        rpl_parent_set_update(p);
     }
   }
 
@@ -854,47 +934,142 @@ rpl_select_dag(rpl_instance_t *instance, rpl_parent_t *p)
   return best_dag;
 }
 /*---------------------------------------------------------------------------*/
+static int
+parent_is_candidate(rpl_dag_t *dag, rpl_parent_t *p, int fresh_only)
+{
+  /* Exclude parents from other DAGs or announcing an infinite rank */
+  if(p->dag != dag || p->rank == INFINITE_RANK) {
+    return 0;
+  }
+
+  if(fresh_only && !rpl_parent_is_fresh(p)) {
+    /* Filter out non-fresh parents if fresh_only is set */
+    return 0;
+  }
+
+#ifndef UIP_CONF_ND6_SEND_NA
+  {
+    uip_ds6_nbr_t *nbr = rpl_get_nbr(p);
+    /* Exclude links to a neighbor that is not reachable at a NUD level */
+    if(nbr == NULL || nbr->state != NBR_REACHABLE) {
+      return 0;
+    }
+  }
+#endif /* UIP_CONF_ND6_SEND_NA */
+
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
 static rpl_parent_t *
 best_parent(rpl_dag_t *dag, int fresh_only)
 {
   rpl_parent_t *p;
   rpl_of_t *of;
   rpl_parent_t *best = NULL;
+  int i;
 
   if(dag == NULL || dag->instance == NULL || dag->instance->of == NULL) {
     return NULL;
   }
 
   of = dag->instance->of;
-  /* Search for the best parent according to the OF */
-  for(p = nbr_table_head(rpl_parents); p != NULL; p = nbr_table_next(rpl_parents, p)) {
-
-	/* Exclude parents from other DAGs or announcing an infinite rank */
-    if(p->dag != dag || p->rank == INFINITE_RANK) {
-      continue;
+  /* The parent set is ordered by path cost, so the best parent is among
+   * the cheapest candidates the OF accepts. Stop after those. */
+  for(i = 0; i < dag->parent_set_len; i++) {
+    p = dag->parent_set[i];
+    if(best != NULL && p->set_cost > best->set_cost) {
+      break;
     }
-
-    if(fresh_only && !rpl_parent_is_fresh(p)) {
-      /* Filter out non-fresh parents if fresh_only is set */
-      continue;
+    if(parent_is_candidate(dag, p, fresh_only)) {
+      best = of->best_parent(best, p);
     }
+  }
 
-#ifndef UIP_CONF_ND6_SEND_NA
-    {
-    uip_ds6_nbr_t *nbr = rpl_get_nbr(p);
-    /* Exclude links to a neighbor that is not reachable at a NUD level */
-    if(nbr == NULL || nbr->state != NBR_REACHABLE) {
-      continue;
-    }
+  /* The OF may keep the preferred parent although it costs a bit more */
+  p = dag->preferred_parent;
+  if(p != NULL && parent_is_candidate(dag, p, fresh_only)) {
+    best = of->best_parent(best, p);
+  }
+  return best;
+}
+/*---------------------------------------------------------------------------*/
+#if RPL_WITH_FAST_REROUTE
+/* A backup parent must have a fresh link and a lower rank than ours, so
+ * that it cannot be one of our descendants. */
+static int
+backup_parent_is_valid(rpl_dag_t *dag, rpl_parent_t *p)
+{
+  rpl_instance_t *instance = dag->instance;
+
+  return p != dag->preferred_parent
+      && parent_is_candidate(dag, p, 1)
+      && instance->of->parent_has_usable_link(p)
+      && DAG_RANK(p->rank, instance) < DAG_RANK(dag->rank, instance)
+      && acceptable_rank(dag, rpl_rank_via_parent(p));
+}
+/*---------------------------------------------------------------------------*/
+static void
+select_backup_parent(rpl_dag_t *dag)
+{
+  int i;
+
+  dag->backup_parent = NULL;
+  if(dag->preferred_parent == NULL) {
+    return;
+  }
+  /* The parent set is ordered, take the cheapest valid alternative */
+  for(i = 0; i < dag->parent_set_len; i++) {
+    if(backup_parent_is_valid(dag, dag->parent_set[i])) {
+      dag->backup_parent = dag->parent_set[i];
+      break;
     }
-#endif /* UIP_CONF_ND6_SEND_NA */
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Switches from a failed preferred parent to the backup parent right away,
+ * without waiting for the parent selection. Returns 1 if it did. */
+int
+rpl_local_reroute(rpl_parent_t *parent)
+{
+  rpl_dag_t *dag = parent->dag;
+  rpl_instance_t *instance;
+  rpl_parent_t *backup;
 
-    /* Now we have an acceptable parent, check if it is the new best */
-    best = of->best_parent(best, p);
+  if(dag == NULL || !dag->joined || dag->preferred_parent != parent) {
+    return 0;
+  }
+  instance = dag->instance;
+  backup = dag->backup_parent;
+  dag->backup_parent = NULL;
 
+  /* The backup was validated at the last parent selection, check again */
+  if(backup == NULL || instance->of == NULL || !backup_parent_is_valid(dag, backup)) {
+    return 0;
   }
-  return best;
+
+  PRINTF("RPL: Fast reroute from ");
+  PRINT6ADDR(rpl_get_parent_ipaddr(parent));
+  PRINTF(" to ");
+  PRINT6ADDR(rpl_get_parent_ipaddr(backup));
+  PRINTF("\n\r");
+
+  rpl_set_preferred_parent(dag, backup);
+  dag->rank = rpl_rank_via_parent(backup);
+  rpl_set_default_route(instance, rpl_get_parent_ipaddr(backup));
+  RPL_STAT(rpl_stats.fast_reroutes++);
+
+  /* The regular parent selection confirms the switch later on */
+  parent->flags |= RPL_PARENT_FLAG_UPDATED;
+
+  if(RPL_IS_STORING(instance)) {
+    /* Trigger DAO transmission from immediate children. */
+    RPL_LOLLIPOP_INCREMENT(instance->dtsn_out);
+  }
+  rpl_schedule_dao(instance);
+  rpl_reset_dio_timer(instance);
+  return 1;
 }
+#endif /* RPL_WITH_FAST_REROUTE */
 /*---------------------------------------------------------------------------*/
 rpl_parent_t *
 rpl_select_parent(rpl_dag_t *dag)
@@ -929,6 +1104,9 @@ rpl_select_parent(rpl_dag_t *dag)
   }
 
   dag->rank = rpl_rank_via_parent(dag->preferred_parent);
+#if RPL_WITH_FAST_REROUTE
+  select_backup_parent(dag);
+#endif /* RPL_WITH_FAST_REROUTE */
   return dag->preferred_parent;
 }
 /*---------------------------------------------------------------------------*/
@@ -941,6 +1119,10 @@ rpl_remove_parent(rpl_parent_t *parent)
 
   rpl_nullify_parent(parent);
 
+  if(parent->dag != NULL && parent->dag->backup_parent == parent) {
+    parent->dag->backup_parent = NULL;
+  }
+  parent_set_remove(parent);
   nbr_table_remove(rpl_parents, parent);
 }
 /*---------------------------------------------------------------------------*/
@@ -1001,6 +1183,7 @@ rpl_move_parent(rpl_dag_t *dag_src, rpl_dag_t *dag_dst, rpl_parent_t *parent)
   PRINTF("\n\r");
 
   parent->dag = dag_dst;
+  rpl_parent_set_update(parent);
 }
 /*---------------------------------------------------------------------------*/
 int
@@ -1149,6 +1332,9 @@ rpl_join_instance(uip_ipaddr_t *from, rpl_dio_t *dio)
   instance->default_lifetime = dio->default_lifetime;
   instance->lifetime_unit = dio->lifetime_unit;
 
+  /* The parent was added before the OF was known */
+  rpl_parent_set_update(p);
+
   memcpy(&dag->dag_id, &dio->dag_id, sizeof(dio->dag_id));
 
   /* Copy prefix information from the DIO into the DAG object. */
@@ -1220,6 +1406,7 @@ rpl_add_dag(uip_ipaddr_t *from, rpl_dio_t *dio)
     }
   }
   p->rank = dio->rank;
+  rpl_parent_set_update(p);
 
   /* Determine the objective function by using the
      objective code point of the DIO. */
@@ -1617,6 +1804,7 @@ rpl_process_dio(uip_ipaddr_t *from, rpl_dio_t *dio)
 #if RPL_WITH_MC
   memcpy(&p->mc, &dio->mc, sizeof(p->mc));
 #endif /* RPL_WITH_MC */
+  rpl_parent_set_update(p);
   if(rpl_process_parent_event(instance, p) == 0) {
     PRINTF("RPL: The candidate parent is rejected\n\r");
     return;
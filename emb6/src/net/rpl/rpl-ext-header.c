@@ -52,6 +52,7 @@
 
 #define DEBUG DEBUG_NONE
 #include "net-debug.h"
+#include "uip-debug.h"
 
 #include <limits.h>
 #include <string.h>
@@ -66,6 +67,37 @@
 #define UIP_EXT_HDR_OPT_BUF       ((struct uip_ext_hdr_opt *)&uip_buf[uip_l2_l3_hdr_len + uip_ext_opt_offset])
 #define UIP_EXT_HDR_OPT_PADN_BUF  ((struct uip_ext_hdr_opt_padn *)&uip_buf[uip_l2_l3_hdr_len + uip_ext_opt_offset])
 #define UIP_EXT_HDR_OPT_RPL_BUF   ((struct uip_ext_hdr_opt_rpl *)&uip_buf[uip_l2_l3_hdr_len + uip_ext_opt_offset])
+
+#ifdef RPL_CONF_OUTPUT_INSTANCE_FUNC
+rpl_instance_t *RPL_CONF_OUTPUT_INSTANCE_FUNC(void);
+#endif /* RPL_CONF_OUTPUT_INSTANCE_FUNC */
+/*---------------------------------------------------------------------------*/
+rpl_instance_t *
+rpl_get_output_instance(void)
+{
+  rpl_instance_t *instance;
+  int uip_ext_opt_offset;
+  int last_uip_ext_len;
+
+  last_uip_ext_len = uip_ext_len;
+  uip_ext_len = 0;
+  uip_ext_opt_offset = 2;
+
+  /* A datagram that already carries a RPL option stays in its instance */
+  if(UIP_IP_BUF->proto == UIP_PROTO_HBHO
+      && UIP_EXT_HDR_OPT_RPL_BUF->opt_type == UIP_EXT_HDR_OPT_RPL) {
+    instance = rpl_get_instance(UIP_EXT_HDR_OPT_RPL_BUF->instance);
+  } else {
+    instance = RPL_OUTPUT_INSTANCE_FUNC();
+  }
+
+  uip_ext_len = last_uip_ext_len;
+
+  if(instance == NULL || !instance->used || instance->current_dag == NULL) {
+    return NULL;
+  }
+  return instance;
+}
 /*---------------------------------------------------------------------------*/
 int
 rpl_verify_hbh_header(int uip_ext_opt_offset)
@@ -102,7 +134,8 @@ rpl_verify_hbh_header(int uip_ext_opt_offset)
        routes that go through the neighbor that sent the packet to
        us. */
     if(RPL_IS_STORING(instance)) {
-      route = uip_ds6_route_lookup(&UIP_IP_BUF->destipaddr);
+      route = uip_ds6_route_lookup_table(&UIP_IP_BUF->destipaddr,
+                                         RPL_ROUTE_TABLE(instance));
       if(route != NULL) {
         uip_ds6_route_rm(route);
       }
@@ -131,6 +164,7 @@ rpl_verify_hbh_header(int uip_ext_opt_offset)
     /* A rank error was signalled, attempt to repair it by updating
      * the sender's rank from ext header */
     sender->rank = sender_rank;
+    rpl_parent_set_update(sender);
     if(RPL_IS_NON_STORING(instance)) {
       /* Select DAG and preferred parent only in non-storing mode. In storing mode,
        * a parent switch would result in an immediate No-path DAO transmission, dropping
@@ -175,6 +209,21 @@ rpl_verify_hbh_header(int uip_ext_opt_offset)
 }
 /*---------------------------------------------------------------------------*/
 #if RPL_WITH_NON_STORING
+/* Returns the DAG of the instance that holds addr, or of any instance if
+ * that one does not */
+static rpl_dag_t *
+srh_get_dag(const rpl_instance_t *instance, const uip_ipaddr_t *addr)
+{
+  rpl_dag_t *dag;
+
+  dag = instance != NULL ? instance->current_dag : NULL;
+  if(dag != NULL && dag->joined
+      && uip_ipaddr_prefixcmp(&dag->dag_id, addr, dag->prefix_info.length)) {
+    return dag;
+  }
+  return rpl_get_dag(addr);
+}
+/*---------------------------------------------------------------------------*/
 int
 rpl_srh_get_next_hop(uip_ipaddr_t *ipaddr)
 {
@@ -207,7 +256,7 @@ rpl_srh_get_next_hop(uip_ipaddr_t *ipaddr)
     }
   }
 
-  dag = rpl_get_dag(&UIP_IP_BUF->destipaddr);
+  dag = srh_get_dag(rpl_get_output_instance(), &UIP_IP_BUF->destipaddr);
   root_node = rpl_ns_get_node(dag, &dag->dag_id);
   dest_node = rpl_ns_get_node(dag, &UIP_IP_BUF->destipaddr);
 
@@ -322,8 +371,64 @@ count_matching_bytes(const void *p1, const void *p2, size_t n)
   return n;
 }
 /*---------------------------------------------------------------------------*/
+#if RPL_NS_SRH_CACHE_ENTRIES > 0
+/* Longest source routing header kept in the cache */
+#define SRH_CACHE_HDR_LEN 64
+
+/* A source routing header as inserted for a destination, with the first
+ * hop that becomes the IPv6 destination */
+struct srh_cache_entry {
+  const rpl_ns_node_t *dest_node;
+  /* rpl_ns_topology_version() when the header was built */
+  uint16_t version;
+  uint8_t ext_len;
+  uip_ipaddr_t next_hop;
+  uint8_t hdr[SRH_CACHE_HDR_LEN];
+};
+
+static struct srh_cache_entry srh_cache[RPL_NS_SRH_CACHE_ENTRIES];
+/* Entry to be replaced next */
+static uint8_t srh_cache_next;
+
+/*---------------------------------------------------------------------------*/
+static struct srh_cache_entry *
+srh_cache_lookup(const rpl_ns_node_t *dest_node)
+{
+  int i;
+  for(i = 0; i < RPL_NS_SRH_CACHE_ENTRIES; i++) {
+    if(srh_cache[i].dest_node == dest_node) {
+      if(srh_cache[i].version != rpl_ns_topology_version()) {
+        /* Some node changed its parent, the route may be stale */
+        srh_cache[i].dest_node = NULL;
+        return NULL;
+      }
+      return &srh_cache[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+srh_cache_store(const rpl_ns_node_t *dest_node)
+{
+  struct srh_cache_entry *e;
+  uint8_t ext_len = (UIP_RH_BUF->len << 3) + 8;
+
+  if(ext_len > SRH_CACHE_HDR_LEN) {
+    return;
+  }
+  e = &srh_cache[srh_cache_next];
+  srh_cache_next = (srh_cache_next + 1) % RPL_NS_SRH_CACHE_ENTRIES;
+  e->dest_node = dest_node;
+  e->version = rpl_ns_topology_version();
+  e->ext_len = ext_len;
+  uip_ipaddr_copy(&e->next_hop, &UIP_IP_BUF->destipaddr);
+  memcpy(e->hdr, UIP_RH_BUF, ext_len);
+}
+#endif /* RPL_NS_SRH_CACHE_ENTRIES > 0 */
+/*---------------------------------------------------------------------------*/
 static int
-insert_srh_header(void)
+insert_srh_header(const rpl_instance_t *instance)
 {
   /* Implementation of RFC6554 */
   uint8_t temp_len;
@@ -338,6 +443,9 @@ insert_srh_header(void)
   rpl_ns_node_t *node;
   rpl_dag_t *dag;
   uip_ipaddr_t node_addr;
+#if RPL_NS_SRH_CACHE_ENTRIES > 0
+  struct srh_cache_entry *cached;
+#endif /* RPL_NS_SRH_CACHE_ENTRIES > 0 */
 
   PRINTF("RPL: SRH creating source routing header with destination ");
   PRINT6ADDR(&UIP_IP_BUF->destipaddr);
@@ -346,7 +454,7 @@ insert_srh_header(void)
   /* Construct source route. We do not do this recursively to keep the runtime stack usage constant. */
 
   /* Get link of the destination and root */
-  dag = rpl_get_dag(&UIP_IP_BUF->destipaddr);
+  dag = srh_get_dag(instance, &UIP_IP_BUF->destipaddr);
 
   if(dag == NULL) {
     PRINTF("RPL: SRH DAG not found\n\r");
@@ -359,6 +467,25 @@ insert_srh_header(void)
     return 1;
   }
 
+#if RPL_NS_SRH_CACHE_ENTRIES > 0
+  cached = srh_cache_lookup(dest_node);
+  if(cached != NULL) {
+    ext_len = cached->ext_len;
+    if(uip_len + ext_len > UIP_BUFSIZE) {
+      PRINTF("RPL: Packet too long: impossible to add source routing header (%u bytes)\n\r", ext_len);
+      return 1;
+    }
+    PRINTF("RPL: SRH from cache, ext len %u\n\r", ext_len);
+    memmove(uip_buf + uip_l2_l3_hdr_len + ext_len,
+        uip_buf + uip_l2_l3_hdr_len, uip_len - UIP_IPH_LEN);
+    memcpy(uip_buf + uip_l2_l3_hdr_len, cached->hdr, ext_len);
+    UIP_RH_BUF->next = UIP_IP_BUF->proto;
+    UIP_IP_BUF->proto = UIP_PROTO_ROUTING;
+    uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &cached->next_hop);
+    goto update_len;
+  }
+#endif /* RPL_NS_SRH_CACHE_ENTRIES > 0 */
+
   root_node = rpl_ns_get_node(dag, &dag->dag_id);
   if(root_node == NULL) {
     PRINTF("RPL: SRH root node not found\n\r");
@@ -450,6 +577,11 @@ insert_srh_header(void)
   rpl_ns_get_node_global_addr(&node_addr, node);
   uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &node_addr);
 
+#if RPL_NS_SRH_CACHE_ENTRIES > 0
+  srh_cache_store(dest_node);
+
+update_len:
+#endif /* RPL_NS_SRH_CACHE_ENTRIES > 0 */
   /* In-place update of IPv6 length field */
   temp_len = UIP_IP_BUF->len[1];
   UIP_IP_BUF->len[1] += ext_len;
@@ -463,7 +595,7 @@ insert_srh_header(void)
   return 1;
 }
 #else /* RPL_WITH_NON_STORING */
-int insert_srh_header(void);
+int insert_srh_header(const rpl_instance_t *instance);
 #endif /* RPL_WITH_NON_STORING */
 /*---------------------------------------------------------------------------*/
 static int
@@ -506,7 +638,8 @@ update_hbh_header(void)
             general not go back up again. If this happens, a
             RPL_HDR_OPT_FWD_ERR should be flagged. */
       if((UIP_EXT_HDR_OPT_RPL_BUF->flags & RPL_HDR_OPT_DOWN)) {
-        if(uip_ds6_route_lookup(&UIP_IP_BUF->destipaddr) == NULL) {
+        if(uip_ds6_route_lookup_table(&UIP_IP_BUF->destipaddr,
+                                      RPL_ROUTE_TABLE(instance)) == NULL) {
           UIP_EXT_HDR_OPT_RPL_BUF->flags |= RPL_HDR_OPT_FWD_ERR;
           PRINTF("RPL forwarding error\n\r");
           /* We should send back the packet to the originating parent,
@@ -523,7 +656,8 @@ update_hbh_header(void)
         /* Set the down extension flag correctly as described in Section
              11.2 of RFC6550. If the packet progresses along a DAO route,
              the down flag should be set. */
-        if(uip_ds6_route_lookup(&UIP_IP_BUF->destipaddr) == NULL) {
+        if(uip_ds6_route_lookup_table(&UIP_IP_BUF->destipaddr,
+                                      RPL_ROUTE_TABLE(instance)) == NULL) {
           /* No route was found, so this packet will go towards the RPL
              root. If so, we should not set the down flag. */
           UIP_EXT_HDR_OPT_RPL_BUF->flags &= ~RPL_HDR_OPT_DOWN;
@@ -635,26 +769,34 @@ rpl_remove_header(void)
 int
 rpl_update_header(void)
 {
+  rpl_instance_t *instance;
+
   if(default_instance == NULL || default_instance->current_dag == NULL
       || uip_is_addr_linklocal(&UIP_IP_BUF->destipaddr) || uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
     return 1;
   }
 
-  if(default_instance->current_dag->rank == ROOT_RANK(default_instance)) {
+  instance = rpl_get_output_instance();
+  if(instance == NULL) {
+    /* Drops datagrams whose RPL option names an unknown instance */
+    return update_hbh_header();
+  }
+
+  if(instance->current_dag->rank == ROOT_RANK(instance)) {
     /* At the root, remove headers if any, and insert SRH or HBH
      * (SRH is inserted only if the destination is in the DODAG) */
     rpl_remove_header();
-    if(RPL_IS_NON_STORING(default_instance)) {
-      return insert_srh_header();
+    if(RPL_IS_NON_STORING(instance)) {
+      return insert_srh_header(instance);
     } else {
-      return insert_hbh_header(default_instance);
+      return insert_hbh_header(instance);
     }
   } else {
     if(uip_ds6_is_my_addr(&UIP_IP_BUF->srcipaddr)
         && UIP_IP_BUF->ttl == uip_ds6_if.cur_hop_limit) {
       /* Insert HBH option at source. Checking the address is not sufficient because
        * in non-storing mode, a packet may go up and then down the same path again */
-      return insert_hbh_header(default_instance);
+      return insert_hbh_header(instance);
     } else {
       /* Update HBH option at forwarders */
       return update_hbh_header();
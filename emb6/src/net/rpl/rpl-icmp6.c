@@ -93,6 +93,49 @@ void RPL_DEBUG_DAO_OUTPUT(rpl_parent_t *);
 
 static uint8_t dao_sequence = RPL_LOLLIPOP_INIT;
 
+/* A DAO target and the lifetime of its transit information. parent_pos
+ * is the offset of the parent address of the transit information in the
+ * received DAO, or 0 if there is none. */
+struct dao_target {
+  uip_ipaddr_t prefix;
+  uint8_t prefixlen;
+  uint8_t lifetime;
+  uint8_t parent_pos;
+};
+
+/* Targets of the DAO being processed */
+static struct dao_target dao_in_targets[RPL_DAO_AGGREGATION_MAX_TARGETS];
+
+#if RPL_WITH_DAO_ACK
+/* DAO-ACKs waiting to be sent by the root */
+struct dao_ack_entry {
+  uip_ipaddr_t dest;
+  rpl_instance_t *instance;
+  uint8_t sequence;
+  uint8_t status;
+};
+static struct dao_ack_entry dao_ack_queue[RPL_DAO_ACK_QUEUE_SIZE];
+static uint8_t dao_ack_num;
+static struct ctimer dao_ack_timer;
+#endif /* RPL_WITH_DAO_ACK */
+
+#if RPL_WITH_STORING
+/* Lengths of the DAO base object and of a target with its transit
+ * information, and room for a DAO in uip_buf */
+#define DAO_BASE_LEN        (4 + (RPL_DAO_SPECIFY_DAG ? 16 : 0))
+#define DAO_TARGET_LEN(t)   (4 + ((t)->prefixlen + 7) / CHAR_BIT + 6)
+#define DAO_FWD_MAX_LEN     (UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPH_LEN - \
+                             UIP_ICMPH_LEN - RPL_HOP_BY_HOP_LEN)
+
+/* Targets received from children, to be forwarded in a single DAO */
+static struct dao_target dao_fwd_targets[RPL_DAO_AGGREGATION_MAX_TARGETS];
+static uint8_t dao_fwd_num;
+static uint16_t dao_fwd_len;
+static uint8_t dao_fwd_seq;
+static rpl_instance_t *dao_fwd_instance;
+static struct ctimer dao_fwd_timer;
+#endif /* RPL_WITH_STORING */
+
 #if RPL_WITH_MULTICAST
 static uip_mcast6_route_t *mcast_group;
 #endif
@@ -104,39 +147,223 @@ UIP_ICMP6_HANDLER(dao_handler, ICMP6_RPL, RPL_CODE_DAO, dao_input);
 UIP_ICMP6_HANDLER(dao_ack_handler, ICMP6_RPL, RPL_CODE_DAO_ACK, dao_ack_input);
 /*---------------------------------------------------------------------------*/
 
-#if RPL_WITH_DAO_ACK
-static uip_ds6_route_t *
-find_route_entry_by_dao_ack(uint8_t seq)
+#if RPL_WITH_STORING
+/*---------------------------------------------------------------------------*/
+/* Sends the queued targets to the preferred parent in a single DAO */
+static void
+dao_fwd_flush(void)
 {
-  uip_ds6_route_t *re;
-  re = uip_ds6_route_head();
-  while(re != NULL) {
-    if(re->state.dao_seqno_out == seq && RPL_ROUTE_IS_DAO_PENDING(re)) {
-      /* found it! */
-      return re;
+  rpl_instance_t *instance;
+  rpl_parent_t *parent;
+  struct dao_target *target;
+  unsigned char *buffer;
+  uint8_t num;
+  int pos;
+  int i;
+
+  ctimer_stop(&dao_fwd_timer);
+  instance = dao_fwd_instance;
+  num = dao_fwd_num;
+  dao_fwd_num = 0;
+
+  if(num == 0 || instance == NULL || instance->current_dag == NULL) {
+    return;
+  }
+  parent = instance->current_dag->preferred_parent;
+  if(parent == NULL || rpl_get_parent_ipaddr(parent) == NULL) {
+    PRINTF("RPL: No parent to forward the DAO to\n\r");
+    return;
+  }
+
+  buffer = UIP_ICMP_PAYLOAD;
+
+  pos = 0;
+  buffer[pos++] = instance->instance_id;
+  buffer[pos] = 0;
+#if RPL_DAO_SPECIFY_DAG
+  buffer[pos] |= RPL_DAO_D_FLAG;
+#endif /* RPL_DAO_SPECIFY_DAG */
+#if RPL_WITH_DAO_ACK
+  for(i = 0; i < num; i++) {
+    if(dao_fwd_targets[i].lifetime != RPL_ZERO_LIFETIME) {
+      buffer[pos] |= RPL_DAO_K_FLAG;
+      break;
     }
-    re = uip_ds6_route_next(re);
   }
-  return NULL;
-}
 #endif /* RPL_WITH_DAO_ACK */
+  ++pos;
+  buffer[pos++] = 0; /* reserved */
+  buffer[pos++] = dao_fwd_seq;
+#if RPL_DAO_SPECIFY_DAG
+  memcpy(buffer + pos, &instance->current_dag->dag_id, sizeof(uip_ipaddr_t));
+  pos += sizeof(uip_ipaddr_t);
+#endif /* RPL_DAO_SPECIFY_DAG */
 
-#if RPL_WITH_STORING
-/* prepare for forwarding of DAO */
-static uint8_t
-prepare_for_dao_fwd(uint8_t sequence, uip_ds6_route_t *rep)
+  /* A transit information sub-option applies to the targets preceding it */
+  for(i = 0; i < num; i++) {
+    target = &dao_fwd_targets[i];
+    buffer[pos++] = RPL_OPTION_TARGET;
+    buffer[pos++] = 2 + ((target->prefixlen + 7) / CHAR_BIT);
+    buffer[pos++] = 0; /* reserved */
+    buffer[pos++] = target->prefixlen;
+    memcpy(buffer + pos, &target->prefix, (target->prefixlen + 7) / CHAR_BIT);
+    pos += ((target->prefixlen + 7) / CHAR_BIT);
+
+    buffer[pos++] = RPL_OPTION_TRANSIT;
+    buffer[pos++] = 4;
+    buffer[pos++] = 0; /* flags - ignored */
+    buffer[pos++] = 0; /* path control - ignored */
+    buffer[pos++] = 0; /* path seq - ignored */
+    buffer[pos++] = target->lifetime;
+  }
+
+  PRINTF("RPL: Forwarding %u DAO targets with sequence number %u to ",
+      num, dao_fwd_seq);
+  PRINT6ADDR(rpl_get_parent_ipaddr(parent));
+  PRINTF("\n\r");
+
+  uip_icmp6_send(rpl_get_parent_ipaddr(parent), ICMP6_RPL, RPL_CODE_DAO, pos);
+}
+/*---------------------------------------------------------------------------*/
+static void
+dao_fwd_timeout(void *ptr)
 {
-  /* not pending - or pending but not a retransmission */
-  RPL_LOLLIPOP_INCREMENT(dao_sequence);
+  dao_fwd_flush();
+}
+/*---------------------------------------------------------------------------*/
+/* Queues a target for the next DAO to the preferred parent. The route
+ * towards the target waits for the DAO-ACK of that DAO. */
+static void
+dao_fwd_add(rpl_instance_t *instance, const struct dao_target *target,
+            uip_ds6_route_t *rep, uint8_t sequence)
+{
+  int i;
 
-  /* set DAO pending and sequence numbers */
-  rep->state.dao_seqno_in = sequence;
-  rep->state.dao_seqno_out = dao_sequence;
-  RPL_ROUTE_SET_DAO_PENDING(rep);
-  return dao_sequence;
+  for(i = 0; i < dao_fwd_num; i++) {
+    if(dao_fwd_targets[i].prefixlen == target->prefixlen &&
+       uip_ipaddr_cmp(&dao_fwd_targets[i].prefix, &target->prefix)) {
+      /* Already queued, the newest lifetime is forwarded */
+      break;
+    }
+  }
+
+  if(i == dao_fwd_num) {
+    /* dao_fwd_reserve() made room for the targets of the DAO */
+    if(dao_fwd_num > 0 &&
+       (dao_fwd_instance != instance ||
+        dao_fwd_num == RPL_DAO_AGGREGATION_MAX_TARGETS ||
+        dao_fwd_len + DAO_TARGET_LEN(target) > DAO_FWD_MAX_LEN)) {
+      PRINTF("RPL: No room to forward a DAO target\n\r");
+      return;
+    }
+    if(dao_fwd_num == 0) {
+      RPL_LOLLIPOP_INCREMENT(dao_sequence);
+      dao_fwd_seq = dao_sequence;
+      dao_fwd_len = DAO_BASE_LEN;
+      dao_fwd_instance = instance;
+      if(RPL_DAO_AGGREGATION_DELAY > 0) {
+        ctimer_set(&dao_fwd_timer, RPL_DAO_AGGREGATION_DELAY,
+                   dao_fwd_timeout, NULL);
+      }
+    }
+    i = dao_fwd_num++;
+    dao_fwd_len += DAO_TARGET_LEN(target);
+  }
+  dao_fwd_targets[i] = *target;
+
+  if(rep != NULL) {
+    /* set DAO pending and sequence numbers */
+    rep->state.dao_seqno_in = sequence;
+    rep->state.dao_seqno_out = dao_fwd_seq;
+    RPL_ROUTE_SET_DAO_PENDING(rep);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Sends the queued targets if the targets of the received DAO may not fit
+ * in the same DAO. Sending overwrites uip_buf and the packetbuf, so this
+ * is done once before the targets are processed. */
+static void
+dao_fwd_reserve(rpl_instance_t *instance, int num_targets)
+{
+  uint16_t len;
+  int i;
+
+  if(dao_fwd_num == 0) {
+    return;
+  }
+
+  len = dao_fwd_len;
+  for(i = 0; i < num_targets; i++) {
+    len += DAO_TARGET_LEN(&dao_in_targets[i]);
+  }
+  if(dao_fwd_instance != instance ||
+     dao_fwd_num + num_targets > RPL_DAO_AGGREGATION_MAX_TARGETS ||
+     len > DAO_FWD_MAX_LEN) {
+    dao_fwd_flush();
+  }
 }
 #endif /* RPL_WITH_STORING */
 /*---------------------------------------------------------------------------*/
+#if RPL_WITH_DAO_ACK
+/* Sends the DAO-ACKs queued by the root */
+static void
+dao_ack_flush(void)
+{
+  struct dao_ack_entry *e;
+
+  ctimer_stop(&dao_ack_timer);
+  for(e = dao_ack_queue; e < &dao_ack_queue[dao_ack_num]; e++) {
+    dao_ack_output(e->instance, &e->dest, e->sequence, e->status);
+  }
+  dao_ack_num = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+dao_ack_timeout(void *ptr)
+{
+  dao_ack_flush();
+}
+#endif /* RPL_WITH_DAO_ACK */
+/*---------------------------------------------------------------------------*/
+/* Acknowledges a DAO. With queue set (at the root), the DAO-ACK is sent
+ * along with the others pending RPL_DAO_ACK_DELAY after the first one. A
+ * newer DAO from the same node replaces its pending DAO-ACK. */
+static void
+dao_ack_send(rpl_instance_t *instance, uip_ipaddr_t *dest, uint8_t sequence,
+             uint8_t status, int queue)
+{
+#if RPL_WITH_DAO_ACK
+  struct dao_ack_entry *e;
+
+  uip_clear_buf();
+  if(!queue || RPL_DAO_ACK_DELAY == 0) {
+    dao_ack_output(instance, dest, sequence, status);
+    return;
+  }
+
+  for(e = dao_ack_queue; e < &dao_ack_queue[dao_ack_num]; e++) {
+    if(e->instance == instance && uip_ipaddr_cmp(&e->dest, dest)) {
+      RPL_STAT(rpl_stats.dao_acks_coalesced++);
+      break;
+    }
+  }
+
+  if(e == &dao_ack_queue[dao_ack_num]) {
+    if(dao_ack_num == RPL_DAO_ACK_QUEUE_SIZE) {
+      dao_ack_flush();
+      e = dao_ack_queue;
+    }
+    if(dao_ack_num++ == 0) {
+      ctimer_set(&dao_ack_timer, RPL_DAO_ACK_DELAY, dao_ack_timeout, NULL);
+    }
+    uip_ipaddr_copy(&e->dest, dest);
+    e->instance = instance;
+  }
+  e->sequence = sequence;
+  e->status = status;
+#endif /* RPL_WITH_DAO_ACK */
+}
+/*---------------------------------------------------------------------------*/
 static int
 get_global_addr(uip_ipaddr_t *addr)
 {
@@ -623,6 +850,67 @@ dio_output(rpl_instance_t *instance, uip_ipaddr_t *uc_addr)
 #endif /* RPL_LEAF_ONLY */
 }
 /*---------------------------------------------------------------------------*/
+/* Parses the Target and Transit Information options of a DAO into
+ * dao_in_targets. Each transit information option applies to the targets
+ * preceding it, targets without one get the default lifetime. Returns the
+ * number of targets. */
+static int
+dao_parse_targets(unsigned char *buffer, int pos, int buffer_length,
+                  uint8_t lifetime)
+{
+  struct dao_target *target;
+  int num_targets;
+  int num_transit;
+  int len;
+  int i;
+
+  num_targets = 0;
+  num_transit = 0;
+  for(i = pos; i < buffer_length; i += len) {
+    if(buffer[i] == RPL_OPTION_PAD1) {
+      len = 1;
+    } else {
+      /* The option consists of a two-byte header and a payload. */
+      len = 2 + buffer[i + 1];
+    }
+    if(i + len > buffer_length) {
+      RPL_STAT(rpl_stats.malformed_msgs++);
+      break;
+    }
+
+    switch(buffer[i]) {
+    case RPL_OPTION_TARGET:
+      /* Handle the target option. */
+      if(num_targets < RPL_DAO_AGGREGATION_MAX_TARGETS && len >= 4 &&
+         buffer[i + 3] <= sizeof(uip_ipaddr_t) * CHAR_BIT &&
+         4 + (buffer[i + 3] + 7) / CHAR_BIT <= len) {
+        target = &dao_in_targets[num_targets++];
+        target->prefixlen = buffer[i + 3];
+        memset(&target->prefix, 0, sizeof(target->prefix));
+        memcpy(&target->prefix, buffer + i + 4, (target->prefixlen + 7) / CHAR_BIT);
+        target->parent_pos = 0;
+      }
+      break;
+    case RPL_OPTION_TRANSIT:
+      /* The path sequence and control are ignored. */
+      /*      pathcontrol = buffer[i + 3];
+              pathsequence = buffer[i + 4];*/
+      if(len >= 6) {
+        lifetime = buffer[i + 5];
+        for(; num_transit < num_targets; num_transit++) {
+          dao_in_targets[num_transit].lifetime = lifetime;
+          dao_in_targets[num_transit].parent_pos = len >= 22 ? i + 6 : 0;
+        }
+      }
+      break;
+    }
+  }
+  for(; num_transit < num_targets; num_transit++) {
+    dao_in_targets[num_transit].lifetime = lifetime;
+  }
+  return num_targets;
+}
+/*---------------------------------------------------------------------------*/
 static void
 dao_input_storing(void)
 {
@@ -633,27 +921,23 @@ dao_input_storing(void)
   unsigned char *buffer;
   uint16_t sequence;
   uint8_t instance_id;
-  uint8_t lifetime;
-  uint8_t prefixlen;
   uint8_t flags;
-  uint8_t subopt_type;
-  /*
-  uint8_t pathcontrol;
-  uint8_t pathsequence;
-  */
-  uip_ipaddr_t prefix;
+  struct dao_target *target;
   uip_ds6_route_t *rep;
+  uip_ipaddr_t *nexthop;
   uint8_t buffer_length;
   int pos;
-  int len;
   int i;
+  int num_targets;
   int learned_from;
   rpl_parent_t *parent;
   uip_ds6_nbr_t *nbr;
   int is_root;
+  int ack_now;
+  uint8_t status;
 
-  prefixlen = 0;
   parent = NULL;
+  nbr = NULL;
 
   uip_ipaddr_copy(&dao_sender_addr, &UIP_IP_BUF->srcipaddr);
 
@@ -665,8 +949,6 @@ dao_input_storing(void)
 
   instance = rpl_get_instance(instance_id);
 
-  lifetime = instance->default_lifetime;
-
   flags = buffer[pos++];
   /* reserved */
   pos++;
@@ -679,6 +961,7 @@ dao_input_storing(void)
   if(flags & RPL_DAO_D_FLAG) {
     if(memcmp(&dag->dag_id, &buffer[pos], sizeof(dag->dag_id))) {
       PRINTF("RPL: Ignoring a DAO for a DAG different from ours\n\r");
+      RPL_STAT(rpl_stats.dao_dropped++);
       return;
     }
     pos += 16;
@@ -704,6 +987,8 @@ dao_input_storing(void)
                   DAG_RANK(parent->rank, instance), DAG_RANK(dag->rank, instance));
           parent->rank = INFINITE_RANK;
           parent->flags |= RPL_PARENT_FLAG_UPDATED;
+          rpl_parent_set_update(parent);
+          RPL_STAT(rpl_stats.dao_dropped++);
           return;
       }
 
@@ -712,181 +997,157 @@ dao_input_storing(void)
           PRINTF("RPL: Loop detected when receiving a unicast DAO from our parent\n");
           parent->rank = INFINITE_RANK;
           parent->flags |= RPL_PARENT_FLAG_UPDATED;
+          rpl_parent_set_update(parent);
+          RPL_STAT(rpl_stats.dao_dropped++);
           return;
       }
   }
 
-  /* Check if there are any RPL options present. */
-  for(i = pos; i < buffer_length; i += len) {
-    subopt_type = buffer[i];
-    if(subopt_type == RPL_OPTION_PAD1) {
-      len = 1;
-    } else {
-      /* The option consists of a two-byte header and a payload. */
-      len = 2 + buffer[i + 1];
-    }
-
-    switch(subopt_type) {
-    case RPL_OPTION_TARGET:
-      /* Handle the target option. */
-      prefixlen = buffer[i + 3];
-      memset(&prefix, 0, sizeof(prefix));
-      memcpy(&prefix, buffer + i + 4, (prefixlen + 7) / CHAR_BIT);
-      break;
-    case RPL_OPTION_TRANSIT:
-      /* The path sequence and control are ignored. */
-      /*      pathcontrol = buffer[i + 3];
-              pathsequence = buffer[i + 4];*/
-      lifetime = buffer[i + 5];
-      /* The parent address is also ignored. */
+  /* A DAO may carry several targets. The parent address of the transit
+   * information is ignored in storing mode. */
+  num_targets = dao_parse_targets(buffer, pos, buffer_length,
+                                  instance->default_lifetime);
+
+  /* The sender is added to the neighbor cache with the link-layer address
+   * of the packetbuf before forwarding a DAO overwrites it */
+  for(i = 0; i < num_targets; i++) {
+    if(dao_in_targets[i].lifetime != RPL_ZERO_LIFETIME) {
+      nbr = rpl_icmp6_update_nbr_table(&dao_sender_addr, NBR_TABLE_REASON_RPL_DAO, instance);
+      if(nbr == NULL) {
+        PRINTF("RPL: Out of Memory, dropping DAO from ");
+        PRINT6ADDR(&dao_sender_addr);
+        PRINTF(", ");
+        PRINTLLADDR((uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
+        PRINTF("\n");
+      }
       break;
     }
   }
 
-  PRINTF("RPL: DAO lifetime: %u, prefix length: %u prefix: ",
-          (unsigned)lifetime, (unsigned)prefixlen);
-  PRINT6ADDR(&prefix);
-  PRINTF("\n\r");
+  dao_fwd_reserve(instance, num_targets);
+
+  status = RPL_DAO_ACK_UNCONDITIONAL_ACCEPT;
+  ack_now = 1;
+
+  for(i = 0; i < num_targets; i++) {
+    target = &dao_in_targets[i];
+
+    PRINTF("RPL: DAO lifetime: %u, prefix length: %u prefix: ",
+        (unsigned)target->lifetime, (unsigned)target->prefixlen);
+    PRINT6ADDR(&target->prefix);
+    PRINTF("\n\r");
+
+    rep = NULL;
 
 #if RPL_WITH_MULTICAST
-  if(uip_is_addr_mcast_global(&prefix)) {
-      mcast_group = uip_mcast6_route_add(&prefix);
+    if(uip_is_addr_mcast_global(&target->prefix)) {
+      mcast_group = uip_mcast6_route_add(&target->prefix);
       if(mcast_group) {
-          mcast_group->dag = dag;
-          mcast_group->lifetime = RPL_LIFETIME(instance, lifetime);
+        mcast_group->dag = dag;
+        mcast_group->lifetime = RPL_LIFETIME(instance, target->lifetime);
       }
       goto fwd_dao;
-  }
+    }
 #endif
 
-  rep = uip_ds6_route_lookup(&prefix);
-
-  if(lifetime == RPL_ZERO_LIFETIME) {
-    PRINTF("RPL: No-Path DAO received\n\r");
-    /* No-Path DAO received; invoke the route purging routine. */
-    if(rep != NULL &&
-       !RPL_ROUTE_IS_NOPATH_RECEIVED(rep) &&
-       rep->length == prefixlen &&
-       uip_ds6_route_nexthop(rep) != NULL &&
-       uip_ipaddr_cmp(uip_ds6_route_nexthop(rep), &dao_sender_addr)) {
-      PRINTF("RPL: Setting expiration timer for prefix ");
-      PRINT6ADDR(&prefix);
-      PRINTF("\n\r");
-      RPL_ROUTE_SET_NOPATH_RECEIVED(rep);
-      rep->state.lifetime = RPL_NOPATH_REMOVAL_DELAY;
-      /* We forward the incoming No-Path DAO to our parent, if we have
-           one. */
-      if(dag->preferred_parent != NULL &&
-              rpl_get_parent_ipaddr(dag->preferred_parent) != NULL) {
-    	  uint8_t out_seq;
-    	  out_seq = prepare_for_dao_fwd(sequence, rep);
-
-    	  PRINTF("RPL: Forwarding No-path DAO to parent - out_seq:%d",
-    	         out_seq);
-          PRINT6ADDR(rpl_get_parent_ipaddr(dag->preferred_parent));
-          PRINTF("\n");
-
-          buffer = UIP_ICMP_PAYLOAD;
-          buffer[3] = out_seq; /* add an outgoing seq no before fwd */
-          uip_icmp6_send(rpl_get_parent_ipaddr(dag->preferred_parent),
-                  ICMP6_RPL, RPL_CODE_DAO, buffer_length);
+    /* The route is looked up once, a route that only needs to be
+     * refreshed is updated in place below. */
+    rep = uip_ds6_route_lookup_table(&target->prefix, RPL_ROUTE_TABLE(instance));
+    nexthop = NULL;
+    if(rep != NULL && rep->length == target->prefixlen) {
+      nexthop = uip_ds6_route_nexthop(rep);
+      if(nexthop != NULL && !uip_ipaddr_cmp(nexthop, &dao_sender_addr)) {
+        nexthop = NULL;
       }
     }
-    /* independent if we remove or not - ACK the request */
-    if(flags & RPL_DAO_K_FLAG) {
-    /* indicate that we accepted the no-path DAO */
-    uip_clear_buf();
-    dao_ack_output(instance, &dao_sender_addr, sequence,
-                   RPL_DAO_ACK_UNCONDITIONAL_ACCEPT);
-    }
-    return;
-  }
 
+    if(target->lifetime == RPL_ZERO_LIFETIME) {
+      PRINTF("RPL: No-Path DAO received\n\r");
+      /* No-Path DAO received; invoke the route purging routine. */
+      if(nexthop != NULL &&
+         !RPL_ROUTE_IS_NOPATH_RECEIVED(rep)) {
+        PRINTF("RPL: Setting expiration timer for prefix ");
+        PRINT6ADDR(&target->prefix);
+        PRINTF("\n\r");
+        RPL_ROUTE_SET_NOPATH_RECEIVED(rep);
+        rep->state.lifetime = RPL_NOPATH_REMOVAL_DELAY;
+        /* We forward the incoming No-Path DAO to our parent, if we have
+           one. */
+        if(dag->preferred_parent != NULL &&
+                rpl_get_parent_ipaddr(dag->preferred_parent) != NULL) {
+          dao_fwd_add(instance, target, rep, sequence);
+        }
+      }
+      /* independent if we remove or not - ACK the request */
+      continue;
+    }
 
-  PRINTF("RPL: Adding DAO route\n\r");
+    PRINTF("RPL: Adding DAO route\n\r");
 
-  /* Update and add neighbor - if no room - fail. */
-  if((nbr = rpl_icmp6_update_nbr_table(&dao_sender_addr, NBR_TABLE_REASON_RPL_DAO, instance)) == NULL) {
-    PRINTF("RPL: Out of Memory, dropping DAO from ");
-    PRINT6ADDR(&dao_sender_addr);
-    PRINTF(", ");
-    PRINTLLADDR((uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
-    PRINTF("\n");
-    if(flags & RPL_DAO_K_FLAG) {
+    /* No room for the neighbor - fail. */
+    if(nbr == NULL) {
       /* signal the failure to add the node */
-      dao_ack_output(instance, &dao_sender_addr, sequence,
-    		         is_root ? RPL_DAO_ACK_UNABLE_TO_ADD_ROUTE_AT_ROOT :
-    		  	     RPL_DAO_ACK_UNABLE_TO_ACCEPT);
+      status = is_root ? RPL_DAO_ACK_UNABLE_TO_ADD_ROUTE_AT_ROOT :
+                         RPL_DAO_ACK_UNABLE_TO_ACCEPT;
+      break;
     }
-    return;
-  }
-
-  rep = rpl_add_route(dag, &prefix, prefixlen, &dao_sender_addr);
-  if(rep == NULL) {
-    RPL_STAT(rpl_stats.mem_overflows++);
-    PRINTF("RPL: Could not add a route after receiving a DAO\n\r");
 
-    if(flags & RPL_DAO_K_FLAG) {
-      /* signal the failure to add the node */
-      dao_ack_output(instance, &dao_sender_addr, sequence,
-    		         is_root ? RPL_DAO_ACK_UNABLE_TO_ADD_ROUTE_AT_ROOT :
-    		  	     RPL_DAO_ACK_UNABLE_TO_ACCEPT);
+    if(nexthop != NULL) {
+      /* Refresh of an installed route */
+      rep->state.dag = dag;
+    } else {
+      rep = rpl_add_route(dag, &target->prefix, target->prefixlen, &dao_sender_addr);
+      if(rep == NULL) {
+        RPL_STAT(rpl_stats.mem_overflows++);
+        PRINTF("RPL: Could not add a route after receiving a DAO\n\r");
+        /* signal the failure to add the node */
+        status = is_root ? RPL_DAO_ACK_UNABLE_TO_ADD_ROUTE_AT_ROOT :
+                           RPL_DAO_ACK_UNABLE_TO_ACCEPT;
+        break;
+      }
     }
-    return;
-  }
 
-  /* set lifetime and clear NOPATH bit */
-  rep->state.lifetime = RPL_LIFETIME(instance, lifetime);
-  RPL_ROUTE_CLEAR_NOPATH_RECEIVED(rep);
+    /* set lifetime and clear NOPATH bit */
+    rep->state.lifetime = RPL_LIFETIME(instance, target->lifetime);
+    RPL_ROUTE_CLEAR_NOPATH_RECEIVED(rep);
 
 #if RPL_WITH_MULTICAST
   fwd_dao:
 #endif
 
-  if(learned_from == RPL_ROUTE_FROM_UNICAST_DAO) {
-    int should_ack = 0;
-
-    if(flags & RPL_DAO_K_FLAG) {
+    if(learned_from == RPL_ROUTE_FROM_UNICAST_DAO) {
       /*
        * check if this route is already installed and we can ack now!
        * not pending - and same seq-no means that we can ack.
        * (e.g. the route is installed already so it will not take any
        * more room that it already takes - so should be ok!)
        */
-      if((!RPL_ROUTE_IS_DAO_PENDING(rep) &&
-          rep->state.dao_seqno_in == sequence) ||
-          dag->rank == ROOT_RANK(instance)) {
-        should_ack = 1;
+      if(!is_root && (rep == NULL || RPL_ROUTE_IS_DAO_PENDING(rep) ||
+                      rep->state.dao_seqno_in != sequence)) {
+        ack_now = 0;
       }
-    }
 
-    if(dag->preferred_parent != NULL &&
-        rpl_get_parent_ipaddr(dag->preferred_parent) != NULL) {
-      uint8_t out_seq = 0;
-      /* if this is pending and we get the same seq no it is a retrans */
-      if(RPL_ROUTE_IS_DAO_PENDING(rep) &&
-          rep->state.dao_seqno_in == sequence) {
-        /* keep the same seq-no as before for parent also */
-        out_seq = rep->state.dao_seqno_out;
-      } else {
-        out_seq = prepare_for_dao_fwd(sequence, rep);
+      if(dag->preferred_parent != NULL &&
+          rpl_get_parent_ipaddr(dag->preferred_parent) != NULL) {
+        dao_fwd_add(instance, target, rep, sequence);
       }
+    } else {
+      ack_now = 0;
+    }
+  }
 
-      PRINTF("RPL: Forwarding DAO to parent ");
-      PRINT6ADDR(rpl_get_parent_ipaddr(dag->preferred_parent));
-      PRINTF(" in seq: %d out seq: %d\n", sequence, out_seq);
+  if(status >= RPL_DAO_ACK_UNABLE_TO_ACCEPT) {
+    RPL_STAT(rpl_stats.dao_dropped++);
+  }
 
-      buffer = UIP_ICMP_PAYLOAD;
-      buffer[3] = out_seq; /* add an outgoing seq no before fwd */
-      uip_icmp6_send(rpl_get_parent_ipaddr(dag->preferred_parent),
-          ICMP6_RPL, RPL_CODE_DAO, buffer_length);
-    }
+  if(RPL_DAO_AGGREGATION_DELAY == 0) {
+    dao_fwd_flush();
+  }
 
-    if(should_ack) {
+  if(flags & RPL_DAO_K_FLAG) {
+    if(status >= RPL_DAO_ACK_UNABLE_TO_ACCEPT || ack_now) {
       PRINTF("RPL: Sending DAO ACK\n\r");
-      uip_clear_buf();
-      dao_ack_output(instance, &dao_sender_addr, sequence,
-          RPL_DAO_ACK_UNCONDITIONAL_ACCEPT);
+      dao_ack_send(instance, &dao_sender_addr, sequence, status, is_root);
     }
   }
 
@@ -904,20 +1165,15 @@ dao_input_nonstoring(void)
   unsigned char *buffer;
   uint16_t sequence;
   uint8_t instance_id;
-  uint8_t lifetime;
-  uint8_t prefixlen;
   uint8_t flags;
-  uint8_t subopt_type;
-  uip_ipaddr_t prefix;
+  uint8_t status;
+  struct dao_target *target;
   uint8_t buffer_length;
   int pos;
-  int len;
   int i;
-
-  prefixlen = 0;
+  int num_targets;
 
   uip_ipaddr_copy(&dao_sender_addr, &UIP_IP_BUF->srcipaddr);
-  memset(&dao_parent_addr, 0, 16);
 
   buffer = UIP_ICMP_PAYLOAD;
   buffer_length = uip_len - uip_l3_icmp_hdr_len;
@@ -925,7 +1181,6 @@ dao_input_nonstoring(void)
   pos = 0;
   instance_id = buffer[pos++];
   instance = rpl_get_instance(instance_id);
-  lifetime = instance->default_lifetime;
 
   flags = buffer[pos++];
   /* reserved */
@@ -937,62 +1192,50 @@ dao_input_nonstoring(void)
   if(flags & RPL_DAO_D_FLAG) {
     if(memcmp(&dag->dag_id, &buffer[pos], sizeof(dag->dag_id))) {
       PRINTF("RPL: Ignoring a DAO for a DAG different from ours\n");
+      RPL_STAT(rpl_stats.dao_dropped++);
       return;
     }
     pos += 16;
   }
 
-  /* Check if there are any RPL options present. */
-  for(i = pos; i < buffer_length; i += len) {
-    subopt_type = buffer[i];
-    if(subopt_type == RPL_OPTION_PAD1) {
-      len = 1;
+  /* A DAO may carry several targets, each with the parent address of the
+   * transit information following it. */
+  num_targets = dao_parse_targets(buffer, pos, buffer_length,
+                                  instance->default_lifetime);
+
+  status = RPL_DAO_ACK_UNCONDITIONAL_ACCEPT;
+  for(i = 0; i < num_targets; i++) {
+    target = &dao_in_targets[i];
+    if(target->parent_pos != 0) {
+      memcpy(&dao_parent_addr, buffer + target->parent_pos, 16);
     } else {
-      /* The option consists of a two-byte header and a payload. */
-      len = 2 + buffer[i + 1];
+      memset(&dao_parent_addr, 0, 16);
     }
 
-    switch(subopt_type) {
-    case RPL_OPTION_TARGET:
-      /* Handle the target option. */
-      prefixlen = buffer[i + 3];
-      memset(&prefix, 0, sizeof(prefix));
-      memcpy(&prefix, buffer + i + 4, (prefixlen + 7) / CHAR_BIT);
-      break;
-    case RPL_OPTION_TRANSIT:
-      /* The path sequence and control are ignored. */
-      /*      pathcontrol = buffer[i + 3];
-                pathsequence = buffer[i + 4];*/
-      lifetime = buffer[i + 5];
-      if(len >= 20) {
-        memcpy(&dao_parent_addr, buffer + i + 6, 16);
-      }
-      break;
+    PRINTF("RPL: DAO lifetime: %u, prefix length: %u prefix: ",
+        (unsigned)target->lifetime, (unsigned)target->prefixlen);
+    PRINT6ADDR(&target->prefix);
+    PRINTF(", parent: ");
+    PRINT6ADDR(&dao_parent_addr);
+    PRINTF(" \n");
+
+    if(target->lifetime == RPL_ZERO_LIFETIME) {
+      PRINTF("RPL: No-Path DAO received\n");
+      rpl_ns_expire_parent(dag, &target->prefix, &dao_parent_addr);
+    } else if(rpl_ns_update_node(dag, &target->prefix, &dao_parent_addr,
+                                 RPL_LIFETIME(instance, target->lifetime)) == NULL) {
+      PRINTF("RPL: failed to add link\n");
+      status = RPL_DAO_ACK_UNABLE_TO_ADD_ROUTE_AT_ROOT;
     }
   }
 
-  PRINTF("RPL: DAO lifetime: %u, prefix length: %u prefix: ",
-      (unsigned)lifetime, (unsigned)prefixlen);
-  PRINT6ADDR(&prefix);
-  PRINTF(", parent: ");
-  PRINT6ADDR(&dao_parent_addr);
-  PRINTF(" \n");
-
-  if(lifetime == RPL_ZERO_LIFETIME) {
-    PRINTF("RPL: No-Path DAO received\n");
-    rpl_ns_expire_parent(dag, &prefix, &dao_parent_addr);
-  } else {
-    if(rpl_ns_update_node(dag, &prefix, &dao_parent_addr, RPL_LIFETIME(instance, lifetime)) == NULL) {
-      PRINTF("RPL: failed to add link\n");
-      return;
-    }
+  if(status >= RPL_DAO_ACK_UNABLE_TO_ACCEPT) {
+    RPL_STAT(rpl_stats.dao_dropped++);
   }
 
   if(flags & RPL_DAO_K_FLAG) {
     PRINTF("RPL: Sending DAO ACK\n");
-    uip_clear_buf();
-    dao_ack_output(instance, &dao_sender_addr, sequence,
-        RPL_DAO_ACK_UNCONDITIONAL_ACCEPT);
+    dao_ack_send(instance, &dao_sender_addr, sequence, status, 1);
   }
 #endif /* RPL_WITH_NON_STORING */
 }
@@ -1002,17 +1245,26 @@ dao_input(void)
 {
   rpl_instance_t *instance;
   uint8_t instance_id;
+#if RPL_CONF_STATS
+  clock_time_t received;
+  clock_time_t latency;
+
+  received = bsp_getTick();
+#endif /* RPL_CONF_STATS */
 
   /* Destination Advertisement Object */
   PRINTF("RPL: Received a DAO from ");
   PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
   PRINTF("\n");
 
+  RPL_STAT(rpl_stats.dao_received++);
+
   instance_id = UIP_ICMP_PAYLOAD[0];
   instance = rpl_get_instance(instance_id);
   if(instance == NULL) {
     PRINTF("RPL: Ignoring a DAO for an unknown RPL instance(%u)\n",
         instance_id);
+    RPL_STAT(rpl_stats.dao_dropped++);
     goto discard;
   }
 
@@ -1022,6 +1274,13 @@ dao_input(void)
     dao_input_nonstoring();
   }
 
+#if RPL_CONF_STATS
+  latency = bsp_getTick() - received;
+  if(latency > rpl_stats.dao_latency_max) {
+    rpl_stats.dao_latency_max = latency;
+  }
+#endif /* RPL_CONF_STATS */
+
  discard:
   uip_clear_buf();
 }
@@ -1306,30 +1565,53 @@ dao_ack_input(void)
 #endif
 
   } else if(RPL_IS_STORING(instance)) {
-	/* this DAO ACK should be forwarded to another recently registered route */
+    /* this DAO ACK should be forwarded to the children whose targets
+       were aggregated in the acknowledged DAO */
     uip_ds6_route_t *re;
+    uip_ds6_route_t *next;
     uip_ipaddr_t *nexthop;
-    if((re = find_route_entry_by_dao_ack(sequence)) != NULL) {
+    uip_ipaddr_t *acked_nexthop[RPL_DAO_AGGREGATION_MAX_TARGETS];
+    uint8_t acked_seqno[RPL_DAO_AGGREGATION_MAX_TARGETS];
+    int num_acked;
+    int i;
+
+    num_acked = 0;
+    for(re = uip_ds6_route_head(); re != NULL; re = next) {
+      next = uip_ds6_route_next(re);
+      if(re->state.dao_seqno_out != sequence || !RPL_ROUTE_IS_DAO_PENDING(re)) {
+        continue;
+      }
       /* pick the recorded seq no from that node and forward DAO ACK - and
          clear the pending flag*/
       RPL_ROUTE_CLEAR_DAO_PENDING(re);
 
       nexthop = uip_ds6_route_nexthop(re);
+      /* A child gets a single DAO ACK for all the targets of its DAO */
+      for(i = 0; i < num_acked; i++) {
+        if(acked_nexthop[i] == nexthop && acked_seqno[i] == re->state.dao_seqno_in) {
+          break;
+        }
+      }
       if(nexthop == NULL) {
     	PRINTF("RPL: No next hop to fwd DAO ACK to\n\r");
-      } else {
+      } else if(i == num_acked) {
     	PRINTF("RPL: Fwd DAO ACK to:");
     	PRINT6ADDR(nexthop);
     	PRINTF("\n\r");
-        buffer[2] = re->state.dao_seqno_in;
-        uip_icmp6_send(nexthop, ICMP6_RPL, RPL_CODE_DAO_ACK, 4);
+        if(num_acked < RPL_DAO_AGGREGATION_MAX_TARGETS) {
+          acked_nexthop[num_acked] = nexthop;
+          acked_seqno[num_acked] = re->state.dao_seqno_in;
+          num_acked++;
+        }
+        dao_ack_output(instance, nexthop, re->state.dao_seqno_in, status);
       }
 
       if(status >= RPL_DAO_ACK_UNABLE_TO_ACCEPT) {
         /* this node did not get in to the routing tables above... - remove */
         uip_ds6_route_rm(re);
       }
-    } else {
+    }
+    if(num_acked == 0) {
       PRINTF("RPL: No route entry found to forward DAO ACK (seqno %u)\n\r", sequence);
     }
   }
@@ -110,6 +110,7 @@ dao_ack_callback(rpl_parent_t *p, int status)
     /* punish the total lack of ACK with a similar punishment */
 	link_stats_packet_sent(rpl_get_parent_lladdr(p), MAC_TX_OK, 10);
   }
+  rpl_parent_set_update(p);
 }
 #endif /* RPL_WITH_DAO_ACK */
 /*---------------------------------------------------------------------------*/
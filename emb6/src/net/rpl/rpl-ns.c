@@ -51,7 +51,7 @@
 #if RPL_WITH_NON_STORING
 
 #define DEBUG DEBUG_NONE
-#include "net/ip/uip-debug.h"
+#include "uip-debug.h"
 
 #include <limits.h>
 #include <string.h>
@@ -63,6 +63,12 @@ static int num_nodes;
 LIST(nodelist);
 MEMB(nodememb, rpl_ns_node_t, RPL_NS_LINK_NUM);
 
+/* Nodes hashed by link identifier */
+static rpl_ns_node_t *nodehash[RPL_NS_HASH_SIZE];
+
+/* Version of the source routes, see rpl_ns_topology_version() */
+static uint16_t topology_version;
+
 /*---------------------------------------------------------------------------*/
 int
 rpl_ns_num_nodes(void)
@@ -70,6 +76,36 @@ rpl_ns_num_nodes(void)
   return num_nodes;
 }
 /*---------------------------------------------------------------------------*/
+uint16_t
+rpl_ns_topology_version(void)
+{
+  return topology_version;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned
+node_hash(const unsigned char *link_identifier)
+{
+  unsigned h = 0;
+  int i;
+  for(i = 0; i < 8; i++) {
+    h = (h * 31) + link_identifier[i];
+  }
+  return h & (RPL_NS_HASH_SIZE - 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+node_hash_remove(rpl_ns_node_t *node)
+{
+  rpl_ns_node_t **l;
+  for(l = &nodehash[node_hash(node->link_identifier)]; *l != NULL;
+      l = &(*l)->hash_next) {
+    if(*l == node) {
+      *l = node->hash_next;
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
 static int
 node_matches_address(const rpl_dag_t *dag, const rpl_ns_node_t *node, const uip_ipaddr_t *addr)
 {
@@ -85,7 +121,11 @@ rpl_ns_node_t *
 rpl_ns_get_node(const rpl_dag_t *dag, const uip_ipaddr_t *addr)
 {
   rpl_ns_node_t *l;
-  for(l = list_head(nodelist); l != NULL; l = list_item_next(l)) {
+  if(addr == NULL) {
+    return NULL;
+  }
+  for(l = nodehash[node_hash(((const unsigned char *)addr) + 8)]; l != NULL;
+      l = l->hash_next) {
     /* Compare prefix and node identifier */
     if(node_matches_address(dag, l, addr)) {
       return l;
@@ -123,6 +163,8 @@ rpl_ns_update_node(rpl_dag_t *dag, const uip_ipaddr_t *child, const uip_ipaddr_t
   rpl_ns_node_t *child_node = rpl_ns_get_node(dag, child);
   rpl_ns_node_t *parent_node = rpl_ns_get_node(dag, parent);
   rpl_ns_node_t *old_parent_node;
+  rpl_dag_t *old_dag;
+  unsigned h;
 
   if(parent != NULL) {
     /* No node for the parent, add one with infinite lifetime */
@@ -142,18 +184,23 @@ rpl_ns_update_node(rpl_dag_t *dag, const uip_ipaddr_t *child, const uip_ipaddr_t
       return NULL;
     }
     child_node->parent = NULL;
+    child_node->dag = NULL;
     list_add(nodelist, child_node);
     num_nodes++;
+    memcpy(child_node->link_identifier, ((const unsigned char *)child) + 8, 8);
+    h = node_hash(child_node->link_identifier);
+    child_node->hash_next = nodehash[h];
+    nodehash[h] = child_node;
   }
 
   /* Initialize node */
+  old_dag = child_node->dag;
+  old_parent_node = child_node->parent;
   child_node->dag = dag;
   child_node->lifetime = lifetime;
-  memcpy(child_node->link_identifier, ((const unsigned char *)child) + 8, 8);
 
   /* Is the node reachable before the update? */
   if(rpl_ns_is_node_reachable(dag, child)) {
-    old_parent_node = child_node->parent;
     /* Update node */
     child_node->parent = parent_node;
     /* Has the node become unreachable? May happen if we create a loop. */
@@ -167,6 +214,10 @@ rpl_ns_update_node(rpl_dag_t *dag, const uip_ipaddr_t *child, const uip_ipaddr_t
     child_node->parent = parent_node;
   }
 
+  if(child_node->parent != old_parent_node || child_node->dag != old_dag) {
+    topology_version++;
+  }
+
   return child_node;
 }
 /*---------------------------------------------------------------------------*/
@@ -176,6 +227,8 @@ rpl_ns_init(void)
   num_nodes = 0;
   memb_init(&nodememb);
   list_init(nodelist);
+  memset(nodehash, 0, sizeof(nodehash));
+  topology_version++;
 }
 /*---------------------------------------------------------------------------*/
 rpl_ns_node_t *
@@ -203,6 +256,7 @@ void
 rpl_ns_periodic(void)
 {
   rpl_ns_node_t *l;
+  rpl_ns_node_t *next;
   /* First pass, decrement lifetime for all nodes with non-infinite lifetime */
   for(l = list_head(nodelist); l != NULL; l = list_item_next(l)) {
     /* Don't touch infinite lifetime nodes */
@@ -211,7 +265,8 @@ rpl_ns_periodic(void)
     }
   }
   /* Second pass, for all expire nodes, deallocate them iff no child points to them */
-  for(l = list_head(nodelist); l != NULL; l = list_item_next(l)) {
+  for(l = list_head(nodelist); l != NULL; l = next) {
+    next = list_item_next(l);
     if(l->lifetime == 0) {
       rpl_ns_node_t *l2;
       for(l2 = list_head(nodelist); l2 != NULL; l2 = list_item_next(l2)) {
@@ -220,9 +275,13 @@ rpl_ns_periodic(void)
         }
       }
       /* No child found, deallocate node */
-      list_remove(nodelist, l);
-      memb_free(&nodememb, l);
-      num_nodes--;
+      if(l2 == NULL) {
+        node_hash_remove(l);
+        list_remove(nodelist, l);
+        memb_free(&nodememb, l);
+        num_nodes--;
+        topology_version++;
+      }
     }
   }
 }
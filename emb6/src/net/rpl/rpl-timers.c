@@ -107,6 +107,84 @@ handle_periodic_timer(void *ptr)
   ctimer_reset(&periodic_timer);
 }
 /*---------------------------------------------------------------------------*/
+#if RPL_WITH_ADAPTIVE_TRICKLE
+/* Minimum DIO interval currently in use: the advertised one, raised by
+ * the adaptive trickle while the topology is stable. */
+static uint8_t
+dio_intmin(rpl_instance_t *instance)
+{
+  return instance->dio_intmin +
+    MIN(instance->trickle.imin_boost, instance->dio_intdoubl);
+}
+/*---------------------------------------------------------------------------*/
+/* DIO redundancy constant currently in use. A redundancy of 0 disables
+ * suppression and is kept as is. */
+static uint8_t
+dio_redundancy(rpl_instance_t *instance)
+{
+  uint8_t k;
+
+  k = instance->dio_redundancy;
+  if(k > RPL_TRICKLE_MIN_REDUNDANCY) {
+    k = MAX(k - instance->trickle.redundancy_cut, RPL_TRICKLE_MIN_REDUNDANCY);
+  }
+  return k;
+}
+/*---------------------------------------------------------------------------*/
+/* Called at the end of each DIO interval: steps towards fewer DIOs after
+ * RPL_TRICKLE_STABLE_INTERVALS stable intervals and falls back to the
+ * advertised parameters after an unstable one. */
+static void
+trickle_interval_end(rpl_instance_t *instance)
+{
+  struct rpl_trickle_stats *t = &instance->trickle;
+
+  t->intervals++;
+  t->consistent += instance->dio_counter;
+  t->win_consistent += instance->dio_counter;
+
+  if(t->win_parent_changes == 0 &&
+     (uint32_t)t->win_inconsistent * RPL_TRICKLE_CONSISTENCY_RATIO <=
+     t->win_consistent) {
+    if(++t->stable_intervals >= RPL_TRICKLE_STABLE_INTERVALS) {
+      t->stable_intervals = 0;
+      if(t->imin_boost < RPL_TRICKLE_MAX_IMIN_BOOST) {
+        t->imin_boost++;
+      }
+      if(instance->dio_redundancy - t->redundancy_cut > RPL_TRICKLE_MIN_REDUNDANCY) {
+        t->redundancy_cut++;
+      }
+      PRINTF("RPL: Topology stable, DIO Imin %u k %u\n\r",
+             dio_intmin(instance), dio_redundancy(instance));
+    }
+  } else {
+    t->stable_intervals = 0;
+    t->imin_boost = 0;
+    t->redundancy_cut = 0;
+  }
+
+  t->win_consistent = 0;
+  t->win_inconsistent = 0;
+  t->win_parent_changes = 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_trickle_parent_changed(rpl_instance_t *instance)
+{
+  struct rpl_trickle_stats *t = &instance->trickle;
+
+  t->parent_changes++;
+  t->win_parent_changes++;
+  /* React to the change with the advertised parameters right away */
+  t->stable_intervals = 0;
+  t->imin_boost = 0;
+  t->redundancy_cut = 0;
+}
+#else /* RPL_WITH_ADAPTIVE_TRICKLE */
+#define dio_intmin(instance)     ((instance)->dio_intmin)
+#define dio_redundancy(instance) ((instance)->dio_redundancy)
+#endif /* RPL_WITH_ADAPTIVE_TRICKLE */
+/*---------------------------------------------------------------------------*/
 static void
 new_dio_interval(rpl_instance_t *instance)
 {
@@ -176,22 +254,34 @@ handle_dio_timer(void *ptr)
 
   if(instance->dio_send) {
       PRINTF("RPL: Trying DIO transmission (%d >= %d)\n\r",
-                   instance->dio_counter, instance->dio_redundancy);
+                   instance->dio_counter, dio_redundancy(instance));
     /* send DIO if counter is less than desired redundancy */
-    if(instance->dio_redundancy == 0 || instance->dio_counter < instance->dio_redundancy) {
+    if(dio_redundancy(instance) == 0 || instance->dio_counter < dio_redundancy(instance)) {
 #if RPL_CONF_STATS
       instance->dio_totsend++;
 #endif /* RPL_CONF_STATS */
+#if RPL_WITH_ADAPTIVE_TRICKLE
+      instance->trickle.dio_sent++;
+#endif /* RPL_WITH_ADAPTIVE_TRICKLE */
       dio_output(instance, NULL);
     } else {
     	PRINTF("RPL: Suppressing DIO transmission (%d >= %d)\n\r",
-             instance->dio_counter, instance->dio_redundancy);
+             instance->dio_counter, dio_redundancy(instance));
+#if RPL_WITH_ADAPTIVE_TRICKLE
+      instance->trickle.dio_suppressed++;
+#endif /* RPL_WITH_ADAPTIVE_TRICKLE */
     }
     instance->dio_send = 0;
     PRINTF("RPL: Scheduling DIO timer %lu ticks in future (sent)\n\r",
            instance->dio_next_delay);
     ctimer_set(&instance->dio_timer, instance->dio_next_delay, handle_dio_timer, instance);
   } else {
+#if RPL_WITH_ADAPTIVE_TRICKLE
+    trickle_interval_end(instance);
+    if(instance->dio_intcurrent < dio_intmin(instance)) {
+      instance->dio_intcurrent = dio_intmin(instance);
+    } else
+#endif /* RPL_WITH_ADAPTIVE_TRICKLE */
     /* check if we need to double interval */
     if(instance->dio_intcurrent < instance->dio_intmin + instance->dio_intdoubl) {
       instance->dio_intcurrent++;
@@ -219,11 +309,15 @@ void
 rpl_reset_dio_timer(rpl_instance_t *instance)
 {
 #if !RPL_LEAF_ONLY
+#if RPL_WITH_ADAPTIVE_TRICKLE
+  instance->trickle.inconsistent++;
+  instance->trickle.win_inconsistent++;
+#endif /* RPL_WITH_ADAPTIVE_TRICKLE */
   /* Do not reset if we are already on the minimum interval,
      unless forced to do so. */
-  if(instance->dio_intcurrent > instance->dio_intmin) {
+  if(instance->dio_intcurrent > dio_intmin(instance)) {
     instance->dio_counter = 0;
-    instance->dio_intcurrent = instance->dio_intmin;
+    instance->dio_intcurrent = dio_intmin(instance);
     new_dio_interval(instance);
   }
 #if RPL_CONF_STATS
@@ -392,19 +486,45 @@ get_probing_delay(rpl_dag_t *dag)
   }
 }
 /*---------------------------------------------------------------------------*/
+/* Could p become our preferred parent? Even over a perfect link, the rank
+ * via p is at least its own rank plus MinHopRankIncrease */
+static int
+probing_is_candidate(rpl_dag_t *dag, rpl_parent_t *p)
+{
+  if(p->dag != dag || p->rank == INFINITE_RANK) {
+    return 0;
+  }
+  if(p == dag->preferred_parent) {
+    return 1;
+  }
+  return (uint32_t)p->rank + dag->instance->min_hoprankinc < dag->rank;
+}
+/*---------------------------------------------------------------------------*/
+/* Is the link to p kept up to date by unicast traffic already? */
+static int
+probing_is_piggybacked(rpl_parent_t *p)
+{
+  const struct link_stats *stats = rpl_get_parent_link_stats(p);
+
+  return stats != NULL && stats->freshness > 0
+      && bsp_getTick() - stats->last_tx_time < RPL_PROBING_PIGGYBACK_TIME;
+}
+/*---------------------------------------------------------------------------*/
 rpl_parent_t *
 get_probing_target(rpl_dag_t *dag)
 {
  /* Returns the next probing target. The current implementation probes the urgent
   * probing target if any, or the preferred parent if its link statistics need refresh.
-  * Otherwise, it picks at random between:
-  * (1) selecting the best parent with non-fresh link statistics
-  * (2) selecting the least recently updated parent
+  * Otherwise, it picks the non-fresh neighbor with the largest expected rank
+  * improvement, and falls back to the least recently updated one.
+  * Neighbors that could never become the preferred parent, that were probed
+  * in the current probing window, or whose link is refreshed by unicast
+  * traffic are not probed.
   */
 
   rpl_parent_t *p;
   rpl_parent_t *probing_target = NULL;
-  rpl_rank_t probing_target_rank = INFINITE_RANK;
+  int32_t probing_target_gain = 0;
   clock_time_t probing_target_age = 0;
   clock_time_t clock_now = bsp_getTick();
 
@@ -419,25 +539,30 @@ get_probing_target(rpl_dag_t *dag)
   }
 
   /* The preferred parent needs probing */
-  if(dag->preferred_parent != NULL && !rpl_parent_is_fresh(dag->preferred_parent)) {
+  if(dag->preferred_parent != NULL && !rpl_parent_is_fresh(dag->preferred_parent)
+      && !(dag->preferred_parent->flags & RPL_PARENT_FLAG_PROBED)
+      && !probing_is_piggybacked(dag->preferred_parent)) {
     return dag->preferred_parent;
   }
 
-  /* With 50% probability: probe best non-fresh parent */
-  if(random_rand() % 2 == 0) {
-    p = nbr_table_head(rpl_parents);
-    while(p != NULL) {
-      if(p->dag == dag && !rpl_parent_is_fresh(p)) {
-        /* p is in our dag and needs probing */
-    	rpl_rank_t p_rank = rpl_rank_via_parent(p);
-        if(probing_target == NULL
-            || p_rank < probing_target_rank) {
-          probing_target = p;
-          probing_target_rank = p_rank;
-        }
+  /* Probe the non-fresh neighbor with the largest expected rank gain, the
+   * least recently updated one on a tie */
+  p = nbr_table_head(rpl_parents);
+  while(p != NULL) {
+    if(probing_is_candidate(dag, p) && !rpl_parent_is_fresh(p)
+        && !(p->flags & RPL_PARENT_FLAG_PROBED) && !probing_is_piggybacked(p)) {
+      const struct link_stats *stats = rpl_get_parent_link_stats(p);
+      int32_t p_gain = (int32_t)dag->rank - rpl_rank_via_parent(p);
+      clock_time_t p_age = stats != NULL ? clock_now - stats->last_tx_time : 0;
+      if(probing_target == NULL
+          || p_gain > probing_target_gain
+          || (p_gain == probing_target_gain && p_age > probing_target_age)) {
+        probing_target = p;
+        probing_target_gain = p_gain;
+        probing_target_age = p_age;
       }
-      p = nbr_table_next(rpl_parents, p);
     }
+    p = nbr_table_next(rpl_parents, p);
   }
 
   /* If we still do not have a probing target: pick the least recently updated parent */
@@ -445,7 +570,8 @@ get_probing_target(rpl_dag_t *dag)
     p = nbr_table_head(rpl_parents);
     while(p != NULL) {
       const struct link_stats *stats =rpl_get_parent_link_stats(p);
-      if(p->dag == dag && stats != NULL) {
+      if(probing_is_candidate(dag, p) && stats != NULL
+          && !(p->flags & RPL_PARENT_FLAG_PROBED) && !probing_is_piggybacked(p)) {
         if(probing_target == NULL
             || clock_now - stats->last_tx_time > probing_target_age) {
           probing_target = p;
@@ -459,26 +585,58 @@ get_probing_target(rpl_dag_t *dag)
   return probing_target;
 }
 /*---------------------------------------------------------------------------*/
+/* Starts a new probing window once RPL_PROBING_INTERVAL has elapsed: the
+ * airtime budget is refilled and every neighbor may be probed again */
+static void
+probing_window_update(rpl_instance_t *instance)
+{
+  rpl_parent_t *p;
+
+  if(bsp_getTick() - instance->probing_window_start < RPL_PROBING_INTERVAL) {
+    return;
+  }
+  instance->probing_window_start = bsp_getTick();
+  instance->probing_airtime = 0;
+  for(p = nbr_table_head(rpl_parents); p != NULL; p = nbr_table_next(rpl_parents, p)) {
+    p->flags &= ~RPL_PARENT_FLAG_PROBED;
+  }
+}
+/*---------------------------------------------------------------------------*/
 static void
 handle_probing_timer(void *ptr)
 {
   rpl_instance_t *instance = (rpl_instance_t *)ptr;
-  rpl_parent_t *probing_target = RPL_PROBING_SELECT_FUNC(instance->current_dag);
-  uip_ipaddr_t *target_ipaddr = rpl_get_parent_ipaddr(probing_target);
+  rpl_parent_t *probing_target;
+  uip_ipaddr_t *target_ipaddr;
+  uint8_t probes = 0;
+
+  probing_window_update(instance);
+
+  /* Send a batch of probes within the airtime budget. Beyond the first one,
+   * only neighbors whose statistics need refresh are probed */
+  while(instance->probing_airtime + RPL_PROBING_PROBE_AIRTIME <= RPL_PROBING_MAX_AIRTIME) {
+    probing_target = RPL_PROBING_SELECT_FUNC(instance->current_dag);
+    target_ipaddr = rpl_get_parent_ipaddr(probing_target);
+    if(target_ipaddr == NULL) {
+      break;
+    }
+    if(probes > 0 && (rpl_parent_is_fresh(probing_target)
+        || (probing_target->flags & RPL_PARENT_FLAG_PROBED))) {
+      break;
+    }
 
-  /* Perform probing */
-  if(target_ipaddr != NULL) {
-    const struct link_stats *stats = rpl_get_parent_link_stats(probing_target);
-    (void)stats;
     PRINTF("RPL: probing %u %s last tx %u min ago\n",
     	rpl_get_parent_lladdr(probing_target)->u8[7],
         instance->urgent_probing_target != NULL ? "(urgent)" : "",
-        probing_target != NULL ?
-        (unsigned)((clock_time() - stats->last_tx_time) / (60 * bsp_getTRes())) : 0
+        rpl_get_parent_link_stats(probing_target) != NULL ?
+        (unsigned)((bsp_getTick() - rpl_get_parent_link_stats(probing_target)->last_tx_time) / (60 * bsp_getTRes())) : 0
         );
     /* Send probe, e.g. unicast DIO or DIS */
     RPL_PROBING_SEND_FUNC(instance, target_ipaddr);
+    probing_target->flags |= RPL_PARENT_FLAG_PROBED;
+    instance->probing_airtime += RPL_PROBING_PROBE_AIRTIME;
     instance->urgent_probing_target = NULL;
+    probes++;
   }
 
   /* Schedule next probing */
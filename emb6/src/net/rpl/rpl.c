@@ -143,7 +143,7 @@ rpl_purge_routes(void)
     if(r->state.lifetime < 1) {
       /* Routes with lifetime == 1 have only just been decremented from 2 to 1,
        * thus we want to keep them. Hence < and not <= */
-      uip_ipaddr_copy(&prefix, &r->ipaddr);
+      uip_ds6_route_ipaddr(r, &prefix);
       uip_ds6_route_rm(r);
       r = uip_ds6_route_head();
       PRINTF("No more routes to ");
@@ -233,7 +233,8 @@ rpl_add_route(rpl_dag_t *dag, uip_ipaddr_t *prefix, int prefix_len,
 {
   uip_ds6_route_t *rep;
 
-  if((rep = uip_ds6_route_add(prefix, prefix_len, next_hop)) == NULL) {
+  if((rep = uip_ds6_route_add_table(prefix, prefix_len, next_hop,
+                                    RPL_ROUTE_TABLE(dag->instance))) == NULL) {
     PRINTF("RPL: No space for more route entries\n\r");
     return NULL;
   }
@@ -252,6 +253,80 @@ rpl_add_route(rpl_dag_t *dag, uip_ipaddr_t *prefix, int prefix_len,
   return rep;
 }
 /*---------------------------------------------------------------------------*/
+uip_ds6_route_t *
+rpl_route_lookup(uip_ipaddr_t *addr)
+{
+#if RPL_MAX_INSTANCES > 1
+  rpl_instance_t *instance = rpl_get_output_instance();
+
+  if(instance != NULL) {
+    return uip_ds6_route_lookup_table(addr, RPL_ROUTE_TABLE(instance));
+  }
+#endif /* RPL_MAX_INSTANCES > 1 */
+  return uip_ds6_route_lookup(addr);
+}
+/*---------------------------------------------------------------------------*/
+uip_ipaddr_t *
+rpl_defrt_choose(void)
+{
+#if RPL_MAX_INSTANCES > 1
+  rpl_instance_t *instance = rpl_get_output_instance();
+
+  if(instance != NULL && instance->def_route != NULL) {
+    return &instance->def_route->ipaddr;
+  }
+#endif /* RPL_MAX_INSTANCES > 1 */
+  return uip_ds6_defrt_choose();
+}
+/*---------------------------------------------------------------------------*/
+#if RPL_WITH_FAST_REROUTE
+/* The preferred parent that failed last, and the parent replacing it */
+static linkaddr_t rerouted_from;
+static rpl_parent_t *rerouted_to;
+/*---------------------------------------------------------------------------*/
+static void
+local_reroute(rpl_parent_t *parent)
+{
+  if(rpl_local_reroute(parent)) {
+    linkaddr_copy(&rerouted_from, rpl_get_parent_lladdr(parent));
+    rerouted_to = parent->dag->preferred_parent;
+  }
+}
+#endif /* RPL_WITH_FAST_REROUTE */
+/*---------------------------------------------------------------------------*/
+/* Returns the link-layer address of the new preferred parent if the
+ * transmission to addr just failed and RPL switched to a backup parent.
+ * The answer is given only once per reroute. */
+const linkaddr_t *
+rpl_get_reroute_nexthop(const linkaddr_t *addr)
+{
+#if RPL_WITH_FAST_REROUTE
+  rpl_parent_t *p = rerouted_to;
+
+  rerouted_to = NULL;
+  if(p != NULL && linkaddr_cmp(addr, &rerouted_from)
+      && p->dag != NULL && p->dag->preferred_parent == p) {
+    return rpl_get_parent_lladdr(p);
+  }
+#endif /* RPL_WITH_FAST_REROUTE */
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Tells whether addr is a preferred parent that RPL would replace by a
+ * backup parent right away if the transmission to it failed. */
+int
+rpl_has_backup_parent(const linkaddr_t *addr)
+{
+#if RPL_WITH_FAST_REROUTE
+  rpl_parent_t *p = rpl_get_parent((uip_lladdr_t *)addr);
+
+  return p != NULL && p->dag != NULL && p->dag->preferred_parent == p
+      && p->dag->backup_parent != NULL;
+#else /* RPL_WITH_FAST_REROUTE */
+  return 0;
+#endif /* RPL_WITH_FAST_REROUTE */
+}
+/*---------------------------------------------------------------------------*/
 void
 rpl_link_neighbor_callback(const linkaddr_t *addr, int status, int numtx)
 {
@@ -270,6 +345,13 @@ rpl_link_neighbor_callback(const linkaddr_t *addr, int status, int numtx)
         /* Trigger DAG rank recalculation. */
         PRINTF("RPL: rpl_link_neighbor_callback triggering update\n\r");
         parent->flags |= RPL_PARENT_FLAG_UPDATED;
+        /* The link metric changed */
+        rpl_parent_set_update(parent);
+#if RPL_WITH_FAST_REROUTE
+        if(status == MAC_TX_NOACK) {
+          local_reroute(parent);
+        }
+#endif /* RPL_WITH_FAST_REROUTE */
       }
     }
   }
@@ -293,7 +375,15 @@ rpl_ipv6_neighbor_callback(uip_ds6_nbr_t *nbr)
     if(instance->used == 1 ) {
       p = rpl_find_parent_any_dag(instance, &nbr->ipaddr);
       if(p != NULL) {
+#if RPL_WITH_FAST_REROUTE
+        if(nbr->state == NBR_REMOVED) {
+          /* the neighbor is gone, e.g. NUD failed, do not wait for the
+           * parent selection */
+          local_reroute(p);
+        }
+#endif /* RPL_WITH_FAST_REROUTE */
         p->rank = INFINITE_RANK;
+        rpl_parent_set_update(p);
         /* Trigger DAG rank recalculation. */
         PRINTF("RPL: rpl_ipv6_neighbor_callback infinite rank\n\r");
         p->flags |= RPL_PARENT_FLAG_UPDATED;
@@ -65,12 +65,14 @@
 #include "emb6.h"
 
 #include "timer.h"
+#include "ctimer.h"
 //#include "dev/watchdog.h"
 #include "link-stats.h"
 #include "bsp.h"
 #include "tcpip.h"
 #include "uip.h"
 #include "uip-ds6.h"
+#include "uip-icmp6.h"
 #include "rime.h"
 #include "sicslowpan.h"
 
@@ -83,6 +85,10 @@
 
 #include "uip-ds6-nbr.h"
 
+#if UIP_CONF_IPV6_RPL
+#include "rpl.h"
+#endif /* UIP_CONF_IPV6_RPL */
+
 
 
 
@@ -194,6 +200,93 @@ void uip_log(char *msg);
 #define SICSLOWPAN_FIXED_HDRLEN 21
 #endif
 
+/** \brief Generic header compression (RFC 7400) of UDP and RPL messages.
+    GHC is only applied when it lets the packet fit into a single frame. */
+#if defined(SICSLOWPAN_CONF_GHC) && SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
+#define SICSLOWPAN_GHC SICSLOWPAN_CONF_GHC
+#else
+#define SICSLOWPAN_GHC 0
+#endif
+
+/** \brief Minimum size of a UDP or ICMPv6 message for GHC to be tried */
+#ifdef SICSLOWPAN_CONF_GHC_THRESHOLD
+#define SICSLOWPAN_GHC_THRESHOLD SICSLOWPAN_CONF_GHC_THRESHOLD
+#else
+#define SICSLOWPAN_GHC_THRESHOLD 32
+#endif
+
+/** \brief Maximum distance of a GHC backreference searched for. The
+    default reaches the whole dictionary from the first 16 bytes of a
+    message. Bounds the time spent per byte on the TX path. */
+#ifdef SICSLOWPAN_CONF_GHC_WINDOW
+#define SICSLOWPAN_GHC_WINDOW SICSLOWPAN_CONF_GHC_WINDOW
+#else
+#define SICSLOWPAN_GHC_WINDOW 64
+#endif
+
+/** \brief Maximum length of a GHC backreference searched for */
+#ifdef SICSLOWPAN_CONF_GHC_MAX_MATCH
+#define SICSLOWPAN_GHC_MAX_MATCH SICSLOWPAN_CONF_GHC_MAX_MATCH
+#else
+#define SICSLOWPAN_GHC_MAX_MATCH 32
+#endif
+
+/** \brief Bitmap of the address contexts whose nodes support GHC at
+    startup. Changed at runtime with sicslowpan_set_context_ghc(). */
+#ifdef SICSLOWPAN_CONF_GHC_CONTEXTS
+#define SICSLOWPAN_GHC_CONTEXTS SICSLOWPAN_CONF_GHC_CONTEXTS
+#else
+#define SICSLOWPAN_GHC_CONTEXTS 0x01
+#endif
+
+/** \brief Use GHC towards link-local and link-scope multicast
+    destinations, e.g. for RPL control messages. Only enable this when
+    all neighbours are known to support GHC, as they cannot signal it
+    (RFC 7400, 3.3). */
+#ifdef SICSLOWPAN_CONF_GHC_LINK_LOCAL
+#define SICSLOWPAN_GHC_LINK_LOCAL SICSLOWPAN_CONF_GHC_LINK_LOCAL
+#else
+#define SICSLOWPAN_GHC_LINK_LOCAL 0
+#endif
+
+/** \brief Cache of the IPHC headers of recent flows. Packets of a known
+    flow get a copy of the cached header with the hop limit and the UDP
+    checksum patched in. */
+#if defined(SICSLOWPAN_CONF_FLOW_CACHE) && SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
+#define SICSLOWPAN_FLOW_CACHE SICSLOWPAN_CONF_FLOW_CACHE
+#else
+#define SICSLOWPAN_FLOW_CACHE 0
+#endif
+
+/** \brief Number of flows whose IPHC header is cached */
+#ifdef SICSLOWPAN_CONF_FLOW_CACHE_ENTRIES
+#define SICSLOWPAN_FLOW_CACHE_ENTRIES SICSLOWPAN_CONF_FLOW_CACHE_ENTRIES
+#else
+#define SICSLOWPAN_FLOW_CACHE_ENTRIES 4
+#endif
+
+#if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 16
+#error "IPHC context identifiers are 4 bits, at most 16 contexts"
+#endif
+
+/** \brief Buckets of the prefix index of the address contexts, a power
+    of two of at least twice the number of contexts */
+#ifdef SICSLOWPAN_CONF_CONTEXT_HASH_SIZE
+#define SICSLOWPAN_CONTEXT_HASH_SIZE SICSLOWPAN_CONF_CONTEXT_HASH_SIZE
+#elif SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS <= 4
+#define SICSLOWPAN_CONTEXT_HASH_SIZE 8
+#else
+#define SICSLOWPAN_CONTEXT_HASH_SIZE 32
+#endif
+
+/** \brief Time in seconds an expired context is still used for
+    decompression (MIN_CONTEXT_CHANGE_DELAY, RFC 6775) */
+#ifdef SICSLOWPAN_CONF_CONTEXT_CHANGE_DELAY
+#define SICSLOWPAN_CONTEXT_CHANGE_DELAY SICSLOWPAN_CONF_CONTEXT_CHANGE_DELAY
+#else
+#define SICSLOWPAN_CONTEXT_CHANGE_DELAY 300
+#endif
+
 /** \name General variables
  *  @{
  */
@@ -273,6 +366,64 @@ static uint16_t my_tag;
 /* Assuming that the worst growth for uncompression is 38 bytes */
 #define SICSLOWPAN_FIRST_FRAGMENT_SIZE (SICSLOWPAN_FRAGMENT_SIZE + 38)
 
+/* Fragment forwarding: a router relays the fragments of a datagram that
+ * is not addressed to itself as soon as they arrive instead of
+ * reassembling the whole datagram first. */
+#if defined(SICSLOWPAN_CONF_FRAG_FORWARDING) && UIP_CONF_ROUTER
+#define SICSLOWPAN_FRAG_FORWARDING SICSLOWPAN_CONF_FRAG_FORWARDING
+#else
+#define SICSLOWPAN_FRAG_FORWARDING 0
+#endif
+
+/* FRAG_FWD_ENTRIES corresponds to the number of datagrams that can be
+ * forwarded simultaneously. */
+#ifdef SICSLOWPAN_CONF_FRAG_FWD_ENTRIES
+#define SICSLOWPAN_FRAG_FWD_ENTRIES SICSLOWPAN_CONF_FRAG_FWD_ENTRIES
+#else
+#define SICSLOWPAN_FRAG_FWD_ENTRIES 4
+#endif
+
+/* Selective fragment recovery (RFC 8931): datagrams are sent as
+ * recoverable fragments and the receiver acknowledges them with a
+ * bitmap, so that only the fragments that got lost are sent again. */
+#ifdef SICSLOWPAN_CONF_SFR
+#define SICSLOWPAN_SFR SICSLOWPAN_CONF_SFR
+#else
+#define SICSLOWPAN_SFR 0
+#endif
+
+/* SFR_RX_CONTEXTS corresponds to the number of simultaneous
+ * reassemblies of recoverable fragments. Each context holds a whole
+ * compressed datagram since fragments may arrive in any order. */
+#ifdef SICSLOWPAN_CONF_SFR_RX_CONTEXTS
+#define SICSLOWPAN_SFR_RX_CONTEXTS SICSLOWPAN_CONF_SFR_RX_CONTEXTS
+#else
+#define SICSLOWPAN_SFR_RX_CONTEXTS 1
+#endif
+
+/* Time (in ms) to wait for an RFRAG-ACK before requesting it again */
+#ifdef SICSLOWPAN_CONF_SFR_ACK_TIMEOUT
+#define SICSLOWPAN_SFR_ACK_TIMEOUT SICSLOWPAN_CONF_SFR_ACK_TIMEOUT
+#else
+#define SICSLOWPAN_SFR_ACK_TIMEOUT 1000
+#endif
+
+/* Number of recovery rounds before a datagram is given up */
+#ifdef SICSLOWPAN_CONF_SFR_MAX_RETRIES
+#define SICSLOWPAN_SFR_MAX_RETRIES SICSLOWPAN_CONF_SFR_MAX_RETRIES
+#else
+#define SICSLOWPAN_SFR_MAX_RETRIES 3
+#endif
+
+/* The 5 bit sequence number and the 32 bit acknowledgment bitmap limit
+ * the number of recoverable fragments per datagram */
+#define SICSLOWPAN_SFR_MAX_FRAGMENTS 32
+
+/* RFRAG-ACK bitmaps, bit 31 acknowledges the fragment with sequence 0 */
+#define SICSLOWPAN_SFR_BITMAP_NULL 0x00000000UL
+#define SICSLOWPAN_SFR_BITMAP_FULL 0xffffffffUL
+#define SICSLOWPAN_SFR_BIT(seq)    (0x80000000UL >> (seq))
+
 /* all information needed for reassembly */
 struct sicslowpan_frag_info {
   /** When reassembling, the source address of the fragments being merged */
@@ -379,6 +530,12 @@ add_fragment(uint16_t tag, uint16_t frag_size, uint8_t offset)
 	clear_fragments(i);
       }
 
+      /* A first fragment received again joins its datagram */
+      if(frag_info[i].len == frag_size && frag_info[i].tag == tag &&
+         linkaddr_cmp(&frag_info[i].sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))) {
+        return i;
+      }
+
       /* We use len as indication on used or not used */
       if(found < 0 && frag_info[i].len == 0) {
         /* We remember the first free fragment info but must continue
@@ -395,6 +552,8 @@ add_fragment(uint16_t tag, uint16_t frag_size, uint8_t offset)
     /* Found a free fragment info to store data in */
     frag_info[found].len = frag_size;
     frag_info[found].tag = tag;
+    frag_info[found].reassembled_len = 0;
+    frag_info[found].first_frag_len = 0;
     linkaddr_copy(&frag_info[found].sender,
                   packetbuf_addr(PACKETBUF_ADDR_SENDER));
     timer_set(&frag_info[found].reass_timer, SICSLOWPAN_REASS_MAXAGE * bsp_getTRes() / 16);
@@ -455,6 +614,113 @@ copy_frags2uip(int context)
   /* deallocate all the fragments for this context */
   clear_fragments(context);
 }
+
+#if SICSLOWPAN_FRAG_FORWARDING
+/* all information needed to switch the fragments of a datagram */
+struct sicslowpan_frag_fwd {
+  /** The link layer address of the previous hop */
+  linkaddr_t sender;
+  /** The link layer address of the next hop */
+  linkaddr_t next_hop;
+  /** The tag used by the previous hop */
+  uint16_t in_tag;
+  /** The tag used towards the next hop */
+  uint16_t out_tag;
+  /** Total length of the datagram (if zero this entry is not used) */
+  uint16_t len;
+  /** Number of bytes of the datagram forwarded so far */
+  uint16_t forwarded_len;
+  /** The entry is released when this timer expires */
+  struct timer lifetime;
+};
+
+static struct sicslowpan_frag_fwd frag_fwd[SICSLOWPAN_FRAG_FWD_ENTRIES];
+
+/*---------------------------------------------------------------------------*/
+/* find the switching entry of the datagram with the given tag */
+static struct sicslowpan_frag_fwd *
+frag_fwd_lookup(const linkaddr_t *sender, uint16_t tag)
+{
+  int i;
+  for(i = 0; i < SICSLOWPAN_FRAG_FWD_ENTRIES; i++) {
+    if(frag_fwd[i].len > 0 && timer_expired(&frag_fwd[i].lifetime)) {
+      frag_fwd[i].len = 0;
+    }
+    if(frag_fwd[i].len > 0 && frag_fwd[i].in_tag == tag &&
+       linkaddr_cmp(&frag_fwd[i].sender, sender)) {
+      return &frag_fwd[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* get a free switching entry */
+static struct sicslowpan_frag_fwd *
+frag_fwd_alloc(void)
+{
+  int i;
+  for(i = 0; i < SICSLOWPAN_FRAG_FWD_ENTRIES; i++) {
+    if(frag_fwd[i].len == 0 || timer_expired(&frag_fwd[i].lifetime)) {
+      frag_fwd[i].len = 0;
+      return &frag_fwd[i];
+    }
+  }
+  return NULL;
+}
+#endif /* SICSLOWPAN_FRAG_FORWARDING */
+
+#if SICSLOWPAN_SFR
+/* Datagram being sent as recoverable fragments. The datagram is kept in
+ * its compressed form, which is what RFRAG offsets refer to. */
+struct sicslowpan_sfr_tx {
+  /** The link layer destination of the fragments */
+  linkaddr_t dest;
+  /** Size of the compressed datagram (if zero no datagram is pending) */
+  uint16_t size;
+  /** Number of bytes of the datagram carried by each fragment */
+  uint16_t frag_len;
+  /** Datagram tag of the fragments */
+  uint8_t tag;
+  /** Number of fragments of the datagram */
+  uint8_t count;
+  /** Number of recovery rounds done so far */
+  uint8_t retries;
+  /** Timer to request an acknowledgment again */
+  struct ctimer ack_timer;
+  /** The compressed datagram */
+  uint8_t data[UIP_BUFSIZE];
+};
+
+static struct sicslowpan_sfr_tx sfr_tx;
+
+/* States of a reassembly context for recoverable fragments */
+#define SICSLOWPAN_SFR_RX_FREE     0
+#define SICSLOWPAN_SFR_RX_ACTIVE   1
+#define SICSLOWPAN_SFR_RX_COMPLETE 2
+
+/* Reassembly of recoverable fragments. A completed context is kept
+ * until it times out so that a lost final RFRAG-ACK can be repeated. */
+struct sicslowpan_sfr_rx {
+  /** The source address of the fragments being merged */
+  linkaddr_t sender;
+  /** Size of the compressed datagram (zero until sequence 0 arrived) */
+  uint16_t size;
+  /** Number of bytes of the compressed datagram received so far */
+  uint16_t received_len;
+  /** Fragments received so far, in RFRAG-ACK bitmap format */
+  uint32_t bitmap;
+  /** Reassembly %process %timer. */
+  struct timer reass_timer;
+  /** The tag in the fragments being merged */
+  uint8_t tag;
+  /** State of the context */
+  uint8_t state;
+  /** The compressed datagram */
+  uint8_t data[UIP_BUFSIZE];
+};
+
+static struct sicslowpan_sfr_rx sfr_rx[SICSLOWPAN_SFR_RX_CONTEXTS];
+#endif /* SICSLOWPAN_SFR */
 #endif /* SICSLOWPAN_CONF_FRAG */
 
 /* -------------------------------------------------------------------------- */
@@ -519,6 +785,18 @@ set_packet_attrs(void)
 #if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
 static struct sicslowpan_addr_context 
 addr_contexts[SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS];
+
+#define ADDR_CONTEXT_NONE 0xff
+
+/** Index of the context of each CID, ADDR_CONTEXT_NONE if unused. */
+static uint8_t addr_context_cid[16];
+
+/** Open addressing index of the contexts usable for compression,
+    hashed by their 64 bit prefix. */
+static uint8_t addr_context_hash[SICSLOWPAN_CONTEXT_HASH_SIZE];
+
+/** Expires contexts with a finite lifetime. */
+static struct ctimer addr_context_timer;
 #endif
 
 /** pointer to an address context. */
@@ -527,6 +805,9 @@ static struct sicslowpan_addr_context *context;
 /** pointer to the byte where to write next inline field. */
 static uint8_t *hc06_ptr;
 
+/** pointer to the end of the compressed packet being uncompressed. */
+static uint8_t *hc06_end;
+
 /* Uncompression of linklocal */
 /*   0 -> 16 bytes from packet  */
 /*   1 -> 2 bytes from prefix - bunch of zeroes and 8 from packet */
@@ -555,24 +836,89 @@ const uint8_t llprefix[] = {0xfe, 0x80};
 
 /* TTL uncompression values */
 static const uint8_t ttl_values[] = {0, 1, 64, 255};
+
+#if SICSLOWPAN_GHC
+/* GHC dictionary: the source and destination addresses followed by
+   16 static bytes (RFC 7400, section 3.3) */
+#define GHC_DICT_LEN (2 * sizeof(uip_ipaddr_t) + sizeof(ghc_static_dict))
+static const uint8_t ghc_static_dict[] = {
+  0x16, 0xfe, 0xfd, 0x17, 0xfe, 0xfd, 0x00, 0x01,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00
+};
+
+/* GHC output is built here before it replaces the NHC */
+static uint8_t ghc_buf[MAC_MAX_PAYLOAD];
+#endif /* SICSLOWPAN_GHC */
+
+#if SICSLOWPAN_FLOW_CACHE
+/* Largest IPHC header: encoding, CID, TF, NH, HLIM, two inline
+   addresses and LOWPAN_UDP with inline ports and checksum */
+#define FLOW_CACHE_HDR_LEN (3 + 4 + 1 + 1 + 2 * 16 + 7)
+
+/* A flow is identified by the fields that determine its IPHC header */
+struct sicslowpan_flow {
+  /** L2 destination, needed for the IID compression of the destination */
+  linkaddr_t dest;
+  uip_ipaddr_t srcipaddr;
+  uip_ipaddr_t destipaddr;
+  /** version, traffic class and flow label */
+  uint8_t vtcflow[4];
+  uint16_t srcport;
+  uint16_t destport;
+  uint8_t proto;
+  /** hop limit encoding (SICSLOWPAN_IPHC_TTL_xx) */
+  uint8_t ttl_enc;
+  /** uncomp_hdr_len after compression */
+  uint8_t uncomp_len;
+  /** length of the cached header (if zero the entry is not used) */
+  uint8_t hdr_len;
+  /** offset of the inline hop limit, zero if it is compressed */
+  uint8_t ttl_offset;
+  uint8_t hdr[FLOW_CACHE_HDR_LEN];
+};
+
+static struct sicslowpan_flow flow_cache[SICSLOWPAN_FLOW_CACHE_ENTRIES];
+/* Entry to be replaced next */
+static uint8_t flow_cache_next;
+#endif /* SICSLOWPAN_FLOW_CACHE */
 /** @} */
 
 /*--------------------------------------------------------------------*/
 /** \name IPHC related functions
  * @{                                                                 */
 /*--------------------------------------------------------------------*/
+#if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
+/** \brief bucket of a 64 bit prefix in addr_context_hash */
+static uint8_t
+addr_context_hash_key(const uint8_t *prefix)
+{
+  uint8_t h = 0;
+  int i;
+  for(i = 0; i < 8; i++) {
+    h = ((h << 3) | (h >> 5)) ^ prefix[i];
+  }
+  return h & (SICSLOWPAN_CONTEXT_HASH_SIZE - 1);
+}
+#endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
+/*--------------------------------------------------------------------*/
 /** \brief find the context corresponding to prefix ipaddr */
 static struct sicslowpan_addr_context*
 addr_context_lookup_by_prefix(uip_ipaddr_t *ipaddr)
 {
 /* Remove code to avoid warnings and save flash if no context is used */
 #if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
-  int i;
-  for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
-    if((addr_contexts[i].used == 1) &&
-       uip_ipaddr_prefixcmp(&addr_contexts[i].prefix, ipaddr, 64)) {
+  uint8_t h, i, n;
+  h = addr_context_hash_key(ipaddr->u8);
+  /* the index is never full, an empty bucket ends the probe sequence */
+  for(n = 0; n < SICSLOWPAN_CONTEXT_HASH_SIZE; n++) {
+    i = addr_context_hash[h];
+    if(i == ADDR_CONTEXT_NONE) {
+      break;
+    }
+    if(memcmp(addr_contexts[i].prefix, ipaddr->u8, 8) == 0) {
       return &addr_contexts[i];
     }
+    h = (h + 1) & (SICSLOWPAN_CONTEXT_HASH_SIZE - 1);
   }
 #endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
   return NULL;
@@ -584,12 +930,9 @@ addr_context_lookup_by_number(uint8_t number)
 {
 /* Remove code to avoid warnings and save flash if no context is used */ 
 #if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
-  int i;
-  for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
-    if((addr_contexts[i].used == 1) &&
-       addr_contexts[i].number == number) {
-      return &addr_contexts[i];
-    }
+  if((number < sizeof(addr_context_cid)) &&
+     (addr_context_cid[number] != ADDR_CONTEXT_NONE)) {
+    return &addr_contexts[addr_context_cid[number]];
   }
 #endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
   return NULL;
@@ -655,95 +998,551 @@ uncompress_addr(uip_ipaddr_t *ipaddr, uint8_t const prefix[],
   PRINTF("\n\r");
 }
 
+#if SICSLOWPAN_GHC
+/*--------------------------------------------------------------------*/
+/** \name GHC (RFC 7400) related functions
+ * @{                                                                 */
+/*--------------------------------------------------------------------*/
+static int get_max_payload(linkaddr_t *dest);
 /*--------------------------------------------------------------------*/
 /**
- * \brief Compress IP/UDP header
- *
- * This function is called by the 6lowpan code to create a compressed
- * 6lowpan packet in the packetbuf buffer from a full IPv6 packet in the
- * uip_buf buffer.
- *
- *
- * IPHC (RFC 6282)\n
- * http://tools.ietf.org/html/
- *
- * \note We do not support ISA100_UDP header compression
+ * \brief Byte of the GHC window, which is the dictionary followed by
+ * the uncompressed data
+ * \param addrs source and destination address of the packet
+ * \param data the uncompressed data
+ * \param idx index in data, negative indexes are in the dictionary
+ */
+static uint8_t
+ghc_window(const uint8_t *addrs, const uint8_t *data, int idx)
+{
+  if(idx >= 0) {
+    return data[idx];
+  }
+  idx += GHC_DICT_LEN;
+  if(idx < 2 * sizeof(uip_ipaddr_t)) {
+    return addrs[idx];
+  }
+  return ghc_static_dict[idx - 2 * sizeof(uip_ipaddr_t)];
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Number of 101nssss bytecodes a backreference needs
+ * \param n length of the reference
+ * \param s distance of the reference (s >= n)
+ */
+static int
+ghc_ext_count(int n, int s)
+{
+  int na = (n - 2) >> 3;
+  int sa = (((s - n) >> 3) + 14) / 15;
+
+  return na > sa ? na : sa;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Compress data with GHC
+ * \param addrs source and destination address of the packet
+ * \param in data to compress
+ * \param len length of the data
+ * \param out buffer for the compressed data
+ * \param max_len size of the output buffer
+ * \return length of the compressed data, 0 if it does not fit
  *
- * For LOWPAN_UDP compression, we either compress both ports or none.
- * General format with LOWPAN_UDP compression is
- * \verbatim
- *                      1                   2                   3
- *  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
- * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- * |0|1|1|TF |N|HLI|C|S|SAM|M|D|DAM| SCI   | DCI   | comp. IPv6 hdr|
- * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- * | compressed IPv6 fields .....                                  |
- * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- * | LOWPAN_UDP    | non compressed UDP fields ...                 |
- * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- * | L4 data ...                                                   |
- * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- * \endverbatim
- * \note The context number 00 is reserved for the link local prefix.
- * For unicast addresses, if we cannot compress the prefix, we neither
- * compress the IID.
- * \param link_destaddr L2 destination address, needed to compress IP
- * dest
+ * Greedy LZ77: at each position the longest reference into the
+ * dictionary and the data already coded is used if it saves space.
+ * References are searched within SICSLOWPAN_GHC_WINDOW bytes and up to
+ * SICSLOWPAN_GHC_MAX_MATCH bytes long. Compression is given up as soon
+ * as the rest of the data cannot fit into the output buffer any more,
+ * even as runs of zeros, the densest code.
  */
-static void
-compress_hdr_iphc(linkaddr_t *link_destaddr)
+static int
+ghc_compress(const uint8_t *addrs, const uint8_t *in, int len,
+             uint8_t *out, int max_len)
 {
-  uint8_t tmp, iphc0, iphc1;
-#if DEBUG
-  { uint16_t ndx;
-    PRINTF("before compression (%d): ", UIP_IP_BUF->len[1]);
-    for(ndx = 0; ndx < UIP_IP_BUF->len[1] + 40; ndx++) {
-      uint8_t data = ((uint8_t *) (UIP_IP_BUF))[ndx];
-      PRINTF("%02x", data);
+  int i = 0;
+  int o = 0;
+  int lit = -1;
+  int n, s, j, best_n, best_s, max_s, max_n, zeros, na, sa;
+
+  while(i < len) {
+    if(o + (len - i + 16) / 17 > max_len) {
+      /* does not pay off */
+      return 0;
     }
-    PRINTF("\n\r");
-  }
-#endif
 
-  hc06_ptr = packetbuf_ptr + 2;
-  /*
-   * As we copy some bit-length fields, in the IPHC encoding bytes,
-   * we sometimes use |=
-   * If the field is 0, and the current bit value in memory is 1,
-   * this does not work. We therefore reset the IPHC encoding here
-   */
+    for(zeros = 0; i + zeros < len && zeros < 17 && in[i + zeros] == 0; zeros++);
 
-  iphc0 = SICSLOWPAN_DISPATCH_IPHC;
-  iphc1 = 0;
-  PACKETBUF_IPHC_BUF[2] = 0; /* might not be used - but needs to be cleared */
+    /* Longest match, the nearest one wins on equal length */
+    best_n = 0;
+    best_s = 0;
+    max_s = i + (int)GHC_DICT_LEN;
+    if(max_s > SICSLOWPAN_GHC_WINDOW) {
+      max_s = SICSLOWPAN_GHC_WINDOW;
+    }
+    max_n = len - i;
+    if(max_n > SICSLOWPAN_GHC_MAX_MATCH) {
+      max_n = SICSLOWPAN_GHC_MAX_MATCH;
+    }
+    for(s = 2; s <= max_s && best_n < max_n; s++) {
+      for(n = 0; n < s && n < max_n &&
+          ghc_window(addrs, in, i + n - s) == in[i + n]; n++);
+      if(n > best_n) {
+        best_n = n;
+        best_s = s;
+      }
+    }
 
-  /*
-   * Address handling needs to be made first since it might
-   * cause an extra byte with [ SCI | DCI ]
-   *
-   */
+    if(zeros >= 2 &&
+       (best_n < 2 || best_n - ghc_ext_count(best_n, best_s) <= zeros)) {
+      n = zeros;
+    } else if(best_n >= 2 && best_n > 1 + ghc_ext_count(best_n, best_s)) {
+      n = best_n;
+    } else {
+      /* Append to the pending literal run, lit is its bytecode */
+      if(lit < 0 || out[lit] == SICSLOWPAN_GHC_APPEND_MAX) {
+        if(o >= max_len) {
+          return 0;
+        }
+        lit = o;
+        out[o++] = 0;
+      }
+      if(o >= max_len) {
+        return 0;
+      }
+      out[o++] = in[i++];
+      out[lit]++;
+      continue;
+    }
 
+    lit = -1;
+    if(n == zeros) {
+      if(o >= max_len) {
+        return 0;
+      }
+      out[o++] = SICSLOWPAN_GHC_ZEROS | (n - 2);
+    } else {
+      /* n = na + nnn + 2 and s = sa + kkk + n, na and sa in units of 8 */
+      s = best_s - n;
+      na = (n - 2) >> 3;
+      sa = s >> 3;
+      j = ghc_ext_count(n, best_s);
+      if(o + j + 1 > max_len) {
+        return 0;
+      }
+      for(; j > 0; j--) {
+        out[o++] = SICSLOWPAN_GHC_EXT | (na > 0 ? 0x10 : 0) | (sa > 15 ? 15 : sa);
+        na -= na > 0 ? 1 : 0;
+        sa -= sa > 15 ? 15 : sa;
+      }
+      out[o++] = SICSLOWPAN_GHC_BACKREF | (((n - 2) & 0x07) << 3) | (s & 0x07);
+    }
+    i += n;
+  }
+  return o;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Decompress GHC data
+ * \param addrs source and destination address of the packet
+ * \param in compressed data
+ * \param len length of the compressed data
+ * \param out buffer for the decompressed data
+ * \param max_len size of the output buffer
+ * \return length of the decompressed data, -1 if it is malformed
+ */
+static int
+ghc_decompress(const uint8_t *addrs, const uint8_t *in, int len,
+               uint8_t *out, int max_len)
+{
+  int i = 0;
+  int o = 0;
+  int na = 0;
+  int sa = 0;
+  int n, s;
+  uint8_t code;
+
+  while(i < len) {
+    code = in[i++];
+    if((code & 0x80) == 0) {
+      /* 0kkkkkkk: append k bytes */
+      n = code;
+      if(n > SICSLOWPAN_GHC_APPEND_MAX || i + n > len || o + n > max_len) {
+        return -1;
+      }
+      memcpy(out + o, in + i, n);
+      i += n;
+      o += n;
+    } else if((code & 0xf0) == SICSLOWPAN_GHC_ZEROS) {
+      /* 1000nnnn: append n + 2 zeroes */
+      n = (code & 0x0f) + 2;
+      if(o + n > max_len) {
+        return -1;
+      }
+      memset(out + o, 0, n);
+      o += n;
+    } else if(code == SICSLOWPAN_GHC_STOP) {
+      break;
+    } else if((code & 0xe0) == SICSLOWPAN_GHC_EXT) {
+      /* 101nssss: extend the next backreference */
+      na += (code & 0x10) >> 1;
+      sa += (code & 0x0f) << 3;
+    } else if((code & 0xc0) == SICSLOWPAN_GHC_BACKREF) {
+      /* 11nnnkkk: copy n bytes from s bytes back */
+      n = na + ((code >> 3) & 0x07) + 2;
+      s = (code & 0x07) + sa + n;
+      if(s > o + (int)GHC_DICT_LEN || o + n > max_len) {
+        return -1;
+      }
+      for(; n > 0; n--, o++) {
+        out[o] = ghc_window(addrs, out, o - s);
+      }
+      na = 0;
+      sa = 0;
+    } else {
+      return -1;
+    }
+  }
+  return o;
+}
+/*--------------------------------------------------------------------*/
+/** \brief Check whether GHC may be used for the packet in uip_buf */
+static int
+ghc_applicable(void)
+{
+  struct sicslowpan_addr_context *ctx;
 
-  /* check if dest context exists (for allocating third byte) */
-  /* TODO: fix this so that it remembers the looked up values for
-     avoiding two lookups - or set the lookup values immediately */
-  if(addr_context_lookup_by_prefix(&UIP_IP_BUF->destipaddr) != NULL ||
-     addr_context_lookup_by_prefix(&UIP_IP_BUF->srcipaddr) != NULL) {
-    /* set context flag and increase hc06_ptr */
-    PRINTF("IPHC: compressing dest or src ipaddr - setting CID\n\r");
-    iphc1 |= SICSLOWPAN_IPHC_CID;
-    hc06_ptr++;
+  /* The whole message is needed, so this does not work for the header
+     of a forwarded fragment */
+  if(uip_len - UIP_IPH_LEN < SICSLOWPAN_GHC_THRESHOLD ||
+     uip_len != ((UIP_IP_BUF->len[0] << 8) | UIP_IP_BUF->len[1]) + UIP_IPH_LEN) {
+    return 0;
+  }
+  if(UIP_IP_BUF->proto != UIP_PROTO_UDP &&
+     (UIP_IP_BUF->proto != UIP_PROTO_ICMP6 || UIP_ICMP_BUF->type != ICMP6_RPL)) {
+    return 0;
   }
 
-  /*
-   * Traffic class, flow label
-   * If flow label is 0, compress it. If traffic class is 0, compress it
-   * We have to process both in the same time as the offset of traffic class
-   * depends on the presence of version and flow label
-   */
+  /* The destination must be known to decompress GHC */
+  if(uip_is_addr_linklocal(&UIP_IP_BUF->destipaddr) ||
+     (uip_is_addr_mcast(&UIP_IP_BUF->destipaddr) &&
+      (UIP_IP_BUF->destipaddr.u8[1] & 0x0f) == 0x02)) {
+    return SICSLOWPAN_GHC_LINK_LOCAL;
+  }
+  ctx = addr_context_lookup_by_prefix(&UIP_IP_BUF->destipaddr);
+  return ctx != NULL && ctx->ghc;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Replace the compressed next header of an IPHC header by the
+ * GHC compressed UDP or ICMPv6 message, if that makes it fit into one
+ * frame.
+ * \param link_destaddr L2 destination address
+ * \param iphc0 first IPHC encoding byte, the NH flag gets set
+ * \param nh_ptr position of the inline next header field
+ * \param nhc_ptr position of the NHC
+ * \return the new end of the IPHC header
+ */
+static uint8_t *
+ghc_compress_nh(linkaddr_t *link_destaddr, uint8_t *iphc0,
+                uint8_t *nh_ptr, uint8_t *nhc_ptr)
+{
+  int hdr_len, max_len, len;
 
-  /* IPHC format of tc is ECN | DSCP , original is DSCP | ECN */
-  tmp = (UIP_IP_BUF->vtc << 4) | (UIP_IP_BUF->tcflow >> 4);
+  /* Header length without the NHC or the inline next header */
+  if(*iphc0 & SICSLOWPAN_IPHC_NH_C) {
+    hdr_len = nhc_ptr - packetbuf_ptr;
+  } else {
+    hdr_len = hc06_ptr - packetbuf_ptr - 1;
+  }
+
+  /* The compressed packet must fit into a frame and be smaller */
+  max_len = get_max_payload(link_destaddr);
+  if(max_len > (hc06_ptr - packetbuf_ptr) + uip_len - uncomp_hdr_len - 1) {
+    max_len = (hc06_ptr - packetbuf_ptr) + uip_len - uncomp_hdr_len - 1;
+  }
+  max_len -= hdr_len + 1;
+  if(max_len > sizeof(ghc_buf)) {
+    max_len = sizeof(ghc_buf);
+  }
+  if(max_len <= 0) {
+    return hc06_ptr;
+  }
+
+  len = ghc_compress(&UIP_IP_BUF->srcipaddr.u8[0], &uip_buf[UIP_LLIPH_LEN],
+                     uip_len - UIP_IPH_LEN, ghc_buf, max_len);
+  if(len == 0) {
+    return hc06_ptr;
+  }
+  PRINTF("IPHC: GHC compressed %d bytes into %d\n\r", uip_len - UIP_IPH_LEN, len);
+
+  if((*iphc0 & SICSLOWPAN_IPHC_NH_C) == 0) {
+    /* elide the inline next header */
+    memmove(nh_ptr, nh_ptr + 1, hc06_ptr - nh_ptr - 1);
+    *iphc0 |= SICSLOWPAN_IPHC_NH_C;
+  }
+  nhc_ptr = packetbuf_ptr + hdr_len;
+  *nhc_ptr = (UIP_IP_BUF->proto == UIP_PROTO_UDP) ?
+    SICSLOWPAN_NHC_GHC_UDP : SICSLOWPAN_NHC_GHC_ICMP6;
+  memcpy(nhc_ptr + 1, ghc_buf, len);
+  uncomp_hdr_len = uip_len;
+  return nhc_ptr + 1 + len;
+}
+/** @} */
+#endif /* SICSLOWPAN_GHC */
+#if SICSLOWPAN_FLOW_CACHE
+/*--------------------------------------------------------------------*/
+/** \name IPHC flow cache related functions
+ * @{                                                                 */
+/*--------------------------------------------------------------------*/
+/** \brief Hop limit encoding used by IPHC for the packet in uip_buf */
+static uint8_t
+flow_cache_ttl_enc(void)
+{
+  switch(UIP_IP_BUF->ttl) {
+    case 1:
+      return SICSLOWPAN_IPHC_TTL_1;
+    case 64:
+      return SICSLOWPAN_IPHC_TTL_64;
+    case 255:
+      return SICSLOWPAN_IPHC_TTL_255;
+    default:
+      return SICSLOWPAN_IPHC_TTL_I;
+  }
+}
+/*--------------------------------------------------------------------*/
+/** \brief Drop all cached headers, e.g. after an address context changed */
+static void
+flow_cache_flush(void)
+{
+  int i;
+  for(i = 0; i < SICSLOWPAN_FLOW_CACHE_ENTRIES; i++) {
+    flow_cache[i].hdr_len = 0;
+  }
+}
+/*--------------------------------------------------------------------*/
+/** \brief Find the flow of the packet in uip_buf */
+static struct sicslowpan_flow *
+flow_cache_lookup(linkaddr_t *link_destaddr)
+{
+  struct sicslowpan_flow *f;
+  uint16_t srcport = 0;
+  uint16_t destport = 0;
+  int i;
+
+  if(UIP_IP_BUF->proto == UIP_PROTO_UDP) {
+    srcport = UIP_UDP_BUF->srcport;
+    destport = UIP_UDP_BUF->destport;
+  }
+  for(i = 0; i < SICSLOWPAN_FLOW_CACHE_ENTRIES; i++) {
+    f = &flow_cache[i];
+    if(f->hdr_len > 0 && f->proto == UIP_IP_BUF->proto &&
+       f->srcport == srcport && f->destport == destport &&
+       f->ttl_enc == flow_cache_ttl_enc() &&
+       memcmp(f->vtcflow, &UIP_IP_BUF->vtc, sizeof(f->vtcflow)) == 0 &&
+       uip_ipaddr_cmp(&f->destipaddr, &UIP_IP_BUF->destipaddr) &&
+       uip_ipaddr_cmp(&f->srcipaddr, &UIP_IP_BUF->srcipaddr) &&
+       linkaddr_cmp(&f->dest, link_destaddr)) {
+      return f;
+    }
+  }
+  return NULL;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Remember the IPHC header just built in packetbuf for the flow
+ * of the packet in uip_buf
+ */
+static void
+flow_cache_store(linkaddr_t *link_destaddr)
+{
+  struct sicslowpan_flow *f;
+  uint8_t iphc0;
+  uint8_t offset;
+
+  if(packetbuf_hdr_len > FLOW_CACHE_HDR_LEN) {
+    return;
+  }
+
+  f = &flow_cache[flow_cache_next];
+  flow_cache_next = (flow_cache_next + 1) % SICSLOWPAN_FLOW_CACHE_ENTRIES;
+
+  linkaddr_copy(&f->dest, link_destaddr);
+  uip_ipaddr_copy(&f->srcipaddr, &UIP_IP_BUF->srcipaddr);
+  uip_ipaddr_copy(&f->destipaddr, &UIP_IP_BUF->destipaddr);
+  memcpy(f->vtcflow, &UIP_IP_BUF->vtc, sizeof(f->vtcflow));
+  f->proto = UIP_IP_BUF->proto;
+  f->srcport = 0;
+  f->destport = 0;
+  if(f->proto == UIP_PROTO_UDP) {
+    f->srcport = UIP_UDP_BUF->srcport;
+    f->destport = UIP_UDP_BUF->destport;
+  }
+  f->ttl_enc = flow_cache_ttl_enc();
+  f->uncomp_len = uncomp_hdr_len;
+  f->hdr_len = packetbuf_hdr_len;
+  memcpy(f->hdr, packetbuf_ptr, packetbuf_hdr_len);
+
+  /* The inline hop limit follows the CID, TF and NH fields */
+  f->ttl_offset = 0;
+  if(f->ttl_enc == SICSLOWPAN_IPHC_TTL_I) {
+    iphc0 = f->hdr[0];
+    offset = 2;
+    if(f->hdr[1] & SICSLOWPAN_IPHC_CID) {
+      offset += 1;
+    }
+    switch(iphc0 & (SICSLOWPAN_IPHC_FL_C | SICSLOWPAN_IPHC_TC_C)) {
+      case 0:
+        offset += 4;
+        break;
+      case SICSLOWPAN_IPHC_TC_C:
+        offset += 3;
+        break;
+      case SICSLOWPAN_IPHC_FL_C:
+        offset += 1;
+        break;
+      default:
+        break;
+    }
+    if((iphc0 & SICSLOWPAN_IPHC_NH_C) == 0) {
+      offset += 1;
+    }
+    f->ttl_offset = offset;
+  }
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Put the cached IPHC header of the packet in uip_buf into
+ * packetbuf, patching the fields that change from packet to packet.
+ * \return 1 if the flow was cached, 0 otherwise
+ */
+static int
+flow_cache_compress(linkaddr_t *link_destaddr)
+{
+  struct sicslowpan_flow *f;
+
+  f = flow_cache_lookup(link_destaddr);
+  if(f == NULL) {
+    return 0;
+  }
+
+  memcpy(packetbuf_ptr, f->hdr, f->hdr_len);
+  if(f->ttl_offset > 0) {
+    packetbuf_ptr[f->ttl_offset] = UIP_IP_BUF->ttl;
+  }
+  if(f->uncomp_len > UIP_IPH_LEN) {
+    /* LOWPAN_UDP always ends with the inline checksum */
+    memcpy(packetbuf_ptr + f->hdr_len - 2, &UIP_UDP_BUF->udpchksum, 2);
+  }
+  packetbuf_hdr_len = f->hdr_len;
+  uncomp_hdr_len = f->uncomp_len;
+  return 1;
+}
+/** @} */
+#endif /* SICSLOWPAN_FLOW_CACHE */
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Compress IP/UDP header
+ *
+ * This function is called by the 6lowpan code to create a compressed
+ * 6lowpan packet in the packetbuf buffer from a full IPv6 packet in the
+ * uip_buf buffer.
+ *
+ *
+ * IPHC (RFC 6282)\n
+ * http://tools.ietf.org/html/
+ *
+ * \note We do not support ISA100_UDP header compression
+ *
+ * For LOWPAN_UDP compression, we either compress both ports or none.
+ * General format with LOWPAN_UDP compression is
+ * \verbatim
+ *                      1                   2                   3
+ *  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |0|1|1|TF |N|HLI|C|S|SAM|M|D|DAM| SCI   | DCI   | comp. IPv6 hdr|
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * | compressed IPv6 fields .....                                  |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * | LOWPAN_UDP    | non compressed UDP fields ...                 |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * | L4 data ...                                                   |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * \endverbatim
+ * \note The context number 00 is reserved for the link local prefix.
+ * For unicast addresses, if we cannot compress the prefix, we neither
+ * compress the IID.
+ * \param link_destaddr L2 destination address, needed to compress IP
+ * dest
+ */
+static void
+compress_hdr_iphc(linkaddr_t *link_destaddr)
+{
+  uint8_t tmp, iphc0, iphc1;
+#if SICSLOWPAN_GHC
+  uint8_t *nh_ptr, *nhc_ptr;
+#endif /* SICSLOWPAN_GHC */
+#if DEBUG
+  { uint16_t ndx;
+    PRINTF("before compression (%d): ", UIP_IP_BUF->len[1]);
+    for(ndx = 0; ndx < UIP_IP_BUF->len[1] + 40; ndx++) {
+      uint8_t data = ((uint8_t *) (UIP_IP_BUF))[ndx];
+      PRINTF("%02x", data);
+    }
+    PRINTF("\n\r");
+  }
+#endif
+
+#if SICSLOWPAN_FLOW_CACHE
+  /* Packets of a known flow reuse its header, unless GHC may apply */
+#if SICSLOWPAN_GHC
+  if(!ghc_applicable())
+#endif /* SICSLOWPAN_GHC */
+  {
+    if(flow_cache_compress(link_destaddr)) {
+      return;
+    }
+  }
+#endif /* SICSLOWPAN_FLOW_CACHE */
+
+  hc06_ptr = packetbuf_ptr + 2;
+  /*
+   * As we copy some bit-length fields, in the IPHC encoding bytes,
+   * we sometimes use |=
+   * If the field is 0, and the current bit value in memory is 1,
+   * this does not work. We therefore reset the IPHC encoding here
+   */
+
+  iphc0 = SICSLOWPAN_DISPATCH_IPHC;
+  iphc1 = 0;
+  PACKETBUF_IPHC_BUF[2] = 0; /* might not be used - but needs to be cleared */
+
+  /*
+   * Address handling needs to be made first since it might
+   * cause an extra byte with [ SCI | DCI ]
+   *
+   */
+
+
+  /* check if dest context exists (for allocating third byte) */
+  /* TODO: fix this so that it remembers the looked up values for
+     avoiding two lookups - or set the lookup values immediately */
+  if(addr_context_lookup_by_prefix(&UIP_IP_BUF->destipaddr) != NULL ||
+     addr_context_lookup_by_prefix(&UIP_IP_BUF->srcipaddr) != NULL) {
+    /* set context flag and increase hc06_ptr */
+    PRINTF("IPHC: compressing dest or src ipaddr - setting CID\n\r");
+    iphc1 |= SICSLOWPAN_IPHC_CID;
+    hc06_ptr++;
+  }
+
+  /*
+   * Traffic class, flow label
+   * If flow label is 0, compress it. If traffic class is 0, compress it
+   * We have to process both in the same time as the offset of traffic class
+   * depends on the presence of version and flow label
+   */
+
+  /* IPHC format of tc is ECN | DSCP , original is DSCP | ECN */
+  tmp = (UIP_IP_BUF->vtc << 4) | (UIP_IP_BUF->tcflow >> 4);
   tmp = ((tmp & 0x03) << 6) | (tmp >> 2);
 
   if(((UIP_IP_BUF->tcflow & 0x0F) == 0) &&
@@ -787,6 +1586,9 @@ compress_hdr_iphc(linkaddr_t *link_destaddr)
   }
 #endif /*UIP_CONF_UDP*/
 
+#if SICSLOWPAN_GHC
+  nh_ptr = hc06_ptr;
+#endif /* SICSLOWPAN_GHC */
   if ((iphc0 & SICSLOWPAN_IPHC_NH_C) == 0) {
     *hc06_ptr = UIP_IP_BUF->proto;
     hc06_ptr += 1;
@@ -898,6 +1700,9 @@ compress_hdr_iphc(linkaddr_t *link_destaddr)
   }
 
   uncomp_hdr_len = UIP_IPH_LEN;
+#if SICSLOWPAN_GHC
+  nhc_ptr = hc06_ptr;
+#endif /* SICSLOWPAN_GHC */
 
 #if UIP_CONF_UDP || UIP_CONF_ROUTER
   /* UDP header compression */
@@ -950,11 +1755,25 @@ compress_hdr_iphc(linkaddr_t *link_destaddr)
   }
 #endif /*UIP_CONF_UDP*/
 
+#if SICSLOWPAN_GHC
+  /* Compress the UDP or RPL message as well if it is worth it */
+  if(ghc_applicable()) {
+    hc06_ptr = ghc_compress_nh(link_destaddr, &iphc0, nh_ptr, nhc_ptr);
+  }
+#endif /* SICSLOWPAN_GHC */
+
   /* before the packetbuf_hdr_len operation */
   PACKETBUF_IPHC_BUF[0] = iphc0;
   PACKETBUF_IPHC_BUF[1] = iphc1;
 
   packetbuf_hdr_len = hc06_ptr - packetbuf_ptr;
+
+#if SICSLOWPAN_FLOW_CACHE
+  /* Headers with GHC data depend on the payload */
+  if(uncomp_hdr_len < uip_len) {
+    flow_cache_store(link_destaddr);
+  }
+#endif /* SICSLOWPAN_FLOW_CACHE */
   return;
 }
 
@@ -974,8 +1793,11 @@ compress_hdr_iphc(linkaddr_t *link_destaddr)
  * \param ip_len Equal to 0 if the packet is not a fragment (IP length
  * is then inferred from the L2 length), non 0 if the packet is a 1st
  * fragment.
+ * \return 1 on success, 0 if the header could not be uncompressed
+ *
+ * hc06_end must point to the end of the compressed packet.
  */
-static void
+static int
 uncompress_hdr_iphc(uint8_t *buf, uint16_t ip_len)
 {
   uint8_t tmp, iphc0, iphc1;
@@ -1060,7 +1882,7 @@ uncompress_hdr_iphc(uint8_t *buf, uint16_t ip_len)
       context = addr_context_lookup_by_number(sci);
       if(context == NULL) {
         PRINTF("sicslowpan uncompress_hdr: error context not found\n\r");
-        return;
+        return 0;
       }
     }
     /* if tmp == 0 we do not have a context and therefore no prefix */
@@ -1108,7 +1930,7 @@ uncompress_hdr_iphc(uint8_t *buf, uint16_t ip_len)
       /* all valid cases below need the context! */
       if(context == NULL) {
     PRINTF("sicslowpan uncompress_hdr: error context not found\n\r");
-    return;
+    return 0;
       }
       uncompress_addr(&SICSLOWPAN_IP_BUF(buf)->destipaddr, context->prefix,
                       unc_ctxconf[tmp],
@@ -1125,6 +1947,28 @@ uncompress_hdr_iphc(uint8_t *buf, uint16_t ip_len)
   /* Next header processing - continued */
   if((iphc0 & SICSLOWPAN_IPHC_NH_C)) {
     /* The next header is compressed, NHC is following */
+#if SICSLOWPAN_GHC
+    if(*hc06_ptr == SICSLOWPAN_NHC_GHC_UDP || *hc06_ptr == SICSLOWPAN_NHC_GHC_ICMP6) {
+      int len;
+      /* The GHC data extends to the end of the packet, which is only
+         known for unfragmented packets */
+      if(ip_len != 0) {
+        PRINTF("IPHC: GHC in fragments is not supported\n\r");
+        return 0;
+      }
+      SICSLOWPAN_IP_BUF(buf)->proto = (*hc06_ptr == SICSLOWPAN_NHC_GHC_UDP) ?
+        UIP_PROTO_UDP : UIP_PROTO_ICMP6;
+      len = ghc_decompress(&SICSLOWPAN_IP_BUF(buf)->srcipaddr.u8[0],
+                           hc06_ptr + 1, hc06_end - hc06_ptr - 1,
+                           buf + UIP_IPH_LEN, UIP_BUFSIZE - UIP_LLIPH_LEN);
+      if(len < 0) {
+        PRINTF("IPHC: malformed GHC data\n\r");
+        return 0;
+      }
+      uncomp_hdr_len += len;
+      hc06_ptr = hc06_end;
+    } else
+#endif /* SICSLOWPAN_GHC */
     if((*hc06_ptr & SICSLOWPAN_NHC_UDP_MASK) == SICSLOWPAN_NHC_UDP_ID) {
       uint8_t checksum_compressed;
       SICSLOWPAN_IP_BUF(buf)->proto = UIP_PROTO_UDP;
@@ -1175,7 +2019,7 @@ uncompress_hdr_iphc(uint8_t *buf, uint16_t ip_len)
 
       default:
         PRINTF("sicslowpan uncompress_hdr: error unsupported UDP compression\n\r");
-        return;
+        return 0;
       }
       if(!checksum_compressed) { /* has_checksum, default  */
     	memcpy(&SICSLOWPAN_UDP_BUF(buf)->udpchksum, hc06_ptr, 2);
@@ -1192,7 +2036,7 @@ uncompress_hdr_iphc(uint8_t *buf, uint16_t ip_len)
 
   /* IP length field. */
   if(ip_len == 0) {
-    int len = packetbuf_datalen() - packetbuf_hdr_len + uncomp_hdr_len - UIP_IPH_LEN;
+    int len = hc06_end - hc06_ptr + uncomp_hdr_len - UIP_IPH_LEN;
     /* This is not a fragmented packet */
     SICSLOWPAN_IP_BUF(buf)->len[0] = len >> 8;
     SICSLOWPAN_IP_BUF(buf)->len[1] = len & 0x00FF;
@@ -1207,7 +2051,7 @@ uncompress_hdr_iphc(uint8_t *buf, uint16_t ip_len)
     memcpy(&SICSLOWPAN_UDP_BUF(buf)->udplen, &SICSLOWPAN_IP_BUF(buf)->len[0], 2);
   }
 
-  return;
+  return 1;
 }
 /** @} */
 #endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
@@ -1282,6 +2126,9 @@ send_packet(linkaddr_t *dest)
   packetbuf_set_attr(PACKETBUF_ATTR_RELIABLE, 1);
 #endif
 
+  /* stays so if the MAC queues the frame and reports on it later */
+  last_tx_status = MAC_TX_DEFERRED;
+
     if ((p_ns != NULL) && (p_ns->dllsec != NULL)) {
         /* Provide a callback function to receive the result of
          a packet transmission. */
@@ -1294,52 +2141,509 @@ send_packet(linkaddr_t *dest)
 
 }
 /*--------------------------------------------------------------------*/
-/** \brief Take an IP packet and format it to be sent on an 802.15.4
- *  network using 6lowpan.
- *  \param localdest The MAC address of the destination
- *
- *  The IP packet is initially in uip_buf. Its header is compressed
- *  and if necessary it is fragmented. The resulting
- *  packet/fragments are put in packetbuf and delivered to the 802.15.4
- *  MAC.
+/**
+ * \brief Get the space available for 6lowpan headers and payload in a
+ * frame sent to the given link layer destination.
+ * \return the maximum 6lowpan payload or -1 if no framer is available
  */
-static uint8_t output(const uip_lladdr_t *localdest)
+static int
+get_max_payload(linkaddr_t *dest)
 {
   int framer_hdrlen;
-  int max_payload;
 
-  /* The MAC address of the destination of the packet */
-  linkaddr_t dest;
+  /* Calculate NETSTACK_FRAMER's header length, that will be added in the NETSTACK_RDC.
+   * We calculate it here only to make a better decision of whether the outgoing packet
+   * needs to be fragmented or not. */
+#ifndef SICSLOWPAN_USE_FIXED_HDRLEN
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, dest);
+  if ((p_ns == NULL) || (p_ns->frame == NULL))
+      return -1;
 
-  /* init */
-  uncomp_hdr_len = 0;
-  packetbuf_hdr_len = 0;
+  framer_hdrlen = p_ns->frame->length();
+  if(framer_hdrlen < 0) {
+    /* Framing failed, we assume the maximum header length */
+	framer_hdrlen = SICSLOWPAN_FIXED_HDRLEN;
+  }
+#else /* USE_FRAMER_HDRLEN */
+  framer_hdrlen = SICSLOWPAN_FIXED_HDRLEN;
+#endif /* USE_FRAMER_HDRLEN */
+  return MAC_MAX_PAYLOAD - framer_hdrlen;
+}
+
+#if SICSLOWPAN_CONF_FRAG && SICSLOWPAN_SFR
+/*--------------------------------------------------------------------*/
+/** \name Selective fragment recovery functions (RFC 8931)
+ * @{                                                                 */
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Send one recoverable fragment of the pending datagram.
+ * \param seq sequence number of the fragment
+ * \param ack_req non-zero to request an RFRAG-ACK from the receiver
+ * \return 1 if the fragment was handed to the MAC, 0 on a TX error
+ *
+ * \verbatim
+ *                      1                   2                   3
+ *  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |1 1 1 0 1 0 0|E|  Datagram_Tag |X| Sequence|   Fragment_Size   |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |       Fragment_Offset         |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * \endverbatim
+ * The first fragment carries the size of the compressed datagram in
+ * place of the offset.
+ */
+static int
+sfr_send_fragment(uint8_t seq, uint8_t ack_req)
+{
+  uint16_t offset;
+  uint16_t len;
+
+  offset = seq * sfr_tx.frag_len;
+  len = sfr_tx.size - offset;
+  if(len > sfr_tx.frag_len) {
+    len = sfr_tx.frag_len;
+  }
 
-  /* reset packetbuf buffer */
   packetbuf_clear();
   packetbuf_ptr = packetbuf_dataptr();
-
   packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
       SICSLOWPAN_MAX_MAC_TRANSMISSIONS);
 
-  if(callback) {
-    /* call the attribution when the callback comes, but set attributes
-       here ! */
-    set_packet_attrs();
+  packetbuf_ptr[0] = SICSLOWPAN_DISPATCH_RFRAG;
+  packetbuf_ptr[1] = sfr_tx.tag;
+  SET16(packetbuf_ptr, 2, (ack_req ? SICSLOWPAN_RFRAG_ACK_REQ : 0) |
+      ((uint16_t)seq << SICSLOWPAN_RFRAG_SEQ_BIT) | len);
+  SET16(packetbuf_ptr, 4, (seq == 0) ? sfr_tx.size : offset);
+  memcpy(packetbuf_ptr + SICSLOWPAN_RFRAG_HDR_LEN, sfr_tx.data + offset, len);
+  packetbuf_set_datalen(SICSLOWPAN_RFRAG_HDR_LEN + len);
+
+  PRINTFO("sicslowpan output: RFRAG (tag %d, seq %d, offset %d, len %d%s)\n\r",
+          sfr_tx.tag, seq, offset, len, ack_req ? ", ack req" : "");
+  send_packet(&sfr_tx.dest);
+
+  /* A missing link layer ack is recovered by the RFRAG-ACK */
+  if((last_tx_status == MAC_TX_COLLISION) ||
+     (last_tx_status == MAC_TX_ERR) ||
+     (last_tx_status == MAC_TX_ERR_FATAL)) {
+    return 0;
   }
-
-#if PACKETBUF_WITH_PACKET_TYPE
-#define TCP_FIN 0x01
-#define TCP_ACK 0x10
-#define TCP_CTL 0x3f
-  /* Set stream mode for all TCP packets, except FIN packets. */
-  if(UIP_IP_BUF->proto == UIP_PROTO_TCP &&
-     (UIP_TCP_BUF->flags & TCP_FIN) == 0 &&
-     (UIP_TCP_BUF->flags & TCP_CTL) != TCP_ACK) {
-    packetbuf_set_attr(PACKETBUF_ATTR_PACKET_TYPE,
-                       PACKETBUF_ATTR_PACKET_TYPE_STREAM);
-  } else if(UIP_IP_BUF->proto == UIP_PROTO_TCP &&
-            (UIP_TCP_BUF->flags & TCP_FIN) == TCP_FIN) {
+  return 1;
+}
+/*--------------------------------------------------------------------*/
+/** \brief Abandon the pending datagram */
+static void
+sfr_tx_abort(void)
+{
+  ctimer_stop(&sfr_tx.ack_timer);
+  sfr_tx.size = 0;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief No RFRAG-ACK arrived in time, request it again by resending
+ * the last fragment with the E flag set.
+ */
+static void
+sfr_ack_timeout(void *ptr)
+{
+  if(sfr_tx.size == 0) {
+    return;
+  }
+  if(sfr_tx.retries++ >= SICSLOWPAN_SFR_MAX_RETRIES ||
+     !sfr_send_fragment(sfr_tx.count - 1, 1)) {
+    PRINTFO("sicslowpan output: no RFRAG-ACK for tag %d, dropping datagram\n\r",
+            sfr_tx.tag);
+    sfr_tx_abort();
+    return;
+  }
+  ctimer_set(&sfr_tx.ack_timer, SICSLOWPAN_SFR_ACK_TIMEOUT * bsp_getTRes() / 1000,
+             sfr_ack_timeout, NULL);
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Send the compressed datagram in packetbuf and uip_buf as
+ * recoverable fragments.
+ * \param dest the link layer destination address of the datagram
+ * \param max_payload space available for 6lowpan headers and payload
+ * \return 1 if the datagram was sent, 0 if it was dropped and -1 if it
+ * has to be sent using RFC 4944 fragments instead
+ */
+static int
+sfr_output(linkaddr_t *dest, int max_payload)
+{
+  uint16_t size;
+  int frag_len;
+  uint8_t seq;
+
+  size = packetbuf_hdr_len + uip_len - uncomp_hdr_len;
+  frag_len = max_payload - SICSLOWPAN_RFRAG_HDR_LEN;
+  if(frag_len > SICSLOWPAN_RFRAG_SIZE_MASK) {
+    frag_len = SICSLOWPAN_RFRAG_SIZE_MASK;
+  }
+
+  /* Only one datagram can be recovered at a time */
+  if(sfr_tx.size != 0 || size > sizeof(sfr_tx.data) ||
+     frag_len < (int)packetbuf_hdr_len ||
+     (size + frag_len - 1) / frag_len > SICSLOWPAN_SFR_MAX_FRAGMENTS) {
+    return -1;
+  }
+
+  linkaddr_copy(&sfr_tx.dest, dest);
+  memcpy(sfr_tx.data, packetbuf_ptr, packetbuf_hdr_len);
+  memcpy(sfr_tx.data + packetbuf_hdr_len,
+         (uint8_t *)UIP_IP_BUF + uncomp_hdr_len, uip_len - uncomp_hdr_len);
+  sfr_tx.size = size;
+  sfr_tx.frag_len = frag_len;
+  sfr_tx.count = (size + frag_len - 1) / frag_len;
+  sfr_tx.tag = (uint8_t)my_tag++;
+  sfr_tx.retries = 0;
+
+  PRINTFO("sicslowpan output: %d RFRAGs for datagram len %d (compressed %d)\n\r",
+          sfr_tx.count, uip_len, size);
+
+  /* Reset last tx status to ok in case the fragment transmissions are deferred */
+  last_tx_status = MAC_TX_OK;
+
+  /* The last fragment requests the acknowledgment */
+  for(seq = 0; seq < sfr_tx.count; seq++) {
+    if(!sfr_send_fragment(seq, seq == sfr_tx.count - 1)) {
+      PRINTFO("error in fragment tx, dropping subsequent fragments.\n\r");
+      sfr_tx_abort();
+      return 0;
+    }
+  }
+
+  ctimer_set(&sfr_tx.ack_timer, SICSLOWPAN_SFR_ACK_TIMEOUT * bsp_getTRes() / 1000,
+             sfr_ack_timeout, NULL);
+  return 1;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Process a received RFRAG-ACK and resend the fragments it
+ * reports missing.
+ *
+ * \verbatim
+ *                      1                   2                   3
+ *  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |1 1 1 0 1 0 1|Y|  Datagram_Tag |                               |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+                               +
+ * |              RFRAG Acknowledgment Bitmap (32 bits)            |
+ * +                               +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |                               |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * \endverbatim
+ */
+static void
+sfr_ack_input(void)
+{
+  uint32_t bitmap;
+  uint32_t all;
+  uint8_t seq;
+  uint8_t last;
+
+  if(packetbuf_datalen() < SICSLOWPAN_RFRAG_ACK_HDR_LEN ||
+     sfr_tx.size == 0 || packetbuf_ptr[1] != sfr_tx.tag ||
+     !linkaddr_cmp(&sfr_tx.dest, packetbuf_addr(PACKETBUF_ADDR_SENDER))) {
+    return;
+  }
+
+  bitmap = ((uint32_t)GET16(packetbuf_ptr, 2) << 16) | GET16(packetbuf_ptr, 4);
+  all = (sfr_tx.count == SICSLOWPAN_SFR_MAX_FRAGMENTS) ?
+      SICSLOWPAN_SFR_BITMAP_FULL : ~(SICSLOWPAN_SFR_BITMAP_FULL >> sfr_tx.count);
+  PRINTFI("sicslowpan input: RFRAG-ACK (tag %d, bitmap %08lx)\n\r",
+          sfr_tx.tag, (unsigned long)bitmap);
+
+  if(bitmap == SICSLOWPAN_SFR_BITMAP_NULL) {
+    /* The receiver aborted the reassembly */
+    sfr_tx_abort();
+    return;
+  }
+  if((bitmap & all) == all) {
+    /* All fragments were received */
+    sfr_tx_abort();
+    return;
+  }
+  if(sfr_tx.retries++ >= SICSLOWPAN_SFR_MAX_RETRIES) {
+    sfr_tx_abort();
+    return;
+  }
+
+  /* Resend the missing fragments, the last of them requests a new ack */
+  for(last = sfr_tx.count - 1; bitmap & SICSLOWPAN_SFR_BIT(last); last--);
+  for(seq = 0; seq <= last; seq++) {
+    if(!(bitmap & SICSLOWPAN_SFR_BIT(seq)) &&
+       !sfr_send_fragment(seq, seq == last)) {
+      sfr_tx_abort();
+      return;
+    }
+  }
+  ctimer_set(&sfr_tx.ack_timer, SICSLOWPAN_SFR_ACK_TIMEOUT * bsp_getTRes() / 1000,
+             sfr_ack_timeout, NULL);
+}
+/*--------------------------------------------------------------------*/
+/** \brief Send an RFRAG-ACK for the given datagram */
+static void
+sfr_send_ack(linkaddr_t *dest, uint8_t tag, uint32_t bitmap)
+{
+  packetbuf_clear();
+  packetbuf_ptr = packetbuf_dataptr();
+  packetbuf_ptr[0] = SICSLOWPAN_DISPATCH_RFRAG_ACK;
+  packetbuf_ptr[1] = tag;
+  SET16(packetbuf_ptr, 2, bitmap >> 16);
+  SET16(packetbuf_ptr, 4, bitmap & 0xffff);
+  packetbuf_set_datalen(SICSLOWPAN_RFRAG_ACK_HDR_LEN);
+  send_packet(dest);
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Find the reassembly context of a datagram or allocate one.
+ * Completed reassemblies are only reused when no context is free.
+ */
+static struct sicslowpan_sfr_rx *
+sfr_rx_get(const linkaddr_t *sender, uint8_t tag)
+{
+  struct sicslowpan_sfr_rx *found = NULL;
+  int i;
+
+  for(i = 0; i < SICSLOWPAN_SFR_RX_CONTEXTS; i++) {
+    if(sfr_rx[i].state != SICSLOWPAN_SFR_RX_FREE &&
+       timer_expired(&sfr_rx[i].reass_timer)) {
+      sfr_rx[i].state = SICSLOWPAN_SFR_RX_FREE;
+    }
+    if(sfr_rx[i].state != SICSLOWPAN_SFR_RX_FREE && sfr_rx[i].tag == tag &&
+       linkaddr_cmp(&sfr_rx[i].sender, sender)) {
+      return &sfr_rx[i];
+    }
+  }
+  for(i = 0; i < SICSLOWPAN_SFR_RX_CONTEXTS; i++) {
+    if(sfr_rx[i].state == SICSLOWPAN_SFR_RX_FREE) {
+      found = &sfr_rx[i];
+      break;
+    }
+    if(found == NULL && sfr_rx[i].state == SICSLOWPAN_SFR_RX_COMPLETE) {
+      found = &sfr_rx[i];
+    }
+  }
+  if(found != NULL) {
+    linkaddr_copy(&found->sender, sender);
+    found->tag = tag;
+    found->size = 0;
+    found->received_len = 0;
+    found->bitmap = SICSLOWPAN_SFR_BITMAP_NULL;
+    found->state = SICSLOWPAN_SFR_RX_ACTIVE;
+    timer_set(&found->reass_timer, SICSLOWPAN_REASS_MAXAGE * bsp_getTRes() / 16);
+  }
+  return found;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Uncompress a reassembled datagram into uip_buf.
+ * \return 1 if uip_buf holds the datagram, 0 if it was malformed
+ */
+static int
+sfr_reassemble(struct sicslowpan_sfr_rx *rx)
+{
+  uint16_t payload_len;
+
+  /* The compressed datagram is parsed in place */
+  packetbuf_ptr = rx->data;
+  packetbuf_hdr_len = 0;
+  uncomp_hdr_len = 0;
+
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
+  if((PACKETBUF_HC1_PTR[PACKETBUF_HC1_DISPATCH] & 0xe0) == SICSLOWPAN_DISPATCH_IPHC) {
+    hc06_end = rx->data + rx->size;
+    if(!uncompress_hdr_iphc((uint8_t *)UIP_IP_BUF, 0)) {
+      return 0;
+    }
+  } else
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
+  if(PACKETBUF_HC1_PTR[PACKETBUF_HC1_DISPATCH] == SICSLOWPAN_DISPATCH_IPV6) {
+    packetbuf_hdr_len += SICSLOWPAN_IPV6_HDR_LEN;
+    memcpy(UIP_IP_BUF, packetbuf_ptr + packetbuf_hdr_len, UIP_IPH_LEN);
+    packetbuf_hdr_len += UIP_IPH_LEN;
+    uncomp_hdr_len += UIP_IPH_LEN;
+  } else {
+    PRINTFI("sicslowpan input: unknown dispatch: %u\n\r",
+            PACKETBUF_HC1_PTR[PACKETBUF_HC1_DISPATCH]);
+    return 0;
+  }
+
+  if(rx->size < packetbuf_hdr_len) {
+    return 0;
+  }
+  payload_len = rx->size - packetbuf_hdr_len;
+  if(UIP_LLH_LEN + uncomp_hdr_len + payload_len > sizeof(uip_buf)) {
+    PRINTF("SICSLOWPAN: RFRAG datagram too large for uip_buf\n\r");
+    return 0;
+  }
+  memcpy((uint8_t *)UIP_IP_BUF + uncomp_hdr_len,
+         packetbuf_ptr + packetbuf_hdr_len, payload_len);
+  uip_len = uncomp_hdr_len + payload_len;
+  return 1;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Process a received recoverable fragment. Once all fragments
+ * of a datagram are in, the datagram is delivered to the IP stack.
+ */
+static void
+sfr_input(void)
+{
+  struct sicslowpan_sfr_rx *rx;
+  linkaddr_t sender;
+  uint8_t ack_req;
+  uint8_t tag;
+  uint8_t seq;
+  uint16_t frag_len;
+  uint16_t offset;
+  uint16_t size = 0;
+  int deliver = 0;
+
+  if(packetbuf_datalen() < SICSLOWPAN_RFRAG_HDR_LEN) {
+    return;
+  }
+  linkaddr_copy(&sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+  ack_req = (GET16(packetbuf_ptr, 2) & SICSLOWPAN_RFRAG_ACK_REQ) != 0;
+  tag = packetbuf_ptr[1];
+  seq = (GET16(packetbuf_ptr, 2) >> SICSLOWPAN_RFRAG_SEQ_BIT) & SICSLOWPAN_RFRAG_SEQ_MASK;
+  frag_len = GET16(packetbuf_ptr, 2) & SICSLOWPAN_RFRAG_SIZE_MASK;
+  offset = GET16(packetbuf_ptr, 4);
+  if(seq == 0) {
+    size = offset;
+    offset = 0;
+  }
+  PRINTFI("sicslowpan input: RFRAG (tag %d, seq %d, offset %d, len %d)\n\r",
+          tag, seq, offset, frag_len);
+
+  rx = sfr_rx_get(&sender, tag);
+  if(rx == NULL) {
+    PRINTF("*** Failed to store RFRAG - no reassembly context - tag: %d\n", tag);
+    if(ack_req) {
+      sfr_send_ack(&sender, tag, SICSLOWPAN_SFR_BITMAP_NULL);
+    }
+    return;
+  }
+
+  if(rx->state == SICSLOWPAN_SFR_RX_ACTIVE) {
+    if(packetbuf_datalen() - SICSLOWPAN_RFRAG_HDR_LEN < frag_len ||
+       offset + frag_len > sizeof(rx->data) || size > sizeof(rx->data)) {
+      /* Cannot be reassembled, abort the datagram */
+      rx->state = SICSLOWPAN_SFR_RX_FREE;
+      if(ack_req) {
+        sfr_send_ack(&sender, tag, SICSLOWPAN_SFR_BITMAP_NULL);
+      }
+      return;
+    }
+    if(!(rx->bitmap & SICSLOWPAN_SFR_BIT(seq))) {
+      memcpy(rx->data + offset, packetbuf_ptr + SICSLOWPAN_RFRAG_HDR_LEN, frag_len);
+      rx->bitmap |= SICSLOWPAN_SFR_BIT(seq);
+      rx->received_len += frag_len;
+      if(seq == 0) {
+        rx->size = size;
+      }
+    }
+    if(rx->size > 0 && rx->received_len >= rx->size) {
+      rx->state = SICSLOWPAN_SFR_RX_COMPLETE;
+      /* Uncompress while the link layer addresses are still in packetbuf */
+      deliver = sfr_reassemble(rx);
+    }
+  }
+
+  if(ack_req) {
+    sfr_send_ack(&sender, tag, (rx->state == SICSLOWPAN_SFR_RX_COMPLETE) ?
+                 SICSLOWPAN_SFR_BITMAP_FULL : rx->bitmap);
+  }
+
+  if(deliver) {
+    PRINTFI("sicslowpan input: IP packet ready (length %d)\n\r", uip_len);
+    tcpip_input();
+  }
+}
+/** @} */
+#endif /* SICSLOWPAN_CONF_FRAG && SICSLOWPAN_SFR */
+
+#if UIP_CONF_IPV6_RPL && RPL_WITH_FAST_REROUTE
+/* Next hop the datagram in uip_buf is sent to again, see reroute_output() */
+static linkaddr_t reroute_nexthop;
+static uint8_t reroute_pending;
+
+static uint8_t reroute_output(const linkaddr_t *dest);
+#endif /* UIP_CONF_IPV6_RPL && RPL_WITH_FAST_REROUTE */
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Classify the datagram in uip_buf for the MAC transmission
+ * policy, e.g. retransmissions to dest matter more if it is the final
+ * destination than if the datagram can take another route.
+ * \return One of MAC_TX_CLASS_DEFAULT, MAC_TX_CLASS_LAST_HOP and
+ * MAC_TX_CLASS_REROUTABLE
+ */
+static uint8_t
+get_tx_class(const linkaddr_t *dest)
+{
+  if(linkaddr_cmp(dest, &linkaddr_null) ||
+     uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
+    return MAC_TX_CLASS_DEFAULT;
+  }
+  if(uip_is_addr_mac_addr_based(&UIP_IP_BUF->destipaddr, (const uip_lladdr_t *)dest)) {
+    return MAC_TX_CLASS_LAST_HOP;
+  }
+#if UIP_CONF_IPV6_RPL && RPL_WITH_FAST_REROUTE
+  /* see reroute_output() */
+  if(!uip_is_addr_linklocal(&UIP_IP_BUF->destipaddr) &&
+     rpl_has_backup_parent(dest)) {
+    return MAC_TX_CLASS_REROUTABLE;
+  }
+#endif /* UIP_CONF_IPV6_RPL && RPL_WITH_FAST_REROUTE */
+  return MAC_TX_CLASS_DEFAULT;
+}
+/*--------------------------------------------------------------------*/
+/** \brief Take an IP packet and format it to be sent on an 802.15.4
+ *  network using 6lowpan.
+ *  \param localdest The MAC address of the destination
+ *
+ *  The IP packet is initially in uip_buf. Its header is compressed
+ *  and if necessary it is fragmented. The resulting
+ *  packet/fragments are put in packetbuf and delivered to the 802.15.4
+ *  MAC.
+ */
+static uint8_t output_datagram(const uip_lladdr_t *localdest)
+{
+  int max_payload;
+
+  /* The MAC address of the destination of the packet */
+  linkaddr_t dest;
+
+  /* init */
+  uncomp_hdr_len = 0;
+  packetbuf_hdr_len = 0;
+
+  /* reset packetbuf buffer */
+  packetbuf_clear();
+  packetbuf_ptr = packetbuf_dataptr();
+
+  packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
+      SICSLOWPAN_MAX_MAC_TRANSMISSIONS);
+
+  if(callback) {
+    /* call the attribution when the callback comes, but set attributes
+       here ! */
+    set_packet_attrs();
+  }
+
+#if PACKETBUF_WITH_PACKET_TYPE
+#define TCP_FIN 0x01
+#define TCP_ACK 0x10
+#define TCP_CTL 0x3f
+  /* Set stream mode for all TCP packets, except FIN packets. */
+  if(UIP_IP_BUF->proto == UIP_PROTO_TCP &&
+     (UIP_TCP_BUF->flags & TCP_FIN) == 0 &&
+     (UIP_TCP_BUF->flags & TCP_CTL) != TCP_ACK) {
+    packetbuf_set_attr(PACKETBUF_ATTR_PACKET_TYPE,
+                       PACKETBUF_ATTR_PACKET_TYPE_STREAM);
+  } else if(UIP_IP_BUF->proto == UIP_PROTO_TCP &&
+            (UIP_TCP_BUF->flags & TCP_FIN) == TCP_FIN) {
     packetbuf_set_attr(PACKETBUF_ATTR_PACKET_TYPE,
                        PACKETBUF_ATTR_PACKET_TYPE_STREAM_END);
   }
@@ -1355,6 +2659,7 @@ static uint8_t output(const uip_lladdr_t *localdest)
   } else {
     linkaddr_copy(&dest, (const linkaddr_t *)localdest);
   }
+  packetbuf_set_attr(PACKETBUF_ATTR_MAC_TX_CLASS, get_tx_class(&dest));
 
   PRINTFO("sicslowpan output: sending packet len %d\n\r", uip_len);
 
@@ -1371,23 +2676,10 @@ static uint8_t output(const uip_lladdr_t *localdest)
   }
   PRINTFO("sicslowpan output: header of len %d\n\r", packetbuf_hdr_len);
 
-  /* Calculate NETSTACK_FRAMER's header length, that will be added in the NETSTACK_RDC.
-   * We calculate it here only to make a better decision of whether the outgoing packet
-   * needs to be fragmented or not. */
-#ifndef SICSLOWPAN_USE_FIXED_HDRLEN
-  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &dest);
-  if ((p_ns == NULL) || (p_ns->frame == NULL))
-      return 0;
-
-  framer_hdrlen = p_ns->frame->length();
-  if(framer_hdrlen < 0) {
-    /* Framing failed, we assume the maximum header length */
-	framer_hdrlen = SICSLOWPAN_FIXED_HDRLEN;
+  max_payload = get_max_payload(&dest);
+  if(max_payload < 0) {
+    return 0;
   }
-#else /* USE_FRAMER_HDRLEN */
-  framer_hdrlen = SICSLOWPAN_FIXED_HDRLEN;
-#endif /* USE_FRAMER_HDRLEN */
-  max_payload = MAC_MAX_PAYLOAD - framer_hdrlen;
   if((int)uip_len - (int)uncomp_hdr_len > max_payload - (int)packetbuf_hdr_len) {
 #if SICSLOWPAN_CONF_FRAG
 	/* Number of bytes processed. */
@@ -1395,6 +2687,15 @@ static uint8_t output(const uip_lladdr_t *localdest)
 
 	struct queuebuf *q;
     uint16_t frag_tag;
+#if SICSLOWPAN_SFR
+    int sfr_status;
+
+    /* Prefer recoverable fragments when they can be used */
+    sfr_status = sfr_output(&dest, max_payload);
+    if(sfr_status >= 0) {
+      return sfr_status;
+    }
+#endif /* SICSLOWPAN_SFR */
 
     /*
      * The outbound IPv6 packet is too large to fit into a single 15.4
@@ -1419,6 +2720,9 @@ static uint8_t output(const uip_lladdr_t *localdest)
     /* Reset last tx status to ok in case the fragment transmissions are deferred */
     last_tx_status = MAC_TX_OK;
 
+    /* Announce the following fragments through the frame pending bit */
+    packetbuf_set_attr(PACKETBUF_ATTR_PENDING, 1);
+
     /* move IPHC/IPv6 header */
     memmove(packetbuf_ptr + SICSLOWPAN_FRAG1_HDR_LEN, packetbuf_ptr, packetbuf_hdr_len);
 
@@ -1457,6 +2761,11 @@ static uint8_t output(const uip_lladdr_t *localdest)
       PRINTFO("error in fragment tx, dropping subsequent fragments.\n\r");
       return 0;
     }
+#if UIP_CONF_IPV6_RPL && RPL_WITH_FAST_REROUTE
+    if(reroute_output(&dest)) {
+      return 1;
+    }
+#endif /* UIP_CONF_IPV6_RPL && RPL_WITH_FAST_REROUTE */
 
     /* set processed_ip_out_len to what we already sent from the IP payload*/
     processed_ip_out_len = packetbuf_payload_len + uncomp_hdr_len;
@@ -1481,6 +2790,8 @@ static uint8_t output(const uip_lladdr_t *localdest)
         /* last fragment */
         packetbuf_payload_len = uip_len - processed_ip_out_len;
       }
+      packetbuf_set_attr(PACKETBUF_ATTR_PENDING,
+                         processed_ip_out_len + packetbuf_payload_len < uip_len);
       PRINTFO("(offset %d, len %d, tag %d)\n\r",
     		 processed_ip_out_len >> 3, packetbuf_payload_len, frag_tag);
       memcpy(packetbuf_ptr + packetbuf_hdr_len,
@@ -1503,7 +2814,11 @@ static uint8_t output(const uip_lladdr_t *localdest)
          (last_tx_status == MAC_TX_NOACK) ||
          (last_tx_status == MAC_TX_ERR_FATAL)) {
         PRINTFO("error in fragment tx, dropping subsequent fragments.\n\r");
+#if UIP_CONF_IPV6_RPL && RPL_WITH_FAST_REROUTE
+        return reroute_output(&dest);
+#else /* UIP_CONF_IPV6_RPL && RPL_WITH_FAST_REROUTE */
         return 0;
+#endif /* UIP_CONF_IPV6_RPL && RPL_WITH_FAST_REROUTE */
       }
     }
 #else /* SICSLOWPAN_CONF_FRAG */
@@ -1520,9 +2835,366 @@ static uint8_t output(const uip_lladdr_t *localdest)
            uip_len - uncomp_hdr_len);
     packetbuf_set_datalen(uip_len - uncomp_hdr_len + packetbuf_hdr_len);
     send_packet(&dest);
+#if UIP_CONF_IPV6_RPL && RPL_WITH_FAST_REROUTE
+    reroute_output(&dest);
+#endif /* UIP_CONF_IPV6_RPL && RPL_WITH_FAST_REROUTE */
+  }
+  return 1;
+}
+
+#if UIP_CONF_IPV6_RPL && RPL_WITH_FAST_REROUTE
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Schedule the datagram in uip_buf to be sent again if its
+ * transmission to dest failed and RPL replaced dest, its preferred
+ * parent, by a backup parent.
+ *
+ * The datagram is compressed again for the new next hop by output() but
+ * does not go back through the IP layer. Datagrams addressed to the
+ * failed neighbor itself are not rerouted. Only a synchronous NOACK is
+ * taken into account, frames queued by the MAC are never rerouted.
+ * \return 1 if the datagram is going to be sent to the new next hop
+ */
+static uint8_t
+reroute_output(const linkaddr_t *dest)
+{
+  const linkaddr_t *nexthop;
+
+  if(last_tx_status != MAC_TX_NOACK || linkaddr_cmp(dest, &linkaddr_null)) {
+    return 0;
+  }
+  nexthop = rpl_get_reroute_nexthop(dest);
+  if(nexthop == NULL ||
+     uip_is_addr_linklocal(&UIP_IP_BUF->destipaddr) ||
+     uip_is_addr_mcast(&UIP_IP_BUF->destipaddr) ||
+     uip_is_addr_mac_addr_based(&UIP_IP_BUF->destipaddr, (const uip_lladdr_t *)dest)) {
+    return 0;
+  }
+  linkaddr_copy(&reroute_nexthop, nexthop);
+  reroute_pending = 1;
+  return 1;
+}
+#endif /* UIP_CONF_IPV6_RPL && RPL_WITH_FAST_REROUTE */
+/*--------------------------------------------------------------------*/
+/** \brief Send the IP packet in uip_buf on an 802.15.4 network
+ *  \param localdest The MAC address of the destination
+ *
+ *  With fast reroute, a datagram that could not be delivered to a
+ *  preferred parent is sent once more to the backup parent replacing it.
+ */
+static uint8_t output(const uip_lladdr_t *localdest)
+{
+  uint8_t ret;
+
+  ret = output_datagram(localdest);
+#if UIP_CONF_IPV6_RPL && RPL_WITH_FAST_REROUTE
+  if(reroute_pending) {
+    PRINTFO("sicslowpan output: rerouting packet to the backup parent\n\r");
+    reroute_pending = 0;
+    ret = output_datagram((const uip_lladdr_t *)&reroute_nexthop);
+    /* at most one reroute per datagram */
+    reroute_pending = 0;
+  }
+#endif /* UIP_CONF_IPV6_RPL && RPL_WITH_FAST_REROUTE */
+  return ret;
+}
+
+#if SICSLOWPAN_CONF_FRAG && SICSLOWPAN_FRAG_FORWARDING
+/*--------------------------------------------------------------------*/
+/** \name Fragment forwarding functions
+ * @{                                                                 */
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Check whether the datagram header in uip_buf allows to
+ * forward the fragments without involving the IP layer.
+ *
+ * Datagrams that are delivered locally, that are not routable or that
+ * carry a routing header are reassembled as usual and handed over to uIP.
+ */
+static int
+frag_fwd_is_forwardable(void)
+{
+  if(uip_is_addr_mcast(&UIP_IP_BUF->destipaddr) ||
+     uip_is_addr_linklocal(&UIP_IP_BUF->destipaddr) ||
+     uip_is_addr_linklocal(&UIP_IP_BUF->srcipaddr) ||
+     uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr) ||
+     uip_is_addr_loopback(&UIP_IP_BUF->destipaddr) ||
+     uip_ds6_is_my_addr(&UIP_IP_BUF->destipaddr)) {
+    return 0;
   }
+
+  /* Let uIP generate the ICMPv6 errors */
+  if(UIP_IP_BUF->ttl <= 1) {
+    return 0;
+  }
+
+  /* A routing header has to be processed by the IP layer */
+  if(UIP_IP_BUF->proto == UIP_PROTO_ROUTING) {
+    return 0;
+  }
+  if(UIP_IP_BUF->proto == UIP_PROTO_HBHO &&
+     ((uint8_t *)UIP_IP_BUF)[UIP_IPH_LEN] == UIP_PROTO_ROUTING) {
+    return 0;
+  }
+
+#if UIP_CONF_IPV6_RPL
+  {
+    /* The DODAG root rewrites the RPL headers of the datagrams it
+       routes, which might change the size of the datagram. */
+    rpl_dag_t *dag = rpl_get_any_dag();
+    if(dag != NULL && uip_ds6_is_my_addr(&dag->dag_id)) {
+      return 0;
+    }
+  }
+#endif /* UIP_CONF_IPV6_RPL */
+
   return 1;
 }
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Determine the link layer address of the next hop of the
+ * datagram in uip_buf.
+ *
+ * This follows the next hop determination of tcpip_ipv6_output() but
+ * never triggers neighbor discovery. Datagrams whose next hop has no
+ * resolved link layer address are reassembled instead.
+ */
+static int
+frag_fwd_nexthop(linkaddr_t *next_hop)
+{
+  uip_ipaddr_t *nexthop;
+  uip_ds6_route_t *route;
+  uip_ds6_nbr_t *nbr;
+
+  if(uip_ds6_is_addr_onlink(&UIP_IP_BUF->destipaddr)) {
+    nexthop = &UIP_IP_BUF->destipaddr;
+#if UIP_CONF_IPV6_RPL
+  } else if((route = rpl_route_lookup(&UIP_IP_BUF->destipaddr)) != NULL) {
+    nexthop = uip_ds6_route_nexthop(route);
+  } else {
+    nexthop = rpl_defrt_choose();
+  }
+#else /* UIP_CONF_IPV6_RPL */
+  } else if((route = uip_ds6_route_lookup(&UIP_IP_BUF->destipaddr)) != NULL) {
+    nexthop = uip_ds6_route_nexthop(route);
+  } else {
+    nexthop = uip_ds6_defrt_choose();
+  }
+#endif /* UIP_CONF_IPV6_RPL */
+
+  if(nexthop == NULL) {
+    return 0;
+  }
+
+  nbr = uip_ds6_nbr_lookup(nexthop);
+  if(nbr == NULL || nbr->state == NBR_INCOMPLETE) {
+    return 0;
+  }
+
+  linkaddr_copy(next_hop, (const linkaddr_t *)uip_ds6_nbr_get_ll(nbr));
+  return 1;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Forward a first fragment towards the next hop.
+ *
+ * The first fragment has already been uncompressed into the reassembly
+ * context. Its header is routed, compressed for the next hop and the
+ * fragment is sent with a new datagram tag. Subsequent fragments are
+ * relabelled using the switching entry created here.
+ *
+ * \param context the reassembly context holding the first fragment
+ * \return 1 if the datagram has been consumed (forwarded or dropped),
+ * 0 if it has to be reassembled.
+ */
+static int
+frag_fwd_first(int8_t context)
+{
+  struct sicslowpan_frag_fwd *fwd;
+  linkaddr_t sender;
+  linkaddr_t next_hop;
+  uint16_t first_len;
+  uint16_t ip_len;
+  int max_payload;
+
+  first_len = frag_info[context].first_frag_len;
+  ip_len = frag_info[context].len;
+
+  /* The header is examined in uip_buf, which is not used before the
+     datagram is complete */
+  memcpy((uint8_t *)UIP_IP_BUF, frag_info[context].first_frag, first_len);
+  uip_len = first_len;
+  uip_ext_len = 0;
+
+  fwd = frag_fwd_lookup(packetbuf_addr(PACKETBUF_ADDR_SENDER),
+                        frag_info[context].tag);
+  if(fwd != NULL) {
+    /* A first fragment received again is sent again with the tag of
+       the forwarded datagram */
+    linkaddr_copy(&next_hop, &fwd->next_hop);
+  } else {
+    if(!frag_fwd_is_forwardable() || !frag_fwd_nexthop(&next_hop) ||
+       linkaddr_cmp(&next_hop, packetbuf_addr(PACKETBUF_ADDR_SENDER))) {
+      uip_clear_buf();
+      return 0;
+    }
+
+    fwd = frag_fwd_alloc();
+    if(fwd == NULL) {
+      PRINTF("sicslowpan: no free fragment forwarding entry\n\r");
+      uip_clear_buf();
+      return 0;
+    }
+  }
+
+#if UIP_CONF_IPV6_RPL
+  /* Same processing uIP does for datagrams it forwards */
+  if(UIP_IP_BUF->proto == UIP_PROTO_HBHO &&
+     ((uint8_t *)UIP_IP_BUF)[UIP_IPH_LEN + 2] == UIP_EXT_HDR_OPT_RPL &&
+     !rpl_verify_hbh_header(2)) {
+    PRINTF("sicslowpan: RPL option verification failed, dropping datagram\n\r");
+    clear_fragments(context);
+    uip_clear_buf();
+    return 1;
+  }
+#endif /* UIP_CONF_IPV6_RPL */
+
+  UIP_IP_BUF->ttl = UIP_IP_BUF->ttl - 1;
+
+#if UIP_CONF_IPV6_RPL
+  if(!rpl_update_header()) {
+    PRINTF("sicslowpan: RPL header update error, dropping datagram\n\r");
+    clear_fragments(context);
+    uip_clear_buf();
+    return 1;
+  }
+  if(uip_len != first_len) {
+    /* RPL changed the size of the header, the offsets of the
+       subsequent fragments would not match anymore */
+    uip_clear_buf();
+    return 0;
+  }
+#endif /* UIP_CONF_IPV6_RPL */
+
+  linkaddr_copy(&sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+
+  /* Compress the header for the next hop */
+  uncomp_hdr_len = 0;
+  packetbuf_hdr_len = 0;
+  packetbuf_clear();
+  packetbuf_ptr = packetbuf_dataptr();
+  packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
+      SICSLOWPAN_MAX_MAC_TRANSMISSIONS);
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
+  compress_hdr_iphc(&next_hop);
+#else
+  compress_hdr_ipv6(&next_hop);
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
+
+  /* The first fragment has to carry the same part of the datagram as
+     before since the offsets of the subsequent fragments are kept */
+  max_payload = get_max_payload(&next_hop);
+  if(SICSLOWPAN_FRAG1_HDR_LEN + packetbuf_hdr_len + first_len - uncomp_hdr_len >
+     max_payload) {
+    PRINTF("sicslowpan: forwarded first fragment too large, dropping datagram\n\r");
+    clear_fragments(context);
+    uip_clear_buf();
+    return 1;
+  }
+
+  /* move IPHC/IPv6 header */
+  memmove(packetbuf_ptr + SICSLOWPAN_FRAG1_HDR_LEN, packetbuf_ptr, packetbuf_hdr_len);
+  SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_DISPATCH_SIZE,
+        ((SICSLOWPAN_DISPATCH_FRAG1 << 8) | ip_len));
+  if(fwd->len == 0) {
+    fwd->out_tag = my_tag++;
+  }
+  SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_TAG, fwd->out_tag);
+  packetbuf_hdr_len += SICSLOWPAN_FRAG1_HDR_LEN;
+
+  memcpy(packetbuf_ptr + packetbuf_hdr_len,
+         (uint8_t *)UIP_IP_BUF + uncomp_hdr_len, first_len - uncomp_hdr_len);
+  packetbuf_set_datalen(first_len - uncomp_hdr_len + packetbuf_hdr_len);
+
+  /* The datagram is not reassembled here anymore */
+  clear_fragments(context);
+  uip_clear_buf();
+
+  PRINTFO("sicslowpan: forwarding first fragment (tag %d -> %d)\n\r",
+          frag_info[context].tag, fwd->out_tag);
+  last_tx_status = MAC_TX_OK;
+  send_packet(&next_hop);
+  if((last_tx_status == MAC_TX_COLLISION) ||
+     (last_tx_status == MAC_TX_ERR) ||
+     (last_tx_status == MAC_TX_ERR_FATAL)) {
+    PRINTFO("error in fragment tx, dropping subsequent fragments.\n\r");
+    return 1;
+  }
+
+  if(fwd->len == 0) {
+    linkaddr_copy(&fwd->sender, &sender);
+    linkaddr_copy(&fwd->next_hop, &next_hop);
+    fwd->in_tag = frag_info[context].tag;
+    fwd->len = ip_len;
+    fwd->forwarded_len = first_len;
+  }
+  timer_set(&fwd->lifetime, SICSLOWPAN_REASS_MAXAGE * bsp_getTRes() / 16);
+  return 1;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Forward a subsequent fragment of a switched datagram.
+ *
+ * The fragment in packetbuf gets the tag of the outgoing datagram and
+ * is sent to the next hop as is.
+ *
+ * \param tag the datagram tag of the received fragment
+ * \return 1 if the fragment belongs to a forwarded datagram, 0 otherwise
+ */
+static int
+frag_fwd_next(uint16_t tag)
+{
+  struct sicslowpan_frag_fwd *fwd;
+  uint8_t *frag;
+  uint16_t len;
+
+  fwd = frag_fwd_lookup(packetbuf_addr(PACKETBUF_ADDR_SENDER), tag);
+  if(fwd == NULL) {
+    return 0;
+  }
+
+  fwd->forwarded_len += packetbuf_datalen() - packetbuf_hdr_len;
+  PRINTFO("sicslowpan: forwarding fragment (tag %d -> %d, offset %d)\n\r",
+          tag, fwd->out_tag, PACKETBUF_FRAG_PTR[PACKETBUF_FRAG_OFFSET]);
+
+  /* relabel the fragment */
+  SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_TAG, fwd->out_tag);
+
+  /* move the fragment to the start of packetbuf and reset the attributes
+     of the received frame */
+  frag = packetbuf_dataptr();
+  len = packetbuf_datalen();
+  packetbuf_clear();
+  memmove(packetbuf_dataptr(), frag, len);
+  packetbuf_set_datalen(len);
+  packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
+      SICSLOWPAN_MAX_MAC_TRANSMISSIONS);
+
+  last_tx_status = MAC_TX_OK;
+  send_packet(&fwd->next_hop);
+
+  if((fwd->forwarded_len >= fwd->len) ||
+     (last_tx_status == MAC_TX_COLLISION) ||
+     (last_tx_status == MAC_TX_ERR) ||
+     (last_tx_status == MAC_TX_NOACK) ||
+     (last_tx_status == MAC_TX_ERR_FATAL)) {
+    /* last fragment sent or the datagram is lost anyway */
+    fwd->len = 0;
+  }
+  return 1;
+}
+/** @} */
+#endif /* SICSLOWPAN_CONF_FRAG && SICSLOWPAN_FRAG_FORWARDING */
 
 /*--------------------------------------------------------------------*/
 /** \brief Process a received 6lowpan packet.
@@ -1615,6 +3287,13 @@ input(void)
              frag_size, frag_tag, frag_offset);
       packetbuf_hdr_len += SICSLOWPAN_FRAGN_HDR_LEN;
 
+#if SICSLOWPAN_FRAG_FORWARDING
+      /* Fragments of a datagram that is forwarded are relayed at once */
+      if(frag_fwd_next(frag_tag)) {
+        return;
+      }
+#endif /* SICSLOWPAN_FRAG_FORWARDING */
+
       /* If this is the last fragment, we may shave off any extrenous
          bytes at the end. We must be liberal in what we accept. */
       PRINTFI("last_fragment?: packetbuf_payload_len %d frag_size %d\n",
@@ -1637,6 +3316,21 @@ input(void)
       }
       is_fragment = 1;
       break;
+#if SICSLOWPAN_SFR
+    case SICSLOWPAN_DISPATCH_RFRAG:
+      /* Recoverable fragments are reassembled apart from the RFC 4944 ones */
+      switch(packetbuf_ptr[0] & SICSLOWPAN_RFRAG_DISPATCH_MASK) {
+        case SICSLOWPAN_DISPATCH_RFRAG:
+          sfr_input();
+          break;
+        case SICSLOWPAN_DISPATCH_RFRAG_ACK:
+          sfr_ack_input();
+          break;
+        default:
+          break;
+      }
+      return;
+#endif /* SICSLOWPAN_SFR */
     default:
       break;
   }
@@ -1651,7 +3345,10 @@ input(void)
 #if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
   if((PACKETBUF_HC1_PTR[PACKETBUF_HC1_DISPATCH] & 0xe0) == SICSLOWPAN_DISPATCH_IPHC) {
     PRINTFI("sicslowpan input: IPHC\n\r");
-    uncompress_hdr_iphc(buffer, frag_size);
+    hc06_end = packetbuf_ptr + packetbuf_datalen();
+    if(!uncompress_hdr_iphc(buffer, frag_size)) {
+      return;
+    }
   } else
 #endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
     switch(PACKETBUF_HC1_PTR[PACKETBUF_HC1_DISPATCH]) {
@@ -1713,10 +3410,24 @@ input(void)
 
 #if SICSLOWPAN_CONF_FRAG
   if(frag_size > 0) {
-    /* Add the size of the header only for the first fragment. */
+    /* Add the size of the header only for the first fragment. A first
+       fragment received again replaces the previous one. */
     if(first_fragment != 0) {
-      frag_info[frag_context].reassembled_len = uncomp_hdr_len + packetbuf_payload_len;
+      frag_info[frag_context].reassembled_len += uncomp_hdr_len + packetbuf_payload_len -
+        frag_info[frag_context].first_frag_len;
       frag_info[frag_context].first_frag_len = uncomp_hdr_len + packetbuf_payload_len;
+      if(frag_info[frag_context].reassembled_len >= frag_size) {
+        last_fragment = 1;
+      }
+#if SICSLOWPAN_FRAG_FORWARDING
+      /* Try to forward the datagram instead of reassembling it, unless
+         other fragments of it are buffered already */
+      if(!last_fragment &&
+         frag_info[frag_context].reassembled_len == frag_info[frag_context].first_frag_len &&
+         frag_fwd_first(frag_context)) {
+        return;
+      }
+#endif /* SICSLOWPAN_FRAG_FORWARDING */
     }
     /* For the last fragment, we are OK if there is extrenous bytes at
        the end of the packet. */
@@ -1770,6 +3481,106 @@ input(void)
 }
 /** @} */
 
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 && SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
+/*--------------------------------------------------------------------*/
+/** \name Address context table
+ * @{                                                                 */
+/*--------------------------------------------------------------------*/
+/** \brief rebuild the CID and prefix indexes after a context changed */
+static void
+addr_context_reindex(void)
+{
+  uint8_t h, i;
+
+  memset(addr_context_cid, ADDR_CONTEXT_NONE, sizeof(addr_context_cid));
+  memset(addr_context_hash, ADDR_CONTEXT_NONE, sizeof(addr_context_hash));
+  for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
+    if(addr_contexts[i].used != 1) {
+      continue;
+    }
+    addr_context_cid[addr_contexts[i].number] = i;
+    if(addr_contexts[i].compress) {
+      h = addr_context_hash_key(addr_contexts[i].prefix);
+      while(addr_context_hash[h] != ADDR_CONTEXT_NONE) {
+        h = (h + 1) & (SICSLOWPAN_CONTEXT_HASH_SIZE - 1);
+      }
+      addr_context_hash[h] = i;
+    }
+  }
+
+#if SICSLOWPAN_FLOW_CACHE
+  /* Cached headers depend on the contexts */
+  flow_cache_flush();
+#endif /* SICSLOWPAN_FLOW_CACHE */
+}
+/*--------------------------------------------------------------------*/
+static void addr_context_expire(void *ptr);
+
+/** \brief set the timer to the next context to expire */
+static void
+addr_context_schedule(void)
+{
+  unsigned long remaining, next = 0;
+  uint8_t found = 0;
+  int i;
+
+  for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
+    if((addr_contexts[i].used == 1) && !addr_contexts[i].isinfinite) {
+      remaining = stimer_remaining(&addr_contexts[i].lifetime);
+      if(!found || (remaining < next)) {
+        next = remaining;
+      }
+      found = 1;
+    }
+  }
+
+  if(!found) {
+    ctimer_stop(&addr_context_timer);
+    return;
+  }
+  /* Long lifetimes are checked hourly to keep the ticks in range */
+  if(next > 3600) {
+    next = 3600;
+  }
+  ctimer_set(&addr_context_timer, (next + 1) * bsp_getTRes(),
+             addr_context_expire, NULL);
+}
+/*--------------------------------------------------------------------*/
+/** \brief expire contexts whose lifetime ran out */
+static void
+addr_context_expire(void *ptr)
+{
+  struct sicslowpan_addr_context *ctx;
+  uint8_t changed = 0;
+  int i;
+
+  for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
+    ctx = &addr_contexts[i];
+    if((ctx->used != 1) || ctx->isinfinite ||
+       !stimer_expired(&ctx->lifetime)) {
+      continue;
+    }
+    if(ctx->compress) {
+      /* Neighbours may still compress with it for a while */
+      PRINTF("sicslowpan: context %u only used for decompression\n",
+             ctx->number);
+      ctx->compress = 0;
+      stimer_set(&ctx->lifetime, SICSLOWPAN_CONTEXT_CHANGE_DELAY);
+    } else {
+      PRINTF("sicslowpan: context %u expired\n", ctx->number);
+      ctx->used = 0;
+    }
+    changed = 1;
+  }
+
+  if(changed) {
+    addr_context_reindex();
+  }
+  addr_context_schedule();
+}
+/** @} */
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 && SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
+
 /*--------------------------------------------------------------------*/
 /* \brief 6lowpan init function (called by the MAC layer)             */
 /*--------------------------------------------------------------------*/
@@ -1834,6 +3645,33 @@ void sicslowpan_init(s_ns_t* p_netStack)
   }
 #endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 1 */
 
+#if SICSLOWPAN_GHC && SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
+  {
+    int i;
+    for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
+      addr_contexts[i].ghc = (SICSLOWPAN_GHC_CONTEXTS >> i) & 1;
+    }
+  }
+#endif /* SICSLOWPAN_GHC && SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
+
+#if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
+  {
+    int i;
+    /* Preconfigured contexts never expire */
+    for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
+      if(addr_contexts[i].used == 1) {
+        addr_contexts[i].length = 64;
+        addr_contexts[i].compress = 1;
+        addr_contexts[i].isinfinite = 1;
+      }
+    }
+  }
+  addr_context_reindex();
+  addr_context_schedule();
+#elif SICSLOWPAN_FLOW_CACHE
+  flow_cache_flush();
+#endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
+
 #endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
 }
 /*--------------------------------------------------------------------*/
@@ -1843,6 +3681,109 @@ sicslowpan_get_last_rssi(void)
   return last_rssi;
 }
 /*--------------------------------------------------------------------*/
+int
+sicslowpan_set_context_ghc(uint8_t number, uint8_t enable)
+{
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
+  struct sicslowpan_addr_context *ctx;
+
+  ctx = addr_context_lookup_by_number(number);
+  if(ctx != NULL) {
+    ctx->ghc = enable ? 1 : 0;
+    return 1;
+  }
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
+  return 0;
+}
+/*--------------------------------------------------------------------*/
+int
+sicslowpan_context_set(uint8_t number, const uip_ipaddr_t *prefix,
+                       uint8_t length, uint8_t compress, uint32_t lifetime)
+{
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 && SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
+  struct sicslowpan_addr_context *ctx;
+  uint8_t newprefix[8];
+  uint8_t changed = 0;
+  int i;
+
+  if(number > 15) {
+    return 0;
+  }
+
+  ctx = addr_context_lookup_by_number(number);
+  if(lifetime == 0) {
+    if(ctx != NULL) {
+      PRINTF("sicslowpan: context %u removed\n", number);
+      ctx->used = 0;
+      addr_context_reindex();
+      addr_context_schedule();
+    }
+    return 1;
+  }
+
+  if(ctx == NULL) {
+    for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
+      if(addr_contexts[i].used != 1) {
+        ctx = &addr_contexts[i];
+        break;
+      }
+    }
+    if(ctx == NULL) {
+      PRINTF("sicslowpan: no room for context %u\n", number);
+      return 0;
+    }
+    ctx->number = number;
+#if SICSLOWPAN_GHC
+    ctx->ghc = (SICSLOWPAN_GHC_CONTEXTS >> number) & 1;
+#endif /* SICSLOWPAN_GHC */
+    changed = 1;
+  }
+
+  /* IPHC takes at most the 64 bit prefix from a context */
+  if(length > 64) {
+    length = 64;
+  }
+  memset(newprefix, 0, sizeof(newprefix));
+  memcpy(newprefix, prefix->u8, (length + 7) >> 3);
+  if(length & 7) {
+    newprefix[length >> 3] &= 0xff << (8 - (length & 7));
+  }
+  compress = compress ? 1 : 0;
+  if(changed || (ctx->compress != compress) ||
+     (memcmp(ctx->prefix, newprefix, sizeof(newprefix)) != 0)) {
+    PRINTF("sicslowpan: context %u set, compress %u\n", number, compress);
+    memcpy(ctx->prefix, newprefix, sizeof(newprefix));
+    ctx->compress = compress;
+    changed = 1;
+  }
+  ctx->length = length;
+  ctx->used = 1;
+  ctx->isinfinite = (lifetime == SICSLOWPAN_CONTEXT_INFINITE);
+  if(!ctx->isinfinite) {
+    stimer_set(&ctx->lifetime, (unsigned long)lifetime * 60);
+  }
+
+  /* A refreshed lifetime does not change the compression */
+  if(changed) {
+    addr_context_reindex();
+  }
+  addr_context_schedule();
+  return 1;
+#else
+  return 0;
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 && SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
+}
+/*--------------------------------------------------------------------*/
+const struct sicslowpan_addr_context *
+sicslowpan_context_get(uint8_t number)
+{
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
+  return addr_context_lookup_by_number(number);
+#else
+  return NULL;
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
+}
+/*--------------------------------------------------------------------*/
 const s_nsHeadComp_t hc_driver_sicslowpan = {
   "sicslowpan",
   sicslowpan_init,
@@ -82,8 +82,6 @@ static void phy_ioctl(e_nsIocCmd_t cmd, void *p_val, e_nsErr_t *p_err);
 
 #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE)
 static void phy_insertCrc(uint8_t *p_data, uint16_t len);
-static uint16_t phy_crc16(uint8_t *p_data, uint16_t len);
-static uint32_t phy_crc32(uint8_t *p_data, uint16_t len);
 #endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) */
 static uint8_t *phy_insertHdr(uint8_t *p_data, uint16_t len);
 
@@ -335,100 +333,55 @@ else
   psdu_len = (len - PHY_HEADER_LEN) - fcs_len;
 #endif
 #else /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == FALSE) */
+  uint16_t psdu_len;
+  e_nsErr_t fcs_err;
+  phy_framer802154_fcs_t fcs;
+
 #if (NETSTK_CFG_IEEE_802154G_EN == TRUE)
-  uint8_t crc_size;
-  uint16_t phr, psdu_len;
-  uint32_t crc_exp, crc_act;
+  uint16_t phr;
 
   /* achieve PHY header */
   phr = (p_data[0] << 8) | (p_data[1]);
 
   /* verify frame length field */
   psdu_len = phr & 0x07FF;
+  fcs_len = PHY_PSDU_CRC16(phr) ? 2 : 4;
+#else
+  /* verify frame length */
+  psdu_len = *p_data;
+#endif /* #if (NETSTK_CFG_IEEE_802154G_EN == TRUE) */
   if (len != (PHY_HEADER_LEN + psdu_len)) {
     *p_err = NETSTK_ERR_BAD_FORMAT;
     return;
   }
 
   if ((psdu_len < PHY_PSDU_MIN(phr)) ||
-      (psdu_len > PHY_PSDU_MAX )) {
+      (psdu_len > PHY_PSDU_MAX)) {
     *p_err = NETSTK_ERR_BAD_FORMAT;
     return;
   }
 
-  p_data += PHY_HEADER_LEN;
-
-  /* verify CRC */
-  crc_exp = 0;
-  crc_act = 0;
-
-  if (PHY_PSDU_CRC16(phr)) {
-    /* 16-bit CRC was used in the received frame */
-    crc_size = 2;
-    psdu_len -= crc_size;
-
-    /* obtain CRC of the received frame */
-    memcpy(&crc_exp, &p_data[psdu_len], crc_size);
-    crc_exp = ((crc_exp & 0x00FF) << 8) |
-              ((crc_exp & 0xFF00) >> 8);
-
-    /* calculated actual CRC */
-    crc_act = phy_crc16(p_data, psdu_len);
-
-  } else {
-    /* 32-bit CRC was used in the received frame */
-    crc_size = 4;
-    psdu_len -= crc_size;
-
-    /* obtain CRC of the received frame */
-    memcpy(&crc_exp, &p_data[psdu_len], crc_size);
-    crc_exp = ((crc_exp & 0x000000FF) << 24) |
-              ((crc_exp & 0x0000FF00) <<  8) |
-              ((crc_exp & 0x00FF0000) >>  8) |
-              ((crc_exp & 0xFF000000) >> 24);
-
-    /* calculated actual CRC */
-    crc_act = phy_crc32(p_data, psdu_len);
+  /*
+   * verify CRC, unless the driver already did so while reading the frame
+   * from the radio
+   */
+  fcs_err = NETSTK_ERR_CMD_UNSUPPORTED;
+  pphy_netstk->rf->ioctrl(NETSTK_CMD_RF_RX_FCS_GET, &fcs_err, p_err);
+  if ((*p_err != NETSTK_ERR_NONE) ||
+      ((fcs_err != NETSTK_ERR_NONE) && (fcs_err != NETSTK_ERR_CRC))) {
+    phy_framer802154_fcsInit(&fcs, psdu_len, fcs_len);
+    phy_framer802154_fcsUpdate(&fcs, p_data + PHY_HEADER_LEN, psdu_len);
+    fcs_err = phy_framer802154_fcsCheck(&fcs);
   }
 
-  if (crc_act != crc_exp) {
+  if (fcs_err != NETSTK_ERR_NONE) {
     *p_err = NETSTK_ERR_CRC;
     return;
   }
-#else
-  uint8_t psdu_len;
-  uint16_t crc_exp, crc_act;
-
-  /* verify frame length */
-  psdu_len = *p_data;
-  if (len != (PHY_HEADER_LEN + psdu_len)) {
-    *p_err = NETSTK_ERR_BAD_FORMAT;
-    return;
-  }
-
-  if ((psdu_len < PHY_PSDU_MIN()) ||
-      (psdu_len > PHY_PSDU_MAX) ) {
-    *p_err = NETSTK_ERR_BAD_FORMAT;
-    return;
-  }
+  *p_err = NETSTK_ERR_NONE;
 
   p_data += PHY_HEADER_LEN;
-
-  /* verify CRC */
   psdu_len -= fcs_len;
-
-  /* calculated actual CRC */
-  crc_act = phy_crc16(p_data, psdu_len);
-
-  /* obtain CRC of the received frame */
-  memcpy(&crc_exp, &p_data[psdu_len], fcs_len);
-  crc_exp = ((crc_exp & 0x00FF) << 8) |
-            ((crc_exp & 0xFF00) >> 8);
-  if (crc_act != crc_exp) {
-    *p_err = NETSTK_ERR_CRC;
-    return;
-  }
-#endif /* #if (NETSTK_CFG_IEEE_802154G_EN == TRUE) */
 #endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == FALSE) */
 
   /* Inform the next higher layer */
@@ -499,71 +452,25 @@ static void phy_insertCrc(uint8_t *p_data, uint16_t len)
   uint8_t *p_crc;
   uint32_t crc = 0;
   packetbuf_attr_t fcs_len;
+  phy_framer802154_fcs_t fcs;
 
   /* get pointer to checksum field */
   p_crc = p_data + len;
 
   fcs_len = packetbuf_attr(PACKETBUF_ATTR_MAC_FCS_LEN);
+  phy_framer802154_fcsInit(&fcs, len + fcs_len, fcs_len);
+  phy_framer802154_fcsUpdate(&fcs, p_data, len);
+  crc = phy_framer802154_fcsFinal(&fcs);
   if (fcs_len == 4) {
-    crc = phy_crc32(p_data, len);
     p_crc[0] = (crc & 0xFF000000u) >> 24;
     p_crc[1] = (crc & 0x00FF0000u) >> 16;
     p_crc[2] = (crc & 0x0000FF00u) >> 8;
     p_crc[3] = (crc & 0x000000FFu);
   } else {
-    crc = phy_crc16(p_data, len);
     p_crc[0] = (crc & 0xFF00u) >> 8;
     p_crc[1] = (crc & 0x00FFu);
   }
 }
-
-/**
- * @brief   Compute CRC-16 over a byte stream
- * @param   p_data  Point to first byte of the stream
- * @param   len     Length of the stream
- * @return  CRC-16 value of the stream
- */
-static uint16_t phy_crc16(uint8_t *p_data, uint16_t len)
-{
-  uint16_t ix;
-  uint32_t crc_res;
-
-  /* calculate CRC */
-  crc_res = CRC16_INIT;
-  for (ix = 0; ix < len; ix++) {
-    crc_res = crc_16_update(crc_res, p_data[ix]);
-  }
-
-  return crc_res;
-}
-
-
-/**
- * @brief   Compute CRC-32 over a byte stream
- * @param   p_data  Point to first byte of the stream
- * @param   len     Length of the stream
- * @return  CRC-32 value of the stream
- */
-static uint32_t phy_crc32(uint8_t *p_data, uint16_t len)
-{
-  uint16_t ix;
-  uint32_t crc_res;
-
-  /* calculate CRC */
-  crc_res = CRC32_INIT;
-  for (ix = 0; ix < len; ix++) {
-    crc_res = crc_32_update(crc_res, p_data[ix]);
-  }
-
-  /* add padding when length is less than 4 octets.
-   * See IEEE-802.15.4g-2012, 5.2.1.9 */
-  if (len < 4) {
-    crc_res = crc_32_update(crc_res, 0x00);
-  }
-  crc_res ^= CRC32_INIT;
-
-  return crc_res;
-}
 #endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) */
 
 
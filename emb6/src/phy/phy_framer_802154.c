@@ -47,6 +47,7 @@
 
 #include "emb6.h"
 #include "phy_framer_802154.h"
+#include "crc.h"
 
 uint16_t phy_framer802154_getPktLen(uint8_t *p_data, uint16_t len)
 {
@@ -78,3 +79,138 @@ uint16_t phy_framer802154_getPktLen(uint8_t *p_data, uint16_t len)
 
   return psdu_len;
 }
+
+/**
+ * @brief   Get length of the FCS of a frame
+ *
+ * @param   p_data  Point to the PHY header of the frame
+ * @return  Length of the FCS in octets
+ */
+uint8_t phy_framer802154_getFcsLen(uint8_t *p_data)
+{
+#if NETSTK_CFG_IEEE_802154G_EN
+  uint16_t phr;
+
+  phr = (p_data[0] << 8) | (p_data[1]);
+  return PHY_PSDU_CRC16(phr) ? 2 : 4;
+#else
+  return 2;
+#endif
+}
+
+/**
+ * @brief   Start computing the FCS of a PSDU
+ *
+ * @param   p_fcs     Pointer to the FCS state
+ * @param   psdu_len  Length of the PSDU, including the FCS
+ * @param   fcs_len   Length of the FCS, 2 or 4 octets
+ */
+void phy_framer802154_fcsInit(phy_framer802154_fcs_t *p_fcs, uint16_t psdu_len, uint8_t fcs_len)
+{
+  p_fcs->psdu_len = psdu_len;
+  p_fcs->num_bytes = 0;
+  p_fcs->fcs_len = fcs_len;
+#if (NETSTK_CFG_IEEE_802154G_EN == TRUE)
+  p_fcs->crc = (fcs_len == 4) ? CRC32_INIT : CRC16_INIT;
+#else
+  p_fcs->crc = CRC16_INIT;
+#endif
+}
+
+/**
+ * @brief   Process the next chunk of a PSDU, e.g. as it is read from the
+ *          RX FIFO. Octets beyond the MAC payload are stored as received FCS
+ *
+ * @param   p_fcs   Pointer to the FCS state
+ * @param   p_data  Point to the first octet of the chunk
+ * @param   len     Length of the chunk
+ */
+void phy_framer802154_fcsUpdate(phy_framer802154_fcs_t *p_fcs, uint8_t *p_data, uint16_t len)
+{
+  uint16_t data_len;
+  uint16_t num_bytes;
+
+  data_len = (p_fcs->psdu_len > p_fcs->fcs_len) ? (p_fcs->psdu_len - p_fcs->fcs_len) : 0;
+
+  /* MHR and MAC payload */
+  if (p_fcs->num_bytes < data_len) {
+    num_bytes = data_len - p_fcs->num_bytes;
+    if (num_bytes > len) {
+      num_bytes = len;
+    }
+
+#if (NETSTK_CFG_IEEE_802154G_EN == TRUE)
+    if (p_fcs->fcs_len == 4) {
+      p_fcs->crc = crc_32_updateN(p_fcs->crc, p_data, num_bytes);
+    } else {
+      p_fcs->crc = crc_16_updateN(p_fcs->crc, p_data, num_bytes);
+    }
+#else
+    p_fcs->crc = crc_16_updateN(p_fcs->crc, p_data, num_bytes);
+#endif
+    p_fcs->num_bytes += num_bytes;
+    p_data += num_bytes;
+    len -= num_bytes;
+  }
+
+  /* received FCS */
+  while ((len > 0) && (p_fcs->num_bytes < p_fcs->psdu_len)) {
+    p_fcs->fcs[p_fcs->num_bytes - data_len] = *p_data++;
+    p_fcs->num_bytes++;
+    len--;
+  }
+}
+
+/**
+ * @brief   Get the FCS of the octets processed so far
+ *
+ * @param   p_fcs   Pointer to the FCS state
+ * @return  FCS value
+ */
+uint32_t phy_framer802154_fcsFinal(phy_framer802154_fcs_t *p_fcs)
+{
+  uint32_t crc = p_fcs->crc;
+
+#if (NETSTK_CFG_IEEE_802154G_EN == TRUE)
+  if (p_fcs->fcs_len == 4) {
+    /* add padding when length is less than 4 octets, FCS excluded.
+     * See IEEE-802.15.4g-2012, 5.2.1.9 */
+    if (p_fcs->psdu_len < 4 + p_fcs->fcs_len) {
+      crc = crc_32_update(crc, 0x00);
+    }
+    crc ^= CRC32_INIT;
+  }
+#endif
+  return crc;
+}
+
+/**
+ * @brief   Verify the received FCS of a PSDU
+ *
+ * @param   p_fcs   Pointer to the FCS state
+ * @return  NETSTK_ERR_NONE if the FCS is valid, NETSTK_ERR_CRC if not and
+ *          NETSTK_ERR_BUSY if the PSDU has not been processed completely
+ */
+e_nsErr_t phy_framer802154_fcsCheck(phy_framer802154_fcs_t *p_fcs)
+{
+  uint32_t crc_exp;
+  uint32_t crc_act;
+
+  if ((p_fcs->psdu_len < p_fcs->fcs_len) ||
+      (p_fcs->num_bytes < p_fcs->psdu_len)) {
+    return NETSTK_ERR_BUSY;
+  }
+
+  crc_act = phy_framer802154_fcsFinal(p_fcs);
+  if (p_fcs->fcs_len == 4) {
+    crc_exp = ((uint32_t)p_fcs->fcs[0] << 24) |
+              ((uint32_t)p_fcs->fcs[1] << 16) |
+              ((uint32_t)p_fcs->fcs[2] <<  8) |
+              ((uint32_t)p_fcs->fcs[3]);
+  } else {
+    crc_exp = ((uint32_t)p_fcs->fcs[0] << 8) |
+              ((uint32_t)p_fcs->fcs[1]);
+  }
+
+  return (crc_act == crc_exp) ? NETSTK_ERR_NONE : NETSTK_ERR_CRC;
+}
@@ -86,8 +86,22 @@ int8_t board_conf( s_ns_t* p_ns )
   EMB6_ASSERT_RET( p_ns != NULL, -1 );
 
   p_ns->dllc = &dllc_driver_802154;
+#if (NETSTK_CFG_LOW_POWER_MODE_EN == TRUE)
+#if (NETSTK_SUPPORT_SW_MAC_AUTOACK != TRUE)
+  /* the native radio does not acknowledge frames, the LPL MAC would take
+   * every unicast frame as acknowledged after its first repetition */
+#error "native: low power mode requires NETSTK_SUPPORT_SW_MAC_AUTOACK"
+#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK != TRUE) */
+  p_ns->mac  = &mac_driver_lpl;
+#else
   p_ns->mac  = &mac_driver_null;
+#endif
+#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE)
+  /* frames carry a PHY header and a FCS verified by the native radio */
+  p_ns->phy  = &phy_driver_802154;
+#else
   p_ns->phy  = &phy_driver_null;
+#endif
   p_ns->rf   = &rf_driver_native;
   etimer_init();
 
@@ -66,6 +66,9 @@
 #include <sys/time.h>
 #include <stdio.h>
 #include <lcm/lcm.h>
+#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE)
+#include "phy_framer_802154.h"
+#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) */
 
 /*==============================================================================
                                     MACROS
@@ -83,6 +86,24 @@
 #define LCM_NETWORK_CONF                  "lcmnetwork.conf"
 #endif /*#ifndef LCM_NETWORK_CONF */
 
+/* Bit rate the airtime of the frames is simulated with, e.g. for the CCA */
+#ifndef NATIVE_CFG_BITRATE
+#define NATIVE_CFG_BITRATE                50000
+#endif /*#ifndef NATIVE_CFG_BITRATE */
+
+/* Length of preamble, sync word and PHY header in octets */
+#define NATIVE_SHR_PHR_LEN                8
+
+/* Airtime of a frame in microseconds */
+#define NATIVE_AIRTIME_US(len)                                                \
+    ((((int64_t)(len) + NATIVE_SHR_PHR_LEN) * 8 * 1000000) / NATIVE_CFG_BITRATE)
+
+/* Number of octets read from the simulated RX FIFO at once. Odd on purpose,
+ * so that chunks split the FCS and do not align with the CRC word size */
+#ifndef NATIVE_CFG_FIFO_CHUNK
+#define NATIVE_CFG_FIFO_CHUNK             13
+#endif /*#ifndef NATIVE_CFG_FIFO_CHUNK */
+
 /*==============================================================================
                                      ENUMS
  ==============================================================================*/
@@ -98,6 +119,20 @@ static lcm_t *ps_lcm;
 static char pc_publish_ch[NODE_INFO_MAX];
 static char *pc_subscribe_ch;
 static lcm_subscription_t *subscr;
+
+/* Simulated radio state. Frames are only received while the radio is on,
+ * and the channel is busy during the airtime of every frame sent by another
+ * node, whether received or not. Times are in microseconds */
+static uint8_t c_isOn;
+static int64_t ll_onSince;
+static int64_t ll_onTime;
+static int64_t ll_busyUntil;
+static uint8_t c_isPolling;
+
+#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE)
+/* FCS of the frame being delivered, as verified while reading the FIFO */
+static e_nsErr_t e_rxFcs = NETSTK_ERR_CMD_UNSUPPORTED;
+#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) */
 /*==============================================================================
                                  GLOBAL CONSTANTS
  ==============================================================================*/
@@ -115,6 +150,11 @@ static void _native_send( uint8_t *p_data, uint16_t len, e_nsErr_t *p_err );
 static void _native_recv(uint8_t *p_buf, uint16_t len, e_nsErr_t *p_err);
 static void _native_ioctl(e_nsIocCmd_t cmd, void *p_val, e_nsErr_t *p_err);
 
+static int64_t _native_now( void );
+#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE)
+static e_nsErr_t _native_readFifo( uint8_t *p_data, uint16_t len );
+#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) */
+static void _native_poll( void );
 static void _native_read( const lcm_recv_buf_t *rbuf, const char * channel,
         void * p_macAddr );
 static void _native_handler( c_event_t c_event, p_data_t p_data );
@@ -326,6 +366,9 @@ static void _native_send( uint8_t *p_data, uint16_t len, e_nsErr_t *p_err )
         LOG_OK( "TX packet [%d]", len );
         LOG2_HEXDUMP( p_data, len );
         *p_err = NETSTK_ERR_NONE;
+
+        /* the radio is busy transmitting for the airtime of the frame */
+        bsp_delayUs( (uint32_t)NATIVE_AIRTIME_US( len ) );
     }
 } /* _native_send() */
 
@@ -342,6 +385,8 @@ static void _native_recv( uint8_t *p_buf, uint16_t len, e_nsErr_t *p_err )
 
 static void _native_ioctl(e_nsIocCmd_t cmd, void *p_val, e_nsErr_t *p_err)
 {
+    uint8_t c_isBusy;
+
 #if NETSTK_CFG_ARG_CHK_EN
     if (p_err == NULL) {
         return;
@@ -349,7 +394,112 @@ static void _native_ioctl(e_nsIocCmd_t cmd, void *p_val, e_nsErr_t *p_err)
 #endif
 
     *p_err = NETSTK_ERR_NONE;
-} /* _native_on() */
+    switch( cmd )
+    {
+        case NETSTK_CMD_RF_CCA_GET:
+            /* take frames sent in the meantime into account */
+            _native_poll();
+            if( _native_now() < ll_busyUntil )
+            {
+                *p_err = NETSTK_ERR_CHANNEL_ACESS_FAILURE;
+            }
+            break;
+
+        case NETSTK_CMD_RF_IS_RX_BUSY:
+            _native_poll();
+            c_isBusy = c_isOn && ( _native_now() < ll_busyUntil );
+            if( p_val != NULL )
+            {
+                *((uint8_t *)p_val) = c_isBusy;
+            }
+            else if( c_isBusy )
+            {
+                *p_err = NETSTK_ERR_BUSY;
+            }
+            break;
+
+        case NETSTK_CMD_RF_ON_TIME_GET:
+            /* time the radio was on in milliseconds */
+            if( p_val == NULL )
+            {
+                *p_err = NETSTK_ERR_INVALID_ARGUMENT;
+            }
+            else
+            {
+                *((uint32_t *)p_val) = (uint32_t)(( ll_onTime +
+                    ( c_isOn ? ( _native_now() - ll_onSince ) : 0 )) / 1000 );
+            }
+            break;
+
+#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE)
+        case NETSTK_CMD_RF_RX_FCS_GET:
+            if( e_rxFcs == NETSTK_ERR_CMD_UNSUPPORTED )
+            {
+                /* no frame is being delivered */
+                *p_err = NETSTK_ERR_CMD_UNSUPPORTED;
+            }
+            else if( p_val == NULL )
+            {
+                *p_err = NETSTK_ERR_INVALID_ARGUMENT;
+            }
+            else
+            {
+                *((e_nsErr_t *)p_val) = e_rxFcs;
+            }
+            break;
+#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) */
+
+        default:
+            break;
+    }
+} /* _native_ioctl() */
+
+/*----------------------------------------------------------------------------*/
+/** \brief  Current time in microseconds, as used by LCM for its timestamps
+ *  \return Time in microseconds
+ */
+/*----------------------------------------------------------------------------*/
+static int64_t _native_now( void )
+{
+    struct timeval s_tv;
+
+    gettimeofday( &s_tv, NULL );
+    return (int64_t)s_tv.tv_sec * 1000000 + s_tv.tv_usec;
+} /* _native_now() */
+
+/*----------------------------------------------------------------------------*/
+/** \brief  Handle all frames that have been sent by other nodes so far.
+ *          Not re-entered from the handlers of the received frames.
+ *  \return void
+ */
+/*----------------------------------------------------------------------------*/
+static void _native_poll( void )
+{
+    int32_t lcm_fd;
+    struct timeval s_tv;
+    fd_set fds;
+
+    if( ( ps_lcm == NULL ) || c_isPolling )
+    {
+        return;
+    }
+
+    c_isPolling = 1;
+    lcm_fd = lcm_get_fileno( ps_lcm );
+    do
+    {
+        s_tv.tv_sec = 0;
+        s_tv.tv_usec = 0;
+        FD_ZERO( &fds );
+        FD_SET( lcm_fd, &fds );
+        if( select( lcm_fd + 1, &fds, 0, 0, &s_tv ) <= 0 )
+        {
+            break;
+        }
+        lcm_handle( ps_lcm );
+    } while( 1 );
+    c_isPolling = 0;
+} /* _native_poll() */
 
 /*----------------------------------------------------------------------------*/
 /** \brief  NATIVE transport message reception
@@ -366,12 +516,22 @@ static void _native_read( const lcm_recv_buf_t *rps_rbuf,
 {
     uint16_t i_dSize = rps_rbuf->data_size;
     e_nsErr_t s_err = NETSTK_ERR_NONE;
+    int64_t ll_end;
 
-    /* Clear buffer where to store received payload */
-    packetbuf_clear();
+    /* the channel is busy for the airtime of the frame */
+    ll_end = rps_rbuf->recv_utime + NATIVE_AIRTIME_US( i_dSize );
+    if( ll_end > ll_busyUntil )
+    {
+        ll_busyUntil = ll_end;
+    }
 
+    /* Check whether the radio was on when the frame was sent */
+    if( !c_isOn || ( rps_rbuf->recv_utime < ll_onSince ) )
+    {
+        LOG_INFO( "RX packet [%d] missed, radio off", i_dSize );
+    }
     /* Check whether recieved packet is not too long */
-    if( i_dSize > PACKETBUF_SIZE )
+    else if( i_dSize > PACKETBUF_SIZE )
     {
         LOG_ERR( "Received packet too long" );
     }
@@ -379,10 +539,17 @@ static void _native_read( const lcm_recv_buf_t *rps_rbuf,
     {
         LOG_OK( "RX packet [%d]", i_dSize);
         LOG2_HEXDUMP( rps_rbuf->data, i_dSize  );
+        /* the packet buffer is left to the upper layers, as it may still
+         * hold a frame being transmitted */
         if( ( rps_rbuf->data_size > 0 ) && ( p_phy != NULL ) )
         {
-            packetbuf_set_datalen( i_dSize );
+#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE)
+            e_rxFcs = _native_readFifo( rps_rbuf->data, i_dSize );
+            p_phy->recv( rps_rbuf->data, i_dSize, &s_err );
+            e_rxFcs = NETSTK_ERR_CMD_UNSUPPORTED;
+#else
             p_phy->recv( rps_rbuf->data, i_dSize, &s_err );
+#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) */
         }
         else
         {
@@ -391,6 +558,45 @@ static void _native_read( const lcm_recv_buf_t *rps_rbuf,
     }
 } /* _native_read() */
 
+#if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE)
+/*----------------------------------------------------------------------------*/
+/** \brief  Read a received frame out of the simulated RX FIFO, verifying its
+ *          FCS chunk by chunk the way a hardware driver does while draining
+ *          the FIFO of the transceiver
+ *  \param  p_data  PHY header and PSDU of the frame
+ *  \param  len     Length of the frame
+ *  \return NETSTK_ERR_NONE if the FCS is valid, NETSTK_ERR_CRC if not, and
+ *          NETSTK_ERR_CMD_UNSUPPORTED if the frame could not be verified
+ */
+/*----------------------------------------------------------------------------*/
+static e_nsErr_t _native_readFifo( uint8_t *p_data, uint16_t len )
+{
+    phy_framer802154_fcs_t s_fcs;
+    uint16_t i_psduLen;
+    uint16_t i_chunk;
+
+    i_psduLen = phy_framer802154_getPktLen( p_data, len );
+    if( ( i_psduLen == 0 ) || ( len != PHY_HEADER_LEN + i_psduLen ) )
+    {
+        /* let the PHY reject the frame */
+        return NETSTK_ERR_CMD_UNSUPPORTED;
+    }
+
+    phy_framer802154_fcsInit( &s_fcs, i_psduLen,
+            phy_framer802154_getFcsLen( p_data ) );
+    p_data += PHY_HEADER_LEN;
+    while( i_psduLen > 0 )
+    {
+        i_chunk = ( i_psduLen < NATIVE_CFG_FIFO_CHUNK ) ?
+                i_psduLen : NATIVE_CFG_FIFO_CHUNK;
+        phy_framer802154_fcsUpdate( &s_fcs, p_data, i_chunk );
+        p_data += i_chunk;
+        i_psduLen -= i_chunk;
+    }
+    return phy_framer802154_fcsCheck( &s_fcs );
+} /* _native_readFifo() */
+#endif /* #if (NETSTK_SUPPORT_SW_MAC_AUTOACK == TRUE) */
+
 /*----------------------------------------------------------------------------*/
 /** \brief  NATIVE transport wrapper function
  *  \return 0
@@ -404,6 +610,11 @@ static void _native_on( e_nsErr_t *p_err )
     }
 #endif
 
+    if( !c_isOn )
+    {
+        c_isOn = 1;
+        ll_onSince = _native_now();
+    }
     *p_err = NETSTK_ERR_NONE;
 } /* _native_on() */
 
@@ -421,6 +632,11 @@ static void _native_off( e_nsErr_t *p_err )
     }
 #endif
 
+    if( c_isOn )
+    {
+        c_isOn = 0;
+        ll_onTime += _native_now() - ll_onSince;
+    }
     *p_err = NETSTK_ERR_NONE;
 } /* _native_off() */
 
@@ -434,30 +650,14 @@ static void _native_off( e_nsErr_t *p_err )
 /*----------------------------------------------------------------------------*/
 static void _native_handler( c_event_t c_event, p_data_t p_data )
 {
-    int32_t lcm_fd;
-    struct timeval s_tv;
-    s_tv.tv_sec = 0;
-    s_tv.tv_usec = 10;
-    fd_set fds;
-
     if( etimer_expired( &ps_nativeTmr ) )
     {
         /* We can't use lcm_handle trigger every time, as
-         * it's a blocking operation. We should instead check whether a lcm file
-         * descriptor is available for reading. We put 10 usec as a timeout.
+         * it's a blocking operation. Frames are only handled while the lcm
+         * file descriptor is available for reading.
          */
-        lcm_fd = lcm_get_fileno( ps_lcm );
-        FD_ZERO( &fds );
-        FD_SET( lcm_fd, &fds );
+        _native_poll();
 
-        select( lcm_fd + 1, &fds, 0, 0, &s_tv );
-        /* If descriptor is available for reading then there is a incoming data
-         * to read.
-         */
-        if( FD_ISSET( lcm_fd, &fds ) )
-        {
-            lcm_handle( ps_lcm );
-        }
         /* Restart a timer anyway. */
         etimer_restart( &ps_nativeTmr );
 
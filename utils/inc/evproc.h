@@ -117,6 +117,12 @@ typedef enum
    /** ULE event */
    EVENT_TYPE_MAC_ULE,
 
+   /** MAC transmission event */
+   EVENT_TYPE_MAC_TX,
+
+   /** MAC reception event */
+   EVENT_TYPE_MAC_RX,
+
    /** Event from RF layer */
    EVENT_TYPE_RF,
 
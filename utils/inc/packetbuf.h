@@ -233,6 +233,7 @@ enum {
   PACKETBUF_ATTR_MAC_SEQNO,
   PACKETBUF_ATTR_MAC_ACK,
   PACKETBUF_ATTR_IS_CREATED_AND_SECURED,
+  PACKETBUF_ATTR_MAC_TX_CLASS,
 
   /* Scope 1 attributes: used between two neighbors only. */
   PACKETBUF_ATTR_REXMIT,